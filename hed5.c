@@ -10,11 +10,20 @@
 *
 *********************************************************************/
 
+#define	_GNU_SOURCE		/* for copy_file_range() */
+
 #include	<stdio.h>
 #include	<fcntl.h>
 #include	<curses.h>
 #include	<sys/types.h>
 #include	<sys/stat.h>
+#include	<sys/mman.h>
+#include	<sys/time.h>
+#include	<sys/uio.h>
+#include	<sys/ioctl.h>
+#include	<sys/inotify.h>
+#include	<poll.h>
+#include	<linux/fs.h>		/* BLKGETSIZE64 , BLKSSZGET */
 /***  #include	<varargs.h>   ***/
 #include	<stdarg.h>
 #include	<stdlib.h>
@@ -22,9 +31,28 @@
 #include	<errno.h>
 #include	<ctype.h>
 #include	<string.h>
+#include	<pthread.h>
+#include	<dirent.h>
+#include	<limits.h>
+#include	<math.h>
+#if defined(__AVX2__)
+#include	<immintrin.h>
+#elif defined(__SSE2__)
+#include	<emmintrin.h>
+#endif
+#if defined(__x86_64__) && defined(__GNUC__)
+#include	<nmmintrin.h>		/* _mm_crc32_u64 , see crc32c_sse42() */
+#define	CRC32C_HARDWARE
+#endif
 
 #define	NE(s1,s2)	(strcmp(s1,s2) !=0)
 
+/* make.mk builds with _FILE_OFFSET_BITS=64 , which makes off_t 64 bits */
+/* and O_LARGEFILE implicit , the flag is still passed for old systems  */
+#ifndef	O_LARGEFILE
+#define	O_LARGEFILE	0
+#endif
+
 #define	NEXT_BLOCK		'n'
 #define	PREV_BLOCK		'p'
 #define	QUIT			'q'
@@ -38,26 +66,612 @@
 #define	SAVE_BLOCK		's'
 #define	SCAN_FORWARD	'/'
 #define	SCAN_BACKWARD	'\\'
+#define	MULTI_SCAN		'm'
+#define	FIND_ALL		'f'
+#define	NEXT_HIT		']'
+#define	PREV_HIT		'['
+#define	UNDO			'u'
+#define	REDO			'r'
+#define	INSERT_BYTES	'i'
+#define	DELETE_BYTES	'd'
+#define	NEXT_DIFF		'>'
+#define	PREV_DIFF		'<'
+#define	COMPARE_AGAIN	'='
+#define	SELECT_REGION	'e'
+#define	HASH_FILE		'h'
+#define	FIND_RECORDS	'F'
+
+/* a file is accessed either through a memory mapping, a heap copy of */
+/* its contents (pipes and /proc files) or through pread()            */
+#define	SOURCE_PREAD	0
+#define	SOURCE_MAPPED	1
+#define	SOURCE_MEMORY	2
+
+/* a heap copy grows from the chunk size by doubling up to the limit */
+#define	SOURCE_CAPTURE_CHUNK	65536
+#define	SOURCE_CAPTURE_LIMIT	(256L << 20)
+
+/* files opened with O_DIRECT (-D) are read and written in whole sectors */
+/* from aligned buffers , disks report their sector size with BLKSSZGET */
+#define	SOURCE_DIRECT_ALIGN	4096L
+
+/* files read with pread() are cached in aligned pages , reused in least */
+/* recently used order and filled ahead of the reader by a helper thread */
+#define	CACHE_PAGE_SIZE		65536L
+#define	CACHE_NUM_PAGES		64
+#define	CACHE_MAX_READ		(4 * CACHE_PAGE_SIZE)
+#define	CACHE_PREFETCH_PAGES	4
+
+#define	SEARCH_CHUNK_SIZE	(1L << 20)
+#define	SEARCH_MAX_PATTERN	256
+#define	SEARCH_SEGMENT_SIZE	(16L << 20)
+#define	MAX_THREADS		64
+#define	SEARCH_POLL_MSECS	100
+#define	HIT_CHECKPOINT		64
+#define	DUMP_CHUNK_SIZE		(1L << 20)
+
+/* in compare mode (-C) differing bytes separated by fewer than */
+/* DIFF_MIN_GAP equal ones are reported as a single range       */
+#define	DIFF_MIN_GAP		16
+#define	DIFF_GROW			1024
+
+/* the overview map (-e) divides the file into at most MAP_MAX_REGIONS  */
+/* regions , of a power of two bytes , whose entropy is worked out by a */
+/* helper thread , first from MAP_SAMPLES samples and then exactly     */
+#define	MAP_MIN_REGION		(64L << 10)
+#define	MAP_MAX_REGIONS		4096L
+#define	MAP_SAMPLES			4
+#define	MAP_SAMPLE_SIZE		4096L
+#define	MAP_CHUNK_SIZE		(1L << 20)
+#define	MAP_POLL_MSECS		250
+#define	MAP_WIDTH			7
+
+/* results of full passes over a regular file are kept between sessions */
+/* in a sidecar file in ~/.cache/hed5 , named after the device and inode */
+/* of the file and only used while its size and mtime are unchanged     */
+#define	SIDECAR_MAGIC		"hed5idx"
+#define	SIDECAR_VERSION		1
+#define	SIDECAR_MAX_SECTIONS	8
+#define	SIDECAR_NAME_LENGTH	(SEARCH_MAX_PATTERN * 4)
+
+#define	SIDECAR_MAP			1		/* MAP_REGION for every region */
+#define	SIDECAR_HITS		2		/* delta encoded find all hits */
+
+#define	SIDECAR_HASHES		3		/* digests then states of a HASH_TREE */
+
+/* files are hashed in chunks of HASH_CHUNK_SIZE bytes whose digests are */
+/* kept , the root digest is the hash of the chunk digests. After a      */
+/* change only the chunks it touched have to be hashed again            */
+#define	HASH_CHUNK_SIZE		(1L << 20)
+#define	HASH_MAX_DIGEST		32
+
+#define	HASH_CRC32C			0
+#define	HASH_XXH64			1
+#define	HASH_SHA256			2
+#define	HASH_NUM_ALGORITHMS	3
+
+#define	CHUNK_NONE			0
+#define	CHUNK_STALE			1		/* digest is of an older version */
+#define	CHUNK_VALID			2
+
+#define	CRC32C_POLYNOMIAL	0x82f63b78U	/* reversed Castagnoli */
+#define	XXH64_PRIME1		11400714785074694791ULL
+#define	XXH64_PRIME2		14029467366897019727ULL
+#define	XXH64_PRIME3		1609587929392839161ULL
+#define	XXH64_PRIME4		9650029242287828579ULL
+#define	XXH64_PRIME5		2870177450012600261ULL
+#define	SHA256_ROTR(x,n)	(((x) >> (n)) | ((x) << (32 - (n))))
+
+#define	MAP_EMPTY		0
+#define	MAP_SAMPLED		1
+#define	MAP_STALE		2
+#define	MAP_EXACT		3
+
+/* a structure template (-T) is compiled into a flat program of decode */
+/* steps , structures used as fields are expanded in place and arrays  */
+/* of them become loops , so drawing the pane needs no lookups. Only   */
+/* the steps which fit in the pane are run                            */
+#define	TEMPLATE_WIDTH		40
+#define	TEMPLATE_NAME_WIDTH	14		/* column of values in the pane */
+#define	TEMPLATE_MAX_NAME	64
+#define	TEMPLATE_MAX_FIELDS	1024
+#define	TEMPLATE_MAX_STRUCTS	128
+#define	TEMPLATE_MAX_OPS	4096
+#define	TEMPLATE_MAX_SHOWN	8		/* elements of an array shown */
+#define	TEMPLATE_WINDOW		4096L
+
+#define	FIELD_UNSIGNED		0
+#define	FIELD_SIGNED		1
+#define	FIELD_FLOAT			2
+#define	FIELD_CHAR			3
+#define	FIELD_STRUCT		4
+
+#define	OP_FIELD			0
+#define	OP_LOOP				1		/* start of a structure field */
+#define	OP_NEXT				2		/* end of a structure field */
+
+/* in record mode (-R) each record of a fixed size array starts on a new */
+/* row , the 'F' command compares a field of at most RECORD_MAX_FIELD    */
+/* bytes in every record                                                */
+#define	RECORD_MAX_FIELD	SEARCH_MAX_PATTERN
+
+/* in follow mode (-f) the file is checked for growth whenever inotify */
+/* reports a change , or every FOLLOW_POLL_MSECS when inotify is not   */
+/* available (e.g. on NFS)                                            */
+#define	FOLLOW_POLL_MSECS	500
+#define	FOLLOW_IDLE_MSECS	5000
+
+/* vector primitives used by the search engine prefilter */
+#if defined(__AVX2__)
+#define	SEARCH_LANES	32
+#define	SEARCH_VECTOR	__m256i
+#define	SEARCH_SPLAT(b)	_mm256_set1_epi8((char)(b))
+#define	SEARCH_LOAD(p)	_mm256_loadu_si256((const __m256i *)(p))
+#define	SEARCH_AND(a,b)	_mm256_and_si256(a,b)
+#define	SEARCH_MATCH(f,bf,l,bl)	(unsigned int)_mm256_movemask_epi8( \
+			_mm256_and_si256(_mm256_cmpeq_epi8(f,bf),_mm256_cmpeq_epi8(l,bl)))
+#define	SEARCH_EQUAL(a,b)	_mm256_cmpeq_epi8(a,b)
+#define	SEARCH_MASK(v)	(unsigned int)_mm256_movemask_epi8(v)
+#define	SEARCH_ALL_LANES	0xffffffffU
+#elif defined(__SSE2__)
+#define	SEARCH_LANES	16
+#define	SEARCH_VECTOR	__m128i
+#define	SEARCH_SPLAT(b)	_mm_set1_epi8((char)(b))
+#define	SEARCH_LOAD(p)	_mm_loadu_si128((const __m128i *)(p))
+#define	SEARCH_AND(a,b)	_mm_and_si128(a,b)
+#define	SEARCH_MATCH(f,bf,l,bl)	(unsigned int)_mm_movemask_epi8( \
+			_mm_and_si128(_mm_cmpeq_epi8(f,bf),_mm_cmpeq_epi8(l,bl)))
+#define	SEARCH_EQUAL(a,b)	_mm_cmpeq_epi8(a,b)
+#define	SEARCH_MASK(v)	(unsigned int)_mm_movemask_epi8(v)
+#define	SEARCH_ALL_LANES	0xffffU
+#endif
+
+/* the edited file is described by a sequence of pieces , each referring */
+/* to a range of the original file or of the buffer of added data. The  */
+/* pieces are kept in a treap ordered by file position in which every   */
+/* node knows how many bytes its subtree covers , so that a piece can   */
+/* be found , split , inserted or removed in O(log n) time and bytes    */
+/* can be inserted or deleted without renumbering the following pieces */
+#define	PIECE_ORIGINAL	0
+#define	PIECE_ADDED		1
+
+#define	PIECE_TOTAL(p)	((p) == NULL ? 0L : (p)->total)
+
+#define	EDIT_MAX_IOV	64
+#define	EDIT_COPY_CHUNK	(1L << 20)
+
+typedef struct piece {
+	long	length;
+	long	source_offset;		/* offset in original file or added data */
+	int		source;				/* PIECE_ORIGINAL or PIECE_ADDED */
+	unsigned int	priority;	/* treap heap order */
+	long	total;				/* bytes covered by this subtree */
+	struct piece	*left , *right;
+} PIECE;
+
+/* a piece together with its file offset , see edit_flatten() */
+typedef struct piece_extent {
+	long	start;				/* file offset of first byte */
+	long	length;
+	long	source_offset;
+	int		source;
+} PIECE_EXTENT;
+
+typedef struct edit_buffer {
+	PIECE	*root;
+	long	num_pieces;
+	unsigned char	*added;
+	long	added_length , max_added;
+	long	size;				/* size of the edited file */
+	int		dirty;				/* edits not yet written to the file */
+	int		resized;			/* bytes were inserted or deleted */
+	unsigned int	seed;		/* for piece priorities */
+} EDIT_BUFFER;
+
+/* undo / redo history of changes , each replacing old_length bytes at */
+/* offset by new_length bytes (so inserts and deletes are changes too) ; */
+/* the bytes before and after the change are kept in old_data and       */
+/* new_data at old_offset and new_offset                                */
+#define	JOURNAL_MAX_ENTRIES	262144
+#define	JOURNAL_MAX_DATA	(16L << 20)
+
+typedef struct journal_entry {
+	long	offset;				/* file offset of change */
+	long	old_length , new_length;
+	long	old_offset , new_offset;
+} JOURNAL_ENTRY;
+
+typedef struct edit_journal {
+	JOURNAL_ENTRY	*entries;
+	int		num_entries , max_entries;
+	int		position;			/* entries before this are applied */
+	long	num_dropped;		/* entries forgotten to bound memory */
+	unsigned char	*old_data , *new_data;
+	long	old_length , max_old;
+	long	new_length , max_new;
+} EDIT_JOURNAL;
+
+typedef struct cache_page {
+	long	offset;				/* file offset of page , -1L if unused */
+	long	length;				/* number of valid bytes */
+	long	last_used;			/* cache clock when last used */
+	int		loading;			/* being read by some thread */
+	unsigned char	*data;
+} CACHE_PAGE;
+
+typedef struct page_cache {
+	CACHE_PAGE	pages[CACHE_NUM_PAGES];
+	int		fd;
+	long	size;				/* size of the file */
+	long	clock;
+	long	generation;			/* incremented when the pages go stale */
+	long	hits , misses , prefetched;
+	long	prefetch_offset , prefetch_end;	/* pages wanted by the reader */
+	int		stop;
+	pthread_mutex_t	lock;
+	pthread_cond_t	loaded;		/* a page has been read */
+	pthread_cond_t	work;		/* there is something to prefetch */
+	pthread_t	thread;
+} PAGE_CACHE;
+
+typedef struct data_source {
+	int		fd;
+	int		kind;
+	long	size;
+	unsigned char	*data;		/* mapping or heap copy, NULL for pread */
+	size_t	data_length;
+	EDIT_BUFFER	*edits;			/* pending edits , NULL if none */
+	PAGE_CACHE	*cache;			/* pread() sources only , else NULL */
+	int		direct;				/* opened with O_DIRECT */
+	long	align;				/* O_DIRECT alignment of offsets and buffers */
+} DATA_SOURCE;
+
+/* a compiled search pattern , data matches where (data & mask) == bytes */
+typedef struct search_pattern {
+	int		length;
+	int		exact;				/* all mask bytes are 0xff */
+	int		first , last;		/* anchor bytes used by the prefilter */
+	unsigned char	bytes[SEARCH_MAX_PATTERN];
+	unsigned char	mask[SEARCH_MAX_PATTERN];
+} SEARCH_PATTERN;
+
+typedef struct search_control {
+	volatile int	cancel;
+	volatile long	bytes_searched;
+} SEARCH_CONTROL;
+
+/* a set of patterns searched for together with an Aho-Corasick automaton */
+typedef struct multi_pattern {
+	int		num_patterns , max_patterns;
+	SEARCH_PATTERN	*patterns;
+	char	**names;			/* pattern text as entered */
+	int		*key_offset;		/* start of exact key within pattern */
+	int		*key_length;
+	int		*same_key;			/* next pattern with an identical key */
+	int		max_span;			/* largest key_offset + key_length */
+	int		num_states , max_states;
+	int		*next;				/* num_states x 256 transitions */
+	int		*output;			/* first pattern whose key ends here */
+	int		*output_link;		/* next state on suffix chain with output */
+} MULTI_PATTERN;
+
+/* sorted match offsets from a find all , delta encoded */
+typedef struct hit_index {
+	long	num_hits;
+	long	current;			/* hit most recently visited */
+	long	last_offset;		/* offset of last hit added */
+	unsigned char	*deltas;
+	size_t	num_bytes , max_bytes;
+	long	*checkpoint_offset;	/* offset of every HIT_CHECKPOINT'th hit */
+	size_t	*checkpoint_position;	/* and position of its encoding */
+	size_t	max_checkpoints;
+} HIT_INDEX;
+
+/* the ranges in which two files differ , sorted by offset */
+typedef struct diff_range {
+	long	offset;
+	long	length;
+} DIFF_RANGE;
+
+typedef struct diff_index {
+	DIFF_RANGE	*ranges;
+	long	num_ranges , max_ranges;
+	long	num_bytes;			/* bytes which differ */
+	long	current;			/* range most recently visited , -1 if none */
+} DIFF_INDEX;
+
+/* summary of a region of the overview map */
+typedef struct map_region {
+	float	entropy;			/* bits per byte , -1.0 if unreadable */
+	unsigned char	state;		/* MAP_EMPTY , MAP_SAMPLED , ... */
+	unsigned char	top_byte;	/* most common byte value */
+	unsigned char	top_percent;	/* its share of the region */
+	unsigned char	zero_percent;
+	unsigned char	text_percent;	/* printable ASCII and white space */
+} MAP_REGION;
+
+typedef struct overview_map {
+	MAP_REGION	*regions;
+	long	num_regions , max_regions;
+	long	region_size;
+	long	next_sample;		/* regions before this have been sampled */
+	long	next_exact;			/* regions before this are exact */
+	long	serial;				/* incremented when regions are invalidated */
+	long	updates , drawn;	/* changes to regions , and when last drawn */
+	long	top;				/* first region shown in the strip */
+	int		active;
+	int		stop;				/* thread should exit */
+	pthread_mutex_t	lock;		/* held by main except when waiting for keys */
+	pthread_cond_t	work;		/* there are regions to do */
+	pthread_t	thread;
+	unsigned char	*buffer;
+} OVERVIEW_MAP;
+
+typedef struct sidecar_section {
+	int		type;				/* SIDECAR_MAP , ... */
+	int		unused;
+	long	offset;				/* position of data in sidecar file */
+	long	length;				/* bytes of data */
+	long	count;				/* MAP : regions , HITS : hits , HASHES : chunks */
+	long	param;				/* MAP : region size , HASHES : algorithm */
+	char	name[SIDECAR_NAME_LENGTH];	/* HITS : pattern text */
+} SIDECAR_SECTION;
+
+typedef struct sidecar_header {
+	char	magic[8];
+	int		version;
+	int		num_sections;
+	long	device , inode , size , mtime , mtime_nsec;
+	SIDECAR_SECTION	sections[SIDECAR_MAX_SECTIONS];
+} SIDECAR_HEADER;
+
+typedef struct sidecar {
+	char	path[PATH_MAX];		/* empty if not in use */
+	const unsigned char	*data;	/* mapping of the sidecar , NULL if none */
+	size_t	length;
+	const SIDECAR_HEADER	*header;	/* NULL unless it matches the file */
+	const SIDECAR_HEADER	*previous;	/* of an older version of the file */
+	char	hits_pattern[SIDECAR_NAME_LENGTH];	/* pattern of search_hits */
+	int		hits_current;		/* search_hits are of the file as it is */
+} SIDECAR;
+
+/* a field compared in every record by the 'F' command */
+typedef struct record_filter {
+	long	first;				/* offset of the first record */
+	long	stride;				/* bytes from one record to the next */
+	long	num_records;		/* records holding all of the field */
+	long	field;				/* offset of the field in a record */
+	long	length;				/* bytes in the field */
+	unsigned char	value[RECORD_MAX_FIELD + 32];	/* room for a vector load */
+} RECORD_FILTER;
+
+/* a field of a structure template , or a step of its decode program */
+typedef struct template_op {
+	int		code;				/* OP_FIELD , OP_LOOP or OP_NEXT */
+	int		type;				/* FIELD_UNSIGNED , ... */
+	int		size;				/* bytes , FIELD_STRUCT : structure number */
+	int		big_endian;
+	int		depth;				/* nesting , for indenting */
+	int		count_op;			/* field or step giving the count , -1 if none */
+	int		jump;				/* LOOP : its NEXT , NEXT : its LOOP */
+	long	count;				/* elements , or repeats of a structure */
+	char	name[TEMPLATE_MAX_NAME];
+} TEMPLATE_OP;
+
+typedef struct template_struct {
+	char	name[TEMPLATE_MAX_NAME];
+	int		first , num_fields;	/* in the fields of the template */
+	long	size;				/* bytes , -1L if it varies */
+} TEMPLATE_STRUCT;
+
+typedef struct struct_template {
+	TEMPLATE_OP	*fields;		/* fields of every structure as written */
+	int		num_fields;
+	TEMPLATE_STRUCT	*structs;
+	int		num_structs;
+	TEMPLATE_OP	*program;		/* decode steps for the last structure */
+	int		num_ops;
+	long	record_size;		/* -1L if it varies */
+	unsigned long long	*values;	/* LOOP : repeats , else first element */
+	long	*iterations;		/* LOOP : repeats done */
+	unsigned char	*window;	/* bytes being decoded */
+	long	window_offset , window_length;
+} STRUCT_TEMPLATE;
+
+/* state of a hash being worked out */
+typedef struct hash_state {
+	int		algorithm;			/* HASH_CRC32C , ... */
+	int		num_block;			/* bytes held in block */
+	unsigned long long	length;	/* bytes hashed */
+	unsigned int	crc;
+	unsigned long long	acc[4];	/* XXH64 accumulators */
+	unsigned int	sha[8];
+	unsigned char	block[64];	/* partial block */
+} HASH_STATE;
+
+/* digests of every chunk of the file for one algorithm */
+typedef struct hash_tree {
+	long	num_chunks , max_chunks;
+	unsigned char	*digests;	/* HASH_MAX_DIGEST bytes per chunk */
+	unsigned char	*state;		/* CHUNK_NONE , CHUNK_STALE or CHUNK_VALID */
+	unsigned char	*changed;	/* digest differed when last rehashed */
+} HASH_TREE;
+
+/* the rows of the data window as last drawn , a row is redrawn only */
+/* where it differs from the new contents                            */
+#define	FRAME_MIN_GAP	8
+
+typedef struct screen_frame {
+	char	*cells;				/* num_rows x num_cols characters */
+	char	*text;				/* row being formatted */
+	int		num_rows , num_cols;
+	int		valid;				/* cells match the screen */
+} SCREEN_FRAME;
+
+/* byte patches read from a patch file (see load_patches()) , sorted by */
+/* offset , the new and expected bytes are kept in data                */
+typedef struct patch_record {
+	long	offset;
+	long	length;
+	long	data_offset;		/* new bytes */
+	long	expect_offset;		/* expected old bytes , -1L if none */
+	int		line_number;
+} PATCH_RECORD;
+
+typedef struct patch_set {
+	PATCH_RECORD	*records;
+	long	num_records , max_records;
+	unsigned char	*data;
+	long	data_length , max_data;
+	long	end;				/* offset after the last patched byte */
+	long	num_runs;			/* number of runs of adjacent records */
+} PATCH_SET;
+
+/* files being patched by a pool of threads */
+typedef struct patch_job {
+	PATCH_SET	*patches;
+	char	**files;
+	char	**results;			/* message for each file */
+	int		num_files;
+	int		next_file;			/* next file to be claimed */
+	int		num_failed;
+	pthread_mutex_t	lock;
+} PATCH_JOB;
+
+struct search_job;
+
+typedef struct search_worker {
+	struct search_job	*job;
+	pthread_t	thread;
+	long	segment;			/* segment being searched , -1 if none */
+	SEARCH_CONTROL	control;
+	unsigned char	*buffer;
+	unsigned char	*other_buffer;	/* second file of a compare */
+} SEARCH_WORKER;
+
+typedef struct search_job {
+	DATA_SOURCE	*source;
+	const SEARCH_PATTERN	*pattern;
+	const MULTI_PATTERN	*multi;
+	HIT_INDEX	*hits;				/* find all matches , per segment for records */
+	DATA_SOURCE	*other;				/* second file of a compare */
+	DIFF_INDEX	*diffs;				/* differences found in each segment */
+	HASH_TREE	*tree;				/* chunks to be hashed */
+	HASH_STATE	*hash;				/* hash of a range */
+	const RECORD_FILTER	*filter;	/* field compared in every record */
+	int		algorithm;
+	const char	*activity;			/* shown in the progress message */
+	int		found_pattern;		/* which pattern of a multi search */
+	int		direction;			/* 1 --> forward , -1 --> backward */
+	long	start;
+	long	segment_size;
+	long	num_segments;
+	long	next_segment;		/* next segment to be claimed */
+	long	found_segment;		/* earliest segment with a result */
+	long	found_offset;
+	long	total_bytes;		/* size of the searched range */
+	volatile int	cancel;
+	pthread_mutex_t	lock;
+	int		num_workers;
+	int		num_running;		/* workers which have not finished */
+	SEARCH_WORKER	*workers;
+} SEARCH_JOB;
 
 static	char	*filename = NULL;
 static	long	filesize = 0L , num_blocks = 0L;
 static	long	block_bytes = 0L , current_file_offset = 0L;
+static	long	block_span = 0L;	/* bytes of the file covered by a block */
+static	long	block_end = 0L;		/* offset after the last byte shown */
+static	long	record_size = 0L;	/* bytes shown of each record , 0 unless -R */
+static	long	record_stride = 0L , record_first = 0L , num_records = 0L;
+static	int		record_rows = 1;	/* rows taken by each record */
+static	int		records_per_block = 1;
+static	long	last_match_offset = -1L;
+static	long	search_chunk_size = SEARCH_CHUNK_SIZE;
 static	int	input_fd = -1;
 static unsigned char	*block_buffer;
 static unsigned char	*temp_buffer;
 static	struct stat	filestats;
+static	DATA_SOURCE	input_source;
+static	EDIT_BUFFER	file_edits;
+static	EDIT_JOURNAL	edit_journal;
+static	MULTI_PATTERN	multi_patterns;
+static	HIT_INDEX	search_hits;
+static	char	*compare_name = NULL;	/* file given with -C , NULL if none */
+static	int		compare_fd = -1;
+static	DATA_SOURCE	compare_source;
+static	struct stat	compare_stats;
+static	DIFF_INDEX	file_diffs;
+static	long	compare_bytes = 0L;
+static unsigned char	*compare_buffer;
+static	char	*compare_line;		/* row of the compare file being formatted */
+static	SCREEN_FRAME	data_frame;
+static	OVERVIEW_MAP	overview;
+static	SIDECAR	sidecar;
+static	HASH_TREE	hash_trees[HASH_NUM_ALGORITHMS];
+static	unsigned int	crc32c_table[8][256];
+static	char	*hash_names[HASH_NUM_ALGORITHMS] = { "crc32c" , "xxh64" , "sha256" };
+static	int		hash_digest_lengths[HASH_NUM_ALGORITHMS] = { 4 , 8 , 32 };
+static	int		crc32c_hardware = 0;
+static	char	last_pattern[SEARCH_MAX_PATTERN * 4];	/* as last entered */
 static	WINDOW	*data_win  = NULL, *msg_win = NULL;
+static	WINDOW	*map_win = NULL;
+static	WINDOW	*template_win = NULL;
+static	STRUCT_TEMPLATE	record_template;
 static	WINDOW	*status_win  = NULL;
 static	int		num_lines , num_cols , blocksize , num_data_rows;
 static	int		tty_num_rows , tty_num_cols;
 static	int		num_pairs = 8 , max_data_pairs = 0 , num_pairs_bytes = 0;
 static	int		num_pairs_block_bytes = 0;
+static	int		offset_width = 8;	/* hex digits in the offset column */
 
-static	int		opt_w = 0 , opt_d = 0;
+static	int		opt_w = 0 , opt_d = 0 , opt_x = 0 , opt_D = 0 , opt_f = 0;
+static	int		opt_e = 0 , opt_n = 0;
+static	int		follow_fd = -1;		/* inotify instance for -f , -1 if none */
+static	int		opt_threads = 0;
+
+static	char	*help_lines[] = {
+	"q - quit",
+	"n - next block",
+	"p - previous block",
+	"1 - first block",
+	"$ - last block",
+	"# - goto specified block",
+	"o - goto specified offset",
+	"    (offset can be in decimal or hexadecimal)",
+	"w - write current block to a file",
+	"c - change a byte value",
+	"i - insert bytes",
+	"d - delete bytes",
+	"s - save all changes back to file",
+	"u - undo last change",
+	"r - redo last undone change",
+	"/ - scan forward",
+	"\\ - scan backward",
+	"    (text , or =hex bytes with ?? wildcards)",
+	"m - scan forward for patterns in a file",
+	"f - find all matches of a pattern",
+	"] - goto next match found by f",
+	"[ - goto previous match found by f",
+	"> - goto next difference from the -C file",
+	"< - goto previous difference from the -C file",
+	"= - compare the files again",
+	"e - select a region from the -e overview map",
+	"h - hash the file or a range (crc32c , xxh64 , sha256)",
+	"F - find the -R records in which a field has a value",
+	"    (# then goes to a record number)",
+	"? - display this help summary",
+	NULL
+};
 
 static	FILE	*debug_fp = NULL;
 static	char	debug_filename[100];
 
+/* lookup tables used to format rows of the dump , see format_init() */
+static	char	hex_digits[] = "0123456789abcdef";
+static	char	hex_pairs[512];		/* two hex digits for each byte value */
+static	char	print_chars[256];	/* byte as shown in the ASCII column */
+
 extern	int		optind , optopt , opterr;
 extern	void	die() , quit();
 
@@ -224,10 +838,10 @@ void error_message(char *format,...)
 void status_message(char *format,...)
 {
 	va_list ap;
-	char string[100];
+	char string[256];
 
 	va_start(ap,format);
-	vsprintf(string,format,ap);
+	vsnprintf(string,sizeof(string),format,ap);
 	va_end(ap);
 	wclear(status_win);
 	box(status_win,'|','-');
@@ -238,39 +852,6 @@ void status_message(char *format,...)
 	return;
 } /* end of status_message */
 
-/*********************************************************************
-*
-* Function  : pad_string
-*
-* Purpose   : Pad a string
-*
-* Inputs    : char *string - string to be padded
-*             int pad_length - final length of padded string
-*             char pad_char - padding character
-*
-* Output    : (none)
-*
-* Returns   : (nothing)
-*
-* Example   : pad_string(text,30,'*');
-*
-* Notes     : (none)
-*
-*********************************************************************/
-
-static char *pad_string(char *string, int pad_length, char padding_char)
-{
-	int	length , num_pad_chars;
-
-	length = strlen(string);
-	if ( length < pad_length ) {
-		num_pad_chars = (pad_length - length) + 1;
-		memset(&string[length],padding_char,num_pad_chars);
-		string[pad_length] = '\0';
-	}
-	return(string);
-} /* end of pad_string */
-
 /*********************************************************************
 *
 * Function  : get_number
@@ -281,39 +862,50 @@ static char *pad_string(char *string, int pad_length, char padding_char)
 *
 * Output    : (none)
 *
-* Returns   : long number - the numeric value
+* Returns   : long number - the numeric value , -1L if invalid
 *
 * Example   : count = get_number("Enter : ");
 *
-* Notes     : (none)
+* Notes     : A number starting with x or 0x is hexadecimal. The value
+*             is parsed with strtol() so that offsets past 4 GB are not
+*             truncated , values which do not fit are rejected.
 *
 *********************************************************************/
 
 static long get_number(prompt)
 char *prompt;
 {
-	int	num_digits;
+	int	num_digits , base;
 	long	number;
-	char	digit , digits[100];
+	char	digit , digits[100] , *start , *end;
 
 	message("%s",prompt);
 	digit = (char)wgetch(msg_win);
-	for ( num_digits = 0 ; !isspace(digit) ; ++num_digits ) {
-		waddch(msg_win,digit);
-		wrefresh(msg_win);
-		digits[num_digits] = digit;
+	for ( num_digits = 0 ; !isspace(digit) ; ) {
+		if ( num_digits < (int)sizeof(digits) - 1 ) {
+			waddch(msg_win,digit);
+			wrefresh(msg_win);
+			digits[num_digits++] = digit;
+		} /* IF */
 		digit = (char)wgetch(msg_win);
 	} /* WHILE */
 	digits[num_digits] = '\0';
-	if ( digits[0] == 'x' ) {
-		if ( sscanf(&digits[1],"%lx",&number) != 1 ) {
-			error_message("bad hex data : %s",digits);
-			number = 0;
-		} /* IF */
+	start = digits;
+	base = 10;
+	if ( digits[0] == 'x' || digits[0] == 'X' ) {
+		start = &digits[1];
+		base = 16;
+	} /* IF */
+	else if ( digits[0] == '0' && (digits[1] == 'x' || digits[1] == 'X') ) {
+		start = &digits[2];
+		base = 16;
+	} /* ELSE IF */
+	errno = 0;
+	number = strtol(start,&end,base);
+	if ( *start == '\0' || *end != '\0' || errno == ERANGE || number < 0L ) {
+		error_message("bad number : %s",digits);
+		number = -1L;
 	} /* IF */
-	else {
-		number = atol(digits);
-	} /* ELSE */
 
 	return(number);
 } /* end of get_number */
@@ -357,461 +949,10448 @@ static char *get_string(char *prompt, char *buffer)
 
 /*********************************************************************
 *
-* Function  : display_block
+* Function  : get_line
 *
-* Purpose   : Display a block of data
+* Purpose   : Get a line of text which may contain spaces
 *
-* Inputs    : (none)
+* Inputs    : char *prompt - the input prompt
+*             char *buffer - buffer to receive text
+*             int buffer_size - size of buffer
 *
-* Output    : A hex/character dump of a block of data
+* Output    : (none)
 *
-* Returns   : (nothing)
+* Returns   : pointer to text buffer
 *
-* Example   : display_block();
+* Example   : get_line("Enter pattern : ",text,sizeof(text));
 *
-* Notes     : This function displays the "current" block.
+* Notes     : Input is ended by RETURN. BACKSPACE removes the last
+*             character entered.
 *
 *********************************************************************/
 
-static void display_block()
+static char *get_line(char *prompt, char *buffer, int buffer_size)
 {
-	long	offset , block_offset , block_start;
-	unsigned char	line[100] , chunk[64] , *blockptr , ch;
-	int	count , row , num_bytes , col1;
+	int	num_chars , ch , row , col;
 
-	if ( lseek(input_fd,current_file_offset,SEEK_SET) < 0 ) {
-		system_error("Can't lseek to offset 0x%x",
-				current_file_offset);
-		return;
-	}
-	block_bytes = read(input_fd,block_buffer,blocksize);
-	if ( block_bytes < 0L ) {
-		system_error("Can't read block at offset 0x%x",
-				current_file_offset);
-		return;
-	}
-	status_message("File : %s, offset 0x%x, size = %ld (0x%x)",
-		filename,current_file_offset,filesize,filesize);
-	row = 1;
-	block_offset = 0L;
-	wclear(data_win);
-	box(data_win,'|','-');
-	wborder(data_win,0,0,0,0,0,0,0,0);
-	col1 = 2;
-	for ( row = 1 ; row <= num_data_rows && block_offset < block_bytes; ++row ) {
-		offset = current_file_offset + block_offset;
-		blockptr = &block_buffer[block_offset];
-		sprintf((char *)line,"%08x : ",offset);
-		num_bytes = 0;
-		block_start = block_offset;
-		for ( num_bytes = 0 ; num_bytes < num_pairs_bytes && offset < filesize ; ) {
-			if ( offset+1L < filesize ) {
-				sprintf((char *)chunk,"%02x%02x ",blockptr[0],
-							blockptr[1]);
-				num_bytes += 2;
-			} /* IF */
-			else {
-				sprintf((char *)chunk,"%02x%-2s ",blockptr[0]," ");
-				num_bytes += 1;
-			} /* ELSE */
-			blockptr += 2;
-			offset += 2L;
-			block_offset += 2L;
-			strcat((char *)line,(char *)chunk);
-		} /* FOR */
-		pad_string((char *)line,11 + num_pairs_block_bytes,' ');
-		sprintf((char *)chunk,"|%-*.*s|",num_pairs_bytes,num_pairs_bytes," ");
-		strcat((char *)line,(char *)chunk);
-		mvwaddstr(data_win,row,col1,(char *)line);
-		wrefresh(data_win);
-		blockptr = &block_buffer[block_start];
-/***		col = col1 + 52; ***/
-		sprintf((char *)line,"%-*.*s",num_pairs_bytes,num_pairs_bytes," ");
-		for ( count = 0 ; count < num_bytes ; ++count ) {
-			ch = *blockptr++;
-			if ( ch < 0x20 || ch > 0x7e ) {
-				line[count] = '.';
+	message("%s",prompt);
+	num_chars = 0;
+	for ( ch = wgetch(msg_win) ; ch != '\r' && ch != '\n' && ch != ERR ;
+									ch = wgetch(msg_win) ) {
+		if ( ch == '\b' || ch == 0x7f || ch == KEY_BACKSPACE ) {
+			if ( num_chars > 0 ) {
+				num_chars -= 1;
+				getyx(msg_win,row,col);
+				mvwaddch(msg_win,row,col-1,' ');
+				wmove(msg_win,row,col-1);
+				wrefresh(msg_win);
 			} /* IF */
-			else {
-				line[count] = ch;
-			} /* ELSE */
-		} /* FOR loop over 1 line */
-		mvwaddstr(data_win,row,col1 + 11 + num_pairs_block_bytes + 1,(char *)line);
-	} /* FOR loop over all lines in block */
-	wrefresh(data_win);
+			continue;
+		} /* IF */
+		if ( num_chars < buffer_size - 1 && isprint(ch) ) {
+			waddch(msg_win,ch);
+			wrefresh(msg_win);
+			buffer[num_chars++] = (char)ch;
+		} /* IF */
+	} /* FOR */
+	buffer[num_chars] = '\0';
 
-	return;
-} /* end of display_block */
+	return(buffer);
+} /* end of get_line */
 
 /*********************************************************************
 *
-* Function  : show_help
+* Function  : source_capture
 *
-* Purpose   : Display a help screen.
+* Purpose   : Read the entire contents of a non seekable or unsized
+*             file into memory.
 *
-* Inputs    : (none)
+* Inputs    : DATA_SOURCE *source - data source being opened
 *
-* Output    : The help screen
+* Output    : (none)
 *
-* Returns   : (nothing)
+* Returns   : 0 --> success , -1 --> error
 *
-* Example   : show_help();
+* Example   : source_capture(&input_source);
 *
-* Notes     : (none)
+* Notes     : Used for pipes , character devices and for /proc style
+*             files whose stat() size is zero. Contents of
+*             SOURCE_CAPTURE_LIMIT bytes or more are refused with EFBIG ,
+*             so that a device such as /dev/zero does not use up all
+*             memory.
 *
 *********************************************************************/
 
-static void show_help()
+static int source_capture(DATA_SOURCE *source)
 {
-	int	row , col;
-	char	buffer[256];
+	size_t	allocated;
+	ssize_t	num_bytes;
+	unsigned char	*buffer;
+	int		status;
 
-	wclear(data_win);
-	box(data_win,'|','-');
-	wborder(data_win,0,0,0,0,0,0,0,0);
-	col = 2;
-	row = 2;
-	mvwaddstr(data_win,row++,col,"Available Commands :");
-	col += 4;
-	row += 1;
-	mvwaddstr(data_win,row++,col,"q - quit");
-	mvwaddstr(data_win,row++,col,"n - next block");
-	mvwaddstr(data_win,row++,col,"p - previous block");
-	mvwaddstr(data_win,row++,col,"1 - first block");
-	mvwaddstr(data_win,row++,col,"$ - last block");
-	mvwaddstr(data_win,row++,col,"# - goto specified block");
-	mvwaddstr(data_win,row++,col,"o - goto specified offset");
-	mvwaddstr(data_win,row++,col,
-		"    (offset can be in decimal or hexadecimal)");
-	mvwaddstr(data_win,row++,col,"w - write current block to a file");
-	mvwaddstr(data_win,row++,col,"c - change a byte value");
-	mvwaddstr(data_win,row++,col,"s - save current block back to file");
-	mvwaddstr(data_win,row++,col,"/ - scan forward");
-	mvwaddstr(data_win,row++,col,"\\ - scan backward");
-	mvwaddstr(data_win,row++,col,"? - display this help summary");
-	sprintf(buffer,"Rows : %d , Cols : %d",tty_num_rows,tty_num_cols);
-	mvwaddstr(data_win,row++,col,buffer);
-	col -= 4;
-	wrefresh(data_win);
-	message("Press any key to continue.");
-	wgetch(msg_win);
+	allocated = SOURCE_CAPTURE_CHUNK;
+	source->data = (unsigned char *)malloc(allocated);
+	if ( source->data == NULL ) {
+		return(-1);
+	} /* IF */
+	source->data_length = 0;
+	status = 0;
+	while ( status == 0 ) {
+		if ( source->data_length == allocated ) {
+			if ( allocated >= (size_t)SOURCE_CAPTURE_LIMIT ) {
+				errno = EFBIG;	/* e.g. /dev/zero , which never ends */
+				status = -1;
+				break;
+			} /* IF */
+			allocated *= 2;
+			buffer = (unsigned char *)realloc(source->data,allocated);
+			if ( buffer == NULL ) {
+				status = -1;
+				break;
+			} /* IF */
+			source->data = buffer;
+		} /* IF */
+		num_bytes = read(source->fd,&source->data[source->data_length],
+						allocated - source->data_length);
+		if ( num_bytes < 0 ) {
+			if ( errno != EINTR ) {
+				status = -1;
+			} /* IF */
+		} /* IF */
+		else if ( num_bytes == 0 ) {
+			break;
+		} /* ELSE IF */
+		else {
+			source->data_length += num_bytes;
+		} /* ELSE */
+	} /* WHILE */
+	if ( status < 0 ) {
+		free(source->data);
+		source->data = NULL;
+		source->data_length = 0;
+		return(-1);
+	} /* IF */
+	source->kind = SOURCE_MEMORY;
+	source->size = (long)source->data_length;
 
-	display_block();
-	return;
-} /* end of show_help */
+	return(0);
+} /* end of source_capture */
 
 /*********************************************************************
 *
-* Function  : write_current_block
+* Function  : device_size
 *
-* Purpose   : Write current block to a file.
+* Purpose   : Get the size of a block device.
 *
-* Inputs    : (none)
+* Inputs    : int fd - file descriptor of open device
+*             long *size - receives size in bytes
+*             long *sector_size - if not NULL , receives the logical
+*                                 sector size
 *
-* Output    : Current block is written to a file.
+* Output    : (none)
 *
-* Returns   : (nothing)
+* Returns   : 0 --> success , -1 --> error
 *
-* Example   : write_current_block();
+* Example   : device_size(fd,&size,&sector_size);
 *
-* Notes     : (none)
+* Notes     : stat() reports a size of 0 for disks , so the size
+*             comes from the BLKGETSIZE64 ioctl.
 *
 *********************************************************************/
 
-int write_current_block()
+static int device_size(int fd, long *size, long *sector_size)
 {
-	char	filename[100];
-	FILE	*output;
+	unsigned long long	num_bytes;
+	int		sector_bytes;
 
-	get_string("Enter filename : ",filename);
-	while ( NE(filename,"$") && access(filename,F_OK) == 0 ) {
-		get_string("File exists, try again : ",filename);
-	} /* WHILE */
-	if ( NE(filename,"$") ) {
-		output = fopen(filename,"w");
-		if ( output == NULL ) {
-			system_error("Can't open file \"%s\"",
-					filename);
+	if ( ioctl(fd,BLKGETSIZE64,&num_bytes) < 0 ) {
+		return(-1);
+	} /* IF */
+	*size = (long)num_bytes;
+	if ( (unsigned long long)*size != num_bytes ) {
+		errno = EFBIG;
+		return(-1);
+	} /* IF */
+	if ( sector_size != NULL ) {
+		*sector_size = 512L;
+		if ( ioctl(fd,BLKSSZGET,&sector_bytes) == 0 && sector_bytes > 0 ) {
+			*sector_size = sector_bytes;
 		} /* IF */
-		else {
-			if ( fwrite(block_buffer,block_bytes,1,output) != 1 ) {
-				system_error("Write failed");
-			} /* IF */
-			fclose(output);
-		} /* ELSE */
 	} /* IF */
 
 	return(0);
-} /* end of write_current_block */
+} /* end of device_size */
 
 /*********************************************************************
 *
-* Function  : save_current_block
+* Function  : source_pread
 *
-* Purpose   : Save current block data back to file.
+* Purpose   : Read a range of the underlying file , honouring the
+*             alignment rules of O_DIRECT.
 *
-* Inputs    : (none)
+* Inputs    : DATA_SOURCE *source - data source
+*             unsigned char *buffer - buffer to receive data
+*             long length - number of bytes wanted
+*             long offset - file offset of first byte
 *
-* Output    : Current block is written back to file.
+* Output    : (none)
 *
-* Returns   : (nothing)
+* Returns   : number of bytes read (less at end of file) , -1L on error
 *
-* Example   : save_current_block();
+* Example   : count = source_pread(source,buffer,length,offset);
 *
-* Notes     : (none)
+* Notes     : Short reads are retried. When the source was opened with
+*             O_DIRECT and the buffer , offset or length is not a
+*             multiple of source->align , the enclosing whole sectors
+*             are read into an aligned bounce buffer and the wanted
+*             bytes copied out.
 *
 *********************************************************************/
 
-void save_current_block()
+static long source_pread(DATA_SOURCE *source, unsigned char *buffer,
+					long length, long offset)
 {
-	if ( ! opt_w ) {
-		message("Can't update a read-only file. Press any key to continue.");
-		wgetch(msg_win);
-		return;
-	} /* IF */
+	unsigned char	*bounce;
+	long	total , start , end;
+	ssize_t	num_bytes;
 
-	if ( lseek(input_fd,current_file_offset,SEEK_SET) < 0 ) {
-		system_error("Can't lseek to offset 0x%x",
-				current_file_offset);
-		return;
-	}
-	if ( write(input_fd,block_buffer,block_bytes) != block_bytes ) {
-		system_error("Write failed");
+	if ( source->direct && ((unsigned long)buffer % source->align != 0 ||
+					offset % source->align != 0 || length % source->align != 0) ) {
+		start = offset / source->align * source->align;
+		end = (offset + length + source->align - 1) / source->align *
+							source->align;
+		if ( posix_memalign((void **)&bounce,source->align,end - start) != 0 ) {
+			errno = ENOMEM;
+			return(-1L);
+		} /* IF */
+		total = source_pread(source,bounce,end - start,start);
+		if ( total >= 0L ) {
+			total -= offset - start;
+			if ( total < 0L ) {
+				total = 0L;
+			} /* IF */
+			if ( total > length ) {
+				total = length;
+			} /* IF */
+			memcpy(buffer,&bounce[offset - start],total);
+		} /* IF */
+		free(bounce);
+		return(total);
 	} /* IF */
-} /* end of save_current_block */
+
+	for ( total = 0L ; total < length ; total += num_bytes ) {
+		num_bytes = pread(source->fd,&buffer[total],length - total,
+						(off_t)(offset + total));
+		if ( num_bytes < 0 ) {
+			if ( errno == EINTR ) {
+				num_bytes = 0;
+				continue;
+			} /* IF */
+			return(-1L);
+		} /* IF */
+		if ( num_bytes == 0 ) {
+			break;
+		} /* IF */
+	} /* FOR */
+
+	return(total);
+} /* end of source_pread */
 
 /*********************************************************************
 *
-* Function  : get_hex_byte
+* Function  : cache_get_page
 *
-* Purpose   : Get a hexadecimal byte value from the user
+* Purpose   : Find a page of the file in the cache , reading it if it
+*             is not there.
 *
-* Inputs    : char *prompt - the input prompt
+* Inputs    : PAGE_CACHE *cache - the cache
+*             long page_offset - file offset of page
+*             int prefetch - 1 --> called by the prefetch thread
 *
 * Output    : (none)
 *
-* Returns   : long number - the numeric value
+* Returns   : pointer to page or NULL on error
 *
-* Example   : count = get_hex_byte("Enter : ");
+* Example   : page = cache_get_page(cache,page_offset,0);
 *
-* Notes     : (none)
+* Notes     : Must be called with cache->lock held. The lock is
+*             released while the page is read , so other threads can
+*             use the cache meanwhile , and is held again on return.
+*             A page read while the cache was invalidated is thrown
+*             away and read again.
 *
 *********************************************************************/
 
-static unsigned char get_hex_byte(char *prompt)
+static CACHE_PAGE *cache_get_page(PAGE_CACHE *cache, long page_offset,
+					int prefetch)
 {
-	int	num_digits;
-	long	number;
-	char	digit , digits[100];
-	unsigned char	hex_byte;
+	CACHE_PAGE	*page , *victim;
+	long	generation;
+	ssize_t	num_bytes;
+	int		index;
 
-	message("%s",prompt);
-	digit = (char)wgetch(msg_win);
-	for ( num_digits = 0 ; !isspace(digit) ; ++num_digits ) {
-		waddch(msg_win,digit);
-		wrefresh(msg_win);
-		digits[num_digits] = digit;
-		digit = (char)wgetch(msg_win);
+	while ( 1 ) {
+		victim = NULL;
+		for ( index = 0 ; index < CACHE_NUM_PAGES ; ++index ) {
+			page = &cache->pages[index];
+			if ( page->offset == page_offset ) {
+				break;
+			} /* IF */
+			if ( ! page->loading &&
+					(victim == NULL || page->last_used < victim->last_used) ) {
+				victim = page;
+			} /* IF */
+		} /* FOR */
+		if ( index < CACHE_NUM_PAGES ) {
+			if ( page->loading ) {
+				pthread_cond_wait(&cache->loaded,&cache->lock);
+				continue;
+			} /* IF */
+			if ( ! prefetch ) {
+				cache->hits += 1L;
+			} /* IF */
+			page->last_used = ++cache->clock;
+			return(page);
+		} /* IF */
+		if ( victim == NULL ) {
+			errno = EBUSY;
+			return(NULL);
+		} /* IF */
+
+		if ( prefetch ) {
+			cache->prefetched += 1L;
+		} /* IF */
+		else {
+			cache->misses += 1L;
+		} /* ELSE */
+		victim->offset = page_offset;
+		victim->loading = 1;
+		generation = cache->generation;
+		pthread_mutex_unlock(&cache->lock);
+		do {
+			num_bytes = pread(cache->fd,victim->data,CACHE_PAGE_SIZE,
+							(off_t)page_offset);
+		} while ( num_bytes < 0 && errno == EINTR );
+		pthread_mutex_lock(&cache->lock);
+		victim->loading = 0;
+		victim->length = num_bytes < 0 ? 0L : (long)num_bytes;
+		victim->last_used = ++cache->clock;
+		pthread_cond_broadcast(&cache->loaded);
+		if ( num_bytes < 0 || generation != cache->generation ) {
+			victim->offset = -1L;
+			if ( num_bytes < 0 ) {
+				return(NULL);
+			} /* IF */
+			continue;
+		} /* IF */
+		return(victim);
 	} /* WHILE */
-	digits[num_digits] = '\0';
-	if ( num_digits < 1 || num_digits > 2 ) {
+} /* end of cache_get_page */
+
+/*********************************************************************
+*
+* Function  : cache_read
+*
+* Purpose   : Copy a range of the file into a buffer through the cache.
+*
+* Inputs    : PAGE_CACHE *cache - the cache
+*             long offset - file offset of first byte
+*             unsigned char *buffer - receives data
+*             long length - number of bytes wanted
+*
+* Output    : (none)
+*
+* Returns   : number of bytes copied (less at end of file) , -1L on error
+*
+* Example   : count = cache_read(source->cache,offset,buffer,length);
+*
+* Notes     : (none)
+*
+*********************************************************************/
+
+static long cache_read(PAGE_CACHE *cache, long offset, unsigned char *buffer,
+					long length)
+{
+	CACHE_PAGE	*page;
+	long	total , page_offset , within , count;
+
+	pthread_mutex_lock(&cache->lock);
+	for ( total = 0L ; total < length ; total += count ) {
+		page_offset = (offset + total) / CACHE_PAGE_SIZE * CACHE_PAGE_SIZE;
+		page = cache_get_page(cache,page_offset,0);
+		if ( page == NULL ) {
+			pthread_mutex_unlock(&cache->lock);
+			return(-1L);
+		} /* IF */
+		within = offset + total - page_offset;
+		count = page->length - within;
+		if ( count <= 0L ) {
+			break;
+		} /* IF */
+		if ( count > length - total ) {
+			count = length - total;
+		} /* IF */
+		memcpy(&buffer[total],&page->data[within],count);
+		if ( page->length < CACHE_PAGE_SIZE && within + count == page->length ) {
+			total += count;
+			break;
+		} /* IF */
+	} /* FOR */
+	pthread_mutex_unlock(&cache->lock);
+
+	return(total);
+} /* end of cache_read */
+
+/*********************************************************************
+*
+* Function  : cache_prefetch_worker
+*
+* Purpose   : Thread function which reads pages into the cache ahead of
+*             the reader.
+*
+* Inputs    : void *argument - the PAGE_CACHE
+*
+* Output    : (none)
+*
+* Returns   : NULL
+*
+* Example   : pthread_create(&thread,NULL,cache_prefetch_worker,cache);
+*
+* Notes     : Runs until cache->stop is set. A new prefetch request
+*             replaces any earlier one still in progress.
+*
+*********************************************************************/
+
+static void *cache_prefetch_worker(void *argument)
+{
+	PAGE_CACHE	*cache;
+	long	page_offset;
+
+	cache = (PAGE_CACHE *)argument;
+	pthread_mutex_lock(&cache->lock);
+	while ( ! cache->stop ) {
+		if ( cache->prefetch_offset >= cache->prefetch_end ) {
+			pthread_cond_wait(&cache->work,&cache->lock);
+			continue;
+		} /* IF */
+		page_offset = cache->prefetch_offset;
+		cache->prefetch_offset += CACHE_PAGE_SIZE;
+		if ( page_offset >= cache->size ) {
+			cache->prefetch_offset = cache->prefetch_end;
+			continue;
+		} /* IF */
+		cache_get_page(cache,page_offset,1);
+	} /* WHILE */
+	pthread_mutex_unlock(&cache->lock);
+
+	return(NULL);
+} /* end of cache_prefetch_worker */
+
+/*********************************************************************
+*
+* Function  : cache_open
+*
+* Purpose   : Setup a page cache for a data source.
+*
+* Inputs    : DATA_SOURCE *source - data source read with pread()
+*
+* Output    : (none)
+*
+* Returns   : (nothing)
+*
+* Example   : cache_open(source);
+*
+* Notes     : The source is used without a cache if there is not
+*             enough memory. The pages are aligned for O_DIRECT reads.
+*
+*********************************************************************/
+
+static void cache_open(DATA_SOURCE *source)
+{
+	PAGE_CACHE	*cache;
+	unsigned char	*data;
+	int		index;
+
+	cache = (PAGE_CACHE *)calloc(1,sizeof(PAGE_CACHE));
+	if ( posix_memalign((void **)&data,source->align,
+						CACHE_NUM_PAGES * CACHE_PAGE_SIZE) != 0 ) {
+		data = NULL;
+	} /* IF */
+	if ( cache == NULL || data == NULL ) {
+		free(cache);
+		free(data);
+		return;
+	} /* IF */
+	cache->fd = source->fd;
+	cache->size = source->size;
+	for ( index = 0 ; index < CACHE_NUM_PAGES ; ++index ) {
+		cache->pages[index].offset = -1L;
+		cache->pages[index].data = &data[index * CACHE_PAGE_SIZE];
+	} /* FOR */
+	pthread_mutex_init(&cache->lock,NULL);
+	pthread_cond_init(&cache->loaded,NULL);
+	pthread_cond_init(&cache->work,NULL);
+	if ( pthread_create(&cache->thread,NULL,cache_prefetch_worker,cache) != 0 ) {
+		cache->stop = 1;
+	} /* IF */
+	source->cache = cache;
+
+	return;
+} /* end of cache_open */
+
+/*********************************************************************
+*
+* Function  : cache_close
+*
+* Purpose   : Release the page cache of a data source.
+*
+* Inputs    : DATA_SOURCE *source - data source
+*
+* Output    : (none)
+*
+* Returns   : (nothing)
+*
+* Example   : cache_close(source);
+*
+* Notes     : (none)
+*
+*********************************************************************/
+
+static void cache_close(DATA_SOURCE *source)
+{
+	PAGE_CACHE	*cache;
+
+	cache = source->cache;
+	if ( cache == NULL ) {
+		return;
+	} /* IF */
+	pthread_mutex_lock(&cache->lock);
+	if ( ! cache->stop ) {
+		cache->stop = 1;
+		pthread_cond_signal(&cache->work);
+		pthread_mutex_unlock(&cache->lock);
+		pthread_join(cache->thread,NULL);
+	} /* IF */
+	else {
+		pthread_mutex_unlock(&cache->lock);
+	} /* ELSE */
+	pthread_mutex_destroy(&cache->lock);
+	pthread_cond_destroy(&cache->loaded);
+	pthread_cond_destroy(&cache->work);
+	free(cache->pages[0].data);
+	free(cache);
+	source->cache = NULL;
+
+	return;
+} /* end of cache_close */
+
+/*********************************************************************
+*
+* Function  : cache_invalidate
+*
+* Purpose   : Forget the cached contents of a data source.
+*
+* Inputs    : DATA_SOURCE *source - data source
+*
+* Output    : (none)
+*
+* Returns   : (nothing)
+*
+* Example   : cache_invalidate(source);
+*
+* Notes     : Called after the file has been written. Pages being read
+*             at the time are thrown away when the read completes.
+*
+*********************************************************************/
+
+static void cache_invalidate(DATA_SOURCE *source)
+{
+	PAGE_CACHE	*cache;
+	int		index;
+
+	cache = source->cache;
+	if ( cache == NULL ) {
+		return;
+	} /* IF */
+	pthread_mutex_lock(&cache->lock);
+	cache->generation += 1L;
+	for ( index = 0 ; index < CACHE_NUM_PAGES ; ++index ) {
+		if ( ! cache->pages[index].loading ) {
+			cache->pages[index].offset = -1L;
+		} /* IF */
+	} /* FOR */
+	pthread_mutex_unlock(&cache->lock);
+
+	return;
+} /* end of cache_invalidate */
+
+/*********************************************************************
+*
+* Function  : source_prefetch
+*
+* Purpose   : Start reading a range of a data source which will soon
+*             be wanted.
+*
+* Inputs    : DATA_SOURCE *source - data source
+*             long offset - file offset of first byte
+*             long length - number of bytes
+*
+* Output    : (none)
+*
+* Returns   : (nothing)
+*
+* Example   : source_prefetch(&input_source,offset,length);
+*
+* Notes     : Does not wait for the data. Mapped files are handed to
+*             the kernel with MADV_WILLNEED , pread() sources are read
+*             into the page cache by its helper thread.
+*
+*********************************************************************/
+
+static void source_prefetch(DATA_SOURCE *source, long offset, long length)
+{
+	long	start , page_size;
+
+	if ( offset < 0L ) {
+		length += offset;
+		offset = 0L;
+	} /* IF */
+	if ( length <= 0L || offset >= source->size ) {
+		return;
+	} /* IF */
+	if ( length > source->size - offset ) {
+		length = source->size - offset;
+	} /* IF */
+	if ( source->kind == SOURCE_MAPPED ) {
+		page_size = sysconf(_SC_PAGESIZE);
+		start = offset / page_size * page_size;
+		madvise(&source->data[start],offset + length - start,MADV_WILLNEED);
+	} /* IF */
+	else if ( source->cache != NULL ) {
+		pthread_mutex_lock(&source->cache->lock);
+		source->cache->prefetch_offset = offset / CACHE_PAGE_SIZE * CACHE_PAGE_SIZE;
+		source->cache->prefetch_end = offset + length;
+		pthread_cond_signal(&source->cache->work);
+		pthread_mutex_unlock(&source->cache->lock);
+	} /* ELSE IF */
+
+	return;
+} /* end of source_prefetch */
+
+/*********************************************************************
+*
+* Function  : source_open
+*
+* Purpose   : Setup the data access layer for an open file.
+*
+* Inputs    : DATA_SOURCE *source - data source to be initialized
+*             int fd - file descriptor of open file
+*             struct stat *stats - stat() information for the file
+*
+* Output    : (none)
+*
+* Returns   : 0 --> success , -1 --> error
+*
+* Example   : source_open(&input_source,input_fd,&filestats);
+*
+* Notes     : Regular files and block devices are memory mapped. If
+*             the mapping fails , or the file is too big for the
+*             address space , the file is accessed with pread(). Files
+*             opened with O_DIRECT are always accessed with pread() ,
+*             in whole sectors. Pipes and zero sized files (e.g. under
+*             /proc) are read into memory. A file whose size does not
+*             fit in a long is refused with EFBIG. The size of a block
+*             device is found with device_size().
+*
+*********************************************************************/
+
+static int source_open(DATA_SOURCE *source, int fd, struct stat *stats)
+{
+	void	*map;
+	int		flags;
+
+	source->fd = fd;
+	source->kind = SOURCE_PREAD;
+	source->size = (long)stats->st_size;
+	source->data = NULL;
+	source->data_length = 0;
+	source->edits = NULL;
+	source->cache = NULL;
+	flags = fcntl(fd,F_GETFL);
+	source->direct = flags >= 0 && (flags & O_DIRECT) != 0;
+	source->align = SOURCE_DIRECT_ALIGN;
+
+	if ( S_ISBLK(stats->st_mode) ) {
+		if ( device_size(fd,&source->size,&source->align) < 0 ) {
+			return(-1);
+		} /* IF */
+	} /* IF */
+	else if ( (off_t)source->size != stats->st_size ) {
+		errno = EFBIG;	/* offsets are held in a long */
+		return(-1);
+	} /* ELSE IF */
+	if ( S_ISFIFO(stats->st_mode) || S_ISSOCK(stats->st_mode) ||
+				S_ISCHR(stats->st_mode) ||
+				(S_ISREG(stats->st_mode) && stats->st_size == 0) ) {
+		source->direct = 0;
+		return(source_capture(source));
+	} /* IF */
+	if ( (S_ISREG(stats->st_mode) || S_ISBLK(stats->st_mode)) &&
+				! source->direct && source->size > 0L &&
+				(long)(size_t)source->size == source->size ) {
+		map = mmap(NULL,(size_t)source->size,PROT_READ,MAP_SHARED,fd,0);
+		if ( map != MAP_FAILED ) {
+			source->kind = SOURCE_MAPPED;
+			source->data = (unsigned char *)map;
+			source->data_length = (size_t)source->size;
+		} /* IF */
+		else {
+			debug_print("mmap failed (%s), using pread\n",strerror(errno));
+		} /* ELSE */
+	} /* IF */
+	if ( source->kind == SOURCE_PREAD ) {
+		cache_open(source);
+	} /* IF */
+
+	return(0);
+} /* end of source_open */
+
+/*********************************************************************
+*
+* Function  : source_close
+*
+* Purpose   : Release the resources held by a data source.
+*
+* Inputs    : DATA_SOURCE *source - data source
+*
+* Output    : (none)
+*
+* Returns   : (nothing)
+*
+* Example   : source_close(&input_source);
+*
+* Notes     : The file descriptor is not closed.
+*
+*********************************************************************/
+
+static void source_close(DATA_SOURCE *source)
+{
+	cache_close(source);
+	if ( source->kind == SOURCE_MAPPED ) {
+		munmap(source->data,source->data_length);
+	} /* IF */
+	else if ( source->kind == SOURCE_MEMORY ) {
+		free(source->data);
+	} /* ELSE IF */
+	source->data = NULL;
+	source->data_length = 0;
+	source->kind = SOURCE_PREAD;
+
+	return;
+} /* end of source_close */
+
+/*********************************************************************
+*
+* Function  : source_grow
+*
+* Purpose   : Let a data source see bytes appended to its file.
+*
+* Inputs    : DATA_SOURCE *source - data source
+*             long new_size - new size of the file
+*
+* Output    : (none)
+*
+* Returns   : 0 --> success , -1 --> error
+*
+* Example   : source_grow(&input_source,(long)stats.st_size);
+*
+* Notes     : A mapping is extended with mremap() , which may move it ,
+*             so no view of the source may be held across the call.
+*             Cached pages from the old end of file onwards are thrown
+*             away since they were read short. In memory sources can
+*             not grow.
+*
+*********************************************************************/
+
+static int source_grow(DATA_SOURCE *source, long new_size)
+{
+	PAGE_CACHE	*cache;
+	long	page_offset;
+	void	*map;
+	int		index;
+
+	if ( new_size <= source->size ) {
+		return(0);
+	} /* IF */
+	if ( source->kind == SOURCE_MEMORY ) {
+		errno = ESPIPE;
+		return(-1);
+	} /* IF */
+	if ( source->kind == SOURCE_MAPPED ) {
+		if ( (long)(size_t)new_size != new_size ) {
+			errno = EFBIG;
+			return(-1);
+		} /* IF */
+		map = mremap(source->data,source->data_length,(size_t)new_size,
+						MREMAP_MAYMOVE);
+		if ( map == MAP_FAILED ) {
+			return(-1);
+		} /* IF */
+		source->data = (unsigned char *)map;
+		source->data_length = (size_t)new_size;
+	} /* IF */
+	cache = source->cache;
+	if ( cache != NULL ) {
+		pthread_mutex_lock(&cache->lock);
+		page_offset = source->size / CACHE_PAGE_SIZE * CACHE_PAGE_SIZE;
+		cache->generation += 1L;
+		for ( index = 0 ; index < CACHE_NUM_PAGES ; ++index ) {
+			if ( ! cache->pages[index].loading &&
+						cache->pages[index].offset >= page_offset ) {
+				cache->pages[index].offset = -1L;
+			} /* IF */
+		} /* FOR */
+		cache->size = new_size;
+		pthread_mutex_unlock(&cache->lock);
+	} /* IF */
+	source->size = new_size;
+
+	return(0);
+} /* end of source_grow */
+
+/*********************************************************************
+*
+* Function  : source_file_view
+*
+* Purpose   : Get a view of a range of bytes of the underlying file.
+*
+* Inputs    : DATA_SOURCE *source - data source
+*             long offset - file offset of first byte
+*             long length - number of bytes wanted
+*             unsigned char *buffer - buffer used when the data can not
+*                                     be referenced in place
+*             long *view_bytes - receives number of bytes available
+*
+* Output    : (none)
+*
+* Returns   : pointer to data or NULL on error
+*
+* Example   : ptr = source_file_view(&input_source,offset,blocksize,
+*                                    temp_buffer,&num_bytes);
+*
+* Notes     : For mapped and in memory sources the returned pointer
+*             references the data directly and must not be modified.
+*             The view is truncated at end of file. Pending edits are
+*             not included , see source_view(). Small reads of pread()
+*             sources go through the page cache , large ones (such as
+*             those of a search) bypass it so as not to flush it.
+*
+*********************************************************************/
+
+static unsigned char *source_file_view(DATA_SOURCE *source, long offset,
+					long length, unsigned char *buffer, long *view_bytes)
+{
+	long	total;
+
+	*view_bytes = 0L;
+	if ( offset < 0L ) {
+		errno = EINVAL;
+		return(NULL);
+	} /* IF */
+	if ( source->data != NULL ) {
+		if ( offset < (long)source->data_length ) {
+			*view_bytes = (long)source->data_length - offset;
+			if ( *view_bytes > length ) {
+				*view_bytes = length;
+			} /* IF */
+		} /* IF */
+		return(&source->data[*view_bytes > 0 ? offset : 0]);
+	} /* IF */
+
+	if ( source->cache != NULL && length <= CACHE_MAX_READ ) {
+		total = cache_read(source->cache,offset,buffer,length);
+		if ( total >= 0L ) {
+			*view_bytes = total;
+			return(buffer);
+		} /* IF */
+	} /* IF */
+	total = source_pread(source,buffer,length,offset);
+	if ( total < 0L ) {
+		return(NULL);
+	} /* IF */
+	*view_bytes = total;
+
+	return(buffer);
+} /* end of source_file_view */
+
+/*********************************************************************
+*
+* Function  : edit_new_piece
+*
+* Purpose   : Allocate a piece of the edit tree.
+*
+* Inputs    : EDIT_BUFFER *edits - the edit buffer
+*             int source - PIECE_ORIGINAL or PIECE_ADDED
+*             long source_offset - offset of data in its source
+*             long length - number of bytes
+*
+* Output    : (none)
+*
+* Returns   : pointer to piece or NULL if out of memory
+*
+* Example   : piece = edit_new_piece(edits,PIECE_ADDED,position,count);
+*
+* Notes     : (none)
+*
+*********************************************************************/
+
+static PIECE *edit_new_piece(EDIT_BUFFER *edits, int source,
+					long source_offset, long length)
+{
+	PIECE	*piece;
+
+	piece = (PIECE *)malloc(sizeof(PIECE));
+	if ( piece == NULL ) {
+		return(NULL);
+	} /* IF */
+	/* xorshift , good enough to keep the treap balanced */
+	edits->seed ^= edits->seed << 13;
+	edits->seed ^= edits->seed >> 17;
+	edits->seed ^= edits->seed << 5;
+	piece->priority = edits->seed;
+	piece->source = source;
+	piece->source_offset = source_offset;
+	piece->length = length;
+	piece->total = length;
+	piece->left = NULL;
+	piece->right = NULL;
+	edits->num_pieces += 1;
+
+	return(piece);
+} /* end of edit_new_piece */
+
+/*********************************************************************
+*
+* Function  : edit_free_tree
+*
+* Purpose   : Release a subtree of the edit tree.
+*
+* Inputs    : EDIT_BUFFER *edits - the edit buffer
+*             PIECE *piece - root of subtree
+*
+* Output    : (none)
+*
+* Returns   : (nothing)
+*
+* Example   : edit_free_tree(edits,edits->root);
+*
+* Notes     : (none)
+*
+*********************************************************************/
+
+static void edit_free_tree(EDIT_BUFFER *edits, PIECE *piece)
+{
+	if ( piece != NULL ) {
+		edit_free_tree(edits,piece->left);
+		edit_free_tree(edits,piece->right);
+		free(piece);
+		edits->num_pieces -= 1;
+	} /* IF */
+
+	return;
+} /* end of edit_free_tree */
+
+/*********************************************************************
+*
+* Function  : edit_reset
+*
+* Purpose   : Describe a file without any edits.
+*
+* Inputs    : EDIT_BUFFER *edits - the edit buffer
+*             long size - size of the file
+*
+* Output    : (none)
+*
+* Returns   : 0 --> success , -1 --> out of memory
+*
+* Example   : edit_reset(edits,edits->size);
+*
+* Notes     : The file is described by a single piece referring to
+*             the original file data.
+*
+*********************************************************************/
+
+static int edit_reset(EDIT_BUFFER *edits, long size)
+{
+	edit_free_tree(edits,edits->root);
+	edits->root = NULL;
+	edits->size = size;
+	edits->added_length = 0L;
+	edits->dirty = 0;
+	edits->resized = 0;
+	if ( size > 0L ) {
+		edits->root = edit_new_piece(edits,PIECE_ORIGINAL,0L,size);
+		if ( edits->root == NULL ) {
+			return(-1);
+		} /* IF */
+	} /* IF */
+
+	return(0);
+} /* end of edit_reset */
+
+/*********************************************************************
+*
+* Function  : edit_init
+*
+* Purpose   : Setup an empty edit buffer for a file.
+*
+* Inputs    : EDIT_BUFFER *edits - the edit buffer
+*             long size - size of the file
+*
+* Output    : (none)
+*
+* Returns   : 0 --> success , -1 --> out of memory
+*
+* Example   : edit_init(&file_edits,filesize);
+*
+* Notes     : (none)
+*
+*********************************************************************/
+
+static int edit_init(EDIT_BUFFER *edits, long size)
+{
+	memset(edits,0,sizeof(EDIT_BUFFER));
+	edits->seed = 2463534242U;
+
+	return(edit_reset(edits,size));
+} /* end of edit_init */
+
+/*********************************************************************
+*
+* Function  : edit_update
+*
+* Purpose   : Recompute the number of bytes covered by a subtree.
+*
+* Inputs    : PIECE *piece - root of subtree
+*
+* Output    : (none)
+*
+* Returns   : (nothing)
+*
+* Example   : edit_update(piece);
+*
+* Notes     : The children must already be up to date.
+*
+*********************************************************************/
+
+static void edit_update(PIECE *piece)
+{
+	piece->total = piece->length + PIECE_TOTAL(piece->left) +
+					PIECE_TOTAL(piece->right);
+
+	return;
+} /* end of edit_update */
+
+/*********************************************************************
+*
+* Function  : edit_merge
+*
+* Purpose   : Join two subtrees of the edit tree.
+*
+* Inputs    : PIECE *first - pieces at the lower file offsets
+*             PIECE *second - pieces following them
+*
+* Output    : (none)
+*
+* Returns   : root of the joined tree
+*
+* Example   : edits->root = edit_merge(left,right);
+*
+* Notes     : (none)
+*
+*********************************************************************/
+
+static PIECE *edit_merge(PIECE *first, PIECE *second)
+{
+	if ( first == NULL ) {
+		return(second);
+	} /* IF */
+	if ( second == NULL ) {
+		return(first);
+	} /* IF */
+	if ( first->priority > second->priority ) {
+		first->right = edit_merge(first->right,second);
+		edit_update(first);
+		return(first);
+	} /* IF */
+	second->left = edit_merge(first,second->left);
+	edit_update(second);
+
+	return(second);
+} /* end of edit_merge */
+
+/*********************************************************************
+*
+* Function  : edit_split
+*
+* Purpose   : Split a subtree of the edit tree at a file offset.
+*
+* Inputs    : PIECE *piece - root of subtree
+*             long offset - offset relative to the start of the subtree
+*             PIECE **first - receives pieces before offset
+*             PIECE **second - receives pieces from offset on
+*             PIECE **spare - a preallocated piece , used and set to
+*                             NULL when a piece has to be cut in two
+*
+* Output    : (none)
+*
+* Returns   : (nothing)
+*
+* Example   : edit_split(edits->root,offset,&left,&right,&spare);
+*
+* Notes     : A single split never cuts more than one piece , so it
+*             can not fail once the spare piece has been allocated.
+*
+*********************************************************************/
+
+static void edit_split(PIECE *piece, long offset, PIECE **first,
+					PIECE **second, PIECE **spare)
+{
+	PIECE	*tail;
+	long	left_total , head;
+
+	if ( piece == NULL ) {
+		*first = NULL;
+		*second = NULL;
+		return;
+	} /* IF */
+	left_total = PIECE_TOTAL(piece->left);
+	if ( offset <= left_total ) {
+		edit_split(piece->left,offset,first,&piece->left,spare);
+		edit_update(piece);
+		*second = piece;
+	} /* IF */
+	else if ( offset >= left_total + piece->length ) {
+		edit_split(piece->right,offset - left_total - piece->length,
+					&piece->right,second,spare);
+		edit_update(piece);
+		*first = piece;
+	} /* ELSE IF */
+	else {
+		/* the offset falls inside this piece */
+		head = offset - left_total;
+		tail = *spare;
+		*spare = NULL;
+		tail->source = piece->source;
+		tail->source_offset = piece->source_offset + head;
+		tail->length = piece->length - head;
+		tail->total = tail->length;
+		tail->left = NULL;
+		tail->right = NULL;
+		piece->length = head;
+		*second = edit_merge(tail,piece->right);
+		piece->right = NULL;
+		edit_update(piece);
+		*first = piece;
+	} /* ELSE */
+
+	return;
+} /* end of edit_split */
+
+/*********************************************************************
+*
+* Function  : edit_find
+*
+* Purpose   : Find the piece containing a file offset.
+*
+* Inputs    : const EDIT_BUFFER *edits - the edit buffer
+*             long offset - file offset
+*             long *piece_start - receives file offset of the piece
+*
+* Output    : (none)
+*
+* Returns   : pointer to piece or NULL if offset is beyond end of file
+*
+* Example   : piece = edit_find(edits,offset,&piece_start);
+*
+* Notes     : (none)
+*
+*********************************************************************/
+
+static PIECE *edit_find(const EDIT_BUFFER *edits, long offset,
+					long *piece_start)
+{
+	PIECE	*piece;
+	long	start , left_total;
+
+	start = 0L;
+	for ( piece = edits->root ; piece != NULL ; ) {
+		left_total = PIECE_TOTAL(piece->left);
+		if ( offset < start + left_total ) {
+			piece = piece->left;
+		} /* IF */
+		else if ( offset < start + left_total + piece->length ) {
+			*piece_start = start + left_total;
+			break;
+		} /* ELSE IF */
+		else {
+			start += left_total + piece->length;
+			piece = piece->right;
+		} /* ELSE */
+	} /* FOR */
+
+	return(piece);
+} /* end of edit_find */
+
+/*********************************************************************
+*
+* Function  : edit_append_data
+*
+* Purpose   : Append bytes to the buffer of added data.
+*
+* Inputs    : EDIT_BUFFER *edits - the edit buffer
+*             const unsigned char *data - the bytes
+*             long count - number of bytes
+*
+* Output    : (none)
+*
+* Returns   : offset of data in added buffer , -1L if out of memory
+*
+* Example   : position = edit_append_data(edits,data,count);
+*
+* Notes     : (none)
+*
+*********************************************************************/
+
+static long edit_append_data(EDIT_BUFFER *edits, const unsigned char *data,
+								long count)
+{
+	unsigned char	*added;
+	long	position , new_size;
+
+	if ( edits->added_length + count > edits->max_added ) {
+		new_size = edits->max_added ? edits->max_added * 2 : 4096L;
+		while ( new_size < edits->added_length + count ) {
+			new_size *= 2;
+		} /* WHILE */
+		added = (unsigned char *)realloc(edits->added,new_size);
+		if ( added == NULL ) {
+			return(-1L);
+		} /* IF */
+		edits->added = added;
+		edits->max_added = new_size;
+	} /* IF */
+	position = edits->added_length;
+	memcpy(&edits->added[position],data,count);
+	edits->added_length += count;
+
+	return(position);
+} /* end of edit_append_data */
+
+/*********************************************************************
+*
+* Function  : edit_replace
+*
+* Purpose   : Replace a range of bytes of the file by other bytes.
+*
+* Inputs    : EDIT_BUFFER *edits - the edit buffer
+*             long offset - file offset of first byte
+*             long old_count - number of bytes replaced
+*             const unsigned char *data - new bytes
+*             long new_count - number of new bytes
+*
+* Output    : (none)
+*
+* Returns   : 0 --> success , -1 --> error
+*
+* Example   : edit_replace(&file_edits,offset,1L,&byte,1L);
+*
+* Notes     : Overwriting , inserting (old_count of 0) and deleting
+*             (new_count of 0) are all done here. Nothing is written
+*             to the file until it is saved. A range inside a piece of
+*             added data is overwritten in place , otherwise the new
+*             bytes become a new piece , which is merged with the
+*             previous piece when their data is adjacent so that a run
+*             of consecutive edits stays a single piece.
+*
+*********************************************************************/
+
+static int edit_replace(EDIT_BUFFER *edits, long offset, long old_count,
+					const unsigned char *data, long new_count)
+{
+	PIECE	*piece , *first , *middle , *last , *spare[3];
+	int		count;
+	long	position , piece_start;
+
+	if ( offset < 0L || old_count < 0L || new_count < 0L ||
+				offset + old_count > edits->size ) {
+		errno = EINVAL;
+		return(-1);
+	} /* IF */
+	if ( old_count == 0L && new_count == 0L ) {
+		return(0);
+	} /* IF */
+	if ( old_count == new_count ) {
+		piece = edit_find(edits,offset,&piece_start);
+		if ( piece != NULL && piece->source == PIECE_ADDED &&
+					offset + new_count <= piece_start + piece->length ) {
+			memcpy(&edits->added[piece->source_offset + offset - piece_start],
+					data,new_count);
+			edits->dirty = 1;
+			return(0);
+		} /* IF */
+	} /* IF */
+
+	/* one piece for each split and one for the new bytes */
+	for ( count = 0 ; count < 3 ; ++count ) {
+		spare[count] = edit_new_piece(edits,PIECE_ORIGINAL,0L,0L);
+	} /* FOR */
+	position = 0L;
+	if ( new_count > 0L ) {
+		position = edit_append_data(edits,data,new_count);
+	} /* IF */
+	if ( spare[0] == NULL || spare[1] == NULL || spare[2] == NULL ||
+				position < 0L ) {
+		for ( count = 0 ; count < 3 ; ++count ) {
+			edit_free_tree(edits,spare[count]);
+		} /* FOR */
+		return(-1);
+	} /* IF */
+
+	edit_split(edits->root,offset,&first,&middle,&spare[0]);
+	edit_split(middle,old_count,&middle,&last,&spare[1]);
+	edit_free_tree(edits,middle);
+	if ( new_count > 0L ) {
+		/* look at the last piece before the change */
+		for ( piece = first ; piece != NULL && piece->right != NULL ; ) {
+			piece = piece->right;
+		} /* FOR */
+		if ( piece != NULL && piece->source == PIECE_ADDED &&
+					piece->source_offset + piece->length == position ) {
+			/* the new data continues it , grow it and its ancestors */
+			piece->length += new_count;
+			for ( piece = first ; piece != NULL ; piece = piece->right ) {
+				piece->total += new_count;
+			} /* FOR */
+		} /* IF */
+		else {
+			piece = spare[2];
+			spare[2] = NULL;
+			piece->source = PIECE_ADDED;
+			piece->source_offset = position;
+			piece->length = new_count;
+			piece->total = new_count;
+			first = edit_merge(first,piece);
+		} /* ELSE */
+	} /* IF */
+	edits->root = edit_merge(first,last);
+	for ( count = 0 ; count < 3 ; ++count ) {
+		edit_free_tree(edits,spare[count]);
+	} /* FOR */
+	edits->size += new_count - old_count;
+	edits->dirty = 1;
+	if ( old_count != new_count ) {
+		edits->resized = 1;
+	} /* IF */
+
+	return(0);
+} /* end of edit_replace */
+
+/*********************************************************************
+*
+* Function  : edit_extend
+*
+* Purpose   : Add bytes appended to the original file to the end of
+*             the edited file.
+*
+* Inputs    : EDIT_BUFFER *edits - the edit buffer
+*             long source_offset - offset of the new bytes in the
+*                                  original file
+*             long count - number of new bytes
+*
+* Output    : (none)
+*
+* Returns   : 0 --> success , -1 --> out of memory
+*
+* Example   : edit_extend(&file_edits,old_size,new_size - old_size);
+*
+* Notes     : Used when the file grows while it is being viewed. The
+*             new bytes are not an edit , so the buffer is not marked
+*             dirty. They follow any bytes inserted at the old end.
+*
+*********************************************************************/
+
+static int edit_extend(EDIT_BUFFER *edits, long source_offset, long count)
+{
+	PIECE	*piece;
+
+	if ( count <= 0L ) {
+		return(0);
+	} /* IF */
+	piece = edit_new_piece(edits,PIECE_ORIGINAL,source_offset,count);
+	if ( piece == NULL ) {
+		return(-1);
+	} /* IF */
+	edits->root = edit_merge(edits->root,piece);
+	edits->size += count;
+
+	return(0);
+} /* end of edit_extend */
+
+/*********************************************************************
+*
+* Function  : edit_read_tree
+*
+* Purpose   : Copy the part of a subtree of the edit tree which lies
+*             within a range of the file into a buffer.
+*
+* Inputs    : EDIT_BUFFER *edits - the edit buffer
+*             DATA_SOURCE *source - the original file
+*             PIECE *piece - root of subtree
+*             long start - file offset of the subtree
+*             long offset - file offset of first byte wanted
+*             long end - file offset after last byte wanted
+*             unsigned char *buffer - receives data for offset
+*
+* Output    : (none)
+*
+* Returns   : 0 --> success , -1 --> read error
+*
+* Example   : edit_read_tree(edits,source,edits->root,0L,offset,
+*                            offset + length,buffer);
+*
+* Notes     : (none)
+*
+*********************************************************************/
+
+static int edit_read_tree(EDIT_BUFFER *edits, DATA_SOURCE *source,
+					PIECE *piece, long start, long offset, long end,
+					unsigned char *buffer)
+{
+	long	piece_start , low , high , num_bytes;
+	unsigned char	*ptr , *dest;
+
+	if ( piece == NULL || start >= end || start + piece->total <= offset ) {
+		return(0);
+	} /* IF */
+	if ( edit_read_tree(edits,source,piece->left,start,offset,end,buffer) < 0 ) {
+		return(-1);
+	} /* IF */
+	piece_start = start + PIECE_TOTAL(piece->left);
+	low = piece_start > offset ? piece_start : offset;
+	high = piece_start + piece->length < end ? piece_start + piece->length : end;
+	if ( low < high ) {
+		dest = &buffer[low - offset];
+		if ( piece->source == PIECE_ADDED ) {
+			memcpy(dest,&edits->added[piece->source_offset + low - piece_start],
+					high - low);
+		} /* IF */
+		else {
+			ptr = source_file_view(source,piece->source_offset + low - piece_start,
+						high - low,dest,&num_bytes);
+			if ( ptr == NULL ) {
+				return(-1);
+			} /* IF */
+			if ( ptr != dest ) {
+				memcpy(dest,ptr,num_bytes);
+			} /* IF */
+			if ( num_bytes < high - low ) {
+				/* file was truncated behind our back */
+				memset(&dest[num_bytes],0,high - low - num_bytes);
+			} /* IF */
+		} /* ELSE */
+	} /* IF */
+
+	return(edit_read_tree(edits,source,piece->right,
+				piece_start + piece->length,offset,end,buffer));
+} /* end of edit_read_tree */
+
+/*********************************************************************
+*
+* Function  : edit_read
+*
+* Purpose   : Copy a range of the edited file into a buffer.
+*
+* Inputs    : EDIT_BUFFER *edits - the edit buffer
+*             DATA_SOURCE *source - the original file
+*             long offset - file offset of first byte
+*             unsigned char *buffer - receives data
+*             long length - number of bytes wanted
+*
+* Output    : (none)
+*
+* Returns   : number of bytes copied or -1L on error
+*
+* Example   : count = edit_read(edits,source,offset,buffer,length);
+*
+* Notes     : Only the subtrees overlapping the range are visited.
+*
+*********************************************************************/
+
+static long edit_read(EDIT_BUFFER *edits, DATA_SOURCE *source, long offset,
+				unsigned char *buffer, long length)
+{
+	if ( offset >= edits->size ) {
+		return(0L);
+	} /* IF */
+	if ( length > edits->size - offset ) {
+		length = edits->size - offset;
+	} /* IF */
+	if ( edit_read_tree(edits,source,edits->root,0L,offset,offset + length,
+					buffer) < 0 ) {
+		return(-1L);
+	} /* IF */
+
+	return(length);
+} /* end of edit_read */
+
+/*********************************************************************
+*
+* Function  : edit_flatten_tree
+*
+* Purpose   : List the pieces of a subtree of the edit tree in file
+*             order.
+*
+* Inputs    : PIECE *piece - root of subtree
+*             long start - file offset of the subtree
+*             PIECE_EXTENT *extents - receives the pieces
+*             long *num_extents - number of pieces listed so far
+*
+* Output    : (none)
+*
+* Returns   : (nothing)
+*
+* Example   : edit_flatten_tree(edits->root,0L,extents,&count);
+*
+* Notes     : (none)
+*
+*********************************************************************/
+
+static void edit_flatten_tree(PIECE *piece, long start,
+					PIECE_EXTENT *extents, long *num_extents)
+{
+	PIECE_EXTENT	*extent;
+
+	if ( piece != NULL ) {
+		edit_flatten_tree(piece->left,start,extents,num_extents);
+		extent = &extents[(*num_extents)++];
+		extent->start = start + PIECE_TOTAL(piece->left);
+		extent->length = piece->length;
+		extent->source_offset = piece->source_offset;
+		extent->source = piece->source;
+		edit_flatten_tree(piece->right,extent->start + piece->length,
+					extents,num_extents);
+	} /* IF */
+
+	return;
+} /* end of edit_flatten_tree */
+
+/*********************************************************************
+*
+* Function  : edit_flatten
+*
+* Purpose   : List the pieces of the edited file in file order.
+*
+* Inputs    : EDIT_BUFFER *edits - the edit buffer
+*             long *num_extents - receives number of pieces
+*
+* Output    : (none)
+*
+* Returns   : pointer to malloc'ed list or NULL if out of memory
+*
+* Example   : extents = edit_flatten(edits,&num_extents);
+*
+* Notes     : (none)
+*
+*********************************************************************/
+
+static PIECE_EXTENT *edit_flatten(EDIT_BUFFER *edits, long *num_extents)
+{
+	PIECE_EXTENT	*extents;
+
+	*num_extents = 0L;
+	extents = (PIECE_EXTENT *)malloc((edits->num_pieces + 1) *
+						sizeof(PIECE_EXTENT));
+	if ( extents != NULL ) {
+		edit_flatten_tree(edits->root,0L,extents,num_extents);
+	} /* IF */
+
+	return(extents);
+} /* end of edit_flatten */
+
+/*********************************************************************
+*
+* Function  : source_pwritev
+*
+* Purpose   : Write a run of bytes to the underlying file , honouring
+*             the alignment rules of O_DIRECT.
+*
+* Inputs    : DATA_SOURCE *source - data source
+*             const struct iovec *iov - the pieces of the run
+*             int num_iov - number of pieces
+*             long offset - file offset of first byte
+*
+* Output    : (none)
+*
+* Returns   : number of bytes written , -1 on error
+*
+* Example   : written = source_pwritev(source,iov,num_iov,run_start);
+*
+* Notes     : Without O_DIRECT this is pwritev(). With O_DIRECT the run
+*             is widened to whole sectors in an aligned buffer. A
+*             partly changed first or last sector is read first , so
+*             that its other bytes are written back unchanged (read
+*             modify write). The first sector is partly changed when
+*             the run starts inside it or ends before its end. A
+*             regular file is never extended by the padding of its
+*             last sector.
+*
+*********************************************************************/
+
+static ssize_t source_pwritev(DATA_SOURCE *source, const struct iovec *iov,
+					int num_iov, long offset)
+{
+	unsigned char	*bounce;
+	long	length , start , end , position , count;
+	ssize_t	num_bytes;
+	int		index;
+
+	if ( ! source->direct ) {
+		return(pwritev(source->fd,iov,num_iov,(off_t)offset));
+	} /* IF */
+	for ( length = 0L , index = 0 ; index < num_iov ; ++index ) {
+		length += (long)iov[index].iov_len;
+	} /* FOR */
+	start = offset / source->align * source->align;
+	end = (offset + length + source->align - 1) / source->align * source->align;
+	if ( posix_memalign((void **)&bounce,source->align,end - start) != 0 ) {
+		errno = ENOMEM;
+		return(-1);
+	} /* IF */
+	memset(bounce,0,end - start);
+	if ( (start < offset || offset + length < start + source->align) &&
+			source_pread(source,bounce,source->align,start) < 0 ) {
+		free(bounce);
+		return(-1);
+	} /* IF */
+	if ( end > offset + length && end - source->align > start &&
+			source_pread(source,&bounce[end - source->align - start],
+					source->align,end - source->align) < 0 ) {
+		free(bounce);
+		return(-1);
+	} /* IF */
+	for ( position = offset - start , index = 0 ; index < num_iov ; ++index ) {
+		memcpy(&bounce[position],iov[index].iov_base,iov[index].iov_len);
+		position += (long)iov[index].iov_len;
+	} /* FOR */
+	debug_print("direct write : %ld bytes at 0x%lx as %ld at 0x%lx\n",
+			length,offset,end - start,start);
+
+	for ( position = 0L ; position < end - start ; position += count ) {
+		num_bytes = pwrite(source->fd,&bounce[position],end - start - position,
+						(off_t)(start + position));
+		if ( num_bytes < 0 && errno == EINTR ) {
+			count = 0L;
+			continue;
+		} /* IF */
+		if ( num_bytes <= 0 ) {
+			if ( num_bytes == 0 ) {
+				errno = EIO;
+			} /* IF */
+			free(bounce);
+			return(-1);
+		} /* IF */
+		count = (long)num_bytes;
+	} /* FOR */
+	free(bounce);
+	if ( end > source->size && ftruncate(source->fd,(off_t)source->size) < 0 ) {
+		return(-1);
+	} /* IF */
+
+	return(length);
+} /* end of source_pwritev */
+
+/*********************************************************************
+*
+* Function  : edit_commit
+*
+* Purpose   : Write all pending edits to the file in place.
+*
+* Inputs    : EDIT_BUFFER *edits - the edit buffer
+*             DATA_SOURCE *source - the original file
+*
+* Output    : (none)
+*
+* Returns   : 0 --> success , -1 --> error
+*
+* Example   : edit_commit(&file_edits,&input_source);
+*
+* Notes     : Only possible when no bytes were inserted or deleted ,
+*             otherwise see edit_stream(). Each run of adjacent
+*             modified pieces is written with a single pwritev() call ,
+*             see source_pwritev().
+*             Afterwards the file is once again described by one
+*             original piece.
+*
+*********************************************************************/
+
+static int edit_commit(EDIT_BUFFER *edits, DATA_SOURCE *source)
+{
+	struct iovec	iov[EDIT_MAX_IOV];
+	PIECE_EXTENT	*extents , *extent;
+	long	index , num_extents , run_start , run_length;
+	int		num_iov;
+	ssize_t	written;
+
+	if ( source->kind == SOURCE_MEMORY ) {
+		errno = ESPIPE;
+		return(-1);
+	} /* IF */
+	if ( edits->resized ) {
+		errno = EINVAL;
+		return(-1);
+	} /* IF */
+	extents = edit_flatten(edits,&num_extents);
+	if ( extents == NULL ) {
+		return(-1);
+	} /* IF */
+	for ( index = 0L ; index < num_extents ; ) {
+		extent = &extents[index];
+		if ( extent->source != PIECE_ADDED ) {
+			index += 1L;
+			continue;
+		} /* IF */
+		run_start = extent->start;
+		run_length = 0L;
+		for ( num_iov = 0 ; num_iov < EDIT_MAX_IOV && index < num_extents &&
+					extents[index].source == PIECE_ADDED ;
+							++num_iov , ++index ) {
+			extent = &extents[index];
+			iov[num_iov].iov_base = &edits->added[extent->source_offset];
+			iov[num_iov].iov_len = extent->length;
+			run_length += extent->length;
+		} /* FOR */
+		written = source_pwritev(source,iov,num_iov,run_start);
+		if ( written != run_length ) {
+			if ( written >= 0 ) {
+				errno = EIO;
+			} /* IF */
+			free(extents);
+			return(-1);
+		} /* IF */
+		debug_print("commit : %ld bytes at 0x%lx in %d pieces\n",
+				run_length,run_start,num_iov);
+	} /* FOR */
+	free(extents);
+	cache_invalidate(source);
+
+	return(edit_reset(edits,edits->size));
+} /* end of edit_commit */
+
+/*********************************************************************
+*
+* Function  : edit_write_all
+*
+* Purpose   : Write a buffer to a file , retrying short writes.
+*
+* Inputs    : int fd - file descriptor
+*             const unsigned char *data - data to be written
+*             long count - number of bytes
+*
+* Output    : (none)
+*
+* Returns   : 0 --> success , -1 --> error
+*
+* Example   : edit_write_all(fd,data,count);
+*
+* Notes     : (none)
+*
+*********************************************************************/
+
+static int edit_write_all(int fd, const unsigned char *data, long count)
+{
+	ssize_t	num_bytes;
+
+	while ( count > 0L ) {
+		num_bytes = write(fd,data,count);
+		if ( num_bytes < 0 ) {
+			if ( errno == EINTR ) {
+				continue;
+			} /* IF */
+			return(-1);
+		} /* IF */
+		data += num_bytes;
+		count -= num_bytes;
+	} /* WHILE */
+
+	return(0);
+} /* end of edit_write_all */
+
+/*********************************************************************
+*
+* Function  : edit_copy_original
+*
+* Purpose   : Copy a range of the original file to another file.
+*
+* Inputs    : DATA_SOURCE *source - the original file
+*             long offset - offset of first byte in original file
+*             long count - number of bytes
+*             int fd - file descriptor of output file
+*             unsigned char *buffer - EDIT_COPY_CHUNK byte work buffer
+*
+* Output    : (none)
+*
+* Returns   : 0 --> success , -1 --> error
+*
+* Example   : edit_copy_original(source,offset,length,fd,buffer);
+*
+* Notes     : copy_file_range() lets the kernel (or the filesystem ,
+*             which may share the blocks) do the copy without the data
+*             passing through user space. Where it is not supported
+*             the data is written from the mapping or read with pread().
+*
+*********************************************************************/
+
+static int edit_copy_original(DATA_SOURCE *source, long offset, long count,
+					int fd, unsigned char *buffer)
+{
+	loff_t	in_offset;
+	ssize_t	num_bytes;
+	long	view_bytes;
+	unsigned char	*ptr;
+
+	in_offset = offset;
+	while ( count > 0L ) {
+		num_bytes = copy_file_range(source->fd,&in_offset,fd,NULL,count,0);
+		if ( num_bytes > 0 ) {
+			count -= num_bytes;
+			continue;
+		} /* IF */
+		if ( num_bytes == 0 ) {
+			errno = EIO;	/* file was truncated behind our back */
+			return(-1);
+		} /* IF */
+		if ( errno == EINTR ) {
+			continue;
+		} /* IF */
+		if ( errno != EXDEV && errno != ENOSYS && errno != EINVAL &&
+					errno != EOPNOTSUPP && errno != EBADF ) {
+			return(-1);
+		} /* IF */
+		debug_print("copy_file_range failed (%s), copying data\n",
+				strerror(errno));
+		break;
+	} /* WHILE */
+
+	for ( offset = (long)in_offset ; count > 0L ;
+					offset += view_bytes , count -= view_bytes ) {
+		ptr = source_file_view(source,offset,
+					count < EDIT_COPY_CHUNK ? count : EDIT_COPY_CHUNK,
+					buffer,&view_bytes);
+		if ( ptr == NULL ) {
+			return(-1);
+		} /* IF */
+		if ( view_bytes == 0L ) {
+			errno = EIO;
+			return(-1);
+		} /* IF */
+		if ( edit_write_all(fd,ptr,view_bytes) < 0 ) {
+			return(-1);
+		} /* IF */
+	} /* FOR */
+
+	return(0);
+} /* end of edit_copy_original */
+
+/*********************************************************************
+*
+* Function  : edit_stream
+*
+* Purpose   : Write the complete edited file to another file.
+*
+* Inputs    : EDIT_BUFFER *edits - the edit buffer
+*             DATA_SOURCE *source - the original file
+*             int fd - file descriptor of output file , positioned at
+*                      its start
+*
+* Output    : (none)
+*
+* Returns   : 0 --> success , -1 --> error
+*
+* Example   : edit_stream(&file_edits,&input_source,temp_fd);
+*
+* Notes     : Used when bytes were inserted or deleted. The file is
+*             produced in a single pass over the pieces , however many
+*             edits were made.
+*
+*********************************************************************/
+
+static int edit_stream(EDIT_BUFFER *edits, DATA_SOURCE *source, int fd)
+{
+	PIECE_EXTENT	*extents , *extent;
+	long	index , num_extents;
+	unsigned char	*buffer;
+	int		status;
+
+	extents = edit_flatten(edits,&num_extents);
+	buffer = (unsigned char *)malloc(EDIT_COPY_CHUNK);
+	if ( extents == NULL || buffer == NULL ) {
+		free(extents);
+		free(buffer);
+		return(-1);
+	} /* IF */
+	status = 0;
+	for ( index = 0L ; index < num_extents && status == 0 ; ++index ) {
+		extent = &extents[index];
+		if ( extent->source == PIECE_ADDED ) {
+			status = edit_write_all(fd,&edits->added[extent->source_offset],
+							extent->length);
+		} /* IF */
+		else {
+			status = edit_copy_original(source,extent->source_offset,
+							extent->length,fd,buffer);
+		} /* ELSE */
+	} /* FOR */
+	debug_print("stream : %ld bytes in %ld pieces , status %d\n",
+			edits->size,num_extents,status);
+	free(extents);
+	free(buffer);
+
+	return(status);
+} /* end of edit_stream */
+
+/*********************************************************************
+*
+* Function  : source_view
+*
+* Purpose   : Get a view of a range of bytes from a data source ,
+*             including any pending edits.
+*
+* Inputs    : DATA_SOURCE *source - data source
+*             long offset - file offset of first byte
+*             long length - number of bytes wanted
+*             unsigned char *buffer - buffer used when the data can not
+*                                     be referenced in place
+*             long *view_bytes - receives number of bytes available
+*
+* Output    : (none)
+*
+* Returns   : pointer to data or NULL on error
+*
+* Example   : ptr = source_view(&input_source,offset,blocksize,
+*                               temp_buffer,&num_bytes);
+*
+* Notes     : A range inside a single unmodified piece is passed
+*             straight to source_file_view() , otherwise the edited
+*             data is assembled in the buffer.
+*
+*********************************************************************/
+
+static unsigned char *source_view(DATA_SOURCE *source, long offset,
+					long length, unsigned char *buffer, long *view_bytes)
+{
+	EDIT_BUFFER	*edits;
+	PIECE	*piece;
+	long	piece_start;
+
+	edits = source->edits;
+	if ( edits == NULL ) {
+		return(source_file_view(source,offset,length,buffer,view_bytes));
+	} /* IF */
+	*view_bytes = 0L;
+	if ( offset < 0L ) {
+		errno = EINVAL;
+		return(NULL);
+	} /* IF */
+	if ( offset >= edits->size ) {
+		return(buffer);
+	} /* IF */
+	if ( length > edits->size - offset ) {
+		length = edits->size - offset;
+	} /* IF */
+	piece = edit_find(edits,offset,&piece_start);
+	if ( piece->source == PIECE_ORIGINAL &&
+				offset + length <= piece_start + piece->length ) {
+		return(source_file_view(source,
+					piece->source_offset + offset - piece_start,
+					length,buffer,view_bytes));
+	} /* IF */
+	*view_bytes = edit_read(edits,source,offset,buffer,length);
+	if ( *view_bytes < 0L ) {
+		*view_bytes = 0L;
+		return(NULL);
+	} /* IF */
+
+	return(buffer);
+} /* end of source_view */
+
+/*********************************************************************
+*
+* Function  : source_size
+*
+* Purpose   : Get the size of a data source including pending edits.
+*
+* Inputs    : DATA_SOURCE *source - data source
+*
+* Output    : (none)
+*
+* Returns   : size in bytes
+*
+* Example   : size = source_size(&input_source);
+*
+* Notes     : (none)
+*
+*********************************************************************/
+
+static long source_size(DATA_SOURCE *source)
+{
+	return(source->edits != NULL ? source->edits->size : source->size);
+} /* end of source_size */
+
+/*********************************************************************
+*
+* Function  : source_read
+*
+* Purpose   : Copy a range of bytes from a data source into a buffer.
+*
+* Inputs    : DATA_SOURCE *source - data source
+*             long offset - file offset of first byte
+*             unsigned char *buffer - buffer to receive data
+*             long length - number of bytes wanted
+*
+* Output    : (none)
+*
+* Returns   : number of bytes copied or -1 on error
+*
+* Example   : count = source_read(&input_source,offset,buffer,blocksize);
+*
+* Notes     : (none)
+*
+*********************************************************************/
+
+static long source_read(DATA_SOURCE *source, long offset,
+					unsigned char *buffer, long length)
+{
+	unsigned char	*ptr;
+	long	num_bytes;
+
+	ptr = source_view(source,offset,length,buffer,&num_bytes);
+	if ( ptr == NULL ) {
+		return(-1L);
+	} /* IF */
+	if ( ptr != buffer && num_bytes > 0L ) {
+		memcpy(buffer,ptr,num_bytes);
+	} /* IF */
+
+	return(num_bytes);
+} /* end of source_read */
+
+/*********************************************************************
+*
+* Function  : source_advise
+*
+* Purpose   : Tell the kernel how a range of a data source will be used.
+*
+* Inputs    : DATA_SOURCE *source - data source
+*             int advice - MADV_SEQUENTIAL , MADV_NORMAL , etc.
+*
+* Output    : (none)
+*
+* Returns   : (nothing)
+*
+* Example   : source_advise(&input_source,MADV_SEQUENTIAL);
+*
+* Notes     : Only meaningful for memory mapped sources.
+*
+*********************************************************************/
+
+static void source_advise(DATA_SOURCE *source, int advice)
+{
+	if ( source->kind == SOURCE_MAPPED ) {
+		madvise(source->data,source->data_length,advice);
+	} /* IF */
+
+	return;
+} /* end of source_advise */
+
+/*********************************************************************
+*
+* Function  : journal_grow
+*
+* Purpose   : Make room for more data in one of the data arrays of the
+*             edit journal.
+*
+* Inputs    : unsigned char **data - the array
+*             long *max_data - allocated size of the array
+*             long needed - number of bytes needed
+*
+* Output    : (none)
+*
+* Returns   : 0 --> success , -1 --> out of memory
+*
+* Example   : journal_grow(&journal->old_data,&journal->max_old,
+*                          journal->old_length + count);
+*
+* Notes     : (none)
+*
+*********************************************************************/
+
+static int journal_grow(unsigned char **data, long *max_data, long needed)
+{
+	unsigned char	*new_data;
+	long	new_size;
+
+	if ( needed <= *max_data ) {
+		return(0);
+	} /* IF */
+	new_size = *max_data ? *max_data * 2 : 4096L;
+	while ( new_size < needed ) {
+		new_size *= 2;
+	} /* WHILE */
+	new_data = (unsigned char *)realloc(*data,new_size);
+	if ( new_data == NULL ) {
+		return(-1);
+	} /* IF */
+	*data = new_data;
+	*max_data = new_size;
+
+	return(0);
+} /* end of journal_grow */
+
+/*********************************************************************
+*
+* Function  : journal_trim
+*
+* Purpose   : Forget the oldest entries of the edit journal.
+*
+* Inputs    : EDIT_JOURNAL *journal - the journal
+*             int count - number of entries to forget
+*
+* Output    : (none)
+*
+* Returns   : (nothing)
+*
+* Example   : journal_trim(journal,journal->num_entries / 4);
+*
+* Notes     : Keeps the journal within JOURNAL_MAX_ENTRIES entries and
+*             JOURNAL_MAX_DATA bytes , at the cost of the oldest undo
+*             steps.
+*
+*********************************************************************/
+
+static void journal_trim(EDIT_JOURNAL *journal, int count)
+{
+	long	old_start , new_start;
+	int		index;
+
+	if ( count > journal->num_entries ) {
+		count = journal->num_entries;
+	} /* IF */
+	if ( count <= 0 ) {
+		return;
+	} /* IF */
+	if ( count < journal->num_entries ) {
+		old_start = journal->entries[count].old_offset;
+		new_start = journal->entries[count].new_offset;
+	} /* IF */
+	else {
+		old_start = journal->old_length;
+		new_start = journal->new_length;
+	} /* ELSE */
+	memmove(journal->entries,&journal->entries[count],
+			(journal->num_entries - count) * sizeof(JOURNAL_ENTRY));
+	journal->num_entries -= count;
+	journal->position -= count;
+	if ( journal->position < 0 ) {
+		journal->position = 0;
+	} /* IF */
+	for ( index = 0 ; index < journal->num_entries ; ++index ) {
+		journal->entries[index].old_offset -= old_start;
+		journal->entries[index].new_offset -= new_start;
+	} /* FOR */
+	memmove(journal->old_data,&journal->old_data[old_start],
+				journal->old_length - old_start);
+	memmove(journal->new_data,&journal->new_data[new_start],
+				journal->new_length - new_start);
+	journal->old_length -= old_start;
+	journal->new_length -= new_start;
+	journal->num_dropped += count;
+
+	return;
+} /* end of journal_trim */
+
+/*********************************************************************
+*
+* Function  : journal_record
+*
+* Purpose   : Record a change in the edit journal.
+*
+* Inputs    : EDIT_JOURNAL *journal - the journal
+*             long offset - file offset of change
+*             const unsigned char *old_bytes - bytes before the change
+*             long old_count - number of bytes before the change
+*             const unsigned char *new_bytes - bytes after the change
+*             long new_count - number of bytes after the change
+*
+* Output    : (none)
+*
+* Returns   : 0 --> success , -1 --> out of memory
+*
+* Example   : journal_record(&edit_journal,offset,old,1L,new,1L);
+*
+* Notes     : Any undone changes are discarded. A change which
+*             extends or rewrites the previous change is merged into
+*             it , so that a run of edits is undone as one step. A
+*             change too big to remember makes everything before it
+*             impossible to undo , in which case old_bytes may be NULL.
+*
+*********************************************************************/
+
+static int journal_record(EDIT_JOURNAL *journal, long offset,
+				const unsigned char *old_bytes, long old_count,
+				const unsigned char *new_bytes, long new_count)
+{
+	JOURNAL_ENTRY	*entry;
+
+	/* forget anything that was undone */
+	journal->num_entries = journal->position;
+	journal->old_length = 0L;
+	journal->new_length = 0L;
+	if ( journal->num_entries > 0 ) {
+		entry = &journal->entries[journal->num_entries-1];
+		journal->old_length = entry->old_offset + entry->old_length;
+		journal->new_length = entry->new_offset + entry->new_length;
+	} /* IF */
+	if ( old_count + new_count > JOURNAL_MAX_DATA / 2 ) {
+		/* too big to remember , nothing before it can be undone either */
+		journal_trim(journal,journal->num_entries);
+		return(0);
+	} /* IF */
+	if ( journal_grow(&journal->old_data,&journal->max_old,
+					journal->old_length + old_count) < 0 ||
+			journal_grow(&journal->new_data,&journal->max_new,
+					journal->new_length + new_count) < 0 ) {
+		return(-1);
+	} /* IF */
+
+	if ( journal->num_entries > 0 ) {
+		entry = &journal->entries[journal->num_entries-1];
+		if ( old_count == new_count && offset >= entry->offset &&
+					offset + new_count <= entry->offset + entry->new_length ) {
+			/* rewrite of bytes already changed , keep the first old bytes */
+			memcpy(&journal->new_data[entry->new_offset + offset - entry->offset],
+						new_bytes,new_count);
+			return(0);
+		} /* IF */
+		if ( journal->old_length + journal->new_length + old_count +
+						new_count <= JOURNAL_MAX_DATA &&
+				((offset == entry->offset + entry->new_length &&
+					/* typing over or inserting a run of bytes */
+					((old_count == new_count &&
+							entry->old_length == entry->new_length) ||
+					(old_count == 0L && entry->old_length == 0L))) ||
+				/* deleting a run of bytes at the same place */
+				(offset == entry->offset && new_count == 0L &&
+							entry->new_length == 0L)) ) {
+			if ( old_count > 0L ) {
+				memcpy(&journal->old_data[journal->old_length],old_bytes,
+							old_count);
+			} /* IF */
+			if ( new_count > 0L ) {
+				memcpy(&journal->new_data[journal->new_length],new_bytes,
+							new_count);
+			} /* IF */
+			journal->old_length += old_count;
+			journal->new_length += new_count;
+			entry->old_length += old_count;
+			entry->new_length += new_count;
+			return(0);
+		} /* IF */
+	} /* IF */
+
+	if ( journal->num_entries >= JOURNAL_MAX_ENTRIES ) {
+		journal_trim(journal,JOURNAL_MAX_ENTRIES / 4);
+	} /* IF */
+	while ( journal->num_entries > 0 &&
+				journal->old_length + journal->new_length + old_count +
+						new_count > JOURNAL_MAX_DATA ) {
+		journal_trim(journal,(journal->num_entries + 3) / 4);
+	} /* WHILE */
+	if ( journal->num_entries == journal->max_entries ) {
+		journal->max_entries = journal->max_entries ?
+							journal->max_entries * 2 : 256;
+		entry = (JOURNAL_ENTRY *)realloc(journal->entries,
+						journal->max_entries * sizeof(JOURNAL_ENTRY));
+		if ( entry == NULL ) {
+			return(-1);
+		} /* IF */
+		journal->entries = entry;
+	} /* IF */
+	entry = &journal->entries[journal->num_entries];
+	entry->offset = offset;
+	entry->old_length = old_count;
+	entry->new_length = new_count;
+	entry->old_offset = journal->old_length;
+	entry->new_offset = journal->new_length;
+	if ( old_count > 0L ) {
+		memcpy(&journal->old_data[journal->old_length],old_bytes,old_count);
+	} /* IF */
+	if ( new_count > 0L ) {
+		memcpy(&journal->new_data[journal->new_length],new_bytes,new_count);
+	} /* IF */
+	journal->old_length += old_count;
+	journal->new_length += new_count;
+	journal->num_entries += 1;
+	journal->position = journal->num_entries;
+
+	return(0);
+} /* end of journal_record */
+
+/*********************************************************************
+*
+* Function  : offset_digits
+*
+* Purpose   : Get the width of the offset column for a file.
+*
+* Inputs    : long size - size of the file
+*
+* Output    : (none)
+*
+* Returns   : number of hex digits needed for the largest offset
+*
+* Example   : offset_width = offset_digits(filesize);
+*
+* Notes     : At least 8 digits are used , so files under 4 GB look
+*             as they always have. Every row of a large file then has
+*             the same width.
+*
+*********************************************************************/
+
+static int offset_digits(long size)
+{
+	int		num_digits;
+
+	for ( num_digits = 8 ; num_digits < 16 &&
+				((unsigned long)size >> (4 * num_digits)) != 0 ; ++num_digits ) {
+		;
+	} /* FOR */
+
+	return(num_digits);
+} /* end of offset_digits */
+
+/*********************************************************************
+*
+* Function  : block_count
+*
+* Purpose   : Work out the number of blocks in the file.
+*
+* Inputs    : (none)
+*
+* Output    : (none)
+*
+* Returns   : number of blocks
+*
+* Example   : num_blocks = block_count();
+*
+* Notes     : In record mode num_records is also updated , a block is
+*             then records_per_block records from record_first on.
+*
+*********************************************************************/
+
+static long block_count()
+{
+	if ( record_size > 0L ) {
+		num_records = filesize > record_first ?
+			(filesize - record_first + record_stride - 1L) / record_stride : 0L;
+		return((num_records + records_per_block - 1L) / records_per_block);
+	} /* IF */
+
+	return((filesize + blocksize - 1) / blocksize);
+} /* end of block_count */
+
+/*********************************************************************
+*
+* Function  : set_file_size
+*
+* Purpose   : Update the size of the file after a change.
+*
+* Inputs    : (none)
+*
+* Output    : (none)
+*
+* Returns   : (nothing)
+*
+* Example   : set_file_size();
+*
+* Notes     : The current offset is kept within the file. The offset
+*             column is widened if the file has grown past what it
+*             can show , but never narrowed while editing.
+*
+*********************************************************************/
+
+static void set_file_size()
+{
+	filesize = file_edits.size;
+	num_blocks = block_count();
+	if ( offset_digits(filesize) > offset_width ) {
+		offset_width = offset_digits(filesize);
+	} /* IF */
+	if ( current_file_offset >= filesize ) {
+		current_file_offset = record_first + (num_blocks - 1L) * block_span;
+		if ( current_file_offset < 0L ) {
+			current_file_offset = 0L;
+		} /* IF */
+	} /* IF */
+
+	return;
+} /* end of set_file_size */
+
+/*********************************************************************
+*
+* Function  : crc32c_tables
+*
+* Purpose   : Build the tables used to work out CRC32C in software.
+*
+* Inputs    : (none)
+*
+* Output    : (none)
+*
+* Returns   : (nothing)
+*
+* Example   : crc32c_tables();
+*
+* Notes     : crc32c_table[n][byte] is the CRC of the byte followed by
+*             n zero bytes , so that 8 bytes can be done at once.
+*             Also finds out whether the processor has the SSE4.2
+*             crc32 instruction. Called from main() before any worker
+*             thread can start a hash.
+*
+*********************************************************************/
+
+static void crc32c_tables()
+{
+	unsigned int	crc;
+	int		value , bit , slice;
+
+	for ( value = 0 ; value < 256 ; ++value ) {
+		crc = (unsigned int)value;
+		for ( bit = 0 ; bit < 8 ; ++bit ) {
+			crc = (crc & 1) ? (crc >> 1) ^ CRC32C_POLYNOMIAL : crc >> 1;
+		} /* FOR */
+		crc32c_table[0][value] = crc;
+	} /* FOR */
+	for ( value = 0 ; value < 256 ; ++value ) {
+		crc = crc32c_table[0][value];
+		for ( slice = 1 ; slice < 8 ; ++slice ) {
+			crc = (crc >> 8) ^ crc32c_table[0][crc & 0xff];
+			crc32c_table[slice][value] = crc;
+		} /* FOR */
+	} /* FOR */
+#if defined(CRC32C_HARDWARE)
+	crc32c_hardware = __builtin_cpu_supports("sse4.2");
+#endif
+
+	return;
+} /* end of crc32c_tables */
+
+#if defined(CRC32C_HARDWARE)
+/*********************************************************************
+*
+* Function  : crc32c_sse42
+*
+* Purpose   : Continue a CRC32C using the SSE4.2 crc32 instruction.
+*
+* Inputs    : unsigned int crc - CRC so far , inverted
+*             const unsigned char *data - the bytes
+*             long length - number of bytes
+*
+* Output    : (none)
+*
+* Returns   : new CRC , inverted
+*
+* Example   : crc = crc32c_sse42(crc,data,length);
+*
+* Notes     : Compiled for SSE4.2 whatever the build flags , and only
+*             called when crc32c_tables() found the instruction.
+*
+*********************************************************************/
+
+__attribute__((target("sse4.2")))
+static unsigned int crc32c_sse42(unsigned int crc, const unsigned char *data,
+					long length)
+{
+	unsigned long long	crc64 , word;
+	long	index;
+
+	crc64 = crc;
+	for ( index = 0L ; index + 8L <= length ; index += 8L ) {
+		memcpy(&word,&data[index],sizeof(word));
+		crc64 = _mm_crc32_u64(crc64,word);
+	} /* FOR */
+	crc = (unsigned int)crc64;
+	for ( ; index < length ; ++index ) {
+		crc = _mm_crc32_u8(crc,data[index]);
+	} /* FOR */
+
+	return(crc);
+} /* end of crc32c_sse42 */
+#endif
+
+/*********************************************************************
+*
+* Function  : crc32c_update
+*
+* Purpose   : Continue a CRC32C (Castagnoli) over more bytes.
+*
+* Inputs    : unsigned int crc - CRC so far , inverted
+*             const unsigned char *data - the bytes
+*             long length - number of bytes
+*
+* Output    : (none)
+*
+* Returns   : new CRC , inverted
+*
+* Example   : state->crc = crc32c_update(state->crc,data,length);
+*
+* Notes     : Uses the crc32 instruction if there is one , otherwise
+*             the tables 8 bytes at a time.
+*
+*********************************************************************/
+
+static unsigned int crc32c_update(unsigned int crc, const unsigned char *data,
+					long length)
+{
+	unsigned long long	word;
+	long	index;
+
+#if defined(CRC32C_HARDWARE)
+	if ( crc32c_hardware ) {
+		return(crc32c_sse42(crc,data,length));
+	} /* IF */
+#endif
+	for ( index = 0L ; index + 8L <= length ; index += 8L ) {
+		memcpy(&word,&data[index],sizeof(word));
+		word ^= crc;		/* little endian */
+		crc = crc32c_table[7][word & 0xff] ^
+				crc32c_table[6][(word >> 8) & 0xff] ^
+				crc32c_table[5][(word >> 16) & 0xff] ^
+				crc32c_table[4][(word >> 24) & 0xff] ^
+				crc32c_table[3][(word >> 32) & 0xff] ^
+				crc32c_table[2][(word >> 40) & 0xff] ^
+				crc32c_table[1][(word >> 48) & 0xff] ^
+				crc32c_table[0][word >> 56];
+	} /* FOR */
+	for ( ; index < length ; ++index ) {
+		crc = (crc >> 8) ^ crc32c_table[0][(crc ^ data[index]) & 0xff];
+	} /* FOR */
+
+	return(crc);
+} /* end of crc32c_update */
+
+/*********************************************************************
+*
+* Function  : xxh64_round
+*
+* Purpose   : Mix 8 bytes into an XXH64 accumulator.
+*
+* Inputs    : unsigned long long acc - the accumulator
+*             unsigned long long input - the bytes
+*
+* Output    : (none)
+*
+* Returns   : new accumulator
+*
+* Example   : acc = xxh64_round(acc,word);
+*
+* Notes     : (none)
+*
+*********************************************************************/
+
+static unsigned long long xxh64_round(unsigned long long acc,
+					unsigned long long input)
+{
+	acc += input * XXH64_PRIME2;
+	acc = (acc << 31) | (acc >> 33);
+
+	return(acc * XXH64_PRIME1);
+} /* end of xxh64_round */
+
+/*********************************************************************
+*
+* Function  : xxh64_stripes
+*
+* Purpose   : Mix whole 32 byte stripes into an XXH64 state.
+*
+* Inputs    : HASH_STATE *state - the state
+*             const unsigned char *data - the bytes
+*             long length - number of bytes , a multiple of 32
+*
+* Output    : (none)
+*
+* Returns   : (nothing)
+*
+* Example   : xxh64_stripes(state,data,length & ~31L);
+*
+* Notes     : The four accumulators are independent , which lets the
+*             processor work on them in parallel.
+*
+*********************************************************************/
+
+static void xxh64_stripes(HASH_STATE *state, const unsigned char *data,
+					long length)
+{
+	unsigned long long	word[4] , acc0 , acc1 , acc2 , acc3;
+	long	index;
+
+	acc0 = state->acc[0];
+	acc1 = state->acc[1];
+	acc2 = state->acc[2];
+	acc3 = state->acc[3];
+	for ( index = 0L ; index < length ; index += 32L ) {
+		memcpy(word,&data[index],sizeof(word));
+		acc0 = xxh64_round(acc0,word[0]);
+		acc1 = xxh64_round(acc1,word[1]);
+		acc2 = xxh64_round(acc2,word[2]);
+		acc3 = xxh64_round(acc3,word[3]);
+	} /* FOR */
+	state->acc[0] = acc0;
+	state->acc[1] = acc1;
+	state->acc[2] = acc2;
+	state->acc[3] = acc3;
+
+	return;
+} /* end of xxh64_stripes */
+
+/*********************************************************************
+*
+* Function  : xxh64_final
+*
+* Purpose   : Finish an XXH64 hash.
+*
+* Inputs    : HASH_STATE *state - the state
+*
+* Output    : (none)
+*
+* Returns   : the hash
+*
+* Example   : value = xxh64_final(state);
+*
+* Notes     : The bytes short of a stripe are still in state->block.
+*
+*********************************************************************/
+
+static unsigned long long xxh64_final(HASH_STATE *state)
+{
+	unsigned long long	hash , word;
+	unsigned int	half;
+	int		index , count;
+
+	if ( state->length >= 32 ) {
+		hash = ((state->acc[0] << 1) | (state->acc[0] >> 63)) +
+				((state->acc[1] << 7) | (state->acc[1] >> 57)) +
+				((state->acc[2] << 12) | (state->acc[2] >> 52)) +
+				((state->acc[3] << 18) | (state->acc[3] >> 46));
+		for ( count = 0 ; count < 4 ; ++count ) {
+			hash ^= xxh64_round(0,state->acc[count]);
+			hash = hash * XXH64_PRIME1 + XXH64_PRIME4;
+		} /* FOR */
+	} /* IF */
+	else {
+		hash = XXH64_PRIME5;
+	} /* ELSE */
+	hash += state->length;
+
+	for ( index = 0 ; index + 8 <= state->num_block ; index += 8 ) {
+		memcpy(&word,&state->block[index],sizeof(word));
+		hash ^= xxh64_round(0,word);
+		hash = ((hash << 27) | (hash >> 37)) * XXH64_PRIME1 + XXH64_PRIME4;
+	} /* FOR */
+	if ( index + 4 <= state->num_block ) {
+		memcpy(&half,&state->block[index],sizeof(half));
+		hash ^= half * XXH64_PRIME1;
+		hash = ((hash << 23) | (hash >> 41)) * XXH64_PRIME2 + XXH64_PRIME3;
+		index += 4;
+	} /* IF */
+	for ( ; index < state->num_block ; ++index ) {
+		hash ^= state->block[index] * XXH64_PRIME5;
+		hash = ((hash << 11) | (hash >> 53)) * XXH64_PRIME1;
+	} /* FOR */
+	hash ^= hash >> 33;
+	hash *= XXH64_PRIME2;
+	hash ^= hash >> 29;
+	hash *= XXH64_PRIME3;
+	hash ^= hash >> 32;
+
+	return(hash);
+} /* end of xxh64_final */
+
+/*********************************************************************
+*
+* Function  : sha256_blocks
+*
+* Purpose   : Run the SHA-256 compression function over 64 byte
+*             blocks.
+*
+* Inputs    : unsigned int *hash - the 8 words of the hash so far
+*             const unsigned char *data - the blocks
+*             long num_blocks - number of blocks
+*
+* Output    : (none)
+*
+* Returns   : (nothing)
+*
+* Example   : sha256_blocks(state->sha,data,length / 64L);
+*
+* Notes     : As in FIPS 180-4.
+*
+*********************************************************************/
+
+static void sha256_blocks(unsigned int *hash, const unsigned char *data,
+					long num_blocks)
+{
+	static	const unsigned int	k[64] = {
+		0x428a2f98 , 0x71374491 , 0xb5c0fbcf , 0xe9b5dba5 , 0x3956c25b ,
+		0x59f111f1 , 0x923f82a4 , 0xab1c5ed5 , 0xd807aa98 , 0x12835b01 ,
+		0x243185be , 0x550c7dc3 , 0x72be5d74 , 0x80deb1fe , 0x9bdc06a7 ,
+		0xc19bf174 , 0xe49b69c1 , 0xefbe4786 , 0x0fc19dc6 , 0x240ca1cc ,
+		0x2de92c6f , 0x4a7484aa , 0x5cb0a9dc , 0x76f988da , 0x983e5152 ,
+		0xa831c66d , 0xb00327c8 , 0xbf597fc7 , 0xc6e00bf3 , 0xd5a79147 ,
+		0x06ca6351 , 0x14292967 , 0x27b70a85 , 0x2e1b2138 , 0x4d2c6dfc ,
+		0x53380d13 , 0x650a7354 , 0x766a0abb , 0x81c2c92e , 0x92722c85 ,
+		0xa2bfe8a1 , 0xa81a664b , 0xc24b8b70 , 0xc76c51a3 , 0xd192e819 ,
+		0xd6990624 , 0xf40e3585 , 0x106aa070 , 0x19a4c116 , 0x1e376c08 ,
+		0x2748774c , 0x34b0bcb5 , 0x391c0cb3 , 0x4ed8aa4a , 0x5b9cca4f ,
+		0x682e6ff3 , 0x748f82ee , 0x78a5636f , 0x84c87814 , 0x8cc70208 ,
+		0x90befffa , 0xa4506ceb , 0xbef9a3f7 , 0xc67178f2
+	};
+	unsigned int	w[64] , v[8] , t1 , t2 , s0 , s1;
+	long	block;
+	int		count;
+
+	for ( block = 0L ; block < num_blocks ; ++block , data += 64 ) {
+		for ( count = 0 ; count < 16 ; ++count ) {
+			w[count] = ((unsigned int)data[4*count] << 24) |
+						((unsigned int)data[4*count+1] << 16) |
+						((unsigned int)data[4*count+2] << 8) | data[4*count+3];
+		} /* FOR */
+		for ( ; count < 64 ; ++count ) {
+			s0 = SHA256_ROTR(w[count-15],7) ^ SHA256_ROTR(w[count-15],18) ^
+					(w[count-15] >> 3);
+			s1 = SHA256_ROTR(w[count-2],17) ^ SHA256_ROTR(w[count-2],19) ^
+					(w[count-2] >> 10);
+			w[count] = w[count-16] + s0 + w[count-7] + s1;
+		} /* FOR */
+		memcpy(v,hash,sizeof(v));
+		for ( count = 0 ; count < 64 ; ++count ) {
+			s1 = SHA256_ROTR(v[4],6) ^ SHA256_ROTR(v[4],11) ^
+					SHA256_ROTR(v[4],25);
+			t1 = v[7] + s1 + ((v[4] & v[5]) ^ (~v[4] & v[6])) + k[count] +
+					w[count];
+			s0 = SHA256_ROTR(v[0],2) ^ SHA256_ROTR(v[0],13) ^
+					SHA256_ROTR(v[0],22);
+			t2 = s0 + ((v[0] & v[1]) ^ (v[0] & v[2]) ^ (v[1] & v[2]));
+			v[7] = v[6];
+			v[6] = v[5];
+			v[5] = v[4];
+			v[4] = v[3] + t1;
+			v[3] = v[2];
+			v[2] = v[1];
+			v[1] = v[0];
+			v[0] = t1 + t2;
+		} /* FOR */
+		for ( count = 0 ; count < 8 ; ++count ) {
+			hash[count] += v[count];
+		} /* FOR */
+	} /* FOR */
+
+	return;
+} /* end of sha256_blocks */
+
+/*********************************************************************
+*
+* Function  : hash_start
+*
+* Purpose   : Start a hash.
+*
+* Inputs    : HASH_STATE *state - the state
+*             int algorithm - HASH_CRC32C , HASH_XXH64 or HASH_SHA256
+*
+* Output    : (none)
+*
+* Returns   : (nothing)
+*
+* Example   : hash_start(&state,HASH_SHA256);
+*
+* Notes     : XXH64 uses a seed of 0.
+*
+*********************************************************************/
+
+static void hash_start(HASH_STATE *state, int algorithm)
+{
+	static	const unsigned int	sha256_initial[8] = {
+		0x6a09e667 , 0xbb67ae85 , 0x3c6ef372 , 0xa54ff53a ,
+		0x510e527f , 0x9b05688c , 0x1f83d9ab , 0x5be0cd19
+	};
+
+	memset(state,0,sizeof(HASH_STATE));
+	state->algorithm = algorithm;
+	state->crc = 0xffffffff;
+	state->acc[0] = XXH64_PRIME1 + XXH64_PRIME2;
+	state->acc[1] = XXH64_PRIME2;
+	state->acc[2] = 0;
+	state->acc[3] = 0 - XXH64_PRIME1;
+	memcpy(state->sha,sha256_initial,sizeof(state->sha));
+
+	return;
+} /* end of hash_start */
+
+/*********************************************************************
+*
+* Function  : hash_update
+*
+* Purpose   : Add bytes to a hash.
+*
+* Inputs    : HASH_STATE *state - the state
+*             const unsigned char *data - the bytes
+*             long length - number of bytes
+*
+* Output    : (none)
+*
+* Returns   : (nothing)
+*
+* Example   : hash_update(&state,data,num_bytes);
+*
+* Notes     : XXH64 and SHA-256 work on blocks of 32 and 64 bytes ,
+*             partial blocks are held in the state until completed.
+*
+*********************************************************************/
+
+static void hash_update(HASH_STATE *state, const unsigned char *data,
+					long length)
+{
+	long	block_size , count , whole;
+
+	state->length += length;
+	if ( state->algorithm == HASH_CRC32C ) {
+		state->crc = crc32c_update(state->crc,data,length);
+		return;
+	} /* IF */
+	block_size = state->algorithm == HASH_XXH64 ? 32L : 64L;
+	if ( state->num_block > 0 ) {
+		count = block_size - state->num_block;
+		if ( count > length ) {
+			count = length;
+		} /* IF */
+		memcpy(&state->block[state->num_block],data,count);
+		state->num_block += (int)count;
+		data += count;
+		length -= count;
+		if ( state->num_block < block_size ) {
+			return;
+		} /* IF */
+		if ( state->algorithm == HASH_XXH64 ) {
+			xxh64_stripes(state,state->block,block_size);
+		} /* IF */
+		else {
+			sha256_blocks(state->sha,state->block,1L);
+		} /* ELSE */
+		state->num_block = 0;
+	} /* IF */
+	whole = length - length % block_size;
+	if ( state->algorithm == HASH_XXH64 ) {
+		xxh64_stripes(state,data,whole);
+	} /* IF */
+	else {
+		sha256_blocks(state->sha,data,whole / block_size);
+	} /* ELSE */
+	memcpy(state->block,&data[whole],length - whole);
+	state->num_block = (int)(length - whole);
+
+	return;
+} /* end of hash_update */
+
+/*********************************************************************
+*
+* Function  : hash_finish
+*
+* Purpose   : Finish a hash.
+*
+* Inputs    : HASH_STATE *state - the state
+*             unsigned char *digest - receives the digest
+*
+* Output    : (none)
+*
+* Returns   : number of bytes in the digest
+*
+* Example   : length = hash_finish(&state,digest);
+*
+* Notes     : The digest is in the byte order the usual tools print
+*             it in , most significant byte first.
+*
+*********************************************************************/
+
+static int hash_finish(HASH_STATE *state, unsigned char *digest)
+{
+	unsigned char	padding[72];
+	unsigned long long	value , bits;
+	long	count;
+	int		index;
+
+	if ( state->algorithm == HASH_CRC32C ) {
+		value = state->crc ^ 0xffffffff;
+		for ( index = 0 ; index < 4 ; ++index ) {
+			digest[index] = (unsigned char)(value >> (24 - 8 * index));
+		} /* FOR */
+		return(4);
+	} /* IF */
+	if ( state->algorithm == HASH_XXH64 ) {
+		value = xxh64_final(state);
+		for ( index = 0 ; index < 8 ; ++index ) {
+			digest[index] = (unsigned char)(value >> (56 - 8 * index));
+		} /* FOR */
+		return(8);
+	} /* IF */
+
+	bits = state->length * 8;
+	count = 64 - (state->num_block + 8) % 64;
+	memset(padding,0,sizeof(padding));
+	padding[0] = 0x80;
+	for ( index = 0 ; index < 8 ; ++index ) {
+		padding[count + index] = (unsigned char)(bits >> (56 - 8 * index));
+	} /* FOR */
+	hash_update(state,padding,count + 8);
+	for ( index = 0 ; index < 32 ; ++index ) {
+		digest[index] = (unsigned char)(state->sha[index / 4] >>
+							(24 - 8 * (index % 4)));
+	} /* FOR */
+
+	return(32);
+} /* end of hash_finish */
+
+/*********************************************************************
+*
+* Function  : map_histogram
+*
+* Purpose   : Count the occurrences of each byte value in a buffer.
+*
+* Inputs    : const unsigned char *data - the bytes
+*             long length - number of bytes , at most 4GB
+*             unsigned long *counts - 256 counts to be added to
+*
+* Output    : (none)
+*
+* Returns   : (nothing)
+*
+* Example   : map_histogram(data,num_bytes,counts);
+*
+* Notes     : The bytes of each 64 bit word are spread over four
+*             tables , so that successive increments rarely wait on
+*             each other. Blocks of zeros , common in disk images ,
+*             are recognised a vector at a time and counted at once.
+*
+*********************************************************************/
+
+static void map_histogram(const unsigned char *data, long length,
+					unsigned long *counts)
+{
+	unsigned int	partial[4][256];
+	unsigned long long	word;
+	long	index , zeros;
+	int		count , value;
+#if defined(SEARCH_LANES)
+	SEARCH_VECTOR	zero;
+	unsigned int	mask;
+
+	zero = SEARCH_SPLAT(0);
+#endif
+	memset(partial,0,sizeof(partial));
+	zeros = 0L;
+	for ( index = 0L ; index + 64L <= length ; index += 64L ) {
+#if defined(SEARCH_LANES)
+		mask = SEARCH_ALL_LANES;
+		for ( count = 0 ; count < 64 ; count += SEARCH_LANES ) {
+			mask &= SEARCH_MASK(SEARCH_EQUAL(SEARCH_LOAD(&data[index + count]),
+								zero));
+		} /* FOR */
+		if ( mask == SEARCH_ALL_LANES ) {
+			zeros += 64L;
+			continue;
+		} /* IF */
+#endif
+		for ( count = 0 ; count < 64 ; count += 8 ) {
+			memcpy(&word,&data[index + count],sizeof(word));
+			partial[0][word & 0xff] += 1;
+			partial[1][(word >> 8) & 0xff] += 1;
+			partial[2][(word >> 16) & 0xff] += 1;
+			partial[3][(word >> 24) & 0xff] += 1;
+			partial[0][(word >> 32) & 0xff] += 1;
+			partial[1][(word >> 40) & 0xff] += 1;
+			partial[2][(word >> 48) & 0xff] += 1;
+			partial[3][word >> 56] += 1;
+		} /* FOR */
+	} /* FOR */
+	for ( ; index < length ; ++index ) {
+		partial[0][data[index]] += 1;
+	} /* FOR */
+	for ( value = 0 ; value < 256 ; ++value ) {
+		counts[value] += (unsigned long)partial[0][value] + partial[1][value] +
+						partial[2][value] + partial[3][value];
+	} /* FOR */
+	counts[0] += zeros;
+
+	return;
+} /* end of map_histogram */
+
+/*********************************************************************
+*
+* Function  : map_summarize
+*
+* Purpose   : Reduce the byte histogram of a region to its entropy and
+*             the shares of the most telling byte classes.
+*
+* Inputs    : const unsigned long *counts - 256 byte counts
+*             long total - number of bytes counted
+*             MAP_REGION *region - receives the summary
+*
+* Output    : (none)
+*
+* Returns   : (nothing)
+*
+* Example   : map_summarize(counts,total,&overview.regions[number]);
+*
+* Notes     : The entropy is in bits per byte , 0.0 for a region of a
+*             single byte value up to 8.0 for random data.
+*
+*********************************************************************/
+
+static void map_summarize(const unsigned long *counts, long total,
+					MAP_REGION *region)
+{
+	double	entropy , share;
+	long	text;
+	int		value , top;
+
+	entropy = 0.0;
+	text = 0L;
+	top = 0;
+	for ( value = 0 ; value < 256 ; ++value ) {
+		if ( counts[value] > 0 ) {
+			share = (double)counts[value] / total;
+			entropy -= share * log2(share);
+		} /* IF */
+		if ( counts[value] > counts[top] ) {
+			top = value;
+		} /* IF */
+		if ( value < 128 && (isprint(value) || isspace(value)) ) {
+			text += counts[value];
+		} /* IF */
+	} /* FOR */
+	if ( total <= 0L ) {
+		total = 1L;
+	} /* IF */
+	region->entropy = (float)entropy;
+	region->top_byte = (unsigned char)top;
+	region->top_percent = (unsigned char)((counts[top] * 100L) / total);
+	region->zero_percent = (unsigned char)((counts[0] * 100L) / total);
+	region->text_percent = (unsigned char)((text * 100L) / total);
+
+	return;
+} /* end of map_summarize */
+
+/*********************************************************************
+*
+* Function  : map_compute
+*
+* Purpose   : Find the entropy of a region of the overview map.
+*
+* Inputs    : long number - number of region
+*             int sampled - 1 --> from MAP_SAMPLES samples ,
+*                           0 --> from every byte
+*
+* Output    : (none)
+*
+* Returns   : 0 --> region updated , -1 --> regions were invalidated
+*             while it was being read
+*
+* Example   : map_compute(number,0);
+*
+* Notes     : Called by the map thread. The map lock is held while
+*             each chunk is read , as the main thread only releases it
+*             while waiting for a key and may change the file at any
+*             other time. A region which can't be read is given an
+*             entropy of -1.
+*
+*********************************************************************/
+
+static int map_compute(long number, int sampled)
+{
+	unsigned long	counts[256];
+	unsigned char	*data;
+	long	offset , end , step , length , num_bytes , total , serial;
+	int		failed;
+
+	memset(counts,0,sizeof(counts));
+	total = 0L;
+	failed = 0;
+	pthread_mutex_lock(&overview.lock);
+	serial = overview.serial;
+	offset = number * overview.region_size;
+	end = offset + overview.region_size;
+	if ( end > filesize ) {
+		end = filesize;
+	} /* IF */
+	pthread_mutex_unlock(&overview.lock);
+	length = sampled ? MAP_SAMPLE_SIZE : MAP_CHUNK_SIZE;
+	step = sampled ? (end - offset) / MAP_SAMPLES : MAP_CHUNK_SIZE;
+	if ( step < length ) {
+		step = length;	/* a short last region is read in full */
+	} /* IF */
+
+	for ( ; offset < end && ! failed ; offset += step ) {
+		pthread_mutex_lock(&overview.lock);
+		if ( overview.stop || overview.serial != serial ) {
+			pthread_mutex_unlock(&overview.lock);
+			return(-1);
+		} /* IF */
+		data = source_view(&input_source,offset,
+						length < end - offset ? length : end - offset,
+						overview.buffer,&num_bytes);
+		if ( data == NULL ) {
+			failed = 1;
+		} /* IF */
+		else {
+			map_histogram(data,num_bytes,counts);
+			total += num_bytes;
+		} /* ELSE */
+		pthread_mutex_unlock(&overview.lock);
+	} /* FOR */
+
+	pthread_mutex_lock(&overview.lock);
+	if ( overview.serial != serial || number >= overview.num_regions ) {
+		pthread_mutex_unlock(&overview.lock);
+		return(-1);
+	} /* IF */
+	map_summarize(counts,total,&overview.regions[number]);
+	if ( failed ) {
+		overview.regions[number].entropy = -1.0;
+	} /* IF */
+	overview.regions[number].state = sampled ? MAP_SAMPLED : MAP_EXACT;
+	overview.updates += 1L;
+	pthread_mutex_unlock(&overview.lock);
+
+	return(0);
+} /* end of map_compute */
+
+/*********************************************************************
+*
+* Function  : map_next
+*
+* Purpose   : Choose the next region for the map thread to work on.
+*
+* Inputs    : long *number - receives number of region
+*             int *sampled - receives 1 if it is to be sampled
+*
+* Output    : (none)
+*
+* Returns   : 1 --> there is work to do , 0 --> the map is complete
+*
+* Example   : while ( ! map_next(&number,&sampled) ) ...
+*
+* Notes     : Called with the map lock held. Every region is sampled
+*             before any is counted exactly , so the whole map takes
+*             shape quickly. Small regions are counted straight away.
+*
+*********************************************************************/
+
+static int map_next(long *number, int *sampled)
+{
+	while ( overview.next_sample < overview.num_regions &&
+			overview.regions[overview.next_sample].state != MAP_EMPTY ) {
+		overview.next_sample += 1L;
+	} /* WHILE */
+	if ( overview.next_sample < overview.num_regions ) {
+		*number = overview.next_sample;
+		*sampled = overview.region_size > MAP_SAMPLES * MAP_SAMPLE_SIZE;
+		return(1);
+	} /* IF */
+	while ( overview.next_exact < overview.num_regions &&
+			overview.regions[overview.next_exact].state == MAP_EXACT ) {
+		overview.next_exact += 1L;
+	} /* WHILE */
+	if ( overview.next_exact < overview.num_regions ) {
+		*number = overview.next_exact;
+		*sampled = 0;
+		return(1);
+	} /* IF */
+
+	return(0);
+} /* end of map_next */
+
+/*********************************************************************
+*
+* Function  : map_worker
+*
+* Purpose   : Thread which fills in the overview map.
+*
+* Inputs    : void *argument - the OVERVIEW_MAP
+*
+* Output    : (none)
+*
+* Returns   : NULL
+*
+* Example   : pthread_create(&overview.thread,NULL,map_worker,&overview);
+*
+* Notes     : Sleeps while the map is complete , map_invalidate()
+*             wakes it when the file changes.
+*
+*********************************************************************/
+
+static void *map_worker(void *argument)
+{
+	OVERVIEW_MAP	*map;
+	long	number;
+	int		sampled;
+
+	map = (OVERVIEW_MAP *)argument;
+	while ( 1 ) {
+		pthread_mutex_lock(&map->lock);
+		while ( ! map->stop && ! map_next(&number,&sampled) ) {
+			pthread_cond_wait(&map->work,&map->lock);
+		} /* WHILE */
+		if ( map->stop ) {
+			pthread_mutex_unlock(&map->lock);
+			break;
+		} /* IF */
+		pthread_mutex_unlock(&map->lock);
+		map_compute(number,sampled);
+	} /* WHILE */
+
+	return(NULL);
+} /* end of map_worker */
+
+/*********************************************************************
+*
+* Function  : map_resize
+*
+* Purpose   : Match the number of regions of the overview map to the
+*             size of the file.
+*
+* Inputs    : (none)
+*
+* Output    : (none)
+*
+* Returns   : 0 --> success , -1 --> out of memory
+*
+* Example   : map_resize();
+*
+* Notes     : The region size is fixed when the map is opened , so a
+*             growing file just gets more regions.
+*
+*********************************************************************/
+
+static int map_resize()
+{
+	MAP_REGION	*regions;
+	long	num_regions , max_regions;
+
+	num_regions = (filesize + overview.region_size - 1L) / overview.region_size;
+	if ( num_regions > overview.max_regions ) {
+		max_regions = num_regions + num_regions / 4L;
+		regions = (MAP_REGION *)realloc(overview.regions,
+							max_regions * sizeof(MAP_REGION));
+		if ( regions == NULL ) {
+			return(-1);
+		} /* IF */
+		overview.regions = regions;
+		overview.max_regions = max_regions;
+	} /* IF */
+	if ( num_regions > overview.num_regions ) {
+		memset(&overview.regions[overview.num_regions],0,
+			(num_regions - overview.num_regions) * sizeof(MAP_REGION));
+		if ( overview.next_sample > overview.num_regions ) {
+			overview.next_sample = overview.num_regions;
+		} /* IF */
+		if ( overview.next_exact > overview.num_regions ) {
+			overview.next_exact = overview.num_regions;
+		} /* IF */
+	} /* IF */
+	overview.num_regions = num_regions;
+
+	return(0);
+} /* end of map_resize */
+
+/*********************************************************************
+*
+* Function  : map_invalidate
+*
+* Purpose   : Mark the regions of the overview map affected by a change
+*             to the file , so that the map thread works them out again.
+*
+* Inputs    : long offset - offset of change
+*             long old_count - number of bytes replaced
+*             long new_count - number of new bytes
+*
+* Output    : (none)
+*
+* Returns   : (nothing)
+*
+* Example   : map_invalidate(offset,1L,1L);
+*
+* Notes     : Called by the main thread , with the map lock held , after
+*             the new size has been set. Inserts and deletes move all the
+*             following bytes so every later region is affected. The old
+*             values are shown until the new ones are ready.
+*
+*********************************************************************/
+
+static void map_invalidate(long offset, long old_count, long new_count)
+{
+	long	first , last , number;
+
+	if ( ! overview.active ) {
+		return;
+	} /* IF */
+	if ( map_resize() < 0 ) {
+		error_message("Out of memory");
+	} /* IF */
+	first = offset / overview.region_size;
+	last = overview.num_regions - 1L;
+	if ( old_count == new_count ) {
+		if ( new_count <= 0L ) {
+			return;
+		} /* IF */
+		last = (offset + new_count - 1L) / overview.region_size;
+	} /* IF */
+	for ( number = first ; number <= last && number < overview.num_regions ;
+						++number ) {
+		if ( overview.regions[number].state != MAP_EMPTY ) {
+			overview.regions[number].state = MAP_STALE;
+		} /* IF */
+	} /* FOR */
+	if ( overview.next_sample > first ) {
+		overview.next_sample = first;
+	} /* IF */
+	if ( overview.next_exact > first ) {
+		overview.next_exact = first;
+	} /* IF */
+	overview.serial += 1L;
+	overview.updates += 1L;
+	pthread_cond_signal(&overview.work);
+
+	return;
+} /* end of map_invalidate */
+
+/*********************************************************************
+*
+* Function  : map_open
+*
+* Purpose   : Start building the overview map of the file.
+*
+* Inputs    : (none)
+*
+* Output    : (none)
+*
+* Returns   : 0 --> success , -1 --> error
+*
+* Example   : map_open();
+*
+* Notes     : On return the main thread holds the map lock , see
+*             get_command().
+*
+*********************************************************************/
+
+static int map_open()
+{
+	memset(&overview,0,sizeof(overview));
+	for ( overview.region_size = MAP_MIN_REGION ;
+			filesize / overview.region_size >= MAP_MAX_REGIONS ;
+			overview.region_size *= 2L ) {
+		;
+	} /* FOR */
+	overview.buffer = (unsigned char *)malloc(MAP_CHUNK_SIZE);
+	if ( overview.buffer == NULL || map_resize() < 0 ) {
+		return(-1);
+	} /* IF */
+	pthread_mutex_init(&overview.lock,NULL);
+	pthread_cond_init(&overview.work,NULL);
+	pthread_mutex_lock(&overview.lock);
+	if ( pthread_create(&overview.thread,NULL,map_worker,&overview) != 0 ) {
+		pthread_mutex_unlock(&overview.lock);
+		return(-1);
+	} /* IF */
+	overview.active = 1;
+
+	return(0);
+} /* end of map_open */
+
+/*********************************************************************
+*
+* Function  : map_close
+*
+* Purpose   : Stop the overview map thread.
+*
+* Inputs    : (none)
+*
+* Output    : (none)
+*
+* Returns   : (nothing)
+*
+* Example   : map_close();
+*
+* Notes     : (none)
+*
+*********************************************************************/
+
+static void map_close()
+{
+	if ( ! overview.active ) {
+		return;
+	} /* IF */
+	overview.stop = 1;
+	pthread_cond_signal(&overview.work);
+	pthread_mutex_unlock(&overview.lock);
+	pthread_join(overview.thread,NULL);
+	overview.active = 0;
+
+	return;
+} /* end of map_close */
+
+/*********************************************************************
+*
+* Function  : map_busy
+*
+* Purpose   : Check whether the overview map is still being built.
+*
+* Inputs    : (none)
+*
+* Output    : (none)
+*
+* Returns   : 1 --> regions remain to be done , 0 --> map is complete
+*
+* Example   : if ( map_busy() ) ...
+*
+* Notes     : (none)
+*
+*********************************************************************/
+
+static int map_busy()
+{
+	return(overview.active && (overview.next_sample < overview.num_regions ||
+				overview.next_exact < overview.num_regions));
+} /* end of map_busy */
+
+/*********************************************************************
+*
+* Function  : map_draw
+*
+* Purpose   : Draw the heat strip of the overview map.
+*
+* Inputs    : long selected - region to highlight , -1L for the one
+*                             holding the current offset
+*
+* Output    : (none)
+*
+* Returns   : (nothing)
+*
+* Example   : map_draw(-1L);
+*
+* Notes     : Each row is one region , shown as a character whose
+*             density follows the entropy and the entropy itself. A '~'
+*             marks a value from samples or from before a change. The
+*             strip scrolls to keep the highlighted region in view.
+*             The window is not refreshed until the next doupdate().
+*
+*********************************************************************/
+
+static void map_draw(long selected)
+{
+	static	char	heat[] = " .:-=+*#%@";
+	MAP_REGION	*region;
+	long	number;
+	int		row , num_rows;
+	char	text[MAP_WIDTH + 1];
+
+	if ( ! overview.active || map_win == NULL ) {
+		return;
+	} /* IF */
+	if ( selected < 0L ) {
+		selected = current_file_offset / overview.region_size;
+	} /* IF */
+	num_rows = getmaxy(map_win) - 2;
+	if ( selected < overview.top ) {
+		overview.top = selected;
+	} /* IF */
+	else if ( selected >= overview.top + num_rows ) {
+		overview.top = selected - num_rows + 1L;
+	} /* ELSE IF */
+	box(map_win,'|','-');
+	wborder(map_win,0,0,0,0,0,0,0,0);
+	for ( row = 0 ; row < num_rows ; ++row ) {
+		number = overview.top + row;
+		region = number < overview.num_regions ?
+						&overview.regions[number] : NULL;
+		if ( region == NULL ) {
+			sprintf(text,"%*s",MAP_WIDTH - 2,"");
+		} /* IF */
+		else if ( region->state == MAP_EMPTY ) {
+			sprintf(text,"%*s",MAP_WIDTH - 2,"?");
+		} /* ELSE IF */
+		else if ( region->entropy < 0.0 ) {
+			sprintf(text,"%*s",MAP_WIDTH - 2,"!");
+		} /* ELSE IF */
+		else {
+			sprintf(text,"%c%c%3.1f",
+				heat[(int)(region->entropy * (sizeof(heat) - 1) / 8.01)],
+				region->state == MAP_EXACT ? ' ' : '~',region->entropy);
+		} /* ELSE */
+		mvwaddnstr(map_win,row + 1,1,text,MAP_WIDTH - 2);
+		mvwchgat(map_win,row + 1,1,MAP_WIDTH - 2,
+				number == selected ? A_REVERSE : A_NORMAL,0,NULL);
+	} /* FOR */
+	overview.drawn = overview.updates;
+	wnoutrefresh(map_win);
+
+	return;
+} /* end of map_draw */
+
+/*********************************************************************
+*
+* Function  : map_describe
+*
+* Purpose   : Show the summary of a region of the overview map in the
+*             status window.
+*
+* Inputs    : long number - number of region
+*
+* Output    : (none)
+*
+* Returns   : (nothing)
+*
+* Example   : map_describe(number);
+*
+* Notes     : (none)
+*
+*********************************************************************/
+
+static void map_describe(long number)
+{
+	MAP_REGION	*region;
+
+	region = &overview.regions[number];
+	if ( region->state == MAP_EMPTY ) {
+		status_message("Region %ld of %ld at 0x%lx : not done yet",
+			number + 1L,overview.num_regions,number * overview.region_size);
+	} /* IF */
+	else {
+		status_message("Region %ld of %ld at 0x%lx : entropy %.2f%s , "
+			"%d%% zero , %d%% text , top byte 0x%02x (%d%%)",
+			number + 1L,overview.num_regions,number * overview.region_size,
+			region->entropy,region->state == MAP_EXACT ? "" : " (approx)",
+			region->zero_percent,region->text_percent,region->top_byte,
+			region->top_percent);
+	} /* ELSE */
+
+	return;
+} /* end of map_describe */
+
+/*********************************************************************
+*
+* Function  : map_select
+*
+* Purpose   : Let the user pick a region from the overview map.
+*
+* Inputs    : (none)
+*
+* Output    : (none)
+*
+* Returns   : If a region was chosen Then its offset Else -1L
+*
+* Example   : offset = map_select();
+*
+* Notes     : j/k or the arrow keys move by a region , PgDn/PgUp or
+*             J/K by a screen , 1 and $ go to the ends of the map. The
+*             map thread carries on while waiting for each key.
+*
+*********************************************************************/
+
+static long map_select()
+{
+	long	selected , page;
+	int		ch;
+
+	if ( ! overview.active ) {
+		error_message("No overview map , use the -e option");
+		return(-1L);
+	} /* IF */
+	if ( overview.num_regions == 0L ) {
+		error_message("File is empty");
+		return(-1L);
+	} /* IF */
+	selected = current_file_offset / overview.region_size;
+	page = getmaxy(map_win) - 2;
+	keypad(msg_win,TRUE);
+	while ( 1 ) {
+		if ( selected >= overview.num_regions ) {
+			selected = overview.num_regions - 1L;
+		} /* IF */
+		if ( selected < 0L ) {
+			selected = 0L;
+		} /* IF */
+		map_draw(selected);
+		map_describe(selected);
+		message("Select a region (j,k,J,K,1,$) , Enter to go there : ");
+		pthread_mutex_unlock(&overview.lock);
+		ch = wgetch(msg_win);
+		pthread_mutex_lock(&overview.lock);
+		if ( ch == 'j' || ch == KEY_DOWN ) {
+			selected += 1L;
+		} /* IF */
+		else if ( ch == 'k' || ch == KEY_UP ) {
+			selected -= 1L;
+		} /* ELSE IF */
+		else if ( ch == 'J' || ch == KEY_NPAGE ) {
+			selected += page;
+		} /* ELSE IF */
+		else if ( ch == 'K' || ch == KEY_PPAGE ) {
+			selected -= page;
+		} /* ELSE IF */
+		else if ( ch == '1' ) {
+			selected = 0L;
+		} /* ELSE IF */
+		else if ( ch == '$' ) {
+			selected = overview.num_regions - 1L;
+		} /* ELSE IF */
+		else {
+			break;
+		} /* ELSE */
+	} /* WHILE */
+	keypad(msg_win,FALSE);
+	if ( ch != '\r' && ch != '\n' && ch != KEY_ENTER ) {
+		map_draw(-1L);
+		doupdate();
+		return(-1L);
+	} /* IF */
+
+	return(selected * overview.region_size);
+} /* end of map_select */
+
+/*********************************************************************
+*
+* Function  : hash_tree_resize
+*
+* Purpose   : Match the number of chunks of a hash tree to the size of
+*             the file.
+*
+* Inputs    : HASH_TREE *tree - the tree
+*
+* Output    : (none)
+*
+* Returns   : 0 --> success , -1 --> out of memory
+*
+* Example   : hash_tree_resize(&hash_trees[HASH_SHA256]);
+*
+* Notes     : New chunks have no digest.
+*
+*********************************************************************/
+
+static int hash_tree_resize(HASH_TREE *tree)
+{
+	unsigned char	*digests , *state , *changed;
+	long	num_chunks , max_chunks;
+
+	num_chunks = (filesize + HASH_CHUNK_SIZE - 1L) / HASH_CHUNK_SIZE;
+	if ( num_chunks > tree->max_chunks ) {
+		max_chunks = num_chunks + num_chunks / 4L + 16L;
+		digests = (unsigned char *)realloc(tree->digests,
+							max_chunks * HASH_MAX_DIGEST);
+		if ( digests == NULL ) {
+			return(-1);
+		} /* IF */
+		tree->digests = digests;
+		state = (unsigned char *)realloc(tree->state,max_chunks);
+		if ( state == NULL ) {
+			return(-1);
+		} /* IF */
+		tree->state = state;
+		changed = (unsigned char *)realloc(tree->changed,max_chunks);
+		if ( changed == NULL ) {
+			return(-1);
+		} /* IF */
+		tree->changed = changed;
+		tree->max_chunks = max_chunks;
+	} /* IF */
+	if ( num_chunks > tree->num_chunks ) {
+		memset(&tree->state[tree->num_chunks],CHUNK_NONE,
+					num_chunks - tree->num_chunks);
+		memset(&tree->changed[tree->num_chunks],0,
+					num_chunks - tree->num_chunks);
+	} /* IF */
+	tree->num_chunks = num_chunks;
+
+	return(0);
+} /* end of hash_tree_resize */
+
+/*********************************************************************
+*
+* Function  : hash_tree_invalidate
+*
+* Purpose   : Mark the chunks of the hash trees affected by a change to
+*             the file.
+*
+* Inputs    : long offset - offset of change
+*             long old_count - number of bytes replaced
+*             long new_count - number of new bytes
+*
+* Output    : (none)
+*
+* Returns   : (nothing)
+*
+* Example   : hash_tree_invalidate(offset,1L,1L);
+*
+* Notes     : As for the overview map , an insert or delete affects
+*             every later chunk. The old digests are kept so that the
+*             chunks which really changed can be told apart when they
+*             are hashed again.
+*
+*********************************************************************/
+
+static void hash_tree_invalidate(long offset, long old_count, long new_count)
+{
+	HASH_TREE	*tree;
+	long	first , last , number;
+	int		algorithm;
+
+	for ( algorithm = 0 ; algorithm < HASH_NUM_ALGORITHMS ; ++algorithm ) {
+		tree = &hash_trees[algorithm];
+		if ( tree->max_chunks == 0L ) {
+			continue;	/* never used */
+		} /* IF */
+		if ( hash_tree_resize(tree) < 0 ) {
+			error_message("Out of memory");
+		} /* IF */
+		first = offset / HASH_CHUNK_SIZE;
+		last = tree->num_chunks - 1L;
+		if ( old_count == new_count ) {
+			if ( new_count <= 0L ) {
+				continue;
+			} /* IF */
+			last = (offset + new_count - 1L) / HASH_CHUNK_SIZE;
+		} /* IF */
+		for ( number = first ; number <= last && number < tree->num_chunks ;
+							++number ) {
+			if ( tree->state[number] == CHUNK_VALID ) {
+				tree->state[number] = CHUNK_STALE;
+			} /* IF */
+		} /* FOR */
+	} /* FOR */
+
+	return;
+} /* end of hash_tree_invalidate */
+
+/*********************************************************************
+*
+* Function  : note_change
+*
+* Purpose   : Bring the results of earlier passes over the file up to
+*             date after it has changed.
+*
+* Inputs    : long offset - offset of change
+*             long old_count - number of bytes replaced
+*             long new_count - number of new bytes
+*
+* Output    : (none)
+*
+* Returns   : (nothing)
+*
+* Example   : note_change(offset,old_count,new_count);
+*
+* Notes     : Called after the new size has been set. The overview map
+*             redoes the affected regions and the hash trees rehash the
+*             affected chunks when next used. The find all hits are kept
+*             for the next and previous hit commands but no longer
+*             stand for the file as it is.
+*
+*********************************************************************/
+
+static void note_change(long offset, long old_count, long new_count)
+{
+	map_invalidate(offset,old_count,new_count);
+	hash_tree_invalidate(offset,old_count,new_count);
+	sidecar.hits_current = 0;
+
+	return;
+} /* end of note_change */
+
+/*********************************************************************
+*
+* Function  : change_bytes
+*
+* Purpose   : Replace bytes of the file , recording the change so that
+*             it can be undone.
+*
+* Inputs    : long offset - file offset of first byte
+*             long old_count - number of bytes replaced
+*             const unsigned char *data - new bytes
+*             long new_count - number of new bytes
+*
+* Output    : (none)
+*
+* Returns   : 0 --> success , -1 --> error
+*
+* Example   : change_bytes(offset,1L,&byte,1L);
+*
+* Notes     : An old_count of 0 inserts bytes , a new_count of 0
+*             deletes them.
+*
+*********************************************************************/
+
+static int change_bytes(long offset, long old_count,
+				const unsigned char *data, long new_count)
+{
+	unsigned char	*old_bytes;
+
+	old_bytes = NULL;
+	if ( old_count > 0L && old_count + new_count <= JOURNAL_MAX_DATA / 2 ) {
+		old_bytes = (unsigned char *)malloc(old_count);
+		if ( old_bytes == NULL ) {
+			return(-1);
+		} /* IF */
+		if ( source_read(&input_source,offset,old_bytes,old_count) !=
+							old_count ) {
+			free(old_bytes);
+			return(-1);
+		} /* IF */
+	} /* IF */
+	if ( journal_record(&edit_journal,offset,old_bytes,old_count,
+					data,new_count) < 0 ||
+			edit_replace(&file_edits,offset,old_count,data,new_count) < 0 ) {
+		free(old_bytes);
+		return(-1);
+	} /* IF */
+	free(old_bytes);
+	set_file_size();
+	note_change(offset,old_count,new_count);
+
+	return(0);
+} /* end of change_bytes */
+
+/*********************************************************************
+*
+* Function  : undo_redo
+*
+* Purpose   : Undo the last change , or redo the last undone change.
+*
+* Inputs    : int redo - 0 --> undo , 1 --> redo
+*
+* Output    : (none)
+*
+* Returns   : If successful Then offset of change Else -1L
+*
+* Example   : offset = undo_redo(0);
+*
+* Notes     : (none)
+*
+*********************************************************************/
+
+static long undo_redo(int redo)
+{
+	JOURNAL_ENTRY	*entry;
+	int		status;
+
+	if ( redo ) {
+		if ( edit_journal.position >= edit_journal.num_entries ) {
+			error_message("Nothing to redo");
+			return(-1L);
+		} /* IF */
+		entry = &edit_journal.entries[edit_journal.position];
+		status = edit_replace(&file_edits,entry->offset,entry->old_length,
+					&edit_journal.new_data[entry->new_offset],entry->new_length);
+	} /* IF */
+	else {
+		if ( edit_journal.position <= 0 ) {
+			error_message(edit_journal.num_dropped > 0 ?
+					"Nothing more to undo (oldest changes were forgotten)" :
+					"Nothing to undo");
+			return(-1L);
+		} /* IF */
+		entry = &edit_journal.entries[edit_journal.position-1];
+		status = edit_replace(&file_edits,entry->offset,entry->new_length,
+					&edit_journal.old_data[entry->old_offset],entry->old_length);
+	} /* ELSE */
+	if ( status < 0 ) {
+		error_message("Out of memory");
+		return(-1L);
+	} /* IF */
+	edit_journal.position += redo ? 1 : -1;
+	set_file_size();
+	if ( redo ) {
+		note_change(entry->offset,entry->old_length,entry->new_length);
+	} /* IF */
+	else {
+		note_change(entry->offset,entry->new_length,entry->old_length);
+	} /* ELSE */
+
+	return(entry->offset);
+} /* end of undo_redo */
+
+/*********************************************************************
+*
+* Function  : format_init
+*
+* Purpose   : Build the lookup tables used by format_row().
+*
+* Inputs    : (none)
+*
+* Output    : (none)
+*
+* Returns   : (nothing)
+*
+* Example   : format_init();
+*
+* Notes     : (none)
+*
+*********************************************************************/
+
+static void format_init()
+{
+	int		value;
+
+	for ( value = 0 ; value < 256 ; ++value ) {
+		hex_pairs[2 * value] = hex_digits[value >> 4];
+		hex_pairs[2 * value + 1] = hex_digits[value & 0x0f];
+		print_chars[value] = (value < 0x20 || value > 0x7e) ? '.' : value;
+	} /* FOR */
+
+	return;
+} /* end of format_init */
+
+/*********************************************************************
+*
+* Function  : format_row
+*
+* Purpose   : Format one row of a hex/character dump.
+*
+* Inputs    : char *line - receives the row
+*             long offset - file offset of the first byte
+*             const unsigned char *data - the bytes
+*             int num_bytes - number of bytes in this row
+*             int pairs_per_row - number of byte pairs in a full row
+*
+* Output    : (none)
+*
+* Returns   : length of row
+*
+* Example   : length = format_row(line,offset,data,num_bytes,num_pairs);
+*
+* Notes     : The row is the offset , the bytes in hex as groups of
+*             two and the bytes as characters between '|'s. Rows with
+*             fewer bytes are padded so that the columns line up. The
+*             offset has at least offset_width digits. line must have
+*             room for 22 + 7 * pairs_per_row characters. The row is
+*             built in one pass using hex_pairs[] and print_chars[].
+*
+*********************************************************************/
+
+static int format_row(char *line, long offset, const unsigned char *data,
+					int num_bytes, int pairs_per_row)
+{
+	char	*ptr , *end;
+	unsigned long	value;
+	int		count , num_digits;
+
+	for ( num_digits = offset_width ; num_digits < 16 &&
+				((unsigned long)offset >> (4 * num_digits)) != 0 ; ++num_digits ) {
+		;
+	} /* FOR */
+	ptr = &line[num_digits];
+	for ( value = (unsigned long)offset , count = 0 ; count < num_digits ;
+					++count , value >>= 4 ) {
+		*--ptr = hex_digits[value & 0x0f];
+	} /* FOR */
+	ptr = &line[num_digits];
+	*ptr++ = ' ';
+	*ptr++ = ':';
+	*ptr++ = ' ';
+	end = ptr + 5 * pairs_per_row;
+
+	for ( count = 0 ; count + 1 < num_bytes ; count += 2 ) {
+		ptr[0] = hex_pairs[2 * data[count]];
+		ptr[1] = hex_pairs[2 * data[count] + 1];
+		ptr[2] = hex_pairs[2 * data[count+1]];
+		ptr[3] = hex_pairs[2 * data[count+1] + 1];
+		ptr[4] = ' ';
+		ptr += 5;
+	} /* FOR */
+	if ( count < num_bytes ) {
+		ptr[0] = hex_pairs[2 * data[count]];
+		ptr[1] = hex_pairs[2 * data[count] + 1];
+		ptr += 2;
+	} /* IF */
+	while ( ptr < end ) {
+		*ptr++ = ' ';
+	} /* WHILE */
+
+	*ptr++ = '|';
+	for ( count = 0 ; count < num_bytes ; ++count ) {
+		*ptr++ = print_chars[data[count]];
+	} /* FOR */
+	for ( ; count < 2 * pairs_per_row ; ++count ) {
+		*ptr++ = ' ';
+	} /* FOR */
+	*ptr++ = '|';
+	*ptr = '\0';
+
+	return((int)(ptr - line));
+} /* end of format_row */
+
+/*********************************************************************
+*
+* Function  : frame_init
+*
+* Purpose   : Setup the record of what is on the screen.
+*
+* Inputs    : SCREEN_FRAME *frame - the frame
+*             int num_rows - number of rows
+*             int num_cols - number of characters per row
+*             int text_length - longest row that will be formatted
+*
+* Output    : (none)
+*
+* Returns   : 0 --> success , -1 --> out of memory
+*
+* Example   : frame_init(&data_frame,num_lines - 6,num_cols - 3,200);
+*
+* Notes     : A row may be formatted past the width of the window ,
+*             only num_cols characters of it are displayed.
+*
+*********************************************************************/
+
+static int frame_init(SCREEN_FRAME *frame, int num_rows, int num_cols,
+					int text_length)
+{
+	if ( num_cols < 1 ) {
+		num_cols = 1;
+	} /* IF */
+	frame->num_rows = num_rows;
+	frame->num_cols = num_cols;
+	frame->valid = 0;
+	frame->cells = (char *)malloc((size_t)num_rows * num_cols);
+	if ( text_length < num_cols ) {
+		text_length = num_cols;
+	} /* IF */
+	frame->text = (char *)malloc(text_length + 1);
+	if ( frame->cells == NULL || frame->text == NULL ) {
+		return(-1);
+	} /* IF */
+
+	return(0);
+} /* end of frame_init */
+
+/*********************************************************************
+*
+* Function  : frame_draw_row
+*
+* Purpose   : Draw a row of a window , skipping the parts which are
+*             already on the screen.
+*
+* Inputs    : SCREEN_FRAME *frame - the frame
+*             WINDOW *window - the window
+*             int row - row number
+*             int col - column of the first character of the row
+*
+* Output    : (none)
+*
+* Returns   : (nothing)
+*
+* Example   : frame_draw_row(&data_frame,data_win,row,2);
+*
+* Notes     : The new contents are in frame->text , num_cols long.
+*             Changed cells separated by fewer than FRAME_MIN_GAP
+*             unchanged ones are drawn together , which is cheaper
+*             than moving the cursor.
+*
+*********************************************************************/
+
+static void frame_draw_row(SCREEN_FRAME *frame, WINDOW *window, int row,
+					int col)
+{
+	char	*cells , *text;
+	int		first , last , same;
+
+	cells = &frame->cells[row * frame->num_cols];
+	text = frame->text;
+	for ( first = 0 ; first < frame->num_cols ; ) {
+		if ( frame->valid && cells[first] == text[first] ) {
+			first += 1;
+			continue;
+		} /* IF */
+		same = 0;
+		for ( last = first + 1 ; last < frame->num_cols ; ++last ) {
+			if ( frame->valid && cells[last] == text[last] ) {
+				if ( ++same >= FRAME_MIN_GAP ) {
+					last += 1;		/* so that last - same is the gap start */
+					break;
+				} /* IF */
+			} /* IF */
+			else {
+				same = 0;
+			} /* ELSE */
+		} /* FOR */
+		last -= same;
+		mvwaddnstr(window,row,col + first,&text[first],last - first);
+		memcpy(&cells[first],&text[first],last - first);
+		first = last;
+	} /* FOR */
+
+	return;
+} /* end of frame_draw_row */
+
+/*********************************************************************
+*
+* Function  : diff_mark
+*
+* Purpose   : Show part of a row of the data window in reverse video.
+*
+* Inputs    : int row - row number
+*             int col - column of the first character of the row
+*             int start - position of the part within the row
+*             int width - number of characters
+*
+* Output    : (none)
+*
+* Returns   : (nothing)
+*
+* Example   : diff_mark(row,2,hex_col,2);
+*
+* Notes     : Anything past the width of the window is ignored.
+*
+*********************************************************************/
+
+static void diff_mark(int row, int col, int start, int width)
+{
+	if ( start + width > data_frame.num_cols ) {
+		width = data_frame.num_cols - start;
+	} /* IF */
+	if ( width > 0 ) {
+		mvwchgat(data_win,row,col + start,width,A_REVERSE,0,NULL);
+	} /* IF */
+
+	return;
+} /* end of diff_mark */
+
+/*********************************************************************
+*
+* Function  : diff_highlight
+*
+* Purpose   : Show the bytes of a compare row which differ between
+*             the two files in reverse video.
+*
+* Inputs    : int row - row number
+*             int col - column of the first character of the row
+*             int first_col - start of this file's hex bytes in the row
+*             int other_col - start of the other file's hex bytes
+*             const unsigned char *first - this file's bytes
+*             int first_bytes - number of them
+*             const unsigned char *second - other file's bytes
+*             int second_bytes - number of them
+*
+* Output    : (none)
+*
+* Returns   : (nothing)
+*
+* Example   : diff_highlight(row,2,first_col,other_col,first,16,
+*                            second,16);
+*
+* Notes     : The row has already been drawn by frame_draw_row() ,
+*             only the attributes are changed. A byte missing from one
+*             file is highlighted in the other.
+*
+*********************************************************************/
+
+static void diff_highlight(int row, int col, int first_col, int other_col,
+			const unsigned char *first, int first_bytes,
+			const unsigned char *second, int second_bytes)
+{
+	int		count , hex , ascii;
+
+	mvwchgat(data_win,row,col,data_frame.num_cols,A_NORMAL,0,NULL);
+	for ( count = 0 ; count < first_bytes || count < second_bytes ; ++count ) {
+		if ( count < first_bytes && count < second_bytes &&
+						first[count] == second[count] ) {
+			continue;
+		} /* IF */
+		hex = (count / 2) * 5 + (count % 2) * 2;
+		ascii = 5 * num_pairs + 1 + count;
+		if ( count < first_bytes ) {
+			diff_mark(row,col,first_col + hex,2);
+			diff_mark(row,col,first_col + ascii,1);
+		} /* IF */
+		if ( count < second_bytes ) {
+			diff_mark(row,col,other_col + hex,2);
+			diff_mark(row,col,other_col + ascii,1);
+		} /* IF */
+	} /* FOR */
+
+	return;
+} /* end of diff_highlight */
+
+/*********************************************************************
+*
+* Function  : template_type
+*
+* Purpose   : Work out the type and count of a field of a structure
+*             template.
+*
+* Inputs    : STRUCT_TEMPLATE *tmpl - the template being read
+*             char *text - the type , e.g. "u32be[4]"
+*             int big_endian - byte order when none is given
+*             TEMPLATE_OP *field - receives the type
+*
+* Output    : (none)
+*
+* Returns   : 0 --> success , -1 --> invalid type
+*
+* Example   : status = template_type(tmpl,"u16[count]",0,field);
+*
+* Notes     : The type is one of u8 u16 u32 u64 i8 i16 i32 i64 f32 f64
+*             or char , optionally followed by le or be , or the name
+*             of a structure defined earlier. The count in [] is a
+*             number or the name of an earlier integer field of the
+*             same structure.
+*
+*********************************************************************/
+
+static int template_type(STRUCT_TEMPLATE *tmpl, char *text, int big_endian,
+					TEMPLATE_OP *field)
+{
+	static	struct {
+		char	*name;
+		int		type , size;
+	} types[] = {
+		{ "u8" , FIELD_UNSIGNED , 1 } , { "u16" , FIELD_UNSIGNED , 2 } ,
+		{ "u32" , FIELD_UNSIGNED , 4 } , { "u64" , FIELD_UNSIGNED , 8 } ,
+		{ "i8" , FIELD_SIGNED , 1 } , { "i16" , FIELD_SIGNED , 2 } ,
+		{ "i32" , FIELD_SIGNED , 4 } , { "i64" , FIELD_SIGNED , 8 } ,
+		{ "f32" , FIELD_FLOAT , 4 } , { "f64" , FIELD_FLOAT , 8 } ,
+		{ "char" , FIELD_CHAR , 1 } , { NULL , 0 , 0 }
+	};
+	TEMPLATE_STRUCT	*structure;
+	TEMPLATE_OP	*other;
+	char	*count_text , *end;
+	size_t	length;
+	int		index;
+
+	structure = &tmpl->structs[tmpl->num_structs];	/* being defined */
+	field->count = 1L;
+	field->count_op = -1;
+	count_text = strchr(text,'[');
+	if ( count_text != NULL ) {
+		end = strchr(count_text,']');
+		if ( end == NULL || end[1] != '\0' ) {
+			return(-1);
+		} /* IF */
+		*count_text++ = '\0';
+		*end = '\0';
+		if ( isdigit((unsigned char)*count_text) ) {
+			field->count = strtol(count_text,&end,0);
+			if ( *end != '\0' || field->count < 0L ) {
+				return(-1);
+			} /* IF */
+		} /* IF */
+		else {
+			for ( index = structure->num_fields - 1 ; index >= 0 ; --index ) {
+				other = &tmpl->fields[structure->first + index];
+				if ( strcmp(other->name,count_text) == 0 ) {
+					break;
+				} /* IF */
+			} /* FOR */
+			if ( index < 0 || other->count != 1L || other->count_op >= 0 ||
+					(other->type != FIELD_UNSIGNED &&
+					other->type != FIELD_SIGNED) ) {
+				return(-1);
+			} /* IF */
+			field->count_op = index;
+		} /* ELSE */
+	} /* IF */
+
+	field->big_endian = big_endian;
+	length = strlen(text);
+	if ( length > 2 && (strcmp(&text[length-2],"le") == 0 ||
+					strcmp(&text[length-2],"be") == 0) ) {
+		for ( index = 0 ; types[index].name != NULL ; ++index ) {
+			if ( strlen(types[index].name) == length - 2 &&
+					strncmp(types[index].name,text,length - 2) == 0 ) {
+				field->big_endian = text[length-2] == 'b';
+				text[length-2] = '\0';
+				break;
+			} /* IF */
+		} /* FOR */
+	} /* IF */
+	for ( index = 0 ; types[index].name != NULL ; ++index ) {
+		if ( strcmp(types[index].name,text) == 0 ) {
+			field->type = types[index].type;
+			field->size = types[index].size;
+			return(0);
+		} /* IF */
+	} /* FOR */
+	for ( index = 0 ; index < tmpl->num_structs ; ++index ) {
+		if ( strcmp(tmpl->structs[index].name,text) == 0 ) {
+			field->type = FIELD_STRUCT;
+			field->size = index;
+			return(0);
+		} /* IF */
+	} /* FOR */
+
+	return(-1);
+} /* end of template_type */
+
+/*********************************************************************
+*
+* Function  : template_size
+*
+* Purpose   : Work out the size of a structure of a template.
+*
+* Inputs    : STRUCT_TEMPLATE *tmpl - the template
+*             TEMPLATE_STRUCT *structure - the structure
+*
+* Output    : (none)
+*
+* Returns   : number of bytes , -1L if it depends on the data
+*
+* Example   : structure->size = template_size(tmpl,structure);
+*
+* Notes     : (none)
+*
+*********************************************************************/
+
+static long template_size(STRUCT_TEMPLATE *tmpl, TEMPLATE_STRUCT *structure)
+{
+	TEMPLATE_OP	*field;
+	long	size , total;
+	int		index;
+
+	total = 0L;
+	for ( index = 0 ; index < structure->num_fields ; ++index ) {
+		field = &tmpl->fields[structure->first + index];
+		size = field->type == FIELD_STRUCT ?
+					tmpl->structs[field->size].size : field->size;
+		if ( field->count_op >= 0 || size < 0L ) {
+			return(-1L);
+		} /* IF */
+		total += size * field->count;
+	} /* FOR */
+
+	return(total);
+} /* end of template_size */
+
+/*********************************************************************
+*
+* Function  : template_expand
+*
+* Purpose   : Add the decode steps for a structure to the program of
+*             a template.
+*
+* Inputs    : STRUCT_TEMPLATE *tmpl - the template
+*             int number - number of the structure
+*             int depth - nesting of the structure
+*
+* Output    : (none)
+*
+* Returns   : 0 --> success , -1 --> too many steps or out of memory
+*
+* Example   : template_expand(tmpl,tmpl->num_structs - 1,0);
+*
+* Notes     : A structure field becomes a LOOP step , the steps of the
+*             structure and a NEXT step. Counts taken from other fields
+*             are changed to refer to the steps made for them.
+*
+*********************************************************************/
+
+static int template_expand(STRUCT_TEMPLATE *tmpl, int number, int depth)
+{
+	TEMPLATE_STRUCT	*structure;
+	TEMPLATE_OP	*field , *op;
+	int		*steps , index , loop , status;
+
+	structure = &tmpl->structs[number];
+	steps = (int *)malloc((structure->num_fields + 1) * sizeof(int));
+	if ( steps == NULL ) {
+		return(-1);
+	} /* IF */
+	status = 0;
+	for ( index = 0 ; status == 0 && index < structure->num_fields ; ++index ) {
+		if ( tmpl->num_ops >= TEMPLATE_MAX_OPS - 1 ) {
+			status = -1;
+			break;
+		} /* IF */
+		field = &tmpl->fields[structure->first + index];
+		steps[index] = tmpl->num_ops;
+		op = &tmpl->program[tmpl->num_ops++];
+		*op = *field;
+		op->depth = depth;
+		if ( field->count_op >= 0 ) {
+			op->count_op = steps[field->count_op];
+		} /* IF */
+		if ( field->type != FIELD_STRUCT ) {
+			continue;
+		} /* IF */
+		op->code = OP_LOOP;
+		loop = steps[index];
+		status = template_expand(tmpl,field->size,depth + 1);
+		if ( status == 0 && tmpl->num_ops < TEMPLATE_MAX_OPS ) {
+			op = &tmpl->program[tmpl->num_ops];
+			memset(op,0,sizeof(TEMPLATE_OP));
+			op->code = OP_NEXT;
+			op->depth = depth;
+			op->count_op = -1;
+			op->jump = loop;
+			tmpl->program[loop].jump = tmpl->num_ops++;
+		} /* IF */
+		else {
+			status = -1;
+		} /* ELSE */
+	} /* FOR */
+	free(steps);
+
+	return(status);
+} /* end of template_expand */
+
+/*********************************************************************
+*
+* Function  : load_template
+*
+* Purpose   : Read a structure template and compile its decode program.
+*
+* Inputs    : char *template_file - name of template file
+*             STRUCT_TEMPLATE *tmpl - receives the template
+*
+* Output    : Error messages on stderr
+*
+* Returns   : 0 --> success , -1 --> error
+*
+* Example   : load_template("elf.tpl",&record_template);
+*
+* Notes     : The file describes one or more structures , e.g.
+*
+*                 struct ident
+*                     char[4]   magic
+*                     u8        class
+*                 end
+*                 endian big
+*                 struct header
+*                     ident     id
+*                     u16       num_items
+*                     u32le[num_items] items
+*                 end
+*
+*             Each field is a type (see template_type()) and a name.
+*             "endian big" or "endian little" sets the byte order of
+*             the fields after it , the default is little endian. The
+*             last structure is the one shown. Blank lines and text
+*             after a '#' are ignored.
+*
+*********************************************************************/
+
+static int load_template(char *template_file, STRUCT_TEMPLATE *tmpl)
+{
+	FILE	*input;
+	char	buffer[4096] , *ptr , *keyword , *name , *extra , *problem;
+	int		line_number , errors , in_struct , big_endian;
+	TEMPLATE_STRUCT	*structure;
+	TEMPLATE_OP	*field;
+
+	memset(tmpl,0,sizeof(STRUCT_TEMPLATE));
+	tmpl->fields = (TEMPLATE_OP *)calloc(TEMPLATE_MAX_FIELDS,sizeof(TEMPLATE_OP));
+	tmpl->structs = (TEMPLATE_STRUCT *)calloc(TEMPLATE_MAX_STRUCTS,
+							sizeof(TEMPLATE_STRUCT));
+	tmpl->program = (TEMPLATE_OP *)calloc(TEMPLATE_MAX_OPS,sizeof(TEMPLATE_OP));
+	tmpl->values = (unsigned long long *)calloc(TEMPLATE_MAX_OPS,
+							sizeof(unsigned long long));
+	tmpl->iterations = (long *)calloc(TEMPLATE_MAX_OPS,sizeof(long));
+	tmpl->window = (unsigned char *)malloc(TEMPLATE_WINDOW);
+	if ( tmpl->fields == NULL || tmpl->structs == NULL || tmpl->program == NULL ||
+				tmpl->values == NULL || tmpl->iterations == NULL ||
+				tmpl->window == NULL ) {
+		fprintf(stderr,"Out of memory\n");
+		return(-1);
+	} /* IF */
+	input = fopen(template_file,"r");
+	if ( input == NULL ) {
+		fprintf(stderr,"Can't open template file \"%s\" : %s\n",
+				template_file,strerror(errno));
+		return(-1);
+	} /* IF */
+	errors = 0;
+	in_struct = 0;
+	big_endian = 0;
+	structure = NULL;
+	for ( line_number = 1 ; fgets(buffer,sizeof(buffer),input) != NULL ;
+							++line_number ) {
+		ptr = strchr(buffer,'#');
+		if ( ptr != NULL ) {
+			*ptr = '\0';
+		} /* IF */
+		keyword = strtok(buffer," \t\r\n");
+		if ( keyword == NULL ) {
+			continue;
+		} /* IF */
+		name = strtok(NULL," \t\r\n");
+		extra = strtok(NULL," \t\r\n");
+		problem = NULL;
+		if ( strcmp(keyword,"struct") == 0 ) {
+			if ( in_struct || name == NULL || extra != NULL ||
+					strlen(name) >= TEMPLATE_MAX_NAME ||
+					tmpl->num_structs >= TEMPLATE_MAX_STRUCTS ) {
+				problem = "invalid struct";
+			} /* IF */
+			else {
+				structure = &tmpl->structs[tmpl->num_structs];
+				strcpy(structure->name,name);
+				structure->first = tmpl->num_fields;
+				structure->num_fields = 0;
+				in_struct = 1;
+			} /* ELSE */
+		} /* IF */
+		else if ( strcmp(keyword,"end") == 0 ) {
+			if ( ! in_struct || name != NULL ) {
+				problem = "unexpected end";
+			} /* IF */
+			else {
+				structure->size = template_size(tmpl,structure);
+				tmpl->num_structs += 1;
+				in_struct = 0;
+			} /* ELSE */
+		} /* ELSE IF */
+		else if ( strcmp(keyword,"endian") == 0 ) {
+			if ( name != NULL && extra == NULL && strcmp(name,"big") == 0 ) {
+				big_endian = 1;
+			} /* IF */
+			else if ( name != NULL && extra == NULL && strcmp(name,"little") == 0 ) {
+				big_endian = 0;
+			} /* ELSE IF */
+			else {
+				problem = "invalid byte order";
+			} /* ELSE */
+		} /* ELSE IF */
+		else if ( ! in_struct ) {
+			problem = "field outside of a struct";
+		} /* ELSE IF */
+		else {
+			field = &tmpl->fields[tmpl->num_fields];
+			if ( name == NULL || extra != NULL ||
+					strlen(name) >= TEMPLATE_MAX_NAME ||
+					tmpl->num_fields >= TEMPLATE_MAX_FIELDS ||
+					template_type(tmpl,keyword,big_endian,field) < 0 ) {
+				problem = "invalid field";
+			} /* IF */
+			else {
+				field->code = OP_FIELD;
+				strcpy(field->name,name);
+				structure->num_fields += 1;
+				tmpl->num_fields += 1;
+			} /* ELSE */
+		} /* ELSE */
+		if ( problem != NULL ) {
+			fprintf(stderr,"%s line %d : %s\n",template_file,line_number,problem);
+			errors += 1;
+		} /* IF */
+	} /* FOR */
+	fclose(input);
+	if ( in_struct ) {
+		fprintf(stderr,"%s : struct %s has no end\n",template_file,
+				structure->name);
+		errors += 1;
+	} /* IF */
+	else if ( tmpl->num_structs == 0 ) {
+		fprintf(stderr,"%s : no structs\n",template_file);
+		errors += 1;
+	} /* ELSE IF */
+	if ( errors > 0 ) {
+		return(-1);
+	} /* IF */
+
+	if ( template_expand(tmpl,tmpl->num_structs - 1,0) < 0 ) {
+		fprintf(stderr,"%s : more than %d steps to decode\n",template_file,
+				TEMPLATE_MAX_OPS);
+		return(-1);
+	} /* IF */
+	tmpl->record_size = tmpl->structs[tmpl->num_structs - 1].size;
+
+	return(0);
+} /* end of load_template */
+
+/*********************************************************************
+*
+* Function  : template_fetch
+*
+* Purpose   : Get bytes of the file for the template pane.
+*
+* Inputs    : STRUCT_TEMPLATE *tmpl - the template
+*             long offset - offset of bytes
+*             long length - number of bytes , at most TEMPLATE_WINDOW
+*
+* Output    : (none)
+*
+* Returns   : If available Then pointer to bytes Else NULL
+*
+* Example   : data = template_fetch(tmpl,offset,4L);
+*
+* Notes     : The bytes are read TEMPLATE_WINDOW at a time , as the
+*             fields being decoded are usually close together.
+*
+*********************************************************************/
+
+static unsigned char *template_fetch(STRUCT_TEMPLATE *tmpl, long offset,
+					long length)
+{
+	if ( offset < tmpl->window_offset ||
+			offset + length > tmpl->window_offset + tmpl->window_length ) {
+		tmpl->window_offset = offset;
+		tmpl->window_length = offset < filesize ? source_read(&input_source,
+							offset,tmpl->window,TEMPLATE_WINDOW) : 0L;
+		if ( tmpl->window_length < 0L ) {
+			tmpl->window_length = 0L;
+		} /* IF */
+	} /* IF */
+	if ( offset + length > tmpl->window_offset + tmpl->window_length ) {
+		return(NULL);
+	} /* IF */
+
+	return(&tmpl->window[offset - tmpl->window_offset]);
+} /* end of template_fetch */
+
+/*********************************************************************
+*
+* Function  : template_format
+*
+* Purpose   : Decode a field for the template pane.
+*
+* Inputs    : STRUCT_TEMPLATE *tmpl - the template
+*             int step - step of the field
+*             long offset - offset of the field
+*             long count - number of elements
+*             char *text - receives the value
+*             int width - width of the pane
+*
+* Output    : (none)
+*
+* Returns   : (nothing)
+*
+* Example   : template_format(tmpl,step,offset,count,text,width);
+*
+* Notes     : Only the elements of an array which fit are decoded. The
+*             first element is kept in tmpl->values , for the fields
+*             whose count it is.
+*
+*********************************************************************/
+
+static void template_format(STRUCT_TEMPLATE *tmpl, int step, long offset,
+					long count, char *text, int width)
+{
+	TEMPLATE_OP	*op;
+	unsigned char	*data;
+	unsigned long long	value;
+	unsigned int	bits;
+	long	shown , index , length;
+	int		byte , shift;
+	float	single;
+	double	number;
+
+	op = &tmpl->program[step];
+	shown = count;
+	if ( shown > (op->type == FIELD_CHAR ? width : TEMPLATE_MAX_SHOWN) ) {
+		shown = op->type == FIELD_CHAR ? width : TEMPLATE_MAX_SHOWN;
+	} /* IF */
+	tmpl->values[step] = 0;
+	data = template_fetch(tmpl,offset,shown * op->size);
+	if ( data == NULL ) {
+		strcpy(text,"<end of file>");
+		return;
+	} /* IF */
+
+	length = 0L;
+	if ( op->type == FIELD_CHAR ) {
+		text[length++] = '"';
+	} /* IF */
+	for ( index = 0L ; index < shown ; ++index ) {
+		value = 0;
+		for ( byte = 0 ; byte < op->size ; ++byte ) {
+			if ( op->big_endian ) {
+				value = (value << 8) | data[index * op->size + byte];
+			} /* IF */
+			else {
+				value |= (unsigned long long)data[index * op->size + byte] <<
+								(8 * byte);
+			} /* ELSE */
+		} /* FOR */
+		if ( index == 0L ) {
+			tmpl->values[step] = value;
+		} /* IF */
+		switch ( op->type ) {
+		case FIELD_UNSIGNED:
+			if ( count == 1L ) {
+				length += sprintf(&text[length],"%llu 0x%llx",value,value);
+			} /* IF */
+			else if ( op->size == 1 ) {
+				length += sprintf(&text[length],"%02llx ",value);
+			} /* ELSE IF */
+			else {
+				length += sprintf(&text[length],"%llu ",value);
+			} /* ELSE */
+			break;
+		case FIELD_SIGNED:
+			shift = 64 - 8 * op->size;
+			length += sprintf(&text[length],"%lld ",
+						(long long)(value << shift) >> shift);
+			break;
+		case FIELD_FLOAT:
+			if ( op->size == 4 ) {
+				bits = (unsigned int)value;
+				memcpy(&single,&bits,sizeof(single));
+				number = single;
+			} /* IF */
+			else {
+				memcpy(&number,&value,sizeof(number));
+			} /* ELSE */
+			length += sprintf(&text[length],"%g ",number);
+			break;
+		default:
+			text[length++] = isprint((int)value) ? (char)value : '.';
+		} /* SWITCH */
+	} /* FOR */
+	if ( op->type == FIELD_CHAR ) {
+		text[length++] = '"';
+	} /* IF */
+	strcpy(&text[length],shown < count ? "..." : "");
+
+	return;
+} /* end of template_format */
+
+/*********************************************************************
+*
+* Function  : template_row
+*
+* Purpose   : Put a row of text in the template pane.
+*
+* Inputs    : int row - the row , 0 for the first
+*             char *text - the text
+*             int attribute - A_NORMAL , A_REVERSE , ...
+*
+* Output    : (none)
+*
+* Returns   : (nothing)
+*
+* Example   : template_row(row,line,A_NORMAL);
+*
+* Notes     : The text is cut or padded to the width of the pane.
+*
+*********************************************************************/
+
+static void template_row(int row, char *text, int attribute)
+{
+	int		width;
+
+	width = getmaxx(template_win) - 2;
+	mvwprintw(template_win,row + 1,1,"%-*.*s",width,width,text);
+	mvwchgat(template_win,row + 1,1,width,attribute,0,NULL);
+
+	return;
+} /* end of template_row */
+
+/*********************************************************************
+*
+* Function  : template_draw
+*
+* Purpose   : Decode the records starting at the current offset into
+*             the template pane.
+*
+* Inputs    : (none)
+*
+* Output    : (none)
+*
+* Returns   : (nothing)
+*
+* Example   : template_draw();
+*
+* Notes     : The decode program is run from the current offset until
+*             the pane is full , record after record , so the time
+*             taken does not depend on the size of the file or of the
+*             records. Arrays of structures are shown one element
+*             after another. The window is not refreshed until the
+*             next doupdate().
+*
+*********************************************************************/
+
+static void template_draw()
+{
+	STRUCT_TEMPLATE	*tmpl;
+	TEMPLATE_OP	*op;
+	char	line[512] , value[256];
+	long	offset , start , record , count;
+	int		step , loop , row , num_rows , width , indent , array;
+
+	tmpl = &record_template;
+	if ( template_win == NULL ) {
+		return;
+	} /* IF */
+	num_rows = getmaxy(template_win) - 2;
+	width = getmaxx(template_win) - 2;
+	tmpl->window_length = 0L;	/* the file may have been changed */
+	box(template_win,'|','-');
+	wborder(template_win,0,0,0,0,0,0,0,0);
+	offset = current_file_offset;
+	row = 0;
+	for ( record = 0L ; row < num_rows && offset < filesize ; ++record ) {
+		start = offset;
+		sprintf(line,"%.*s %ld @ 0x%lx",TEMPLATE_MAX_NAME,
+			tmpl->structs[tmpl->num_structs - 1].name,record,offset);
+		template_row(row++,line,A_REVERSE);
+		for ( step = 0 ; step < tmpl->num_ops && row < num_rows ; ) {
+			op = &tmpl->program[step];
+			indent = op->depth < 8 ? op->depth : 8;
+			count = op->count;
+			if ( op->count_op >= 0 ) {
+				count = tmpl->values[op->count_op] > (unsigned long long)filesize ?
+						filesize : (long)tmpl->values[op->count_op];
+			} /* IF */
+			if ( op->code == OP_NEXT ) {
+				loop = op->jump;
+				tmpl->iterations[loop] += 1L;
+				step += 1;
+				if ( tmpl->iterations[loop] < (long)tmpl->values[loop] ) {
+					sprintf(line,"%*s[%ld]",indent + 1,"",tmpl->iterations[loop]);
+					template_row(row++,line,A_NORMAL);
+					step = loop + 1;
+				} /* IF */
+				continue;
+			} /* IF */
+			if ( op->code == OP_LOOP ) {
+				tmpl->values[step] = count;
+				tmpl->iterations[step] = 0L;
+				array = op->count_op >= 0 || op->count != 1L;
+				sprintf(line,array ? "%*s%s[%ld]" : "%*s%s",indent,"",
+						op->name,count);
+				template_row(row++,line,A_NORMAL);
+				if ( array && count > 0L && row < num_rows ) {
+					sprintf(line,"%*s[0]",indent + 1,"");
+					template_row(row++,line,A_NORMAL);
+				} /* IF */
+				step = count > 0L ? step + 1 : op->jump + 1;
+				continue;
+			} /* IF */
+			template_format(tmpl,step,offset,count,value,width);
+			sprintf(line,"%*s%-*s %s",indent,"",TEMPLATE_NAME_WIDTH - indent,
+					op->name,value);
+			template_row(row++,line,A_NORMAL);
+			offset += count * op->size;
+			step += 1;
+		} /* FOR */
+		if ( offset == start ) {
+			break;	/* nothing to decode */
+		} /* IF */
+	} /* FOR */
+	for ( ; row < num_rows ; ++row ) {
+		template_row(row,"",A_NORMAL);
+	} /* FOR */
+	wnoutrefresh(template_win);
+
+	return;
+} /* end of template_draw */
+
+/*********************************************************************
+*
+* Function  : read_records
+*
+* Purpose   : Read the records of the current block in record mode.
+*
+* Inputs    : (none)
+*
+* Output    : (none)
+*
+* Returns   : number of bytes read , -1L on error
+*
+* Example   : block_bytes = read_records();
+*
+* Notes     : The current offset is first moved back to the start of
+*             its record. The first record_size bytes of each record
+*             are put one after another in block_buffer.
+*
+*********************************************************************/
+
+static long read_records()
+{
+	long	number , offset , count , total;
+
+	if ( current_file_offset < record_first ) {
+		current_file_offset = record_first;
+	} /* IF */
+	current_file_offset -= (current_file_offset - record_first) % record_stride;
+	total = 0L;
+	block_end = current_file_offset;
+	for ( number = 0L ; number < records_per_block ; ++number ) {
+		offset = current_file_offset + number * record_stride;
+		if ( offset >= filesize ) {
+			break;
+		} /* IF */
+		count = source_read(&input_source,offset,
+					&block_buffer[number * record_size],record_size);
+		if ( count < 0L ) {
+			return(-1L);
+		} /* IF */
+		total += count;
+		block_end = offset + count;
+	} /* FOR */
+
+	return(total);
+} /* end of read_records */
+
+/*********************************************************************
+*
+* Function  : display_block
+*
+* Purpose   : Display a block of data
+*
+* Inputs    : (none)
+*
+* Output    : A hex/character dump of a block of data
+*
+* Returns   : (nothing)
+*
+* Example   : display_block();
+*
+* Notes     : This function displays the "current" block. Only the
+*             characters which differ from the previous display are
+*             sent to the terminal , unless data_frame has been
+*             invalidated by drawing something else in data_win.
+*
+*********************************************************************/
+
+static void display_block()
+{
+	long	block_offset , end , row_offset , number , part;
+	char	*line , summary[128];
+	int	row , num_bytes , col1 , length , other_bytes , other_length , start;
+
+	if ( record_size > 0L ) {
+		block_bytes = read_records();
+	} /* IF */
+	else {
+		block_bytes = source_read(&input_source,current_file_offset,
+						block_buffer,(long)blocksize);
+		block_end = current_file_offset + block_bytes;
+	} /* ELSE */
+	if ( block_bytes < 0L ) {
+		system_error("Can't read block at offset 0x%lx",
+				current_file_offset);
+		return;
+	}
+	end = block_bytes;
+	summary[0] = '\0';
+	if ( record_size > 0L ) {
+		sprintf(summary,", record %ld of %ld",
+			(current_file_offset - record_first) / record_stride,num_records);
+	} /* IF */
+	if ( search_hits.num_hits > 0L ) {
+		length = (int)strlen(summary);
+		sprintf(&summary[length],", hit %ld of %ld",
+			search_hits.current + 1L,search_hits.num_hits);
+	} /* IF */
+	if ( compare_name != NULL ) {
+		compare_bytes = source_read(&compare_source,current_file_offset,
+						compare_buffer,(long)blocksize);
+		if ( compare_bytes < 0L ) {
+			compare_bytes = 0L;
+		} /* IF */
+		if ( compare_bytes > end ) {
+			end = compare_bytes;
+		} /* IF */
+		length = (int)strlen(summary);
+		if ( file_diffs.current >= 0L ) {
+			sprintf(&summary[length],", diff %ld of %ld , %ld bytes differ",
+				file_diffs.current + 1L,file_diffs.num_ranges,
+				file_diffs.num_bytes);
+		} /* IF */
+		else {
+			sprintf(&summary[length],", %ld diffs , %ld bytes differ",
+				file_diffs.num_ranges,file_diffs.num_bytes);
+		} /* ELSE */
+	} /* IF */
+	status_message("File : %s%s, offset 0x%0*lx, size = %ld (0x%lx)%s",
+		filename,file_edits.dirty ? " [modified]" : "",
+		offset_width,current_file_offset,filesize,filesize,summary);
+	if ( ! data_frame.valid ) {
+		werase(data_win);
+		box(data_win,'|','-');
+		wborder(data_win,0,0,0,0,0,0,0,0);
+	} /* IF */
+	col1 = 2;
+	line = data_frame.text;
+	for ( row = 1 , block_offset = 0L ; row <= num_data_rows ;
+					++row , block_offset += num_pairs_bytes ) {
+		num_bytes = 0;
+		length = 0;
+		if ( record_size > 0L ) {
+			/* a part of a record , which are held one after another */
+			number = (row - 1) / record_rows;
+			part = ((row - 1) % record_rows) * (long)num_pairs_bytes;
+			row_offset = current_file_offset + number * record_stride + part;
+			if ( number < records_per_block && row_offset < filesize ) {
+				num_bytes = (int)(record_size - part < num_pairs_bytes ?
+								record_size - part : num_pairs_bytes);
+				if ( num_bytes > filesize - row_offset ) {
+					num_bytes = (int)(filesize - row_offset);
+				} /* IF */
+				length = format_row(line,row_offset,
+						&block_buffer[number * record_size + part],
+						num_bytes,num_pairs);
+			} /* IF */
+		} /* IF */
+		else if ( block_offset < end ) {
+			num_bytes = num_pairs_bytes;
+			if ( num_bytes > block_bytes - block_offset ) {
+				num_bytes = block_offset < block_bytes ?
+							(int)(block_bytes - block_offset) : 0;
+			} /* IF */
+			length = format_row(line,current_file_offset + block_offset,
+						&block_buffer[block_offset],num_bytes,num_pairs);
+		} /* IF */
+		if ( compare_name != NULL && block_offset < end ) {
+			/* the other file's bytes follow , without the offset column */
+			other_bytes = num_pairs_bytes;
+			if ( other_bytes > compare_bytes - block_offset ) {
+				other_bytes = block_offset < compare_bytes ?
+							(int)(compare_bytes - block_offset) : 0;
+			} /* IF */
+			other_length = format_row(compare_line,
+						current_file_offset + block_offset,
+						&compare_buffer[block_offset],other_bytes,num_pairs);
+			start = length - (7 * num_pairs + 2);
+			line[length++] = ' ';
+			memcpy(&line[length],&compare_line[start],other_length - start);
+			length += other_length - start;
+			if ( length < data_frame.num_cols ) {
+				memset(&line[length],' ',data_frame.num_cols - length);
+			} /* IF */
+			frame_draw_row(&data_frame,data_win,row,col1);
+			diff_highlight(row,col1,start,start + 7 * num_pairs + 3,
+				&block_buffer[block_offset],num_bytes,
+				&compare_buffer[block_offset],other_bytes);
+			continue;
+		} /* IF */
+		if ( length < data_frame.num_cols ) {
+			/* blank out the rest of the row , or all of it past end of file */
+			memset(&line[length],' ',data_frame.num_cols - length);
+		} /* IF */
+		if ( compare_name != NULL ) {
+			mvwchgat(data_win,row,col1,data_frame.num_cols,A_NORMAL,0,NULL);
+		} /* IF */
+		frame_draw_row(&data_frame,data_win,row,col1);
+	} /* FOR loop over all lines in block */
+	data_frame.valid = 1;
+	wnoutrefresh(data_win);
+	template_draw();
+	map_draw(-1L);
+	doupdate();
+
+	return;
+} /* end of display_block */
+
+/*********************************************************************
+*
+* Function  : show_help
+*
+* Purpose   : Display a help screen.
+*
+* Inputs    : (none)
+*
+* Output    : The help screen
+*
+* Returns   : (nothing)
+*
+* Example   : show_help();
+*
+* Notes     : (none)
+*
+*********************************************************************/
+
+static void show_help()
+{
+	int	row , col , first_row , count;
+	char	buffer[256];
+
+	wclear(data_win);
+	box(data_win,'|','-');
+	wborder(data_win,0,0,0,0,0,0,0,0);
+	col = 2;
+	row = 2;
+	mvwaddstr(data_win,row++,col,"Available Commands :");
+	col += 4;
+	row += 1;
+	first_row = row;
+	for ( count = 0 ; help_lines[count] != NULL ; ++count ) {
+		if ( row >= num_lines - 7 ) {
+			/* out of room , continue in a second column */
+			row = first_row;
+			col = num_cols / 2;
+		} /* IF */
+		mvwaddnstr(data_win,row++,col,help_lines[count],num_cols - col - 1);
+	} /* FOR */
+	sprintf(buffer,"Rows : %d , Cols : %d",tty_num_rows,tty_num_cols);
+	mvwaddnstr(data_win,row++,col,buffer,num_cols - col - 1);
+	if ( input_source.cache != NULL ) {
+		sprintf(buffer,"Page cache : %ld hits , %ld misses , %ld prefetched",
+				input_source.cache->hits,input_source.cache->misses,
+				input_source.cache->prefetched);
+		mvwaddnstr(data_win,row++,col,buffer,num_cols - col - 1);
+	} /* IF */
+	wrefresh(data_win);
+	message("Press any key to continue.");
+	wgetch(msg_win);
+
+	data_frame.valid = 0;
+	display_block();
+	return;
+} /* end of show_help */
+
+/*********************************************************************
+*
+* Function  : write_current_block
+*
+* Purpose   : Write current block to a file.
+*
+* Inputs    : (none)
+*
+* Output    : Current block is written to a file.
+*
+* Returns   : (nothing)
+*
+* Example   : write_current_block();
+*
+* Notes     : (none)
+*
+*********************************************************************/
+
+int write_current_block()
+{
+	char	filename[100];
+	FILE	*output;
+
+	get_string("Enter filename : ",filename);
+	while ( NE(filename,"$") && access(filename,F_OK) == 0 ) {
+		get_string("File exists, try again : ",filename);
+	} /* WHILE */
+	if ( NE(filename,"$") ) {
+		output = fopen(filename,"w");
+		if ( output == NULL ) {
+			system_error("Can't open file \"%s\"",
+					filename);
+		} /* IF */
+		else {
+			if ( fwrite(block_buffer,block_bytes,1,output) != 1 ) {
+				system_error("Write failed");
+			} /* IF */
+			fclose(output);
+		} /* ELSE */
+	} /* IF */
+
+	return(0);
+} /* end of write_current_block */
+
+/*********************************************************************
+*
+* Function  : rewrite_file
+*
+* Purpose   : Replace the file by its edited contents.
+*
+* Inputs    : (none)
+*
+* Output    : The edited file is written to a temporary file which is
+*             then renamed over the original.
+*
+* Returns   : 0 --> success , -1 --> error
+*
+* Example   : rewrite_file();
+*
+* Notes     : Needed once bytes have been inserted or deleted. The
+*             rename is atomic , so the file is never seen half
+*             written. The temporary file becomes the open file and
+*             is mapped in place of the original. Other hard links to
+*             the original file keep the old contents.
+*
+*********************************************************************/
+
+static int rewrite_file()
+{
+	char	*temp_name;
+	int		temp_fd , error;
+	struct stat	stats;
+
+	if ( ! S_ISREG(filestats.st_mode) ) {
+		errno = EINVAL;
+		return(-1);
+	} /* IF */
+	temp_name = (char *)malloc(strlen(filename) + 16);
+	if ( temp_name == NULL ) {
+		return(-1);
+	} /* IF */
+	sprintf(temp_name,"%s.hedXXXXXX",filename);
+	temp_fd = mkstemp(temp_name);
+	if ( temp_fd < 0 ) {
+		free(temp_name);
+		return(-1);
+	} /* IF */
+	if ( fchown(temp_fd,filestats.st_uid,filestats.st_gid) < 0 ) {
+		debug_print("fchown failed (%s)\n",strerror(errno));
+	} /* IF */
+	if ( fchmod(temp_fd,filestats.st_mode & 07777) < 0 ||
+			edit_stream(&file_edits,&input_source,temp_fd) < 0 ||
+			fsync(temp_fd) < 0 || fstat(temp_fd,&stats) < 0 ||
+			rename(temp_name,filename) < 0 ) {
+		error = errno;
+		close(temp_fd);
+		unlink(temp_name);
+		free(temp_name);
+		errno = error;
+		return(-1);
+	} /* IF */
+	free(temp_name);
+	if ( input_source.direct ) {
+		fcntl(temp_fd,F_SETFL,fcntl(temp_fd,F_GETFL) | O_DIRECT);
+	} /* IF */
+
+	source_close(&input_source);
+	close(input_fd);
+	input_fd = temp_fd;
+	filestats = stats;
+	if ( source_open(&input_source,input_fd,&filestats) < 0 ) {
+		return(-1);
+	} /* IF */
+	input_source.edits = &file_edits;
+
+	return(edit_reset(&file_edits,input_source.size));
+} /* end of rewrite_file */
+
+/*********************************************************************
+*
+* Function  : save_changes
+*
+* Purpose   : Write all changes back to the file.
+*
+* Inputs    : (none)
+*
+* Output    : Changed bytes are written back to file.
+*
+* Returns   : (nothing)
+*
+* Example   : save_changes();
+*
+* Notes     : When the size of the file was not changed only the
+*             modified bytes are written , otherwise the whole file
+*             is rewritten.
+*
+*********************************************************************/
+
+void save_changes()
+{
+	int		status;
+
+	if ( ! opt_w ) {
+		message("Can't update a read-only file. Press any key to continue.");
+		wgetch(msg_win);
+		return;
+	} /* IF */
+	if ( ! file_edits.dirty ) {
+		error_message("No changes to save");
+		return;
+	} /* IF */
+
+	if ( file_edits.resized ) {
+		status_message("Rewriting %s ...",filename);
+		status = rewrite_file();
+	} /* IF */
+	else {
+		status = edit_commit(&file_edits,&input_source);
+	} /* ELSE */
+	if ( status < 0 ) {
+		system_error("Write failed");
+	} /* IF */
+	set_file_size();
+	display_block();
+} /* end of save_changes */
+
+/*********************************************************************
+*
+* Function  : get_hex_byte
+*
+* Purpose   : Get a hexadecimal byte value from the user
+*
+* Inputs    : char *prompt - the input prompt
+*
+* Output    : (none)
+*
+* Returns   : long number - the numeric value
+*
+* Example   : count = get_hex_byte("Enter : ");
+*
+* Notes     : (none)
+*
+*********************************************************************/
+
+static unsigned char get_hex_byte(char *prompt)
+{
+	int	num_digits;
+	long	number;
+	char	digit , digits[100];
+	unsigned char	hex_byte;
+
+	message("%s",prompt);
+	digit = (char)wgetch(msg_win);
+	for ( num_digits = 0 ; !isspace(digit) ; ++num_digits ) {
+		waddch(msg_win,digit);
+		wrefresh(msg_win);
+		digits[num_digits] = digit;
+		digit = (char)wgetch(msg_win);
+	} /* WHILE */
+	digits[num_digits] = '\0';
+	if ( num_digits < 1 || num_digits > 2 ) {
 		error_message("Bad number of hex digits");
 		return('\0');
 	} /* IF */
-	if ( sscanf(digits,"%lx",&number) != 1 ) {
-		error_message("bad hex data : %s",digits);
-		hex_byte = 0;
+	if ( sscanf(digits,"%lx",&number) != 1 ) {
+		error_message("bad hex data : %s",digits);
+		hex_byte = 0;
+	} /* IF */
+	else {
+		hex_byte = (unsigned char)(number & 0x000000ff);
+	} /* ELSE */
+
+	return(hex_byte);
+} /* end of get_hex_byte */
+
+/*********************************************************************
+*
+* Function  : change_block_byte
+*
+* Purpose   : Change the value of a single byte
+*
+* Inputs    : (none)
+*
+* Output    : (none)
+*
+* Returns   : zero
+*
+* Example   : change_block_byte();
+*
+* Notes     : The change is held in memory until saved with the
+*             s command.
+*
+*********************************************************************/
+
+int change_block_byte()
+{
+	unsigned char	byte , prompt[100];
+	long	file_offset;
+
+	file_offset = get_number("Enter file offset :");
+	if ( file_offset < current_file_offset ||
+		file_offset >= block_end ) {
+		error_message("Offset not in current block");
+		return(1);
+	} /* IF */
+	sprintf((char *)prompt,"Enter hex value for byte at 0x%lx:",
+			file_offset);
+	byte = get_hex_byte((char *)prompt);
+	if ( change_bytes(file_offset,1L,&byte,1L) < 0 ) {
+		error_message("Can't record change");
+		return(1);
+	} /* IF */
+	display_block();
+
+	return(0);
+} /* end of change_block_byte */
+
+/*********************************************************************
+*
+* Function  : hex_digit_value
+*
+* Purpose   : Convert a hexadecimal digit to its value.
+*
+* Inputs    : int ch - the character
+*
+* Output    : (none)
+*
+* Returns   : value of digit or -1 if not a hex digit
+*
+* Example   : value = hex_digit_value('c');
+*
+* Notes     : (none)
+*
+*********************************************************************/
+
+static int hex_digit_value(int ch)
+{
+	if ( ch >= '0' && ch <= '9' ) {
+		return(ch - '0');
+	} /* IF */
+	if ( ch >= 'a' && ch <= 'f' ) {
+		return(ch - 'a' + 10);
+	} /* IF */
+	if ( ch >= 'A' && ch <= 'F' ) {
+		return(ch - 'A' + 10);
+	} /* IF */
+
+	return(-1);
+} /* end of hex_digit_value */
+
+/*********************************************************************
+*
+* Function  : parse_escape
+*
+* Purpose   : Parse a backslash escape sequence of a search pattern.
+*
+* Inputs    : char **text - pointer to the character after the '\',
+*                           advanced past the escape sequence
+*             unsigned char *byte - receives the byte value
+*             unsigned char *mask - receives the byte mask
+*
+* Output    : (none)
+*
+* Returns   : 0 --> success , -1 --> bad escape sequence
+*
+* Example   : parse_escape(&ptr,&byte,&mask);
+*
+* Notes     : \? is a wildcard byte.
+*
+*********************************************************************/
+
+static int parse_escape(char **text, unsigned char *byte, unsigned char *mask)
+{
+	char	*ptr;
+	int		high , low;
+
+	ptr = *text;
+	*mask = 0xff;
+	switch ( *ptr ) {
+	case 'n':
+		*byte = '\n';
+		break;
+	case 'r':
+		*byte = '\r';
+		break;
+	case 't':
+		*byte = '\t';
+		break;
+	case '0':
+		*byte = '\0';
+		break;
+	case '?':
+		*byte = 0;
+		*mask = 0;
+		break;
+	case 'x':
+		high = hex_digit_value(ptr[1]);
+		low = high < 0 ? -1 : hex_digit_value(ptr[2]);
+		if ( low < 0 ) {
+			return(-1);
+		} /* IF */
+		*byte = (unsigned char)((high << 4) | low);
+		ptr += 2;
+		break;
+	case '\0':
+		return(-1);
+	default:
+		*byte = (unsigned char)*ptr;
+	} /* SWITCH */
+	*text = ptr + 1;
+
+	return(0);
+} /* end of parse_escape */
+
+/*********************************************************************
+*
+* Function  : compile_pattern
+*
+* Purpose   : Convert the text of a search pattern into the bytes and
+*             masks used by the matcher.
+*
+* Inputs    : char *text - pattern text
+*             SEARCH_PATTERN *pattern - receives compiled pattern
+*
+* Output    : (none)
+*
+* Returns   : 0 --> success , -1 --> syntax error
+*
+* Example   : compile_pattern("=7f 45 4c 46",&pattern);
+*
+* Notes     : Text starting with '=' is a list of hex bytes, where
+*             "??" is any byte, "4?" or "?4" match one nibble and
+*             "..." is a quoted ASCII string. Any other text is ASCII.
+*             Backslash escapes (\n \r \t \0 \xNN \? \\ \" \=) may be
+*             used in ASCII text.
+*
+*********************************************************************/
+
+static int compile_pattern(char *text, SEARCH_PATTERN *pattern)
+{
+	char	*ptr;
+	int		length , high , low , quoted , index;
+	unsigned char	byte , mask;
+
+	length = 0;
+	ptr = text;
+	quoted = *ptr != '=';
+	if ( ! quoted ) {
+		ptr += 1;
+	} /* IF */
+	while ( *ptr != '\0' ) {
+		if ( ! quoted && isspace((unsigned char)*ptr) ) {
+			ptr += 1;
+			continue;
+		} /* IF */
+		if ( *ptr == '"' && text[0] == '=' ) {
+			quoted = ! quoted;
+			ptr += 1;
+			continue;
+		} /* IF */
+		if ( length >= SEARCH_MAX_PATTERN ) {
+			return(-1);
+		} /* IF */
+		if ( quoted ) {
+			if ( *ptr == '\\' ) {
+				ptr += 1;
+				if ( parse_escape(&ptr,&byte,&mask) < 0 ) {
+					return(-1);
+				} /* IF */
+			} /* IF */
+			else {
+				byte = (unsigned char)*ptr++;
+				mask = 0xff;
+			} /* ELSE */
+		} /* IF */
+		else {
+			if ( ptr[1] == '\0' ) {
+				return(-1);
+			} /* IF */
+			high = ptr[0] == '?' ? 0 : hex_digit_value(ptr[0]);
+			low = ptr[1] == '?' ? 0 : hex_digit_value(ptr[1]);
+			if ( high < 0 || low < 0 ) {
+				return(-1);
+			} /* IF */
+			byte = (unsigned char)((high << 4) | low);
+			mask = (unsigned char)((ptr[0] == '?' ? 0x00 : 0xf0) |
+								(ptr[1] == '?' ? 0x00 : 0x0f));
+			ptr += 2;
+		} /* ELSE */
+		pattern->bytes[length] = byte & mask;
+		pattern->mask[length] = mask;
+		length += 1;
+	} /* WHILE */
+	if ( length == 0 || (text[0] == '=' && quoted) ) {
+		return(-1);
+	} /* IF */
+
+	pattern->length = length;
+	pattern->exact = 1;
+	pattern->first = -1;
+	pattern->last = -1;
+	for ( index = 0 ; index < length ; ++index ) {
+		if ( pattern->mask[index] != 0xff ) {
+			pattern->exact = 0;
+		} /* IF */
+		else {
+			if ( pattern->first < 0 ) {
+				pattern->first = index;
+			} /* IF */
+			pattern->last = index;
+		} /* ELSE */
+	} /* FOR */
+	if ( pattern->first < 0 ) {
+		/* no exact bytes , use any partially specified ones */
+		for ( index = 0 ; index < length ; ++index ) {
+			if ( pattern->mask[index] != 0 ) {
+				if ( pattern->first < 0 ) {
+					pattern->first = index;
+				} /* IF */
+				pattern->last = index;
+			} /* IF */
+		} /* FOR */
+	} /* IF */
+
+	return(0);
+} /* end of compile_pattern */
+
+/*********************************************************************
+*
+* Function  : get_pattern
+*
+* Purpose   : Get a search pattern from the user and compile it
+*
+* Inputs    : char *prompt - the input prompt
+*             SEARCH_PATTERN *pattern - receives compiled pattern
+*
+* Output    : (none)
+*
+* Returns   : 0 --> pattern entered , -1 --> no pattern or bad pattern
+*
+* Example   : get_pattern("Enter pattern : ",&pattern);
+*
+* Notes     : See compile_pattern() for the pattern syntax.
+*
+*********************************************************************/
+
+static int get_pattern(char *prompt, SEARCH_PATTERN *pattern)
+{
+	char	text[SEARCH_MAX_PATTERN * 4];
+
+	get_line(prompt,text,sizeof(text));
+	if ( text[0] == '\0' ) {
+		return(-1);
+	} /* IF */
+	strcpy(last_pattern,text);
+	if ( compile_pattern(text,pattern) < 0 ) {
+		error_message("Invalid search pattern");
+		return(-1);
+	} /* IF */
+
+	return(0);
+} /* end of get_pattern */
+
+/*********************************************************************
+*
+* Function  : insert_bytes
+*
+* Purpose   : Insert bytes into the file.
+*
+* Inputs    : (none)
+*
+* Output    : (none)
+*
+* Returns   : 0 --> success , 1 --> error
+*
+* Example   : insert_bytes();
+*
+* Notes     : The bytes are entered like a search pattern , as text or
+*             as =hex bytes , but without wildcards. They may be
+*             inserted at any offset in the current block or at the
+*             end of the file.
+*
+*********************************************************************/
+
+static int insert_bytes()
+{
+	long	file_offset;
+	SEARCH_PATTERN	pattern;
+
+	file_offset = get_number("Enter file offset :");
+	if ( file_offset < current_file_offset ||
+				file_offset > block_end ) {
+		error_message("Offset not in current block");
+		return(1);
+	} /* IF */
+	if ( get_pattern("Enter bytes to insert : ",&pattern) < 0 ) {
+		return(1);
+	} /* IF */
+	if ( ! pattern.exact ) {
+		error_message("Wildcards can't be inserted");
+		return(1);
+	} /* IF */
+	if ( change_bytes(file_offset,0L,pattern.bytes,(long)pattern.length) < 0 ) {
+		error_message("Can't record change");
+		return(1);
+	} /* IF */
+	display_block();
+
+	return(0);
+} /* end of insert_bytes */
+
+/*********************************************************************
+*
+* Function  : delete_bytes
+*
+* Purpose   : Delete bytes from the file.
+*
+* Inputs    : (none)
+*
+* Output    : (none)
+*
+* Returns   : 0 --> success , 1 --> error
+*
+* Example   : delete_bytes();
+*
+* Notes     : The deletion starts in the current block but may extend
+*             to the end of the file.
+*
+*********************************************************************/
+
+static int delete_bytes()
+{
+	long	file_offset , count;
+
+	file_offset = get_number("Enter file offset :");
+	if ( file_offset < current_file_offset ||
+				file_offset >= block_end ) {
+		error_message("Offset not in current block");
+		return(1);
+	} /* IF */
+	count = get_number("Enter number of bytes to delete :");
+	if ( count <= 0L ) {
+		error_message("Invalid number of bytes");
+		return(1);
+	} /* IF */
+	if ( count > filesize - file_offset ) {
+		count = filesize - file_offset;
+	} /* IF */
+	if ( change_bytes(file_offset,count,NULL,0L) < 0 ) {
+		error_message("Can't record change");
+		return(1);
+	} /* IF */
+	display_block();
+
+	return(0);
+} /* end of delete_bytes */
+
+/*********************************************************************
+*
+* Function  : pattern_matches
+*
+* Purpose   : Check if a search pattern matches data.
+*
+* Inputs    : const unsigned char *data - data to be checked
+*             const SEARCH_PATTERN *pattern - compiled pattern
+*
+* Output    : (none)
+*
+* Returns   : 1 --> match , 0 --> no match
+*
+* Example   : if ( pattern_matches(&data[index],pattern) ) ...
+*
+* Notes     : data must hold at least pattern->length bytes.
+*
+*********************************************************************/
+
+static int pattern_matches(const unsigned char *data,
+						const SEARCH_PATTERN *pattern)
+{
+	int		index;
+#if defined(__SSE2__)
+	__m128i	block;
+#endif
+
+	if ( pattern->exact ) {
+		return(memcmp(data,pattern->bytes,pattern->length) == 0);
+	} /* IF */
+	index = 0;
+#if defined(__SSE2__)
+	for ( ; index + 16 <= pattern->length ; index += 16 ) {
+		block = _mm_and_si128(_mm_loadu_si128((const __m128i *)&data[index]),
+				_mm_loadu_si128((const __m128i *)&pattern->mask[index]));
+		block = _mm_cmpeq_epi8(block,
+				_mm_loadu_si128((const __m128i *)&pattern->bytes[index]));
+		if ( _mm_movemask_epi8(block) != 0xffff ) {
+			return(0);
+		} /* IF */
+	} /* FOR */
+#endif
+	for ( ; index < pattern->length ; ++index ) {
+		if ( (data[index] & pattern->mask[index]) != pattern->bytes[index] ) {
+			return(0);
+		} /* IF */
+	} /* FOR */
+
+	return(1);
+} /* end of pattern_matches */
+
+/*********************************************************************
+*
+* Function  : find_forward
+*
+* Purpose   : Find the first occurrence of a search pattern in a buffer.
+*
+* Inputs    : const unsigned char *data - buffer to be searched
+*             long length - number of bytes in buffer
+*             const SEARCH_PATTERN *pattern - compiled search pattern
+*
+* Output    : (none)
+*
+* Returns   : If found Then index of match Else -1L
+*
+* Example   : index = find_forward(data,num_bytes,&pattern);
+*
+* Notes     : Candidate positions are located with a SIMD compare of
+*             two anchor bytes of the pattern (normally the first and
+*             last fully specified bytes) over 16 (SSE2) or 32 (AVX2)
+*             positions at a time, then verified. Builds without SIMD
+*             support use Boyer-Moore-Horspool for exact patterns.
+*
+*********************************************************************/
+
+static long find_forward(const unsigned char *data, long length,
+						const SEARCH_PATTERN *pattern)
+{
+	long	index , last;
+	int		first_anchor , last_anchor;
+	const unsigned char	*ptr;
+#if defined(SEARCH_LANES)
+	SEARCH_VECTOR	first_bytes , last_bytes , first_mask , last_mask;
+	SEARCH_VECTOR	block_first , block_last;
+	unsigned int	mask;
+	int		bit;
+#else
+	long	skip[256];
+	int		count;
+#endif
+
+	if ( pattern->length <= 0 || pattern->length > length ) {
+		return(-1L);
+	} /* IF */
+	last = length - pattern->length;
+	first_anchor = pattern->first;
+	last_anchor = pattern->last;
+	if ( first_anchor < 0 ) {
+		return(0L);	/* nothing but wildcards */
+	} /* IF */
+	if ( pattern->length == 1 && pattern->exact ) {
+		ptr = (const unsigned char *)memchr(data,pattern->bytes[0],length);
+		return(ptr == NULL ? -1L : (long)(ptr - data));
+	} /* IF */
+	index = 0L;
+
+#if defined(SEARCH_LANES)
+	first_bytes = SEARCH_SPLAT(pattern->bytes[first_anchor]);
+	last_bytes = SEARCH_SPLAT(pattern->bytes[last_anchor]);
+	first_mask = SEARCH_SPLAT(pattern->mask[first_anchor]);
+	last_mask = SEARCH_SPLAT(pattern->mask[last_anchor]);
+	for ( ; index + SEARCH_LANES - 1 <= last ; index += SEARCH_LANES ) {
+		block_first = SEARCH_AND(SEARCH_LOAD(&data[index + first_anchor]),
+							first_mask);
+		block_last = SEARCH_AND(SEARCH_LOAD(&data[index + last_anchor]),
+							last_mask);
+		mask = SEARCH_MATCH(first_bytes,block_first,last_bytes,block_last);
+		while ( mask != 0 ) {
+			bit = __builtin_ctz(mask);
+			if ( pattern_matches(&data[index+bit],pattern) ) {
+				return(index + bit);
+			} /* IF */
+			mask &= mask - 1;
+		} /* WHILE */
+	} /* FOR */
+#else
+	if ( pattern->exact ) {
+		for ( count = 0 ; count < 256 ; ++count ) {
+			skip[count] = pattern->length;
+		} /* FOR */
+		for ( count = 0 ; count < pattern->length - 1 ; ++count ) {
+			skip[pattern->bytes[count]] = pattern->length - 1 - count;
+		} /* FOR */
+		while ( index <= last ) {
+			if ( memcmp(&data[index],pattern->bytes,pattern->length) == 0 ) {
+				return(index);
+			} /* IF */
+			index += skip[data[index+pattern->length-1]];
+		} /* WHILE */
+		return(-1L);
+	} /* IF */
+#endif
+	for ( ; index <= last ; ++index ) {
+		if ( (data[index+first_anchor] & pattern->mask[first_anchor]) ==
+						pattern->bytes[first_anchor] &&
+				pattern_matches(&data[index],pattern) ) {
+			return(index);
+		} /* IF */
+	} /* FOR */
+
+	return(-1L);
+} /* end of find_forward */
+
+/*********************************************************************
+*
+* Function  : find_backward
+*
+* Purpose   : Find the last occurrence of a search pattern in a buffer.
+*
+* Inputs    : const unsigned char *data - buffer to be searched
+*             long length - number of bytes in buffer
+*             const SEARCH_PATTERN *pattern - compiled search pattern
+*
+* Output    : (none)
+*
+* Returns   : If found Then index of match Else -1L
+*
+* Example   : index = find_backward(data,num_bytes,&pattern);
+*
+* Notes     : Mirror image of find_forward().
+*
+*********************************************************************/
+
+static long find_backward(const unsigned char *data, long length,
+						const SEARCH_PATTERN *pattern)
+{
+	long	index , last;
+	int		first_anchor , last_anchor;
+#if defined(SEARCH_LANES)
+	SEARCH_VECTOR	first_bytes , last_bytes , first_mask , last_mask;
+	SEARCH_VECTOR	block_first , block_last;
+	unsigned int	mask;
+	long	base;
+	int		bit;
+#else
+	long	skip[256];
+	int		count;
+#endif
+
+	if ( pattern->length <= 0 || pattern->length > length ) {
+		return(-1L);
+	} /* IF */
+	last = length - pattern->length;
+	first_anchor = pattern->first;
+	last_anchor = pattern->last;
+	if ( first_anchor < 0 ) {
+		return(last);	/* nothing but wildcards */
+	} /* IF */
+	index = last;
+
+#if defined(SEARCH_LANES)
+	first_bytes = SEARCH_SPLAT(pattern->bytes[first_anchor]);
+	last_bytes = SEARCH_SPLAT(pattern->bytes[last_anchor]);
+	first_mask = SEARCH_SPLAT(pattern->mask[first_anchor]);
+	last_mask = SEARCH_SPLAT(pattern->mask[last_anchor]);
+	for ( ; index >= SEARCH_LANES - 1 ; index -= SEARCH_LANES ) {
+		base = index - (SEARCH_LANES - 1);
+		block_first = SEARCH_AND(SEARCH_LOAD(&data[base + first_anchor]),
+							first_mask);
+		block_last = SEARCH_AND(SEARCH_LOAD(&data[base + last_anchor]),
+							last_mask);
+		mask = SEARCH_MATCH(first_bytes,block_first,last_bytes,block_last);
+		while ( mask != 0 ) {
+			bit = 31 - __builtin_clz(mask);
+			if ( pattern_matches(&data[base+bit],pattern) ) {
+				return(base + bit);
+			} /* IF */
+			mask &= ~(1U << bit);
+		} /* WHILE */
+	} /* FOR */
+#else
+	if ( pattern->exact ) {
+		for ( count = 0 ; count < 256 ; ++count ) {
+			skip[count] = pattern->length;
+		} /* FOR */
+		for ( count = pattern->length - 1 ; count > 0 ; --count ) {
+			skip[pattern->bytes[count]] = count;
+		} /* FOR */
+		while ( index >= 0L ) {
+			if ( memcmp(&data[index],pattern->bytes,pattern->length) == 0 ) {
+				return(index);
+			} /* IF */
+			index -= skip[data[index]];
+		} /* WHILE */
+		return(-1L);
+	} /* IF */
+#endif
+	for ( ; index >= 0L ; --index ) {
+		if ( (data[index+first_anchor] & pattern->mask[first_anchor]) ==
+						pattern->bytes[first_anchor] &&
+				pattern_matches(&data[index],pattern) ) {
+			return(index);
+		} /* IF */
+	} /* FOR */
+
+	return(-1L);
+} /* end of find_backward */
+
+/*********************************************************************
+*
+* Function  : search_forward
+*
+* Purpose   : Search a range of a data source forward for a byte string.
+*
+* Inputs    : DATA_SOURCE *source - data source
+*             long start - first offset at which a match may start
+*             long limit - matches must start before this offset
+*                          (-1L means end of file)
+*             const SEARCH_PATTERN *pattern - compiled search pattern
+*             unsigned char *buffer - read buffer of at least
+*                       search_chunk_size + SEARCH_MAX_PATTERN bytes
+*             SEARCH_CONTROL *control - if not NULL , receives a count
+*                       of bytes searched and is polled for cancellation
+*
+* Output    : (none)
+*
+* Returns   : If found Then file offset of match
+*             Else If not found Then -1L
+*             Else -2L (read error) or -3L (cancelled)
+*
+* Example   : offset = search_forward(&input_source,0L,-1L,&pattern,
+*                               temp_buffer,NULL);
+*
+* Notes     : The range is read in chunks aligned on search_chunk_size
+*             boundaries. Each chunk is extended by pattern length - 1
+*             bytes so that matches straddling two chunks are found.
+*
+*********************************************************************/
+
+static long search_forward(DATA_SOURCE *source, long start, long limit,
+				const SEARCH_PATTERN *pattern, unsigned char *buffer,
+				SEARCH_CONTROL *control)
+{
+	long	offset , chunk , overlap , num_bytes , index;
+	unsigned char	*data;
+
+	overlap = pattern->length - 1;
+	for ( offset = start ; limit < 0L || offset < limit ; offset += chunk ) {
+		if ( control != NULL && control->cancel ) {
+			return(-3L);
+		} /* IF */
+		chunk = search_chunk_size - (offset % search_chunk_size);
+		if ( limit >= 0L && offset + chunk > limit ) {
+			chunk = limit - offset;
+		} /* IF */
+		if ( control != NULL ) {
+			control->bytes_searched += chunk;
+		} /* IF */
+		data = source_view(source,offset,chunk + overlap,buffer,&num_bytes);
+		if ( data == NULL ) {
+			return(-2L);
+		} /* IF */
+		index = find_forward(data,num_bytes,pattern);
+		if ( index >= 0L && (limit < 0L || offset + index < limit) ) {
+			return(offset + index);
+		} /* IF */
+		if ( num_bytes < chunk + overlap ) {
+			break;	/* reached end of file */
+		} /* IF */
+	} /* FOR */
+
+	return(-1L);
+} /* end of search_forward */
+
+/*********************************************************************
+*
+* Function  : search_backward
+*
+* Purpose   : Search a range of a data source backward for a byte string.
+*
+* Inputs    : DATA_SOURCE *source - data source
+*             long start - last offset at which a match may start
+*             long limit - first offset at which a match may start
+*             const SEARCH_PATTERN *pattern - compiled search pattern
+*             unsigned char *buffer - read buffer of at least
+*                       search_chunk_size + SEARCH_MAX_PATTERN bytes
+*             SEARCH_CONTROL *control - if not NULL , receives a count
+*                       of bytes searched and is polled for cancellation
+*
+* Output    : (none)
+*
+* Returns   : If found Then file offset of match
+*             Else If not found Then -1L
+*             Else -2L (read error) or -3L (cancelled)
+*
+* Example   : offset = search_backward(&input_source,offset,0L,&pattern,
+*                               temp_buffer,NULL);
+*
+* Notes     : Chunks are processed from the end of the range towards
+*             its start, each one extended past its end by
+*             pattern length - 1 bytes.
+*
+*********************************************************************/
+
+static long search_backward(DATA_SOURCE *source, long start, long limit,
+				const SEARCH_PATTERN *pattern, unsigned char *buffer,
+				SEARCH_CONTROL *control)
+{
+	long	offset , end , num_bytes , index;
+	unsigned char	*data;
+
+	for ( end = start + 1L ; end > limit ; end = offset ) {
+		if ( control != NULL && control->cancel ) {
+			return(-3L);
+		} /* IF */
+		offset = ((end - 1L) / search_chunk_size) * search_chunk_size;
+		if ( offset < limit ) {
+			offset = limit;
+		} /* IF */
+		if ( control != NULL ) {
+			control->bytes_searched += end - offset;
+		} /* IF */
+		data = source_view(source,offset,end - offset + pattern->length - 1,
+						buffer,&num_bytes);
+		if ( data == NULL ) {
+			return(-2L);
+		} /* IF */
+		index = find_backward(data,num_bytes,pattern);
+		if ( index >= 0L ) {
+			return(offset + index);
+		} /* IF */
+	} /* FOR */
+
+	return(-1L);
+} /* end of search_backward */
+
+/*********************************************************************
+*
+* Function  : search_segment_range
+*
+* Purpose   : Compute the range of match start offsets covered by one
+*             segment of a parallel search.
+*
+* Inputs    : SEARCH_JOB *job - the search
+*             long segment - segment number , 0 is nearest the start
+*             long *low - receives first offset in segment
+*             long *high - receives last offset in segment
+*
+* Output    : (none)
+*
+* Returns   : (nothing)
+*
+* Example   : search_segment_range(job,segment,&low,&high);
+*
+* Notes     : Segments are aligned on segment_size boundaries and are
+*             numbered in the direction of the search.
+*
+*********************************************************************/
+
+static void search_segment_range(SEARCH_JOB *job, long segment,
+					long *low, long *high)
+{
+	long	base;
+
+	if ( job->direction > 0 ) {
+		base = (job->start / job->segment_size + segment) * job->segment_size;
+		*low = base < job->start ? job->start : base;
+		*high = base + job->segment_size - 1L;
+	} /* IF */
+	else {
+		base = (job->start / job->segment_size - segment) * job->segment_size;
+		*low = base;
+		*high = base + job->segment_size - 1L;
+		if ( *high > job->start ) {
+			*high = job->start;
+		} /* IF */
+	} /* ELSE */
+
+	return;
+} /* end of search_segment_range */
+
+/*********************************************************************
+*
+* Function  : search_worker
+*
+* Purpose   : Thread function which searches segments of a file until
+*             none remain or the result of the search is known.
+*
+* Inputs    : void *argument - the SEARCH_WORKER for this thread
+*
+* Output    : (none)
+*
+* Returns   : NULL
+*
+* Example   : pthread_create(&thread,NULL,search_worker,worker);
+*
+* Notes     : When a match is found in a segment, workers still busy
+*             on segments further along are told to stop, since their
+*             results can no longer matter.
+*
+*********************************************************************/
+
+static void *search_worker(void *argument)
+{
+	SEARCH_WORKER	*worker , *other;
+	SEARCH_JOB	*job;
+	long	segment , low , high , result;
+	int		count;
+
+	worker = (SEARCH_WORKER *)argument;
+	job = worker->job;
+	while ( 1 ) {
+		pthread_mutex_lock(&job->lock);
+		segment = job->next_segment;
+		if ( job->cancel || segment >= job->num_segments ||
+				(job->found_segment >= 0L && segment > job->found_segment) ) {
+			pthread_mutex_unlock(&job->lock);
+			break;
+		} /* IF */
+		job->next_segment += 1L;
+		worker->segment = segment;
+		worker->control.cancel = 0;
+		pthread_mutex_unlock(&job->lock);
+
+		search_segment_range(job,segment,&low,&high);
+		if ( job->direction > 0 ) {
+			result = search_forward(job->source,low,high + 1L,job->pattern,
+						worker->buffer,&worker->control);
+		} /* IF */
+		else {
+			result = search_backward(job->source,high,low,job->pattern,
+						worker->buffer,&worker->control);
+		} /* ELSE */
+
+		pthread_mutex_lock(&job->lock);
+		if ( result >= 0L || result == -2L ) {
+			if ( job->found_segment < 0L || segment < job->found_segment ) {
+				job->found_segment = segment;
+				job->found_offset = result;
+				for ( count = 0 ; count < job->num_workers ; ++count ) {
+					other = &job->workers[count];
+					if ( other->segment > segment ) {
+						other->control.cancel = 1;
+					} /* IF */
+				} /* FOR */
+			} /* IF */
+		} /* IF */
+		worker->segment = -1L;
+		pthread_mutex_unlock(&job->lock);
+	} /* WHILE */
+
+	pthread_mutex_lock(&job->lock);
+	job->num_running -= 1;
+	pthread_mutex_unlock(&job->lock);
+
+	return(NULL);
+} /* end of search_worker */
+
+/*********************************************************************
+*
+* Function  : search_monitor
+*
+* Purpose   : Display the progress of a background search and cancel
+*             it if the user presses a key.
+*
+* Inputs    : SEARCH_JOB *job - the running search
+*
+* Output    : progress in the status window
+*
+* Returns   : 0 --> search completed , 1 --> search cancelled
+*
+* Example   : search_monitor(&job);
+*
+* Notes     : Returns once all the workers have finished. Without a
+*             screen (e.g. in hed5_bench) it returns at once and the
+*             caller's pthread_join() waits for them.
+*
+*********************************************************************/
+
+static int search_monitor(SEARCH_JOB *job)
+{
+	struct timeval	start_time , now;
+	double	elapsed , rate;
+	long	bytes_searched , percent;
+	int		count , running , cancelled;
+	const char	*activity;
+
+	if ( msg_win == NULL ) {
+		return(0);
+	} /* IF */
+	activity = job->activity != NULL ? job->activity : "Searching";
+	gettimeofday(&start_time,NULL);
+	cancelled = 0;
+	message("%s ... press any key to cancel",activity);
+	wtimeout(msg_win,SEARCH_POLL_MSECS);
+	while ( 1 ) {
+		if ( wgetch(msg_win) != ERR && ! cancelled ) {
+			cancelled = 1;
+			pthread_mutex_lock(&job->lock);
+			job->cancel = 1;
+			for ( count = 0 ; count < job->num_workers ; ++count ) {
+				job->workers[count].control.cancel = 1;
+			} /* FOR */
+			pthread_mutex_unlock(&job->lock);
+			message("Cancelling ...");
+		} /* IF */
+
+		pthread_mutex_lock(&job->lock);
+		running = job->num_running;
+		pthread_mutex_unlock(&job->lock);
+		if ( running == 0 ) {
+			break;
+		} /* IF */
+
+		bytes_searched = 0L;
+		for ( count = 0 ; count < job->num_workers ; ++count ) {
+			bytes_searched += job->workers[count].control.bytes_searched;
+		} /* FOR */
+		gettimeofday(&now,NULL);
+		elapsed = (now.tv_sec - start_time.tv_sec) +
+					(now.tv_usec - start_time.tv_usec) / 1000000.0;
+		rate = elapsed > 0.0 ? bytes_searched / elapsed : 0.0;
+		percent = job->total_bytes > 0L ?
+					(bytes_searched * 100L) / job->total_bytes : 0L;
+		if ( percent > 100L ) {
+			percent = 100L;
+		} /* IF */
+		status_message("%s %s : %ld%% done , %.1f MB/sec",
+			activity,filename,percent,rate / (1024.0 * 1024.0));
+	} /* WHILE */
+	wtimeout(msg_win,-1);
+
+	return(cancelled);
+} /* end of search_monitor */
+
+/*********************************************************************
+*
+* Function  : parallel_search
+*
+* Purpose   : Search a data source for a byte string using a pool of
+*             worker threads.
+*
+* Inputs    : DATA_SOURCE *source - data source
+*             int direction - 1 --> forward , -1 --> backward
+*             long start - first (forward) or last (backward) offset
+*                          at which a match may start
+*             const SEARCH_PATTERN *pattern - compiled search pattern
+*
+* Output    : (none)
+*
+* Returns   : If found Then file offset of match
+*             Else If not found Then -1L
+*             Else -2L (read error) or -3L (cancelled by user)
+*
+* Example   : offset = parallel_search(&input_source,1,offset,&pattern);
+*
+* Notes     : The file is divided into segments of SEARCH_SEGMENT_SIZE
+*             bytes which the workers claim in search order. Each
+*             segment is read with a pattern length - 1 byte overlap
+*             into the next one , so the result is the same as for a
+*             serial search. The workers run in the background while
+*             search_monitor() keeps the screen up to date.
+*
+*********************************************************************/
+
+static long parallel_search(DATA_SOURCE *source, int direction, long start,
+				const SEARCH_PATTERN *pattern)
+{
+	SEARCH_JOB	job;
+	int		count , num_threads , cancelled;
+	long	size;
+
+	size = source_size(source);
+	if ( size <= 0L ) {
+		/* size unknown , just read until end of file */
+		if ( direction > 0 ) {
+			return(search_forward(source,start,-1L,pattern,temp_buffer,NULL));
+		} /* IF */
+		return(search_backward(source,start,0L,pattern,temp_buffer,NULL));
+	} /* IF */
+
+	memset(&job,0,sizeof(job));
+	job.source = source;
+	job.direction = direction;
+	job.start = start;
+	job.pattern = pattern;
+	job.segment_size = SEARCH_SEGMENT_SIZE;
+	job.found_segment = -1L;
+	job.found_offset = -1L;
+	if ( direction > 0 ) {
+		job.num_segments = start >= size ? 0L :
+			(size - 1L) / job.segment_size -
+					start / job.segment_size + 1L;
+		job.total_bytes = size - start;
+	} /* IF */
+	else {
+		job.num_segments = start < 0L ? 0L : start / job.segment_size + 1L;
+		job.total_bytes = start + 1L;
+	} /* ELSE */
+	num_threads = opt_threads;
+	if ( num_threads > job.num_segments ) {
+		num_threads = (int)job.num_segments;
+	} /* IF */
+	if ( num_threads < 1 ) {
+		return(-1L);
+	} /* IF */
+
+	job.workers = (SEARCH_WORKER *)calloc(num_threads,sizeof(SEARCH_WORKER));
+	if ( job.workers == NULL ) {
+		return(-2L);
+	} /* IF */
+	pthread_mutex_init(&job.lock,NULL);
+	for ( count = 0 ; count < num_threads ; ++count ) {
+		job.workers[count].job = &job;
+		job.workers[count].segment = -1L;
+		job.workers[count].buffer = count == 0 ? temp_buffer :
+			(unsigned char *)malloc(search_chunk_size + SEARCH_MAX_PATTERN);
+		if ( job.workers[count].buffer == NULL ) {
+			break;
+		} /* IF */
+	} /* FOR */
+	job.num_workers = count;
+	pthread_mutex_lock(&job.lock);
+	for ( count = 0 ; count < job.num_workers ; ++count ) {
+		if ( pthread_create(&job.workers[count].thread,NULL,search_worker,
+						&job.workers[count]) != 0 ) {
+			break;
+		} /* IF */
+		job.num_running += 1;
+	} /* FOR */
+	for ( num_threads = count ; count < job.num_workers ; ++count ) {
+		if ( count > 0 ) {
+			free(job.workers[count].buffer);
+		} /* IF */
+	} /* FOR */
+	job.num_workers = num_threads;
+	pthread_mutex_unlock(&job.lock);
+	if ( job.num_workers == 0 ) {
+		pthread_mutex_destroy(&job.lock);
+		free(job.workers);
+		return(-2L);
+	} /* IF */
+
+	cancelled = search_monitor(&job);
+
+	for ( count = 0 ; count < job.num_workers ; ++count ) {
+		pthread_join(job.workers[count].thread,NULL);
+		if ( count > 0 ) {
+			free(job.workers[count].buffer);
+		} /* IF */
+	} /* FOR */
+	pthread_mutex_destroy(&job.lock);
+	free(job.workers);
+
+	if ( cancelled ) {
+		return(-3L);
+	} /* IF */
+	return(job.found_offset);
+} /* end of parallel_search */
+
+/*********************************************************************
+*
+* Function  : multi_add_state
+*
+* Purpose   : Add a new state to a multi pattern automaton.
+*
+* Inputs    : MULTI_PATTERN *multi - the automaton
+*
+* Output    : (none)
+*
+* Returns   : number of new state or -1 on error
+*
+* Example   : state = multi_add_state(multi);
+*
+* Notes     : All transitions of the new state are initially -1.
+*
+*********************************************************************/
+
+static int multi_add_state(MULTI_PATTERN *multi)
+{
+	int		*next , *output , *output_link , state;
+
+	if ( multi->num_states == multi->max_states ) {
+		multi->max_states = multi->max_states ? multi->max_states * 2 : 256;
+		next = (int *)realloc(multi->next,
+						(size_t)multi->max_states * 256 * sizeof(int));
+		output = (int *)realloc(multi->output,
+						multi->max_states * sizeof(int));
+		output_link = (int *)realloc(multi->output_link,
+						multi->max_states * sizeof(int));
+		if ( next != NULL ) {
+			multi->next = next;
+		} /* IF */
+		if ( output != NULL ) {
+			multi->output = output;
+		} /* IF */
+		if ( output_link != NULL ) {
+			multi->output_link = output_link;
+		} /* IF */
+		if ( next == NULL || output == NULL || output_link == NULL ) {
+			return(-1);
+		} /* IF */
+	} /* IF */
+	state = multi->num_states++;
+	memset(&multi->next[state * 256],0xff,256 * sizeof(int));
+	multi->output[state] = -1;
+	multi->output_link[state] = -1;
+
+	return(state);
+} /* end of multi_add_state */
+
+/*********************************************************************
+*
+* Function  : free_multi_pattern
+*
+* Purpose   : Free a multi pattern automaton.
+*
+* Inputs    : MULTI_PATTERN *multi - the automaton
+*
+* Output    : (none)
+*
+* Returns   : (nothing)
+*
+* Example   : free_multi_pattern(&multi_patterns);
+*
+* Notes     : (none)
+*
+*********************************************************************/
+
+static void free_multi_pattern(MULTI_PATTERN *multi)
+{
+	int		count;
+
+	for ( count = 0 ; count < multi->num_patterns ; ++count ) {
+		free(multi->names[count]);
+	} /* FOR */
+	free(multi->names);
+	free(multi->patterns);
+	free(multi->key_offset);
+	free(multi->key_length);
+	free(multi->same_key);
+	free(multi->next);
+	free(multi->output);
+	free(multi->output_link);
+	memset(multi,0,sizeof(MULTI_PATTERN));
+
+	return;
+} /* end of free_multi_pattern */
+
+/*********************************************************************
+*
+* Function  : build_multi_pattern
+*
+* Purpose   : Build an Aho-Corasick automaton for a set of patterns.
+*
+* Inputs    : MULTI_PATTERN *multi - patterns , key_offset and
+*                                    key_length already filled in
+*
+* Output    : (none)
+*
+* Returns   : 0 --> success , -1 --> out of memory
+*
+* Example   : build_multi_pattern(&multi_patterns);
+*
+* Notes     : The automaton is built over the longest run of fully
+*             specified bytes ("key") of each pattern. The failure
+*             function is folded into the transition table , so the
+*             scanner makes exactly one table lookup per byte.
+*
+*********************************************************************/
+
+static int build_multi_pattern(MULTI_PATTERN *multi)
+{
+	int		count , index , state , next_state , fail , byte;
+	int		*queue , *failure , head , tail;
+	unsigned char	*key;
+
+	if ( multi_add_state(multi) < 0 ) {
+		return(-1);
+	} /* IF */
+	for ( count = 0 ; count < multi->num_patterns ; ++count ) {
+		key = &multi->patterns[count].bytes[multi->key_offset[count]];
+		state = 0;
+		for ( index = 0 ; index < multi->key_length[count] ; ++index ) {
+			next_state = multi->next[state * 256 + key[index]];
+			if ( next_state < 0 ) {
+				next_state = multi_add_state(multi);
+				if ( next_state < 0 ) {
+					return(-1);
+				} /* IF */
+				multi->next[state * 256 + key[index]] = next_state;
+			} /* IF */
+			state = next_state;
+		} /* FOR */
+		multi->same_key[count] = multi->output[state];
+		multi->output[state] = count;
+	} /* FOR */
+
+	/* breadth first pass to compute failure and output links */
+	queue = (int *)malloc(multi->num_states * sizeof(int));
+	failure = (int *)malloc(multi->num_states * sizeof(int));
+	if ( queue == NULL || failure == NULL ) {
+		free(queue);
+		free(failure);
+		return(-1);
+	} /* IF */
+	head = tail = 0;
+	for ( byte = 0 ; byte < 256 ; ++byte ) {
+		next_state = multi->next[byte];
+		if ( next_state < 0 ) {
+			multi->next[byte] = 0;
+		} /* IF */
+		else {
+			failure[next_state] = 0;
+			queue[tail++] = next_state;
+		} /* ELSE */
+	} /* FOR */
+	while ( head < tail ) {
+		state = queue[head++];
+		fail = failure[state];
+		multi->output_link[state] = multi->output[fail] >= 0 ? fail :
+										multi->output_link[fail];
+		for ( byte = 0 ; byte < 256 ; ++byte ) {
+			next_state = multi->next[state * 256 + byte];
+			if ( next_state < 0 ) {
+				multi->next[state * 256 + byte] = multi->next[fail * 256 + byte];
+			} /* IF */
+			else {
+				failure[next_state] = multi->next[fail * 256 + byte];
+				queue[tail++] = next_state;
+			} /* ELSE */
+		} /* FOR */
+	} /* WHILE */
+	free(queue);
+	free(failure);
+
+	return(0);
+} /* end of build_multi_pattern */
+
+/*********************************************************************
+*
+* Function  : load_multi_pattern
+*
+* Purpose   : Read a file of search patterns and build the automaton
+*             used to search for all of them at once.
+*
+* Inputs    : char *pattern_file - name of the pattern file
+*             MULTI_PATTERN *multi - receives the pattern set
+*
+* Output    : (none)
+*
+* Returns   : 0 --> success , -1 --> error (message displayed)
+*
+* Example   : load_multi_pattern("magic.txt",&multi_patterns);
+*
+* Notes     : One pattern per line , using the syntax of the / command.
+*             Blank lines and lines starting with '#' are ignored.
+*             Every pattern needs at least one fully specified byte.
+*
+*********************************************************************/
+
+static int load_multi_pattern(char *pattern_file, MULTI_PATTERN *multi)
+{
+	FILE	*input;
+	char	line[SEARCH_MAX_PATTERN * 4] , *ptr , **names;
+	int		line_number , count , index , run , best , best_start;
+	int		max_patterns , *key_offset , *key_length , *same_key;
+	SEARCH_PATTERN	*pattern;
+
+	input = fopen(pattern_file,"r");
+	if ( input == NULL ) {
+		system_error("Can't open pattern file \"%s\"",pattern_file);
+		return(-1);
+	} /* IF */
+	memset(multi,0,sizeof(MULTI_PATTERN));
+	for ( line_number = 1 ; fgets(line,sizeof(line),input) != NULL ;
+									++line_number ) {
+		ptr = strchr(line,'\n');
+		if ( ptr != NULL ) {
+			*ptr = '\0';
+		} /* IF */
+		if ( line[0] == '\0' || line[0] == '#' ) {
+			continue;
+		} /* IF */
+		if ( multi->num_patterns == multi->max_patterns ) {
+			/* each array keeps its old block if it can't grow */
+			max_patterns = multi->max_patterns ? multi->max_patterns * 2 : 32;
+			pattern = (SEARCH_PATTERN *)realloc(multi->patterns,
+						max_patterns * sizeof(SEARCH_PATTERN));
+			if ( pattern != NULL ) {
+				multi->patterns = pattern;
+			} /* IF */
+			names = (char **)realloc(multi->names,max_patterns * sizeof(char *));
+			if ( names != NULL ) {
+				multi->names = names;
+			} /* IF */
+			key_offset = (int *)realloc(multi->key_offset,
+						max_patterns * sizeof(int));
+			if ( key_offset != NULL ) {
+				multi->key_offset = key_offset;
+			} /* IF */
+			key_length = (int *)realloc(multi->key_length,
+						max_patterns * sizeof(int));
+			if ( key_length != NULL ) {
+				multi->key_length = key_length;
+			} /* IF */
+			same_key = (int *)realloc(multi->same_key,max_patterns * sizeof(int));
+			if ( same_key != NULL ) {
+				multi->same_key = same_key;
+			} /* IF */
+			if ( pattern == NULL || names == NULL || key_offset == NULL ||
+						key_length == NULL || same_key == NULL ) {
+				fclose(input);
+				free_multi_pattern(multi);
+				error_message("Out of memory loading patterns");
+				return(-1);
+			} /* IF */
+			multi->max_patterns = max_patterns;
+		} /* IF */
+		count = multi->num_patterns;
+		pattern = &multi->patterns[count];
+		if ( compile_pattern(line,pattern) < 0 ) {
+			fclose(input);
+			free_multi_pattern(multi);
+			error_message("Invalid pattern on line %d",line_number);
+			return(-1);
+		} /* IF */
+
+		/* the key is the longest run of fully specified bytes */
+		best = best_start = 0;
+		for ( index = 0 , run = 0 ; index < pattern->length ; ++index ) {
+			run = pattern->mask[index] == 0xff ? run + 1 : 0;
+			if ( run > best ) {
+				best = run;
+				best_start = index - run + 1;
+			} /* IF */
+		} /* FOR */
+		if ( best == 0 ) {
+			fclose(input);
+			free_multi_pattern(multi);
+			error_message("Pattern on line %d has no exact bytes",line_number);
+			return(-1);
+		} /* IF */
+		multi->key_offset[count] = best_start;
+		multi->key_length[count] = best;
+		if ( best_start + best > multi->max_span ) {
+			multi->max_span = best_start + best;
+		} /* IF */
+		multi->names[count] = strdup(line);
+		multi->num_patterns += 1;
+	} /* FOR */
+	fclose(input);
+
+	if ( multi->num_patterns == 0 ) {
+		error_message("No patterns in \"%s\"",pattern_file);
+		return(-1);
+	} /* IF */
+	if ( build_multi_pattern(multi) < 0 ) {
+		free_multi_pattern(multi);
+		error_message("Out of memory building pattern matcher");
+		return(-1);
+	} /* IF */
+	debug_print("Loaded %d patterns from %s , %d states\n",
+			multi->num_patterns,pattern_file,multi->num_states);
+
+	return(0);
+} /* end of load_multi_pattern */
+
+/*********************************************************************
+*
+* Function  : multi_search_forward
+*
+* Purpose   : Search forward through a data source for the first
+*             occurrence of any pattern of a set.
+*
+* Inputs    : DATA_SOURCE *source - data source
+*             long start - first offset at which a match may start
+*             const MULTI_PATTERN *multi - the pattern set
+*             unsigned char *buffer - read buffer of at least
+*                       search_chunk_size + SEARCH_MAX_PATTERN bytes
+*             SEARCH_CONTROL *control - progress and cancellation
+*             int *which - receives index of matching pattern
+*
+* Output    : (none)
+*
+* Returns   : If found Then file offset of match
+*             Else If not found Then -1L
+*             Else -2L (read error) or -3L (cancelled)
+*
+* Example   : offset = multi_search_forward(&input_source,0L,
+*                       &multi_patterns,temp_buffer,NULL,&which);
+*
+* Notes     : The file is streamed once through the automaton. A key
+*             hit implies where its pattern would start ; the complete
+*             pattern is then checked at that offset. Scanning goes on
+*             past the first hit until no later hit can start earlier.
+*
+*********************************************************************/
+
+static long multi_search_forward(DATA_SOURCE *source, long start,
+				const MULTI_PATTERN *multi, unsigned char *buffer,
+				SEARCH_CONTROL *control, int *which)
+{
+	long	offset , num_bytes , index , key_end , match_start , best;
+	long	view_bytes;
+	unsigned char	*data , *match_data , check[SEARCH_MAX_PATTERN];
+	int		state , hit_state , pattern;
+	const int	*next;
+
+	best = -1L;
+	*which = -1;
+	next = multi->next;
+	state = 0;
+	for ( offset = start ; ; offset += num_bytes ) {
+		if ( control != NULL && control->cancel ) {
+			return(-3L);
+		} /* IF */
+		data = source_view(source,offset,
+					search_chunk_size - (offset % search_chunk_size),
+					buffer,&num_bytes);
+		if ( data == NULL ) {
+			return(-2L);
+		} /* IF */
+		if ( num_bytes <= 0L ) {
+			break;
+		} /* IF */
+		if ( control != NULL ) {
+			control->bytes_searched += num_bytes;
+		} /* IF */
+		for ( index = 0L ; index < num_bytes ; ++index ) {
+			state = next[state * 256 + data[index]];
+			if ( multi->output[state] < 0 && multi->output_link[state] < 0 ) {
+				continue;
+			} /* IF */
+			key_end = offset + index;
+			hit_state = multi->output[state] >= 0 ? state :
+										multi->output_link[state];
+			for ( ; hit_state >= 0 ; hit_state = multi->output_link[hit_state] ) {
+				for ( pattern = multi->output[hit_state] ; pattern >= 0 ;
+								pattern = multi->same_key[pattern] ) {
+					match_start = key_end - multi->key_length[pattern] + 1 -
+										multi->key_offset[pattern];
+					if ( match_start < start ||
+								(best >= 0L && match_start >= best) ) {
+						continue;
+					} /* IF */
+					if ( ! multi->patterns[pattern].exact ) {
+						if ( match_start >= offset && match_start +
+							multi->patterns[pattern].length <= offset + num_bytes ) {
+							match_data = &data[match_start - offset];
+						} /* IF */
+						else {
+							match_data = source_view(source,match_start,
+										multi->patterns[pattern].length,
+										check,&view_bytes);
+							if ( match_data == NULL || view_bytes <
+										multi->patterns[pattern].length ) {
+								continue;
+							} /* IF */
+						} /* ELSE */
+						if ( ! pattern_matches(match_data,
+										&multi->patterns[pattern]) ) {
+							continue;
+						} /* IF */
+					} /* IF */
+					best = match_start;
+					*which = pattern;
+				} /* FOR */
+			} /* FOR */
+		} /* FOR */
+		if ( best >= 0L && offset + num_bytes - multi->max_span > best ) {
+			break;	/* no later key can belong to an earlier match */
+		} /* IF */
+	} /* FOR */
+
+	return(best);
+} /* end of multi_search_forward */
+
+/*********************************************************************
+*
+* Function  : multi_search_worker
+*
+* Purpose   : Thread function which runs a multi pattern search.
+*
+* Inputs    : void *argument - the SEARCH_WORKER for this thread
+*
+* Output    : (none)
+*
+* Returns   : NULL
+*
+* Example   : pthread_create(&thread,NULL,multi_search_worker,worker);
+*
+* Notes     : (none)
+*
+*********************************************************************/
+
+static void *multi_search_worker(void *argument)
+{
+	SEARCH_WORKER	*worker;
+	SEARCH_JOB	*job;
+	long	result;
+	int		which;
+
+	worker = (SEARCH_WORKER *)argument;
+	job = worker->job;
+	result = multi_search_forward(job->source,job->start,job->multi,
+						worker->buffer,&worker->control,&which);
+
+	pthread_mutex_lock(&job->lock);
+	job->found_offset = result;
+	job->found_pattern = which;
+	job->num_running -= 1;
+	pthread_mutex_unlock(&job->lock);
+
+	return(NULL);
+} /* end of multi_search_worker */
+
+/*********************************************************************
+*
+* Function  : multi_scan
+*
+* Purpose   : Search forward for the first occurrence of any of a set
+*             of patterns read from a file.
+*
+* Inputs    : int *which - receives the index of the matching pattern
+*
+* Output    : (none)
+*
+* Returns   : If found Then file offset Else -1L
+*
+* Example   : offset = multi_scan(&which);
+*
+* Notes     : The pattern file from the previous multi pattern search
+*             is used again if no file name is entered.
+*
+*********************************************************************/
+
+static long multi_scan(int *which)
+{
+	char	pattern_file[256];
+	SEARCH_JOB	job;
+	long	start;
+	int		cancelled;
+
+	get_line(multi_patterns.num_patterns > 0 ?
+			"Enter pattern file (RETURN for previous) : " :
+			"Enter pattern file : ",pattern_file,sizeof(pattern_file));
+	if ( pattern_file[0] != '\0' ) {
+		free_multi_pattern(&multi_patterns);
+		if ( load_multi_pattern(pattern_file,&multi_patterns) < 0 ) {
+			display_block();
+			return(-1L);
+		} /* IF */
+	} /* IF */
+	if ( multi_patterns.num_patterns == 0 ) {
+		display_block();
+		return(-1L);
+	} /* IF */
+
+	start = current_file_offset;
+	if ( start == last_match_offset ) {
+		start += 1L;
+	} /* IF */
+	memset(&job,0,sizeof(job));
+	job.source = &input_source;
+	job.direction = 1;
+	job.start = start;
+	job.multi = &multi_patterns;
+	job.total_bytes = filesize - start;
+	job.found_offset = -1L;
+	job.workers = (SEARCH_WORKER *)calloc(1,sizeof(SEARCH_WORKER));
+	if ( job.workers == NULL ) {
+		error_message("Out of memory");
+		return(-1L);
+	} /* IF */
+	job.workers[0].job = &job;
+	job.workers[0].buffer = temp_buffer;
+	pthread_mutex_init(&job.lock,NULL);
+	source_advise(&input_source,MADV_SEQUENTIAL);
+	job.num_workers = 1;
+	job.num_running = 1;
+	if ( pthread_create(&job.workers[0].thread,NULL,multi_search_worker,
+							&job.workers[0]) != 0 ) {
+		multi_search_worker(&job.workers[0]);
+		cancelled = 0;
+	} /* IF */
+	else {
+		cancelled = search_monitor(&job);
+		pthread_join(job.workers[0].thread,NULL);
+	} /* ELSE */
+	source_advise(&input_source,MADV_NORMAL);
+	pthread_mutex_destroy(&job.lock);
+	free(job.workers);
+
+	if ( ! cancelled && job.found_offset >= 0L ) {
+		*which = job.found_pattern;
+		last_match_offset = job.found_offset;
+		return(job.found_offset);
+	} /* IF */
+	if ( cancelled ) {
+		error_message("Search cancelled");
+	} /* IF */
+	else if ( job.found_offset == -2L ) {
+		system_error("Can't read file data");
+	} /* ELSE IF */
+	else {
+		error_message("None of the %d patterns found",
+					multi_patterns.num_patterns);
+	} /* ELSE */
+
+	display_block();
+	return(-1L);
+} /* end of multi_scan */
+
+/*********************************************************************
+*
+* Function  : hit_index_clear
+*
+* Purpose   : Discard the contents of a hit index.
+*
+* Inputs    : HIT_INDEX *hits - the hit index
+*
+* Output    : (none)
+*
+* Returns   : (nothing)
+*
+* Example   : hit_index_clear(&search_hits);
+*
+* Notes     : (none)
+*
+*********************************************************************/
+
+static void hit_index_clear(HIT_INDEX *hits)
+{
+	free(hits->deltas);
+	free(hits->checkpoint_offset);
+	free(hits->checkpoint_position);
+	memset(hits,0,sizeof(HIT_INDEX));
+
+	return;
+} /* end of hit_index_clear */
+
+/*********************************************************************
+*
+* Function  : hit_index_add
+*
+* Purpose   : Append a match offset to a hit index.
+*
+* Inputs    : HIT_INDEX *hits - the hit index
+*             long offset - offset of match , greater than the
+*                           offset of the previous match
+*
+* Output    : (none)
+*
+* Returns   : 0 --> success , -1 --> out of memory
+*
+* Example   : hit_index_add(&hits,offset);
+*
+* Notes     : Offsets are stored as the difference from the previous
+*             offset in a variable length (7 bits per byte) encoding.
+*             Every HIT_CHECKPOINT hits the absolute offset and the
+*             position of its encoding are recorded so that any hit
+*             can be located without decoding the whole list.
+*
+*********************************************************************/
+
+static int hit_index_add(HIT_INDEX *hits, long offset)
+{
+	unsigned long	delta;
+	unsigned char	*deltas;
+	long	*offsets;
+	size_t	*positions , checkpoint;
+
+	if ( hits->num_hits % HIT_CHECKPOINT == 0 ) {
+		checkpoint = hits->num_hits / HIT_CHECKPOINT;
+		if ( checkpoint == hits->max_checkpoints ) {
+			hits->max_checkpoints = hits->max_checkpoints ?
+									hits->max_checkpoints * 2 : 64;
+			offsets = (long *)realloc(hits->checkpoint_offset,
+							hits->max_checkpoints * sizeof(long));
+			if ( offsets == NULL ) {
+				return(-1);
+			} /* IF */
+			hits->checkpoint_offset = offsets;
+			positions = (size_t *)realloc(hits->checkpoint_position,
+							hits->max_checkpoints * sizeof(size_t));
+			if ( positions == NULL ) {
+				return(-1);
+			} /* IF */
+			hits->checkpoint_position = positions;
+		} /* IF */
+		hits->checkpoint_offset[checkpoint] = offset;
+		hits->checkpoint_position[checkpoint] = hits->num_bytes;
+	} /* IF */
+	if ( hits->num_bytes + 10 > hits->max_bytes ) {
+		hits->max_bytes = hits->max_bytes ? hits->max_bytes * 2 : 4096;
+		deltas = (unsigned char *)realloc(hits->deltas,hits->max_bytes);
+		if ( deltas == NULL ) {
+			return(-1);
+		} /* IF */
+		hits->deltas = deltas;
+	} /* IF */
+	delta = (unsigned long)(offset - hits->last_offset);
+	while ( delta >= 0x80 ) {
+		hits->deltas[hits->num_bytes++] = (unsigned char)(delta | 0x80);
+		delta >>= 7;
+	} /* WHILE */
+	hits->deltas[hits->num_bytes++] = (unsigned char)delta;
+	hits->last_offset = offset;
+	hits->num_hits += 1;
+
+	return(0);
+} /* end of hit_index_add */
+
+/*********************************************************************
+*
+* Function  : hit_index_decode
+*
+* Purpose   : Decode one offset difference of a hit index.
+*
+* Inputs    : const HIT_INDEX *hits - the hit index
+*             size_t *position - position of encoded value , advanced
+*                                past it
+*
+* Output    : (none)
+*
+* Returns   : decoded difference
+*
+* Example   : offset += hit_index_decode(hits,&position);
+*
+* Notes     : (none)
+*
+*********************************************************************/
+
+static long hit_index_decode(const HIT_INDEX *hits, size_t *position)
+{
+	unsigned long	value;
+	int		shift;
+	unsigned char	byte;
+
+	value = 0;
+	shift = 0;
+	do {
+		byte = hits->deltas[(*position)++];
+		value |= (unsigned long)(byte & 0x7f) << shift;
+		shift += 7;
+	} while ( byte & 0x80 );
+
+	return((long)value);
+} /* end of hit_index_decode */
+
+/*********************************************************************
+*
+* Function  : hit_index_get
+*
+* Purpose   : Get the offset of a hit from a hit index.
+*
+* Inputs    : const HIT_INDEX *hits - the hit index
+*             long number - hit number (0 is the first hit)
+*
+* Output    : (none)
+*
+* Returns   : offset of hit , -1L if there is no such hit
+*
+* Example   : offset = hit_index_get(&search_hits,10L);
+*
+* Notes     : At most HIT_CHECKPOINT - 1 values are decoded.
+*
+*********************************************************************/
+
+static long hit_index_get(const HIT_INDEX *hits, long number)
+{
+	long	count , offset;
+	size_t	position;
+
+	if ( number < 0L || number >= hits->num_hits ) {
+		return(-1L);
+	} /* IF */
+	offset = hits->checkpoint_offset[number / HIT_CHECKPOINT];
+	position = hits->checkpoint_position[number / HIT_CHECKPOINT];
+	hit_index_decode(hits,&position);
+	for ( count = number % HIT_CHECKPOINT ; count > 0 ; --count ) {
+		offset += hit_index_decode(hits,&position);
+	} /* FOR */
+
+	return(offset);
+} /* end of hit_index_get */
+
+/*********************************************************************
+*
+* Function  : hit_index_find
+*
+* Purpose   : Find the first hit at or after a file offset.
+*
+* Inputs    : const HIT_INDEX *hits - the hit index
+*             long offset - file offset
+*
+* Output    : (none)
+*
+* Returns   : hit number , or the number of hits if all hits are
+*             before the offset
+*
+* Example   : number = hit_index_find(&search_hits,current_file_offset);
+*
+* Notes     : Binary search of the checkpoints followed by a short
+*             sequential decode.
+*
+*********************************************************************/
+
+static long hit_index_find(const HIT_INDEX *hits, long offset)
+{
+	long	low , high , middle , number , hit_offset;
+	size_t	position;
+
+	if ( hits->num_hits == 0L || hits->checkpoint_offset[0] >= offset ) {
+		return(0L);
+	} /* IF */
+	/* last checkpoint before offset */
+	low = 0L;
+	high = (hits->num_hits - 1L) / HIT_CHECKPOINT;
+	while ( low < high ) {
+		middle = (low + high + 1L) / 2L;
+		if ( hits->checkpoint_offset[middle] < offset ) {
+			low = middle;
+		} /* IF */
+		else {
+			high = middle - 1L;
+		} /* ELSE */
+	} /* WHILE */
+	number = low * HIT_CHECKPOINT;
+	hit_offset = hits->checkpoint_offset[low];
+	position = hits->checkpoint_position[low];
+	hit_index_decode(hits,&position);
+	while ( hit_offset < offset && ++number < hits->num_hits ) {
+		hit_offset += hit_index_decode(hits,&position);
+	} /* WHILE */
+
+	return(number);
+} /* end of hit_index_find */
+
+/*********************************************************************
+*
+* Function  : find_all_worker
+*
+* Purpose   : Thread function which records every match of a pattern
+*             in a hit index.
+*
+* Inputs    : void *argument - the SEARCH_WORKER for this thread
+*
+* Output    : (none)
+*
+* Returns   : NULL
+*
+* Example   : pthread_create(&thread,NULL,find_all_worker,worker);
+*
+* Notes     : The file is read in overlapped chunks as for
+*             search_forward() , but each chunk is searched for all
+*             its matches rather than the first one.
+*
+*********************************************************************/
+
+static void *find_all_worker(void *argument)
+{
+	SEARCH_WORKER	*worker;
+	SEARCH_JOB	*job;
+	long	offset , chunk , overlap , num_bytes , index , match , result;
+	unsigned char	*data;
+
+	worker = (SEARCH_WORKER *)argument;
+	job = worker->job;
+	overlap = job->pattern->length - 1;
+	result = 0L;
+	for ( offset = 0L ; ; offset += chunk ) {
+		if ( worker->control.cancel ) {
+			result = -3L;
+			break;
+		} /* IF */
+		chunk = search_chunk_size - (offset % search_chunk_size);
+		data = source_view(job->source,offset,chunk + overlap,worker->buffer,
+						&num_bytes);
+		if ( data == NULL ) {
+			result = -2L;
+			break;
+		} /* IF */
+		worker->control.bytes_searched += chunk;
+		for ( index = 0L ; index < chunk && index < num_bytes ; ++index ) {
+			match = find_forward(&data[index],num_bytes - index,job->pattern);
+			if ( match < 0L || index + match >= chunk ) {
+				break;	/* no more matches start in this chunk */
+			} /* IF */
+			index += match;
+			if ( hit_index_add(job->hits,offset + index) < 0 ) {
+				result = -2L;
+				break;
+			} /* IF */
+		} /* FOR */
+		if ( result < 0L || num_bytes < chunk + overlap ) {
+			break;
+		} /* IF */
+	} /* FOR */
+
+	pthread_mutex_lock(&job->lock);
+	job->found_offset = result;
+	job->num_running -= 1;
+	pthread_mutex_unlock(&job->lock);
+
+	return(NULL);
+} /* end of find_all_worker */
+
+/*********************************************************************
+*
+* Function  : find_all_hits
+*
+* Purpose   : Replace the hit index with every match of a pattern.
+*
+* Inputs    : const SEARCH_PATTERN *pattern - compiled search pattern
+*
+* Output    : (none)
+*
+* Returns   : 0 --> success , -1 --> error or cancelled
+*
+* Example   : find_all_hits(&pattern);
+*
+* Notes     : The text of the pattern is taken from last_pattern , to
+*             be kept with the hits in the sidecar.
+*
+*********************************************************************/
+
+static int find_all_hits(const SEARCH_PATTERN *pattern)
+{
+	SEARCH_JOB	job;
+	HIT_INDEX	hits;
+	int		cancelled;
+
+	memset(&hits,0,sizeof(hits));
+	memset(&job,0,sizeof(job));
+	job.source = &input_source;
+	job.direction = 1;
+	job.pattern = pattern;
+	job.hits = &hits;
+	job.total_bytes = filesize;
+	job.workers = (SEARCH_WORKER *)calloc(1,sizeof(SEARCH_WORKER));
+	if ( job.workers == NULL ) {
+		error_message("Out of memory");
+		return(-1);
+	} /* IF */
+	job.workers[0].job = &job;
+	job.workers[0].buffer = temp_buffer;
+	pthread_mutex_init(&job.lock,NULL);
+	source_advise(&input_source,MADV_SEQUENTIAL);
+	job.num_workers = 1;
+	job.num_running = 1;
+	if ( pthread_create(&job.workers[0].thread,NULL,find_all_worker,
+							&job.workers[0]) != 0 ) {
+		find_all_worker(&job.workers[0]);
+		cancelled = 0;
+	} /* IF */
+	else {
+		cancelled = search_monitor(&job);
+		pthread_join(job.workers[0].thread,NULL);
+	} /* ELSE */
+	source_advise(&input_source,MADV_NORMAL);
+	pthread_mutex_destroy(&job.lock);
+	free(job.workers);
+
+	if ( cancelled || job.found_offset < 0L ) {
+		hit_index_clear(&hits);
+		if ( cancelled ) {
+			error_message("Search cancelled");
+		} /* IF */
+		else {
+			system_error("Can't build hit index");
+		} /* ELSE */
+		return(-1);
+	} /* IF */
+
+	hit_index_clear(&search_hits);
+	search_hits = hits;
+	strcpy(sidecar.hits_pattern,last_pattern);
+	sidecar.hits_current = 1;
+	debug_print("find all : %ld hits in %lu bytes\n",search_hits.num_hits,
+					(unsigned long)search_hits.num_bytes);
+
+	return(0);
+} /* end of find_all_hits */
+
+/*********************************************************************
+*
+* Function  : find_all
+*
+* Purpose   : Find every match of a pattern and build the hit index
+*             used by the next hit and previous hit commands.
+*
+* Inputs    : (none)
+*
+* Output    : (none)
+*
+* Returns   : If any hits Then offset of first hit at or after the
+*             current offset Else -1L
+*
+* Example   : offset = find_all();
+*
+* Notes     : The hits of the last pattern are reused while the file
+*             is unchanged , including those loaded from the sidecar.
+*
+*********************************************************************/
+
+static long find_all()
+{
+	SEARCH_PATTERN	pattern;
+	long	number;
+
+	if ( get_pattern("Find all , enter pattern : ",&pattern) < 0 ) {
+		display_block();
+		return(-1L);
+	} /* IF */
+	if ( search_hits.num_hits == 0L || ! sidecar.hits_current ||
+				strcmp(sidecar.hits_pattern,last_pattern) != 0 ) {
+		/* not already found in this version of the file , perhaps */
+		/* in an earlier session                                  */
+		if ( find_all_hits(&pattern) < 0 ) {
+			display_block();
+			return(-1L);
+		} /* IF */
+	} /* IF */
+	if ( search_hits.num_hits == 0L ) {
+		error_message("Not found");
+		display_block();
+		return(-1L);
+	} /* IF */
+	number = hit_index_find(&search_hits,current_file_offset);
+	if ( number >= search_hits.num_hits ) {
+		number = 0L;
+	} /* IF */
+	search_hits.current = number;
+	last_match_offset = hit_index_get(&search_hits,number);
+
+	return(last_match_offset);
+} /* end of find_all */
+
+/*********************************************************************
+*
+* Function  : goto_hit
+*
+* Purpose   : Move to the next or previous hit recorded by find all.
+*
+* Inputs    : int direction - 1 --> next hit , -1 --> previous hit
+*
+* Output    : (none)
+*
+* Returns   : If there is such a hit Then its offset Else -1L
+*
+* Example   : offset = goto_hit(1);
+*
+* Notes     : Hits are relative to the current offset , so this works
+*             after moving around the file with other commands.
+*
+*********************************************************************/
+
+static long goto_hit(int direction)
+{
+	long	number;
+
+	if ( search_hits.num_hits == 0L ) {
+		error_message("No hit index , use the f command first");
+		return(-1L);
+	} /* IF */
+	if ( direction > 0 ) {
+		number = hit_index_find(&search_hits,current_file_offset + 1L);
+	} /* IF */
+	else {
+		number = hit_index_find(&search_hits,current_file_offset) - 1L;
+	} /* ELSE */
+	if ( number < 0L || number >= search_hits.num_hits ) {
+		error_message(direction > 0 ? "No more hits" : "No previous hits");
+		return(-1L);
+	} /* IF */
+	search_hits.current = number;
+	last_match_offset = hit_index_get(&search_hits,number);
+
+	return(last_match_offset);
+} /* end of goto_hit */
+
+/*********************************************************************
+*
+* Function  : record_match
+*
+* Purpose   : Find the records of a buffer in which a field has a
+*             value.
+*
+* Inputs    : const unsigned char *data - the field of the first record
+*             long num_records - number of records
+*             const RECORD_FILTER *filter - the field and its value
+*             HIT_INDEX *hits - receives the offset of every match
+*             long offset - file offset of the first record
+*
+* Output    : (none)
+*
+* Returns   : 0 --> success , -1 --> out of memory
+*
+* Example   : record_match(&buffer[filter->field],count,filter,hits,offset);
+*
+* Notes     : A field which fits in a vector is compared with a single
+*             load per record , four records at a time so that the
+*             loads overlap. The load may run up to a vector past the
+*             end of the field of the last record , so the buffer
+*             needs that much room after it. Longer fields are
+*             compared with memcmp().
+*
+*********************************************************************/
+
+static int record_match(const unsigned char *data, long num_records,
+				const RECORD_FILTER *filter, HIT_INDEX *hits, long offset)
+{
+	long	number , stride;
+#if defined(SEARCH_LANES)
+	SEARCH_VECTOR	value;
+	unsigned int	want , mask0 , mask1 , mask2 , mask3;
+#endif
+
+	stride = filter->stride;
+	number = 0L;
+#if defined(SEARCH_LANES)
+	if ( filter->length <= SEARCH_LANES ) {
+		want = filter->length == SEARCH_LANES ? SEARCH_ALL_LANES :
+						(1U << filter->length) - 1U;
+		value = SEARCH_LOAD(filter->value);
+		for ( ; number + 4L <= num_records ; number += 4L ) {
+			mask0 = SEARCH_MASK(SEARCH_EQUAL(SEARCH_LOAD(
+								&data[number * stride]),value));
+			mask1 = SEARCH_MASK(SEARCH_EQUAL(SEARCH_LOAD(
+								&data[(number + 1L) * stride]),value));
+			mask2 = SEARCH_MASK(SEARCH_EQUAL(SEARCH_LOAD(
+								&data[(number + 2L) * stride]),value));
+			mask3 = SEARCH_MASK(SEARCH_EQUAL(SEARCH_LOAD(
+								&data[(number + 3L) * stride]),value));
+			if ( ((mask0 & want) == want &&
+					hit_index_add(hits,offset + number * stride) < 0) ||
+				((mask1 & want) == want &&
+					hit_index_add(hits,offset + (number + 1L) * stride) < 0) ||
+				((mask2 & want) == want &&
+					hit_index_add(hits,offset + (number + 2L) * stride) < 0) ||
+				((mask3 & want) == want &&
+					hit_index_add(hits,offset + (number + 3L) * stride) < 0) ) {
+				return(-1);
+			} /* IF */
+		} /* FOR */
+	} /* IF */
+#endif
+	for ( ; number < num_records ; ++number ) {
+		if ( memcmp(&data[number * stride],filter->value,filter->length) == 0 &&
+				hit_index_add(hits,offset + number * stride) < 0 ) {
+			return(-1);
+		} /* IF */
+	} /* FOR */
+
+	return(0);
+} /* end of record_match */
+
+/*********************************************************************
+*
+* Function  : record_segment
+*
+* Purpose   : Find the records of one segment in which a field has a
+*             value.
+*
+* Inputs    : SEARCH_WORKER *worker - worker doing the filter
+*             long low - number of the first record of the segment
+*             long high - number of the record after the segment
+*             HIT_INDEX *hits - receives the offset of every match
+*
+* Output    : (none)
+*
+* Returns   : 0 --> success , -2 --> read error or out of memory ,
+*             -3 --> cancelled
+*
+* Example   : result = record_segment(worker,low,high,&job->hits[segment]);
+*
+* Notes     : As many records as fit are read at a time , from the
+*             start of the first record to the end of the field of the
+*             last one. When the field ends beyond the buffer , records
+*             are read a field at a time.
+*
+*********************************************************************/
+
+static long record_segment(SEARCH_WORKER *worker, long low, long high,
+					HIT_INDEX *hits)
+{
+	SEARCH_JOB	*job;
+	const RECORD_FILTER	*filter;
+	long	record , count , per_read , offset , span , skip , num_bytes;
+
+	job = worker->job;
+	filter = job->filter;
+	if ( filter->field + filter->length > search_chunk_size ) {
+		/* the field is beyond the buffer , read just the field */
+		per_read = 1L;
+		skip = 0L;
+	} /* IF */
+	else {
+		per_read = (search_chunk_size - filter->field - filter->length) /
+						filter->stride + 1L;
+		skip = filter->field;
+	} /* ELSE */
+	for ( record = low ; record < high ; record += count ) {
+		if ( worker->control.cancel ) {
+			return(-3L);
+		} /* IF */
+		count = high - record;
+		if ( count > per_read ) {
+			count = per_read;
+		} /* IF */
+		offset = filter->first + record * filter->stride;
+		span = (count - 1L) * filter->stride + skip + filter->length;
+		num_bytes = source_read(job->source,offset + filter->field - skip,
+							worker->buffer,span);
+		if ( num_bytes < span ) {
+			return(-2L);
+		} /* IF */
+		if ( record_match(&worker->buffer[skip],count,filter,hits,offset) < 0 ) {
+			return(-2L);
+		} /* IF */
+		worker->control.bytes_searched += count * filter->stride;
+	} /* FOR */
+
+	return(0L);
+} /* end of record_segment */
+
+/*********************************************************************
+*
+* Function  : record_worker
+*
+* Purpose   : Thread which filters segments of the records until there
+*             are none left.
+*
+* Inputs    : void *argument - the worker's SEARCH_WORKER
+*
+* Output    : (none)
+*
+* Returns   : NULL
+*
+* Example   : pthread_create(&worker->thread,NULL,record_worker,worker);
+*
+* Notes     : Each segment has its own hit index , so the workers only
+*             need the lock to claim a segment.
+*
+*********************************************************************/
+
+static void *record_worker(void *argument)
+{
+	SEARCH_WORKER	*worker;
+	SEARCH_JOB	*job;
+	long	segment , low , high , result;
+
+	worker = (SEARCH_WORKER *)argument;
+	job = worker->job;
+	while ( 1 ) {
+		pthread_mutex_lock(&job->lock);
+		segment = job->next_segment;
+		if ( job->cancel || segment >= job->num_segments ||
+					job->found_offset < 0L ) {
+			pthread_mutex_unlock(&job->lock);
+			break;
+		} /* IF */
+		job->next_segment += 1L;
+		worker->segment = segment;
+		pthread_mutex_unlock(&job->lock);
+
+		low = segment * job->segment_size;
+		high = low + job->segment_size;
+		if ( high > job->filter->num_records ) {
+			high = job->filter->num_records;
+		} /* IF */
+		result = record_segment(worker,low,high,&job->hits[segment]);
+
+		pthread_mutex_lock(&job->lock);
+		if ( result < 0L && job->found_offset == 0L ) {
+			job->found_offset = result;
+		} /* IF */
+		worker->segment = -1L;
+		pthread_mutex_unlock(&job->lock);
+	} /* WHILE */
+
+	pthread_mutex_lock(&job->lock);
+	job->num_running -= 1;
+	pthread_mutex_unlock(&job->lock);
+
+	return(NULL);
+} /* end of record_worker */
+
+/*********************************************************************
+*
+* Function  : filter_records
+*
+* Purpose   : Find the records in which a field has a value using a
+*             pool of worker threads.
+*
+* Inputs    : DATA_SOURCE *source - data source
+*             const RECORD_FILTER *filter - the records , the field and
+*                                           its value
+*             HIT_INDEX *hits - receives the offset of every match
+*
+* Output    : (none)
+*
+* Returns   : 0 --> success , -2 --> read error or out of memory ,
+*             -3 --> cancelled by user
+*
+* Example   : result = filter_records(&input_source,&filter,&hits);
+*
+* Notes     : The records are divided into segments of about
+*             SEARCH_SEGMENT_SIZE bytes which the workers claim in
+*             order , as for a compare. The hit indexes of the
+*             segments are then joined in order.
+*
+*********************************************************************/
+
+static long filter_records(DATA_SOURCE *source, const RECORD_FILTER *filter,
+					HIT_INDEX *hits)
+{
+	SEARCH_JOB	job;
+	long	segment , number , offset , result;
+	size_t	position;
+	int		count , num_threads , cancelled;
+
+	memset(&job,0,sizeof(job));
+	job.source = source;
+	job.filter = filter;
+	job.activity = "Filtering";
+	job.segment_size = SEARCH_SEGMENT_SIZE / filter->stride;
+	if ( job.segment_size < 1L ) {
+		job.segment_size = 1L;
+	} /* IF */
+	job.num_segments = (filter->num_records + job.segment_size - 1L) /
+							job.segment_size;
+	job.total_bytes = filter->num_records * filter->stride;
+	job.found_offset = 0L;
+	if ( job.num_segments == 0L ) {
+		return(0L);
+	} /* IF */
+	cancelled = 0;
+	num_threads = opt_threads;
+	if ( num_threads > job.num_segments ) {
+		num_threads = (int)job.num_segments;
+	} /* IF */
+	if ( num_threads < 1 ) {
+		num_threads = 1;
+	} /* IF */
+	job.hits = (HIT_INDEX *)calloc(job.num_segments,sizeof(HIT_INDEX));
+	job.workers = (SEARCH_WORKER *)calloc(num_threads,sizeof(SEARCH_WORKER));
+	if ( job.hits == NULL || job.workers == NULL ) {
+		free(job.hits);
+		free(job.workers);
+		errno = ENOMEM;
+		return(-2L);
+	} /* IF */
+	pthread_mutex_init(&job.lock,NULL);
+	for ( count = 0 ; count < num_threads ; ++count ) {
+		job.workers[count].job = &job;
+		job.workers[count].segment = -1L;
+		/* room after the buffer for the loads of record_match() */
+		job.workers[count].buffer = count == 0 ? temp_buffer :
+			(unsigned char *)malloc(search_chunk_size + SEARCH_MAX_PATTERN);
+		if ( job.workers[count].buffer == NULL ) {
+			break;
+		} /* IF */
+	} /* FOR */
+	job.num_workers = count;
+
+	source_advise(source,MADV_SEQUENTIAL);
+	pthread_mutex_lock(&job.lock);
+	for ( count = 0 ; count < job.num_workers ; ++count ) {
+		if ( pthread_create(&job.workers[count].thread,NULL,record_worker,
+						&job.workers[count]) != 0 ) {
+			break;
+		} /* IF */
+		job.num_running += 1;
+	} /* FOR */
+	num_threads = count;
+	pthread_mutex_unlock(&job.lock);
+	if ( num_threads == 0 ) {
+		/* no threads to be had , filter in this one */
+		job.num_running = 1;
+		record_worker(&job.workers[0]);
+	} /* IF */
+	else {
+		cancelled = search_monitor(&job);
+	} /* ELSE */
+	for ( count = 0 ; count < job.num_workers ; ++count ) {
+		if ( count < num_threads ) {
+			pthread_join(job.workers[count].thread,NULL);
+		} /* IF */
+		if ( count > 0 ) {
+			free(job.workers[count].buffer);
+		} /* IF */
+	} /* FOR */
+	source_advise(source,MADV_NORMAL);
+	pthread_mutex_destroy(&job.lock);
+	free(job.workers);
+
+	result = cancelled ? -3L : job.found_offset;
+	for ( segment = 0L ; segment < job.num_segments ; ++segment ) {
+		offset = 0L;
+		position = 0;
+		for ( number = 0L ; result == 0L &&
+					number < job.hits[segment].num_hits ; ++number ) {
+			offset += hit_index_decode(&job.hits[segment],&position);
+			if ( hit_index_add(hits,offset) < 0 ) {
+				errno = ENOMEM;
+				result = -2L;
+			} /* IF */
+		} /* FOR */
+		hit_index_clear(&job.hits[segment]);
+	} /* FOR */
+	free(job.hits);
+
+	return(result);
+} /* end of filter_records */
+
+/*********************************************************************
+*
+* Function  : find_records
+*
+* Purpose   : Find the records in which a field has a value and make
+*             them the hits for the next hit and previous hit commands.
+*
+* Inputs    : (none)
+*
+* Output    : (none)
+*
+* Returns   : If any records match Then offset of the first at or after
+*             the current one Else -1L
+*
+* Example   : offset = find_records();
+*
+* Notes     : The field is given as first..last byte of the record , or
+*             a single byte , and the value as hex bytes in the order
+*             they are in the file , e.g. 8..11 and 2a000000 finds the
+*             records with the little endian int 42 at offset 8.
+*
+*********************************************************************/
+
+static long find_records()
+{
+	static	RECORD_FILTER	filter;
+	HIT_INDEX	hits;
+	char	text[RECORD_MAX_FIELD * 3 + 16] , *ptr;
+	long	last , number , result;
+	int		high , low;
+
+	if ( record_size == 0L ) {
+		error_message("Not in record mode , use the -R option");
+		return(-1L);
+	} /* IF */
+	get_line("Field , first..last byte of the record : ",text,sizeof(text));
+	filter.field = strtol(text,&ptr,0);
+	last = filter.field;
+	if ( ptr[0] == '.' && ptr[1] == '.' ) {
+		last = strtol(ptr + 2,&ptr,0);
+	} /* IF */
+	filter.length = last - filter.field + 1L;
+	if ( text[0] == '\0' || *ptr != '\0' || filter.field < 0L ||
+				last >= record_stride || filter.length < 1L ||
+				filter.length > RECORD_MAX_FIELD ) {
+		error_message("Invalid field \"%.40s\"",text);
+		display_block();
+		return(-1L);
+	} /* IF */
+	get_line("Value , hex bytes : ",text,sizeof(text));
+	memset(filter.value,0,sizeof(filter.value));
+	for ( number = 0L , ptr = text ; *ptr != '\0' ; ) {
+		if ( *ptr == ' ' ) {
+			ptr += 1;
+			continue;
+		} /* IF */
+		high = hex_digit_value(tolower((unsigned char)ptr[0]));
+		low = ptr[1] == '\0' ? -1 :
+					hex_digit_value(tolower((unsigned char)ptr[1]));
+		if ( high < 0 || low < 0 || number >= filter.length ) {
+			break;
+		} /* IF */
+		filter.value[number++] = (unsigned char)(high << 4 | low);
+		ptr += 2;
+	} /* FOR */
+	if ( *ptr != '\0' || number != filter.length ) {
+		error_message("Need %ld hex bytes for the field",filter.length);
+		display_block();
+		return(-1L);
+	} /* IF */
+	filter.first = record_first;
+	filter.stride = record_stride;
+	filter.num_records = filesize >= record_first + filter.field + filter.length ?
+			(filesize - record_first - filter.field - filter.length) /
+					record_stride + 1L : 0L;
+
+	memset(&hits,0,sizeof(hits));
+	result = filter_records(&input_source,&filter,&hits);
+	if ( result < 0L || hits.num_hits == 0L ) {
+		hit_index_clear(&hits);
+		if ( result == -3L ) {
+			error_message("Filter cancelled");
+		} /* IF */
+		else if ( result < 0L ) {
+			system_error("Can't read records");
+		} /* ELSE IF */
+		else {
+			error_message("No records match");
+		} /* ELSE */
+		display_block();
+		return(-1L);
+	} /* IF */
+	hit_index_clear(&search_hits);
+	search_hits = hits;
+	sprintf(sidecar.hits_pattern,"record bytes %ld..%ld = %s",filter.field,
+				last,text);
+	sidecar.hits_current = 1;
+
+	number = hit_index_find(&search_hits,current_file_offset);
+	if ( number >= search_hits.num_hits ) {
+		number = 0L;
+	} /* IF */
+	search_hits.current = number;
+	last_match_offset = hit_index_get(&search_hits,number);
+
+	return(last_match_offset);
+} /* end of find_records */
+
+/*********************************************************************
+*
+* Function  : diff_mismatch
+*
+* Purpose   : Find the first byte at which two buffers differ.
+*
+* Inputs    : const unsigned char *first - first buffer
+*             const unsigned char *second - second buffer
+*             long length - number of bytes in each buffer
+*
+* Output    : (none)
+*
+* Returns   : index of first differing byte , length if they are equal
+*
+* Example   : index = diff_mismatch(first,second,length);
+*
+* Notes     : Equal data is compared four vectors at a time , the
+*             lane of the difference is found from the compare mask.
+*
+*********************************************************************/
+
+static long diff_mismatch(const unsigned char *first,
+				const unsigned char *second, long length)
+{
+	long	index;
+#if defined(SEARCH_LANES)
+	SEARCH_VECTOR	equal;
+	unsigned int	mask;
+#endif
+
+	index = 0L;
+#if defined(SEARCH_LANES)
+	for ( ; index + 4 * SEARCH_LANES <= length ; index += 4 * SEARCH_LANES ) {
+		equal = SEARCH_AND(
+			SEARCH_AND(SEARCH_EQUAL(SEARCH_LOAD(&first[index]),
+						SEARCH_LOAD(&second[index])),
+				SEARCH_EQUAL(SEARCH_LOAD(&first[index + SEARCH_LANES]),
+						SEARCH_LOAD(&second[index + SEARCH_LANES]))),
+			SEARCH_AND(SEARCH_EQUAL(SEARCH_LOAD(&first[index + 2 * SEARCH_LANES]),
+						SEARCH_LOAD(&second[index + 2 * SEARCH_LANES])),
+				SEARCH_EQUAL(SEARCH_LOAD(&first[index + 3 * SEARCH_LANES]),
+						SEARCH_LOAD(&second[index + 3 * SEARCH_LANES]))));
+		if ( SEARCH_MASK(equal) != SEARCH_ALL_LANES ) {
+			break;
+		} /* IF */
+	} /* FOR */
+	for ( ; index + SEARCH_LANES <= length ; index += SEARCH_LANES ) {
+		mask = SEARCH_MASK(SEARCH_EQUAL(SEARCH_LOAD(&first[index]),
+						SEARCH_LOAD(&second[index])));
+		if ( mask != SEARCH_ALL_LANES ) {
+			return(index + __builtin_ctz(~mask));
+		} /* IF */
+	} /* FOR */
+#endif
+	for ( ; index < length && first[index] == second[index] ; ++index ) {
+		;
+	} /* FOR */
+
+	return(index);
+} /* end of diff_mismatch */
+
+/*********************************************************************
+*
+* Function  : diff_match
+*
+* Purpose   : Find the first byte at which two buffers are equal.
+*
+* Inputs    : const unsigned char *first - first buffer
+*             const unsigned char *second - second buffer
+*             long length - number of bytes in each buffer
+*
+* Output    : (none)
+*
+* Returns   : index of first equal byte , length if none are equal
+*
+* Example   : end = index + diff_match(&first[index],&second[index],
+*                                      length - index);
+*
+* Notes     : (none)
+*
+*********************************************************************/
+
+static long diff_match(const unsigned char *first,
+				const unsigned char *second, long length)
+{
+	long	index;
+#if defined(SEARCH_LANES)
+	unsigned int	mask;
+#endif
+
+	index = 0L;
+#if defined(SEARCH_LANES)
+	for ( ; index + SEARCH_LANES <= length ; index += SEARCH_LANES ) {
+		mask = SEARCH_MASK(SEARCH_EQUAL(SEARCH_LOAD(&first[index]),
+						SEARCH_LOAD(&second[index])));
+		if ( mask != 0 ) {
+			return(index + __builtin_ctz(mask));
+		} /* IF */
+	} /* FOR */
+#endif
+	for ( ; index < length && first[index] != second[index] ; ++index ) {
+		;
+	} /* FOR */
+
+	return(index);
+} /* end of diff_match */
+
+/*********************************************************************
+*
+* Function  : diff_add
+*
+* Purpose   : Add a range of differing bytes to a difference index.
+*
+* Inputs    : DIFF_INDEX *diffs - the index
+*             long offset - offset of the range
+*             long length - length of the range
+*             long num_bytes - number of bytes in it which differ
+*
+* Output    : (none)
+*
+* Returns   : 0 --> success , -1 --> out of memory
+*
+* Example   : diff_add(&diffs,offset,length,length);
+*
+* Notes     : Ranges must be added in order of offset. A range less
+*             than DIFF_MIN_GAP bytes after the previous one is merged
+*             into it , which also joins up ranges split across chunks
+*             or segments.
+*
+*********************************************************************/
+
+static int diff_add(DIFF_INDEX *diffs, long offset, long length,
+					long num_bytes)
+{
+	DIFF_RANGE	*last , *ranges;
+	long	max_ranges;
+
+	diffs->num_bytes += num_bytes;
+	if ( diffs->num_ranges > 0L ) {
+		last = &diffs->ranges[diffs->num_ranges - 1L];
+		if ( offset - (last->offset + last->length) < DIFF_MIN_GAP ) {
+			last->length = offset + length - last->offset;
+			return(0);
+		} /* IF */
+	} /* IF */
+	if ( diffs->num_ranges == diffs->max_ranges ) {
+		max_ranges = diffs->max_ranges == 0L ? DIFF_GROW :
+						2L * diffs->max_ranges;
+		ranges = (DIFF_RANGE *)realloc(diffs->ranges,
+						max_ranges * sizeof(DIFF_RANGE));
+		if ( ranges == NULL ) {
+			return(-1);
+		} /* IF */
+		diffs->ranges = ranges;
+		diffs->max_ranges = max_ranges;
+	} /* IF */
+	diffs->ranges[diffs->num_ranges].offset = offset;
+	diffs->ranges[diffs->num_ranges].length = length;
+	diffs->num_ranges += 1L;
+
+	return(0);
+} /* end of diff_add */
+
+/*********************************************************************
+*
+* Function  : diff_clear
+*
+* Purpose   : Release the memory held by a difference index.
+*
+* Inputs    : DIFF_INDEX *diffs - the index
+*
+* Output    : (none)
+*
+* Returns   : (nothing)
+*
+* Example   : diff_clear(&file_diffs);
+*
+* Notes     : (none)
+*
+*********************************************************************/
+
+static void diff_clear(DIFF_INDEX *diffs)
+{
+	free(diffs->ranges);
+	memset(diffs,0,sizeof(DIFF_INDEX));
+	diffs->current = -1L;
+
+	return;
+} /* end of diff_clear */
+
+/*********************************************************************
+*
+* Function  : diff_segment
+*
+* Purpose   : Find the differences between two files in one segment.
+*
+* Inputs    : SEARCH_WORKER *worker - worker doing the compare
+*             long low - first offset of the segment
+*             long high - offset after the segment
+*             DIFF_INDEX *diffs - receives the differences
+*
+* Output    : (none)
+*
+* Returns   : 0 --> success , -2 --> read error or out of memory ,
+*             -3 --> cancelled
+*
+* Example   : result = diff_segment(worker,low,high,&job->diffs[segment]);
+*
+* Notes     : The segment is compared a search chunk at a time.
+*
+*********************************************************************/
+
+static long diff_segment(SEARCH_WORKER *worker, long low, long high,
+					DIFF_INDEX *diffs)
+{
+	SEARCH_JOB	*job;
+	unsigned char	*first , *second;
+	long	offset , chunk , first_bytes , second_bytes , index , end;
+
+	job = worker->job;
+	for ( offset = low ; offset < high ; offset += chunk ) {
+		if ( worker->control.cancel ) {
+			return(-3L);
+		} /* IF */
+		chunk = high - offset;
+		if ( chunk > search_chunk_size ) {
+			chunk = search_chunk_size;
+		} /* IF */
+		first = source_view(job->source,offset,chunk,worker->buffer,
+						&first_bytes);
+		second = source_view(job->other,offset,chunk,worker->other_buffer,
+						&second_bytes);
+		if ( first == NULL || second == NULL ) {
+			return(-2L);
+		} /* IF */
+		if ( first_bytes < chunk || second_bytes < chunk ) {
+			errno = EIO;	/* file shrank while being compared */
+			return(-2L);
+		} /* IF */
+		for ( index = 0L ; ; index = end ) {
+			index += diff_mismatch(&first[index],&second[index],chunk - index);
+			if ( index >= chunk ) {
+				break;
+			} /* IF */
+			end = index + diff_match(&first[index],&second[index],
+							chunk - index);
+			if ( diff_add(diffs,offset + index,end - index,end - index) < 0 ) {
+				return(-2L);
+			} /* IF */
+		} /* FOR */
+		worker->control.bytes_searched += chunk;
+	} /* FOR */
+
+	return(0L);
+} /* end of diff_segment */
+
+/*********************************************************************
+*
+* Function  : diff_worker
+*
+* Purpose   : Thread which compares segments of two files until there
+*             are none left.
+*
+* Inputs    : void *argument - the worker's SEARCH_WORKER
+*
+* Output    : (none)
+*
+* Returns   : NULL
+*
+* Example   : pthread_create(&worker->thread,NULL,diff_worker,worker);
+*
+* Notes     : Each segment has its own difference index , so the
+*             workers only need the lock to claim a segment.
+*
+*********************************************************************/
+
+static void *diff_worker(void *argument)
+{
+	SEARCH_WORKER	*worker;
+	SEARCH_JOB	*job;
+	long	segment , low , high , result;
+
+	worker = (SEARCH_WORKER *)argument;
+	job = worker->job;
+	while ( 1 ) {
+		pthread_mutex_lock(&job->lock);
+		segment = job->next_segment;
+		if ( job->cancel || segment >= job->num_segments ||
+					job->found_offset < 0L ) {
+			pthread_mutex_unlock(&job->lock);
+			break;
+		} /* IF */
+		job->next_segment += 1L;
+		worker->segment = segment;
+		pthread_mutex_unlock(&job->lock);
+
+		low = segment * job->segment_size;
+		high = low + job->segment_size;
+		if ( high > job->total_bytes ) {
+			high = job->total_bytes;
+		} /* IF */
+		result = diff_segment(worker,low,high,&job->diffs[segment]);
+
+		pthread_mutex_lock(&job->lock);
+		if ( result < 0L && job->found_offset == 0L ) {
+			job->found_offset = result;
+		} /* IF */
+		worker->segment = -1L;
+		pthread_mutex_unlock(&job->lock);
+	} /* WHILE */
+
+	pthread_mutex_lock(&job->lock);
+	job->num_running -= 1;
+	pthread_mutex_unlock(&job->lock);
+
+	return(NULL);
+} /* end of diff_worker */
+
+/*********************************************************************
+*
+* Function  : compare_files
+*
+* Purpose   : Build the index of the ranges in which the file differs
+*             from the file given with -C.
+*
+* Inputs    : (none)
+*
+* Output    : (none)
+*
+* Returns   : 0 --> success , -1 --> error or cancelled
+*
+* Example   : compare_files();
+*
+* Notes     : The common part of the files is divided into segments
+*             which a pool of workers compare in parallel , as for a
+*             search. The segment indexes are then joined in order.
+*             Bytes present in only one of the files form a final
+*             range. The previous index is kept if this fails.
+*
+*********************************************************************/
+
+static int compare_files()
+{
+	SEARCH_JOB	job;
+	DIFF_INDEX	diffs;
+	DIFF_RANGE	*range;
+	long	size , other_size , segment , number;
+	int		count , num_threads , cancelled , status;
+
+	size = source_size(&input_source);
+	other_size = source_size(&compare_source);
+	memset(&job,0,sizeof(job));
+	job.source = &input_source;
+	job.other = &compare_source;
+	job.activity = "Comparing";
+	job.segment_size = SEARCH_SEGMENT_SIZE;
+	job.total_bytes = size < other_size ? size : other_size;
+	job.num_segments = (job.total_bytes + job.segment_size - 1L) /
+							job.segment_size;
+	job.found_offset = 0L;
+	cancelled = 0;
+	num_threads = opt_threads;
+	if ( num_threads > job.num_segments ) {
+		num_threads = (int)job.num_segments;
+	} /* IF */
+	if ( num_threads < 1 ) {
+		num_threads = 1;
+	} /* IF */
+	job.diffs = (DIFF_INDEX *)calloc(job.num_segments + 1L,sizeof(DIFF_INDEX));
+	job.workers = (SEARCH_WORKER *)calloc(num_threads,sizeof(SEARCH_WORKER));
+	if ( job.diffs == NULL || job.workers == NULL ) {
+		free(job.diffs);
+		free(job.workers);
+		error_message("Out of memory");
+		return(-1);
+	} /* IF */
+	pthread_mutex_init(&job.lock,NULL);
+	for ( count = 0 ; count < num_threads ; ++count ) {
+		job.workers[count].job = &job;
+		job.workers[count].segment = -1L;
+		job.workers[count].buffer = count == 0 ? temp_buffer :
+			(unsigned char *)malloc(search_chunk_size);
+		job.workers[count].other_buffer =
+			(unsigned char *)malloc(search_chunk_size);
+		if ( job.workers[count].buffer == NULL ||
+					job.workers[count].other_buffer == NULL ) {
+			if ( count > 0 ) {
+				free(job.workers[count].buffer);
+			} /* IF */
+			free(job.workers[count].other_buffer);
+			break;
+		} /* IF */
+	} /* FOR */
+	job.num_workers = count;
+	if ( job.num_workers == 0 ) {
+		pthread_mutex_destroy(&job.lock);
+		free(job.diffs);
+		free(job.workers);
+		error_message("Out of memory");
+		return(-1);
+	} /* IF */
+
+	source_advise(&input_source,MADV_SEQUENTIAL);
+	source_advise(&compare_source,MADV_SEQUENTIAL);
+	pthread_mutex_lock(&job.lock);
+	for ( count = 0 ; count < job.num_workers ; ++count ) {
+		if ( pthread_create(&job.workers[count].thread,NULL,diff_worker,
+						&job.workers[count]) != 0 ) {
+			break;
+		} /* IF */
+		job.num_running += 1;
+	} /* FOR */
+	num_threads = count;
+	pthread_mutex_unlock(&job.lock);
+	if ( num_threads == 0 ) {
+		/* no threads to be had , compare in this one */
+		job.num_running = 1;
+		diff_worker(&job.workers[0]);
+	} /* IF */
+	else {
+		cancelled = search_monitor(&job);
+	} /* ELSE */
+	for ( count = 0 ; count < job.num_workers ; ++count ) {
+		if ( count < num_threads ) {
+			pthread_join(job.workers[count].thread,NULL);
+		} /* IF */
+		if ( count > 0 ) {
+			free(job.workers[count].buffer);
+		} /* IF */
+		free(job.workers[count].other_buffer);
+	} /* FOR */
+	source_advise(&input_source,MADV_NORMAL);
+	source_advise(&compare_source,MADV_NORMAL);
+	pthread_mutex_destroy(&job.lock);
+	free(job.workers);
+
+	memset(&diffs,0,sizeof(diffs));
+	diffs.current = -1L;
+	status = cancelled || job.found_offset < 0L ? -1 : 0;
+	for ( segment = 0L ; segment < job.num_segments ; ++segment ) {
+		for ( number = 0L ; status == 0 &&
+					number < job.diffs[segment].num_ranges ; ++number ) {
+			range = &job.diffs[segment].ranges[number];
+			if ( diff_add(&diffs,range->offset,range->length,0L) < 0 ) {
+				status = -1;
+			} /* IF */
+		} /* FOR */
+		diffs.num_bytes += job.diffs[segment].num_bytes;
+		free(job.diffs[segment].ranges);
+	} /* FOR */
+	free(job.diffs);
+	if ( status == 0 && size != other_size ) {
+		number = size > other_size ? size - other_size : other_size - size;
+		if ( diff_add(&diffs,job.total_bytes,number,number) < 0 ) {
+			status = -1;
+		} /* IF */
+	} /* IF */
+	if ( status < 0 ) {
+		diff_clear(&diffs);
+		if ( cancelled ) {
+			error_message("Compare cancelled");
+		} /* IF */
+		else {
+			system_error("Can't compare with \"%s\"",compare_name);
+		} /* ELSE */
+		return(-1);
+	} /* IF */
+
+	diff_clear(&file_diffs);
+	file_diffs = diffs;
+	debug_print("compare : %ld ranges , %ld bytes differ\n",
+				file_diffs.num_ranges,file_diffs.num_bytes);
+
+	return(0);
+} /* end of compare_files */
+
+/*********************************************************************
+*
+* Function  : goto_diff
+*
+* Purpose   : Move to the next or previous range in which the files
+*             being compared differ.
+*
+* Inputs    : int direction - 1 --> next range , -1 --> previous range
+*
+* Output    : (none)
+*
+* Returns   : If there is such a range Then its offset Else -1L
+*
+* Example   : offset = goto_diff(1);
+*
+* Notes     : Ranges are relative to the current offset , the index is
+*             sorted so a binary search finds the neighbours. A range
+*             past the end of this file is shown from its last byte.
+*
+*********************************************************************/
+
+static long goto_diff(int direction)
+{
+	long	low , high , middle , number , offset , position;
+
+	if ( compare_name == NULL ) {
+		error_message("No file to compare with , use the -C option");
+		return(-1L);
+	} /* IF */
+	position = current_file_offset;
+	if ( file_diffs.current >= 0L && file_diffs.current < file_diffs.num_ranges &&
+			position == filesize - 1L &&
+			file_diffs.ranges[file_diffs.current].offset >= filesize ) {
+		position = file_diffs.ranges[file_diffs.current].offset;
+	} /* IF */
+	low = 0L;
+	high = file_diffs.num_ranges;
+	while ( low < high ) {
+		middle = low + (high - low) / 2L;
+		if ( file_diffs.ranges[middle].offset <= position ) {
+			low = middle + 1L;
+		} /* IF */
+		else {
+			high = middle;
+		} /* ELSE */
+	} /* WHILE */
+	/* low is now the first range which starts after the current offset */
+	number = low;
+	if ( direction < 0 ) {
+		number = low - 1L;
+		if ( number >= 0L &&
+				file_diffs.ranges[number].offset == position ) {
+			number -= 1L;
+		} /* IF */
+	} /* IF */
+	if ( number < 0L || number >= file_diffs.num_ranges ) {
+		if ( file_diffs.num_ranges == 0L ) {
+			error_message("The files are identical");
+		} /* IF */
+		else {
+			error_message(direction > 0 ? "No more differences" :
+						"No previous differences");
+		} /* ELSE */
+		return(-1L);
+	} /* IF */
+	file_diffs.current = number;
+	offset = file_diffs.ranges[number].offset;
+	if ( offset >= filesize && filesize > 0L ) {
+		offset = filesize - 1L;
+	} /* IF */
+
+	return(offset);
+} /* end of goto_diff */
+
+/*********************************************************************
+*
+* Function  : hash_bytes
+*
+* Purpose   : Add a range of the file to a hash.
+*
+* Inputs    : SEARCH_WORKER *worker - the worker doing the hashing
+*             HASH_STATE *state - the hash
+*             long low - first offset
+*             long high - offset after the last byte
+*
+* Output    : (none)
+*
+* Returns   : 0 --> success , -1 --> read error , 1 --> cancelled
+*
+* Example   : status = hash_bytes(worker,&state,low,high);
+*
+* Notes     : The range is read a chunk at a time into the worker's
+*             buffer , so edits not yet saved are included.
+*
+*********************************************************************/
+
+static int hash_bytes(SEARCH_WORKER *worker, HASH_STATE *state, long low,
+					long high)
+{
+	SEARCH_JOB	*job;
+	long	offset , count , num_bytes;
+
+	job = worker->job;
+	for ( offset = low ; offset < high ; offset += num_bytes ) {
+		if ( worker->control.cancel ) {
+			return(1);
+		} /* IF */
+		count = high - offset;
+		if ( count > search_chunk_size ) {
+			count = search_chunk_size;
+		} /* IF */
+		num_bytes = source_read(job->source,offset,worker->buffer,count);
+		if ( num_bytes <= 0L ) {
+			return(-1);
+		} /* IF */
+		hash_update(state,worker->buffer,num_bytes);
+		worker->control.bytes_searched += num_bytes;
+	} /* FOR */
+
+	return(0);
+} /* end of hash_bytes */
+
+/*********************************************************************
+*
+* Function  : hash_chunk_worker
+*
+* Purpose   : Thread which hashes the chunks of a hash tree without a
+*             valid digest until there are none left.
+*
+* Inputs    : void *argument - the worker's SEARCH_WORKER
+*
+* Output    : (none)
+*
+* Returns   : NULL
+*
+* Example   : pthread_create(&worker->thread,NULL,hash_chunk_worker,worker);
+*
+* Notes     : Each chunk is claimed under the lock , after that the
+*             worker is the only one to touch its digest. A chunk which
+*             had a stale digest is marked as changed if the new digest
+*             differs.
+*
+*********************************************************************/
+
+static void *hash_chunk_worker(void *argument)
+{
+	SEARCH_WORKER	*worker;
+	SEARCH_JOB	*job;
+	HASH_TREE	*tree;
+	HASH_STATE	state;
+	unsigned char	digest[HASH_MAX_DIGEST] , *old_digest;
+	long	chunk , low , high;
+	int		status , length;
+
+	worker = (SEARCH_WORKER *)argument;
+	job = worker->job;
+	tree = job->tree;
+	while ( 1 ) {
+		pthread_mutex_lock(&job->lock);
+		chunk = job->next_segment;
+		while ( chunk < job->num_segments && tree->state[chunk] == CHUNK_VALID ) {
+			chunk += 1L;
+		} /* WHILE */
+		if ( job->cancel || chunk >= job->num_segments ||
+					job->found_offset < 0L ) {
+			pthread_mutex_unlock(&job->lock);
+			break;
+		} /* IF */
+		job->next_segment = chunk + 1L;
+		worker->segment = chunk;
+		pthread_mutex_unlock(&job->lock);
+
+		low = chunk * HASH_CHUNK_SIZE;
+		high = low + HASH_CHUNK_SIZE;
+		if ( high > filesize ) {
+			high = filesize;
+		} /* IF */
+		hash_start(&state,job->algorithm);
+		status = hash_bytes(worker,&state,low,high);
+		if ( status == 0 ) {
+			length = hash_finish(&state,digest);
+			old_digest = &tree->digests[chunk * HASH_MAX_DIGEST];
+			tree->changed[chunk] = tree->state[chunk] == CHUNK_STALE &&
+							memcmp(old_digest,digest,length) != 0;
+			memcpy(old_digest,digest,length);
+			tree->state[chunk] = CHUNK_VALID;
+		} /* IF */
+
+		pthread_mutex_lock(&job->lock);
+		if ( status < 0 ) {
+			job->found_offset = -2L;
+		} /* IF */
+		worker->segment = -1L;
+		pthread_mutex_unlock(&job->lock);
+	} /* WHILE */
+
+	pthread_mutex_lock(&job->lock);
+	job->num_running -= 1;
+	pthread_mutex_unlock(&job->lock);
+
+	return(NULL);
+} /* end of hash_chunk_worker */
+
+/*********************************************************************
+*
+* Function  : hash_range_worker
+*
+* Purpose   : Thread which hashes a range of the file.
+*
+* Inputs    : void *argument - the worker's SEARCH_WORKER
+*
+* Output    : (none)
+*
+* Returns   : NULL
+*
+* Example   : pthread_create(&worker->thread,NULL,hash_range_worker,worker);
+*
+* Notes     : A flat hash is serial , so only one worker is used.
+*
+*********************************************************************/
+
+static void *hash_range_worker(void *argument)
+{
+	SEARCH_WORKER	*worker;
+	SEARCH_JOB	*job;
+	int		status;
+
+	worker = (SEARCH_WORKER *)argument;
+	job = worker->job;
+	status = hash_bytes(worker,job->hash,job->start,
+					job->start + job->total_bytes);
+
+	pthread_mutex_lock(&job->lock);
+	job->found_offset = status < 0 ? -2L : 0L;
+	job->num_running -= 1;
+	pthread_mutex_unlock(&job->lock);
+
+	return(NULL);
+} /* end of hash_range_worker */
+
+/*********************************************************************
+*
+* Function  : hash_tree_update
+*
+* Purpose   : Hash the chunks of the file without a valid digest and
+*             work out the root digest.
+*
+* Inputs    : int algorithm - HASH_CRC32C , HASH_XXH64 or HASH_SHA256
+*             unsigned char *root - receives the root digest
+*             long *num_changed - receives the number of chunks whose
+*                                 stale digest turned out to differ
+*             long *first_changed - receives the offset of the first
+*                                   of them
+*
+* Output    : (none)
+*
+* Returns   : length of root digest , -1 --> error or cancelled
+*
+* Example   : length = hash_tree_update(HASH_SHA256,root,&count,&first);
+*
+* Notes     : The chunks are shared out among a pool of workers as the
+*             segments of a search are. Chunks hashed before a cancel
+*             keep their digests.
+*
+*********************************************************************/
+
+static int hash_tree_update(int algorithm, unsigned char *root,
+					long *num_changed, long *first_changed)
+{
+	SEARCH_JOB	job;
+	HASH_TREE	*tree;
+	HASH_STATE	state;
+	long	chunk;
+	int		count , num_threads , cancelled;
+
+	tree = &hash_trees[algorithm];
+	if ( hash_tree_resize(tree) < 0 ) {
+		error_message("Out of memory");
+		return(-1);
+	} /* IF */
+	memset(&job,0,sizeof(job));
+	job.source = &input_source;
+	job.tree = tree;
+	job.algorithm = algorithm;
+	job.activity = "Hashing";
+	job.num_segments = tree->num_chunks;
+	for ( chunk = 0L ; chunk < tree->num_chunks ; ++chunk ) {
+		tree->changed[chunk] = 0;
+		if ( tree->state[chunk] != CHUNK_VALID ) {
+			job.total_bytes += chunk == tree->num_chunks - 1L ?
+				filesize - chunk * HASH_CHUNK_SIZE : HASH_CHUNK_SIZE;
+		} /* IF */
+	} /* FOR */
+	cancelled = 0;
+	num_threads = opt_threads;
+	if ( num_threads > job.total_bytes / HASH_CHUNK_SIZE + 1L ) {
+		num_threads = (int)(job.total_bytes / HASH_CHUNK_SIZE + 1L);
+	} /* IF */
+	if ( num_threads < 1 ) {
+		num_threads = 1;
+	} /* IF */
+	job.workers = (SEARCH_WORKER *)calloc(num_threads,sizeof(SEARCH_WORKER));
+	if ( job.workers == NULL ) {
+		error_message("Out of memory");
+		return(-1);
+	} /* IF */
+	pthread_mutex_init(&job.lock,NULL);
+	for ( count = 0 ; count < num_threads ; ++count ) {
+		job.workers[count].job = &job;
+		job.workers[count].segment = -1L;
+		job.workers[count].buffer = count == 0 ? temp_buffer :
+			(unsigned char *)malloc(search_chunk_size);
+		if ( job.workers[count].buffer == NULL ) {
+			break;
+		} /* IF */
+	} /* FOR */
+	job.num_workers = count;
+
+	if ( job.total_bytes > 0L ) {
+		source_advise(&input_source,MADV_SEQUENTIAL);
+		pthread_mutex_lock(&job.lock);
+		for ( count = 0 ; count < job.num_workers ; ++count ) {
+			if ( pthread_create(&job.workers[count].thread,NULL,
+					hash_chunk_worker,&job.workers[count]) != 0 ) {
+				break;
+			} /* IF */
+			job.num_running += 1;
+		} /* FOR */
+		num_threads = count;
+		pthread_mutex_unlock(&job.lock);
+		if ( num_threads == 0 ) {
+			/* no threads to be had , hash in this one */
+			job.num_running = 1;
+			hash_chunk_worker(&job.workers[0]);
+		} /* IF */
+		else {
+			cancelled = search_monitor(&job);
+		} /* ELSE */
+		for ( count = 0 ; count < num_threads ; ++count ) {
+			pthread_join(job.workers[count].thread,NULL);
+		} /* FOR */
+		source_advise(&input_source,MADV_NORMAL);
+	} /* IF */
+	for ( count = 1 ; count < job.num_workers ; ++count ) {
+		free(job.workers[count].buffer);
+	} /* FOR */
+	pthread_mutex_destroy(&job.lock);
+	free(job.workers);
+	if ( cancelled ) {
+		error_message("Hash cancelled");
+		return(-1);
+	} /* IF */
+	if ( job.found_offset < 0L ) {
+		system_error("Can't hash \"%s\"",filename);
+		return(-1);
+	} /* IF */
+
+	*num_changed = 0L;
+	*first_changed = -1L;
+	hash_start(&state,algorithm);
+	for ( chunk = 0L ; chunk < tree->num_chunks ; ++chunk ) {
+		hash_update(&state,&tree->digests[chunk * HASH_MAX_DIGEST],
+						hash_digest_lengths[algorithm]);
+		if ( tree->changed[chunk] ) {
+			if ( *num_changed == 0L ) {
+				*first_changed = chunk * HASH_CHUNK_SIZE;
+			} /* IF */
+			*num_changed += 1L;
+		} /* IF */
+	} /* FOR */
+
+	return(hash_finish(&state,root));
+} /* end of hash_tree_update */
+
+/*********************************************************************
+*
+* Function  : hash_range
+*
+* Purpose   : Hash a range of the file in one piece.
+*
+* Inputs    : int algorithm - HASH_CRC32C , HASH_XXH64 or HASH_SHA256
+*             long offset - offset of range
+*             long length - number of bytes
+*             unsigned char *digest - receives the digest
+*
+* Output    : (none)
+*
+* Returns   : length of digest , -1 --> error or cancelled
+*
+* Example   : length = hash_range(HASH_SHA256,0L,filesize,digest);
+*
+* Notes     : Over the whole file the digest is the one given by
+*             sha256sum , xxhsum etc.
+*
+*********************************************************************/
+
+static int hash_range(int algorithm, long offset, long length,
+					unsigned char *digest)
+{
+	SEARCH_JOB	job;
+	HASH_STATE	state;
+	int		cancelled;
+
+	hash_start(&state,algorithm);
+	memset(&job,0,sizeof(job));
+	job.source = &input_source;
+	job.hash = &state;
+	job.activity = "Hashing";
+	job.start = offset;
+	job.total_bytes = length;
+	job.workers = (SEARCH_WORKER *)calloc(1,sizeof(SEARCH_WORKER));
+	if ( job.workers == NULL ) {
+		error_message("Out of memory");
+		return(-1);
+	} /* IF */
+	job.workers[0].job = &job;
+	job.workers[0].buffer = temp_buffer;
+	pthread_mutex_init(&job.lock,NULL);
+	source_advise(&input_source,MADV_SEQUENTIAL);
+	job.num_workers = 1;
+	job.num_running = 1;
+	if ( pthread_create(&job.workers[0].thread,NULL,hash_range_worker,
+							&job.workers[0]) != 0 ) {
+		hash_range_worker(&job.workers[0]);
+		cancelled = 0;
+	} /* IF */
+	else {
+		cancelled = search_monitor(&job);
+		pthread_join(job.workers[0].thread,NULL);
+	} /* ELSE */
+	source_advise(&input_source,MADV_NORMAL);
+	pthread_mutex_destroy(&job.lock);
+	free(job.workers);
+
+	if ( cancelled ) {
+		error_message("Hash cancelled");
+		return(-1);
+	} /* IF */
+	if ( job.found_offset < 0L ) {
+		system_error("Can't hash \"%s\"",filename);
+		return(-1);
+	} /* IF */
+
+	return(hash_finish(&state,digest));
+} /* end of hash_range */
+
+/*********************************************************************
+*
+* Function  : hash_file
+*
+* Purpose   : Hash the file , or a range of it , and show the digest.
+*
+* Inputs    : (none)
+*
+* Output    : the digest in the status window
+*
+* Returns   : (nothing)
+*
+* Example   : hash_file();
+*
+* Notes     : For the whole file the root of the chunk tree is shown ,
+*             which only needs the chunks changed since it was last
+*             worked out to be hashed again. The chunks whose contents
+*             changed , perhaps since an earlier session , are
+*             reported.
+*
+*********************************************************************/
+
+static void hash_file()
+{
+	static	char	hash_keys[] = "cxs";	/* in HASH_CRC32C ... order */
+	unsigned char	digest[HASH_MAX_DIGEST];
+	char	text[2 * HASH_MAX_DIGEST + 1] , range[100] , *ptr;
+	long	offset , length , num_changed , first_changed;
+	int		algorithm , key , count , digest_length;
+
+	message("Hash with c (crc32c) , x (xxh64) or s (sha256) : ");
+	key = wgetch(msg_win);
+	ptr = key > 0 && key < 256 ? strchr(hash_keys,key) : NULL;
+	if ( ptr == NULL ) {
+		error_message("Invalid hash [%c]",key);
+		return;
+	} /* IF */
+	algorithm = (int)(ptr - hash_keys);
+	get_line("Range offset[,length] , RETURN for the whole file : ",
+				range,sizeof(range));
+
+	num_changed = 0L;
+	first_changed = -1L;
+	offset = 0L;
+	length = filesize;
+	if ( range[0] == '\0' ) {
+		digest_length = hash_tree_update(algorithm,digest,&num_changed,
+							&first_changed);
+	} /* IF */
+	else {
+		offset = strtol(range,&ptr,0);
+		if ( *ptr == ',' ) {
+			length = strtol(ptr + 1,&ptr,0);
+		} /* IF */
+		else {
+			length = filesize - offset;
+		} /* ELSE */
+		if ( *ptr != '\0' || offset < 0L || offset > filesize ||
+					length < 0L || length > filesize - offset ) {
+			error_message("Invalid range \"%s\"",range);
+			return;
+		} /* IF */
+		digest_length = hash_range(algorithm,offset,length,digest);
+	} /* ELSE */
+	display_block();
+	if ( digest_length < 0 ) {
+		return;
+	} /* IF */
+
+	for ( count = 0 ; count < digest_length ; ++count ) {
+		sprintf(&text[2 * count],"%02x",digest[count]);
+	} /* FOR */
+	if ( range[0] == '\0' ) {
+		status_message("%s root of %ld chunks : %s",hash_names[algorithm],
+				hash_trees[algorithm].num_chunks,text);
+	} /* IF */
+	else {
+		status_message("%s of 0x%lx,%ld : %s",hash_names[algorithm],
+				offset,length,text);
+	} /* ELSE */
+	if ( num_changed > 0L ) {
+		error_message("%ld chunks changed , the first at offset 0x%lx",
+				num_changed,first_changed);
+	} /* IF */
+
+	return;
+} /* end of hash_file */
+
+/*********************************************************************
+*
+* Function  : sidecar_path
+*
+* Purpose   : Build the name of the sidecar file of a file.
+*
+* Inputs    : const struct stat *stats - status of the file
+*
+* Output    : (none)
+*
+* Returns   : 0 --> success , -1 --> no place for sidecars
+*
+* Example   : sidecar_path(&filestats);
+*
+* Notes     : Sidecars are kept in $XDG_CACHE_HOME/hed5 or else in
+*             ~/.cache/hed5 , which are created if need be. The name
+*             is made from the device and inode so that any name of
+*             the file finds it.
+*
+*********************************************************************/
+
+static int sidecar_path(const struct stat *stats)
+{
+	char	*base;
+	int		length;
+
+	base = getenv("XDG_CACHE_HOME");
+	if ( base != NULL && base[0] != '\0' ) {
+		length = snprintf(sidecar.path,sizeof(sidecar.path),"%s/hed5",base);
+	} /* IF */
+	else {
+		base = getenv("HOME");
+		if ( base == NULL ) {
+			return(-1);
+		} /* IF */
+		snprintf(sidecar.path,sizeof(sidecar.path),"%s/.cache",base);
+		mkdir(sidecar.path,0700);
+		length = snprintf(sidecar.path,sizeof(sidecar.path),"%s/.cache/hed5",
+						base);
+	} /* ELSE */
+	mkdir(sidecar.path,0700);	/* usually there already */
+	if ( length >= (int)sizeof(sidecar.path) - 40 ) {
+		sidecar.path[0] = '\0';
+		return(-1);
+	} /* IF */
+	sprintf(&sidecar.path[length],"/%lx-%lx.idx",
+		(unsigned long)stats->st_dev,(unsigned long)stats->st_ino);
+
+	return(0);
+} /* end of sidecar_path */
+
+/*********************************************************************
+*
+* Function  : sidecar_matches
+*
+* Purpose   : Check that a sidecar describes a file as it now is.
+*
+* Inputs    : const SIDECAR_HEADER *header - header of the sidecar
+*             const struct stat *stats - status of the file
+*
+* Output    : (none)
+*
+* Returns   : 1 --> it does , 0 --> it doesn't
+*
+* Example   : if ( sidecar_matches(header,&filestats) ) ...
+*
+* Notes     : (none)
+*
+*********************************************************************/
+
+static int sidecar_matches(const SIDECAR_HEADER *header,
+					const struct stat *stats)
+{
+	return(header != NULL &&
+			header->device == (long)stats->st_dev &&
+			header->inode == (long)stats->st_ino &&
+			header->size == (long)stats->st_size &&
+			header->mtime == (long)stats->st_mtim.tv_sec &&
+			header->mtime_nsec == (long)stats->st_mtim.tv_nsec);
+} /* end of sidecar_matches */
+
+/*********************************************************************
+*
+* Function  : sidecar_open
+*
+* Purpose   : Map the sidecar of the file being edited.
+*
+* Inputs    : const struct stat *stats - status of the file
+*
+* Output    : (none)
+*
+* Returns   : (nothing)
+*
+* Example   : sidecar_open(&filestats);
+*
+* Notes     : Only regular files have sidecars. A sidecar which is
+*             damaged is ignored and replaced when hed5 exits. Of one
+*             left by an older version of the file only the chunk
+*             digests are used.
+*
+*********************************************************************/
+
+static void sidecar_open(const struct stat *stats)
+{
+	const SIDECAR_HEADER	*header;
+	const SIDECAR_SECTION	*section;
+	struct stat	info;
+	void	*map;
+	int		fd , count;
+
+	memset(&sidecar,0,sizeof(sidecar));
+	if ( ! S_ISREG(stats->st_mode) || sidecar_path(stats) < 0 ) {
+		return;
+	} /* IF */
+	fd = open(sidecar.path,O_RDONLY);
+	if ( fd < 0 ) {
+		return;
+	} /* IF */
+	if ( fstat(fd,&info) == 0 && info.st_size >= (off_t)sizeof(SIDECAR_HEADER) ) {
+		map = mmap(NULL,(size_t)info.st_size,PROT_READ,MAP_PRIVATE,fd,0);
+		if ( map != MAP_FAILED ) {
+			sidecar.data = (const unsigned char *)map;
+			sidecar.length = (size_t)info.st_size;
+		} /* IF */
+	} /* IF */
+	close(fd);
+	if ( sidecar.data == NULL ) {
+		return;
+	} /* IF */
+
+	header = (const SIDECAR_HEADER *)sidecar.data;
+	if ( memcmp(header->magic,SIDECAR_MAGIC,sizeof(SIDECAR_MAGIC)) != 0 ||
+				header->version != SIDECAR_VERSION ||
+				header->num_sections < 0 ||
+				header->num_sections > SIDECAR_MAX_SECTIONS ) {
+		debug_print("sidecar %s is not valid\n",sidecar.path);
+		return;
+	} /* IF */
+	for ( count = 0 ; count < header->num_sections ; ++count ) {
+		section = &header->sections[count];
+		if ( section->offset < (long)sizeof(SIDECAR_HEADER) ||
+				section->length < 0L ||
+				section->offset > (long)sidecar.length - section->length ||
+				memchr(section->name,'\0',SIDECAR_NAME_LENGTH) == NULL ) {
+			debug_print("sidecar %s is damaged\n",sidecar.path);
+			return;
+		} /* IF */
+	} /* FOR */
+	if ( ! sidecar_matches(header,stats) ) {
+		debug_print("sidecar %s is out of date\n",sidecar.path);
+		sidecar.previous = header;
+		return;
+	} /* IF */
+	sidecar.header = header;
+
+	return;
+} /* end of sidecar_open */
+
+/*********************************************************************
+*
+* Function  : sidecar_section
+*
+* Purpose   : Find a section of the sidecar.
+*
+* Inputs    : int type - SIDECAR_MAP , ...
+*
+* Output    : (none)
+*
+* Returns   : If present Then the section Else NULL
+*
+* Example   : section = sidecar_section(SIDECAR_HITS);
+*
+* Notes     : Sections are only found in a sidecar which matches the
+*             file as it was opened.
+*
+*********************************************************************/
+
+static const SIDECAR_SECTION *sidecar_section(int type)
+{
+	int		count;
+
+	if ( sidecar.header == NULL ) {
+		return(NULL);
+	} /* IF */
+	for ( count = 0 ; count < sidecar.header->num_sections ; ++count ) {
+		if ( sidecar.header->sections[count].type == type ) {
+			return(&sidecar.header->sections[count]);
+		} /* IF */
+	} /* FOR */
+
+	return(NULL);
+} /* end of sidecar_section */
+
+/*********************************************************************
+*
+* Function  : sidecar_load_hits
+*
+* Purpose   : Restore the hit index of the last find all.
+*
+* Inputs    : (none)
+*
+* Output    : (none)
+*
+* Returns   : (nothing)
+*
+* Example   : sidecar_load_hits();
+*
+* Notes     : The hits are stored as they are held in memory , as
+*             deltas between offsets , and are added one by one so
+*             that the checkpoints are rebuilt.
+*
+*********************************************************************/
+
+static void sidecar_load_hits()
+{
+	const SIDECAR_SECTION	*section;
+	HIT_INDEX	stored , hits;
+	size_t	position;
+	long	number , offset;
+
+	section = sidecar_section(SIDECAR_HITS);
+	if ( section == NULL ) {
+		return;
+	} /* IF */
+	memset(&stored,0,sizeof(stored));
+	stored.deltas = (unsigned char *)&sidecar.data[section->offset];
+	stored.num_bytes = (size_t)section->length;
+	memset(&hits,0,sizeof(hits));
+	position = 0;
+	offset = 0L;
+	for ( number = 0L ; number < section->count ; ++number ) {
+		if ( position >= stored.num_bytes ) {
+			hit_index_clear(&hits);
+			return;
+		} /* IF */
+		offset += hit_index_decode(&stored,&position);
+		if ( hit_index_add(&hits,offset) < 0 ) {
+			hit_index_clear(&hits);
+			return;
+		} /* IF */
+	} /* FOR */
+	hit_index_clear(&search_hits);
+	search_hits = hits;
+	strcpy(sidecar.hits_pattern,section->name);
+	sidecar.hits_current = 1;
+	debug_print("sidecar : %ld hits of [%s]\n",search_hits.num_hits,
+				sidecar.hits_pattern);
+
+	return;
+} /* end of sidecar_load_hits */
+
+/*********************************************************************
+*
+* Function  : sidecar_load_map
+*
+* Purpose   : Restore the regions of the overview map.
+*
+* Inputs    : (none)
+*
+* Output    : (none)
+*
+* Returns   : (nothing)
+*
+* Example   : sidecar_load_map();
+*
+* Notes     : Called with the map lock held , the map thread then only
+*             works on the regions which were not finished.
+*
+*********************************************************************/
+
+static void sidecar_load_map()
+{
+	const SIDECAR_SECTION	*section;
+	long	number;
+
+	section = sidecar_section(SIDECAR_MAP);
+	if ( section == NULL || ! overview.active ||
+				section->param != overview.region_size ||
+				section->count != overview.num_regions ||
+				section->length != section->count * (long)sizeof(MAP_REGION) ) {
+		return;
+	} /* IF */
+	memcpy(overview.regions,&sidecar.data[section->offset],section->length);
+	for ( number = 0L ; number < overview.num_regions ; ++number ) {
+		if ( overview.regions[number].state != MAP_SAMPLED &&
+					overview.regions[number].state != MAP_EXACT ) {
+			overview.regions[number].state = MAP_EMPTY;
+		} /* IF */
+	} /* FOR */
+	overview.updates += 1L;
+
+	return;
+} /* end of sidecar_load_map */
+
+/*********************************************************************
+*
+* Function  : sidecar_load_hashes
+*
+* Purpose   : Restore the chunk digests of the hash trees.
+*
+* Inputs    : (none)
+*
+* Output    : (none)
+*
+* Returns   : (nothing)
+*
+* Example   : sidecar_load_hashes();
+*
+* Notes     : The digests are also taken from a sidecar left by an
+*             older version of the file , marked as stale , so that
+*             the next hash reports the chunks which have changed
+*             since then (e.g. by a patch applied elsewhere).
+*
+*********************************************************************/
+
+static void sidecar_load_hashes()
+{
+	const SIDECAR_HEADER	*header;
+	const SIDECAR_SECTION	*section;
+	const unsigned char	*states;
+	HASH_TREE	*tree;
+	long	number , count;
+	int		index;
+
+	header = sidecar.header != NULL ? sidecar.header : sidecar.previous;
+	if ( header == NULL ) {
+		return;
+	} /* IF */
+	for ( index = 0 ; index < header->num_sections ; ++index ) {
+		section = &header->sections[index];
+		if ( section->type != SIDECAR_HASHES || section->param < 0L ||
+				section->param >= HASH_NUM_ALGORITHMS || section->count < 0L ||
+				section->length != section->count * (HASH_MAX_DIGEST + 1L) ) {
+			continue;
+		} /* IF */
+		tree = &hash_trees[section->param];
+		if ( hash_tree_resize(tree) < 0 ) {
+			continue;
+		} /* IF */
+		count = section->count < tree->num_chunks ?
+					section->count : tree->num_chunks;
+		memcpy(tree->digests,&sidecar.data[section->offset],
+					count * HASH_MAX_DIGEST);
+		states = &sidecar.data[section->offset + section->count * HASH_MAX_DIGEST];
+		for ( number = 0L ; number < count ; ++number ) {
+			tree->state[number] = states[number];
+			if ( states[number] > CHUNK_VALID ||
+					(header != sidecar.header && states[number] == CHUNK_VALID) ) {
+				tree->state[number] = CHUNK_STALE;
+			} /* IF */
+		} /* FOR */
+		debug_print("sidecar : %ld %s digests\n",count,
+					hash_names[section->param]);
+	} /* FOR */
+
+	return;
+} /* end of sidecar_load_hashes */
+
+/*********************************************************************
+*
+* Function  : sidecar_save
+*
+* Purpose   : Write the sidecar of the file being edited.
+*
+* Inputs    : (none)
+*
+* Output    : (none)
+*
+* Returns   : (nothing)
+*
+* Example   : sidecar_save();
+*
+* Notes     : Nothing is written while there are unsaved changes , as
+*             the results are for the edited file. The overview map is
+*             carried over from the old sidecar if it was not built
+*             this time and the file has not changed , the chunk
+*             digests are always those in memory. The new sidecar is
+*             written alongside and renamed into place. Saving the
+*             file with inserts or deletes renames a new inode over
+*             it , so the sidecar is named again from the file as it
+*             now is and the one of the old inode is removed.
+*
+*********************************************************************/
+
+static void sidecar_save()
+{
+	SIDECAR_HEADER	header;
+	SIDECAR_SECTION	*section;
+	const SIDECAR_SECTION	*old;
+	const void	*data[SIDECAR_MAX_SECTIONS];
+	MAP_REGION	*regions;
+	HASH_TREE	*tree;
+	unsigned char	*hashes[HASH_NUM_ALGORITHMS];
+	struct stat	stats;
+	char	temp_path[PATH_MAX + 32] , old_path[PATH_MAX];
+	FILE	*fp;
+	long	offset , number;
+	int		count , ok , algorithm;
+	static	char	padding[8];
+
+	if ( sidecar.path[0] == '\0' || fstat(input_fd,&stats) < 0 ) {
+		return;
+	} /* IF */
+	strcpy(old_path,sidecar.path);
+	if ( sidecar_path(&stats) < 0 ) {
+		return;
+	} /* IF */
+	if ( strcmp(old_path,sidecar.path) != 0 ) {
+		unlink(old_path);	/* rewrite_file() gave the file a new inode */
+	} /* IF */
+	if ( file_edits.dirty ) {
+		return;
+	} /* IF */
+	memset(&header,0,sizeof(header));
+	memcpy(header.magic,SIDECAR_MAGIC,sizeof(SIDECAR_MAGIC));
+	header.version = SIDECAR_VERSION;
+	header.device = (long)stats.st_dev;
+	header.inode = (long)stats.st_ino;
+	header.size = (long)stats.st_size;
+	header.mtime = (long)stats.st_mtim.tv_sec;
+	header.mtime_nsec = (long)stats.st_mtim.tv_nsec;
+	regions = NULL;
+	old = sidecar_matches(sidecar.header,&stats) ?
+				sidecar_section(SIDECAR_MAP) : NULL;
+
+	section = &header.sections[0];
+	if ( overview.active && overview.num_regions > 0L ) {
+		regions = (MAP_REGION *)malloc(overview.num_regions * sizeof(MAP_REGION));
+		if ( regions == NULL ) {
+			return;
+		} /* IF */
+		memcpy(regions,overview.regions,overview.num_regions * sizeof(MAP_REGION));
+		for ( number = 0L ; number < overview.num_regions ; ++number ) {
+			if ( regions[number].state == MAP_STALE ) {
+				regions[number].state = MAP_EMPTY;
+			} /* IF */
+		} /* FOR */
+		section->type = SIDECAR_MAP;
+		section->length = overview.num_regions * sizeof(MAP_REGION);
+		section->count = overview.num_regions;
+		section->param = overview.region_size;
+		data[section - header.sections] = regions;
+		section += 1;
+	} /* IF */
+	else if ( old != NULL ) {
+		*section = *old;
+		data[section - header.sections] = &sidecar.data[old->offset];
+		section += 1;
+	} /* ELSE IF */
+	if ( search_hits.num_hits > 0L && sidecar.hits_current ) {
+		section->type = SIDECAR_HITS;
+		section->length = (long)search_hits.num_bytes;
+		section->count = search_hits.num_hits;
+		strcpy(section->name,sidecar.hits_pattern);
+		data[section - header.sections] = search_hits.deltas;
+		section += 1;
+	} /* IF */
+	for ( algorithm = 0 ; algorithm < HASH_NUM_ALGORITHMS ; ++algorithm ) {
+		tree = &hash_trees[algorithm];
+		hashes[algorithm] = NULL;
+		if ( tree->num_chunks == 0L ) {
+			continue;
+		} /* IF */
+		hashes[algorithm] = (unsigned char *)malloc(tree->num_chunks *
+								(HASH_MAX_DIGEST + 1L));
+		if ( hashes[algorithm] == NULL ) {
+			continue;
+		} /* IF */
+		memcpy(hashes[algorithm],tree->digests,tree->num_chunks * HASH_MAX_DIGEST);
+		memcpy(&hashes[algorithm][tree->num_chunks * HASH_MAX_DIGEST],
+					tree->state,tree->num_chunks);
+		section->type = SIDECAR_HASHES;
+		section->length = tree->num_chunks * (HASH_MAX_DIGEST + 1L);
+		section->count = tree->num_chunks;
+		section->param = algorithm;
+		data[section - header.sections] = hashes[algorithm];
+		section += 1;
+	} /* FOR */
+	header.num_sections = (int)(section - header.sections);
+	offset = sizeof(header);
+	for ( count = 0 ; count < header.num_sections ; ++count ) {
+		header.sections[count].offset = offset;
+		offset = (offset + header.sections[count].length + 7L) & ~7L;
+	} /* FOR */
+
+	sprintf(temp_path,"%s.%d",sidecar.path,(int)getpid());
+	fp = header.num_sections > 0 ? fopen(temp_path,"w") : NULL;
+	ok = fp != NULL && fwrite(&header,sizeof(header),1,fp) == 1;
+	for ( count = 0 ; ok && count < header.num_sections ; ++count ) {
+		section = &header.sections[count];
+		ok = fwrite(data[count],1,section->length,fp) == (size_t)section->length &&
+				fwrite(padding,1,(8 - section->length % 8) % 8,fp) ==
+						(size_t)((8 - section->length % 8) % 8);
+	} /* FOR */
+	if ( fp != NULL && fclose(fp) != 0 ) {
+		ok = 0;
+	} /* IF */
+	if ( fp != NULL && (! ok || rename(temp_path,sidecar.path) < 0) ) {
+		unlink(temp_path);
+	} /* IF */
+	free(regions);
+	for ( algorithm = 0 ; algorithm < HASH_NUM_ALGORITHMS ; ++algorithm ) {
+		free(hashes[algorithm]);
+	} /* FOR */
+
+	return;
+} /* end of sidecar_save */
+
+/*********************************************************************
+*
+* Function  : sidecar_close
+*
+* Purpose   : Release the mapping of the sidecar.
+*
+* Inputs    : (none)
+*
+* Output    : (none)
+*
+* Returns   : (nothing)
+*
+* Example   : sidecar_close();
+*
+* Notes     : (none)
+*
+*********************************************************************/
+
+static void sidecar_close()
+{
+	if ( sidecar.data != NULL ) {
+		munmap((void *)sidecar.data,sidecar.length);
+	} /* IF */
+	sidecar.data = NULL;
+	sidecar.header = NULL;
+	sidecar.previous = NULL;
+
+	return;
+} /* end of sidecar_close */
+
+/*********************************************************************
+*
+* Function  : scan_forward
+*
+* Purpose   : Scan forward for a pattern.
+*
+* Inputs    : (none)
+*
+* Output    : (none)
+*
+* Returns   : If found Then file offset Else -1L
+*
+* Example   : scan_forward();
+*
+* Notes     : The search starts at the current offset, or just past it
+*             when the current offset is the previous match.
+*
+*********************************************************************/
+
+long scan_forward()
+{
+	SEARCH_PATTERN	pattern;
+	long	offset , start;
+
+	if ( get_pattern("Enter pattern : ",&pattern) < 0 ) {
+		display_block();
+		return(-1L);
+	} /* IF */
+
+	start = current_file_offset;
+	if ( start == last_match_offset ) {
+		start += 1L;
 	} /* IF */
+	source_advise(&input_source,MADV_SEQUENTIAL);
+	offset = parallel_search(&input_source,1,start,&pattern);
+	source_advise(&input_source,MADV_NORMAL);
+	if ( offset >= 0L ) {
+		last_match_offset = offset;
+		return(offset);
+	} /* IF */
+	if ( offset == -2L ) {
+		system_error("Can't read file data");
+	} /* IF */
+	else if ( offset == -3L ) {
+		error_message("Search cancelled");
+	} /* ELSE IF */
 	else {
-		hex_byte = (unsigned char)(number & 0x000000ff);
+		error_message("Not found");
+	} /* ELSE */
+
+	display_block();
+	return(-1L);
+} /* end of scan_forward */
+
+/*********************************************************************
+*
+* Function  : scan_backward
+*
+* Purpose   : Scan backward for a pattern.
+*
+* Inputs    : (none)
+*
+* Output    : (none)
+*
+* Returns   : If found Then file offset Else -1L
+*
+* Example   : scan_backward();
+*
+* Notes     : The search starts at the current offset, or just before
+*             it when the current offset is the previous match.
+*
+*********************************************************************/
+
+long scan_backward()
+{
+	SEARCH_PATTERN	pattern;
+	long	offset , start;
+
+	if ( get_pattern("Enter pattern : ",&pattern) < 0 ) {
+		display_block();
+		return(-1L);
+	} /* IF */
+
+	start = current_file_offset;
+	if ( start == last_match_offset ) {
+		start -= 1L;
+	} /* IF */
+	debug_print("scan_backward() from offset 0x%lx , pattern length %d\n",
+					start,pattern.length);
+	offset = -1L;
+	if ( start >= 0L ) {
+		offset = parallel_search(&input_source,-1,start,&pattern);
+	} /* IF */
+	if ( offset >= 0L ) {
+		debug_print("Found it at 0x%lx.\n",offset);
+		last_match_offset = offset;
+		return(offset);
+	} /* IF */
+	if ( offset == -2L ) {
+		system_error("Can't read file data");
+	} /* IF */
+	else if ( offset == -3L ) {
+		error_message("Search cancelled");
+	} /* ELSE IF */
+	else {
+		error_message("Not found");
 	} /* ELSE */
+	debug_print("Not found\n");
+
+	display_block();
+	return(-1L);
+} /* end of scan_backward */
+
+/*********************************************************************
+*
+* Function  : dump_file
+*
+* Purpose   : Write a hex/character dump of the file to stdout.
+*
+* Inputs    : long start - file offset of first byte
+*             long length - number of bytes , -1L for rest of file
+*
+* Output    : The dump
+*
+* Returns   : 0 --> success , 1 --> error
+*
+* Example   : exit(dump_file(0L,-1L));
+*
+* Notes     : Used for the -x option , without curses. The rows have
+*             the layout of the screen display with num_pairs pairs
+*             per row. The file is read DUMP_CHUNK_SIZE bytes at a
+*             time (in place when it is mapped) and the rows are
+*             collected into a buffer of about the same size which is
+*             written with a single write().
+*
+*********************************************************************/
+
+static int dump_file(long start, long length)
+{
+	unsigned char	*input , *data;
+	char	*output;
+	long	end , offset , chunk_size , row_bytes , view_bytes , index;
+	long	output_length , max_row;
+	int		num_bytes;
+
+	end = filesize;
+	if ( length >= 0L && length < filesize - start ) {
+		end = start + length;
+	} /* IF */
+	row_bytes = 2L * num_pairs;
+	chunk_size = (DUMP_CHUNK_SIZE / row_bytes) * row_bytes;
+	if ( chunk_size < row_bytes ) {
+		chunk_size = row_bytes;	/* a single row wider than a chunk */
+	} /* IF */
+	max_row = 23L + 7L * num_pairs;
+	input = (unsigned char *)malloc(chunk_size);
+	output = (char *)malloc(DUMP_CHUNK_SIZE + max_row);
+	if ( input == NULL || output == NULL ) {
+		quit(1,"malloc failed");
+	} /* IF */
+	source_advise(&input_source,MADV_SEQUENTIAL);
+
+	output_length = 0L;
+	for ( offset = start ; offset < end ; offset += view_bytes ) {
+		data = source_view(&input_source,offset,
+					end - offset < chunk_size ? end - offset : chunk_size,
+					input,&view_bytes);
+		if ( data == NULL ) {
+			quit(1,"Can't read \"%s\" at offset 0x%lx",filename,offset);
+		} /* IF */
+		if ( view_bytes == 0L ) {
+			break;
+		} /* IF */
+		for ( index = 0L ; index < view_bytes ; index += num_bytes ) {
+			num_bytes = (int)(view_bytes - index < row_bytes ?
+							view_bytes - index : row_bytes);
+			output_length += format_row(&output[output_length],offset + index,
+								&data[index],num_bytes,num_pairs);
+			output[output_length++] = '\n';
+			if ( output_length >= DUMP_CHUNK_SIZE ) {
+				if ( edit_write_all(1,(unsigned char *)output,
+								output_length) < 0 ) {
+					quit(1,"Write failed");
+				} /* IF */
+				output_length = 0L;
+			} /* IF */
+		} /* FOR */
+	} /* FOR */
+	if ( edit_write_all(1,(unsigned char *)output,output_length) < 0 ) {
+		quit(1,"Write failed");
+	} /* IF */
+	free(input);
+	free(output);
+
+	return(0);
+} /* end of dump_file */
+
+/*********************************************************************
+*
+* Function  : patch_add_bytes
+*
+* Purpose   : Convert a string of hex digits and add the bytes to the
+*             data of a patch set.
+*
+* Inputs    : PATCH_SET *patches - the patch set
+*             char *text - the hex digits
+*             long *length - receives number of bytes
+*
+* Output    : (none)
+*
+* Returns   : offset of bytes in patches->data , -1L on error
+*
+* Example   : position = patch_add_bytes(patches,"9090",&length);
+*
+* Notes     : (none)
+*
+*********************************************************************/
+
+static long patch_add_bytes(PATCH_SET *patches, char *text, long *length)
+{
+	long	position , count , new_size;
+	unsigned char	*data;
+	int		high , low;
+
+	count = (long)strlen(text);
+	if ( count == 0L || count % 2 != 0 ) {
+		return(-1L);
+	} /* IF */
+	count /= 2;
+	if ( patches->data_length + count > patches->max_data ) {
+		new_size = patches->max_data ? patches->max_data * 2 : 4096L;
+		while ( new_size < patches->data_length + count ) {
+			new_size *= 2;
+		} /* WHILE */
+		data = (unsigned char *)realloc(patches->data,new_size);
+		if ( data == NULL ) {
+			return(-1L);
+		} /* IF */
+		patches->data = data;
+		patches->max_data = new_size;
+	} /* IF */
+	position = patches->data_length;
+	for ( *length = 0L ; *length < count ; *length += 1L , text += 2 ) {
+		high = hex_digit_value(tolower((unsigned char)text[0]));
+		low = hex_digit_value(tolower((unsigned char)text[1]));
+		if ( high < 0 || low < 0 ) {
+			return(-1L);
+		} /* IF */
+		patches->data[position + *length] = (unsigned char)(high << 4 | low);
+	} /* FOR */
+	patches->data_length += count;
+
+	return(position);
+} /* end of patch_add_bytes */
+
+/*********************************************************************
+*
+* Function  : compare_patches
+*
+* Purpose   : qsort() comparison function for patch records.
+*
+* Inputs    : const void *first - first record
+*             const void *second - second record
+*
+* Output    : (none)
+*
+* Returns   : < 0 , 0 or > 0
+*
+* Example   : qsort(records,count,sizeof(PATCH_RECORD),compare_patches);
+*
+* Notes     : Records are ordered by offset , then by line number.
+*
+*********************************************************************/
+
+static int compare_patches(const void *first, const void *second)
+{
+	const PATCH_RECORD	*record1 , *record2;
+
+	record1 = (const PATCH_RECORD *)first;
+	record2 = (const PATCH_RECORD *)second;
+	if ( record1->offset != record2->offset ) {
+		return(record1->offset < record2->offset ? -1 : 1);
+	} /* IF */
+
+	return(record1->line_number - record2->line_number);
+} /* end of compare_patches */
+
+/*********************************************************************
+*
+* Function  : load_patches
+*
+* Purpose   : Read and check a patch file.
+*
+* Inputs    : char *patch_file - name of patch file
+*             PATCH_SET *patches - receives the patches
+*
+* Output    : Error messages on stderr
+*
+* Returns   : 0 --> success , -1 --> error
+*
+* Example   : load_patches("fix.patch",&patches);
+*
+* Notes     : Each line of the file is
+*
+*                 offset new_bytes [expected_bytes]
+*
+*             where the offset is decimal or 0x hex and the bytes are
+*             strings of hex digits , e.g. "0x1f0 9090 7405" replaces
+*             74 05 by 90 90 at 0x1f0 , but only if 74 05 is there.
+*             Blank lines and text after a '#' are ignored. The
+*             records are sorted by offset and must not overlap.
+*
+*********************************************************************/
+
+static int load_patches(char *patch_file, PATCH_SET *patches)
+{
+	FILE	*input;
+	char	buffer[4096] , *ptr , *offset_text , *new_text , *expect_text;
+	int		line_number , errors;
+	long	index , expect_length;
+	PATCH_RECORD	*record;
+
+	memset(patches,0,sizeof(PATCH_SET));
+	input = fopen(patch_file,"r");
+	if ( input == NULL ) {
+		fprintf(stderr,"Can't open patch file \"%s\" : %s\n",
+				patch_file,strerror(errno));
+		return(-1);
+	} /* IF */
+	errors = 0;
+	for ( line_number = 1 ; fgets(buffer,sizeof(buffer),input) != NULL ;
+							++line_number ) {
+		ptr = strchr(buffer,'#');
+		if ( ptr != NULL ) {
+			*ptr = '\0';
+		} /* IF */
+		offset_text = strtok(buffer," \t\r\n");
+		if ( offset_text == NULL ) {
+			continue;
+		} /* IF */
+		new_text = strtok(NULL," \t\r\n");
+		expect_text = strtok(NULL," \t\r\n");
+		if ( patches->num_records == patches->max_records ) {
+			patches->max_records = patches->max_records ?
+							patches->max_records * 2 : 256;
+			record = (PATCH_RECORD *)realloc(patches->records,
+							patches->max_records * sizeof(PATCH_RECORD));
+			if ( record == NULL ) {
+				fprintf(stderr,"Out of memory\n");
+				fclose(input);
+				return(-1);
+			} /* IF */
+			patches->records = record;
+		} /* IF */
+		record = &patches->records[patches->num_records];
+		record->line_number = line_number;
+		record->offset = strtol(offset_text,&ptr,0);
+		record->expect_offset = -1L;
+		if ( *ptr != '\0' || record->offset < 0L || new_text == NULL ||
+				strtok(NULL," \t\r\n") != NULL ||
+				(record->data_offset = patch_add_bytes(patches,new_text,
+									&record->length)) < 0L ||
+				(expect_text != NULL &&
+				((record->expect_offset = patch_add_bytes(patches,expect_text,
+									&expect_length)) < 0L ||
+								expect_length != record->length)) ) {
+			fprintf(stderr,"%s line %d : invalid patch\n",patch_file,line_number);
+			errors += 1;
+			continue;
+		} /* IF */
+		patches->num_records += 1;
+	} /* FOR */
+	fclose(input);
+
+	qsort(patches->records,patches->num_records,sizeof(PATCH_RECORD),
+			compare_patches);
+	for ( index = 0L ; index < patches->num_records ; ++index ) {
+		record = &patches->records[index];
+		if ( index == 0L || record->offset > patches->end ) {
+			patches->num_runs += 1L;
+		} /* IF */
+		else if ( record->offset < patches->end ) {
+			fprintf(stderr,"%s line %d : overlaps line %d\n",patch_file,
+					record->line_number,record[-1].line_number);
+			errors += 1;
+		} /* ELSE IF */
+		patches->end = record->offset + record->length;
+	} /* FOR */
+	if ( patches->num_records == 0L ) {
+		fprintf(stderr,"%s : no patches\n",patch_file);
+		errors += 1;
+	} /* IF */
+
+	return(errors > 0 ? -1 : 0);
+} /* end of load_patches */
+
+/*********************************************************************
+*
+* Function  : patch_run_end
+*
+* Purpose   : Find the end of a run of adjacent patch records.
+*
+* Inputs    : PATCH_SET *patches - the patch set
+*             long first - index of first record of the run
+*
+* Output    : (none)
+*
+* Returns   : index of the record after the run
+*
+* Example   : last = patch_run_end(patches,first);
+*
+* Notes     : (none)
+*
+*********************************************************************/
+
+static long patch_run_end(PATCH_SET *patches, long first)
+{
+	long	last;
+
+	for ( last = first + 1L ; last < patches->num_records &&
+				patches->records[last].offset ==
+					patches->records[last-1].offset +
+						patches->records[last-1].length ; ++last ) {
+		;
+	} /* FOR */
+
+	return(last);
+} /* end of patch_run_end */
+
+/*********************************************************************
+*
+* Function  : patch_file
+*
+* Purpose   : Apply a set of patches to a file.
+*
+* Inputs    : PATCH_SET *patches - the patches
+*             char *path - name of file
+*             char *result - receives a message
+*             int result_size - size of result buffer
+*
+* Output    : The file is patched
+*
+* Returns   : 0 --> success , -1 --> error
+*
+* Example   : patch_file(&patches,"image.bin",result,sizeof(result));
+*
+* Notes     : All the expected bytes are checked before anything is
+*             written , so unexpected bytes leave the file alone. A
+*             write which fails can leave the file partly patched ,
+*             which is then said in the result. Each run of adjacent
+*             records is read with one pread() and written with one
+*             pwritev().
+*
+*********************************************************************/
+
+static int patch_file(PATCH_SET *patches, char *path, char *result,
+					int result_size)
+{
+	struct iovec	iov[EDIT_MAX_IOV];
+	struct stat	stats;
+	PATCH_RECORD	*record;
+	unsigned char	*buffer;
+	long	first , last , index , run_length , max_run , num_bytes;
+	long	num_writes;
+	int		fd , num_iov , pass;
+
+	fd = open(path,O_RDWR | O_LARGEFILE);
+	if ( fd < 0 || fstat(fd,&stats) < 0 ) {
+		snprintf(result,result_size,"%s : can't open : %s",path,strerror(errno));
+		if ( fd >= 0 ) {
+			close(fd);
+		} /* IF */
+		return(-1);
+	} /* IF */
+	if ( S_ISBLK(stats.st_mode) && device_size(fd,&num_bytes,NULL) == 0 ) {
+		stats.st_size = (off_t)num_bytes;
+	} /* IF */
+	if ( (S_ISREG(stats.st_mode) || S_ISBLK(stats.st_mode)) &&
+				patches->end > (long)stats.st_size ) {
+		snprintf(result,result_size,"%s : patches extend past end of file",path);
+		close(fd);
+		return(-1);
+	} /* IF */
+
+	max_run = 0L;
+	for ( first = 0L ; first < patches->num_records ; first = last ) {
+		last = patch_run_end(patches,first);
+		run_length = patches->records[last-1].offset +
+				patches->records[last-1].length - patches->records[first].offset;
+		if ( run_length > max_run ) {
+			max_run = run_length;
+		} /* IF */
+	} /* FOR */
+	buffer = (unsigned char *)malloc(max_run);
+	if ( buffer == NULL ) {
+		snprintf(result,result_size,"%s : out of memory",path);
+		close(fd);
+		return(-1);
+	} /* IF */
+
+	/* pass 0 checks the expected bytes , pass 1 writes the new bytes */
+	num_writes = 0L;
+	for ( pass = 0 ; pass < 2 ; ++pass ) {
+		for ( first = 0L ; first < patches->num_records ; first = last ) {
+			last = patch_run_end(patches,first);
+			record = &patches->records[first];
+			run_length = patches->records[last-1].offset +
+							patches->records[last-1].length - record->offset;
+			if ( pass == 0 ) {
+				for ( index = first ; index < last &&
+							patches->records[index].expect_offset < 0L ; ++index ) {
+					;
+				} /* FOR */
+				if ( index == last ) {
+					continue;
+				} /* IF */
+				num_bytes = pread(fd,buffer,run_length,(off_t)record->offset);
+				if ( num_bytes != run_length ) {
+					snprintf(result,result_size,"%s : can't read 0x%lx : %s",path,
+							record->offset,num_bytes < 0 ? strerror(errno) :
+							"end of file");
+					break;
+				} /* IF */
+				for ( ; index < last ; ++index ) {
+					record = &patches->records[index];
+					if ( record->expect_offset >= 0L &&
+							memcmp(&buffer[record->offset -
+									patches->records[first].offset],
+								&patches->data[record->expect_offset],
+								record->length) != 0 ) {
+						snprintf(result,result_size,
+							"%s : unexpected bytes at 0x%lx (line %d) , not patched",
+							path,record->offset,record->line_number);
+						break;
+					} /* IF */
+				} /* FOR */
+				if ( index < last ) {
+					break;
+				} /* IF */
+				continue;
+			} /* IF */
+			for ( index = first ; index < last ; index += num_iov ) {
+				for ( num_iov = 0 , run_length = 0L ; num_iov < EDIT_MAX_IOV &&
+								index + num_iov < last ; ++num_iov ) {
+					record = &patches->records[index + num_iov];
+					iov[num_iov].iov_base = &patches->data[record->data_offset];
+					iov[num_iov].iov_len = record->length;
+					run_length += record->length;
+				} /* FOR */
+				num_bytes = pwritev(fd,iov,num_iov,
+							(off_t)patches->records[index].offset);
+				num_writes += 1L;
+				if ( num_bytes != run_length ) {
+					snprintf(result,result_size,"%s : write failed at 0x%lx : %s , %s",
+							path,patches->records[index].offset,
+							num_bytes < 0 ? strerror(errno) : "short write",
+							num_writes > 1L || num_bytes > 0L ?
+								"file partly patched" : "file not changed");
+					break;
+				} /* IF */
+			} /* FOR */
+			if ( index < last ) {
+				break;
+			} /* IF */
+		} /* FOR */
+		if ( first < patches->num_records ) {
+			free(buffer);
+			close(fd);
+			return(-1);
+		} /* IF */
+	} /* FOR */
+	free(buffer);
+	if ( fdatasync(fd) < 0 ) {
+		snprintf(result,result_size,"%s : sync failed : %s",path,strerror(errno));
+		close(fd);
+		return(-1);
+	} /* IF */
+	close(fd);
+	snprintf(result,result_size,"%s : %ld patches applied with %ld writes",
+				path,patches->num_records,num_writes);
+
+	return(0);
+} /* end of patch_file */
+
+/*********************************************************************
+*
+* Function  : patch_worker
+*
+* Purpose   : Thread function which patches files until none remain.
+*
+* Inputs    : void *argument - the PATCH_JOB
+*
+* Output    : (none)
+*
+* Returns   : NULL
+*
+* Example   : pthread_create(&thread,NULL,patch_worker,&job);
+*
+* Notes     : (none)
+*
+*********************************************************************/
+
+static void *patch_worker(void *argument)
+{
+	PATCH_JOB	*job;
+	int		index , status;
+	char	result[1024];
+
+	job = (PATCH_JOB *)argument;
+	while ( 1 ) {
+		pthread_mutex_lock(&job->lock);
+		index = job->next_file++;
+		pthread_mutex_unlock(&job->lock);
+		if ( index >= job->num_files ) {
+			break;
+		} /* IF */
+		status = patch_file(job->patches,job->files[index],result,
+						sizeof(result));
+		pthread_mutex_lock(&job->lock);
+		job->results[index] = strdup(result);
+		if ( status < 0 ) {
+			job->num_failed += 1;
+		} /* IF */
+		pthread_mutex_unlock(&job->lock);
+	} /* WHILE */
 
-	return(hex_byte);
-} /* end of get_hex_byte */
+	return(NULL);
+} /* end of patch_worker */
 
 /*********************************************************************
 *
-* Function  : change_block_byte
+* Function  : patch_add_file
 *
-* Purpose   : Change the value of a single byte
+* Purpose   : Add a file to the list of files to be patched.
 *
-* Inputs    : (none)
+* Inputs    : PATCH_JOB *job - the job
+*             char *path - name of file
 *
 * Output    : (none)
 *
-* Returns   : zero
+* Returns   : (nothing)
 *
-* Example   : change_block_byte();
+* Example   : patch_add_file(&job,path);
 *
 * Notes     : (none)
 *
 *********************************************************************/
 
-int change_block_byte()
+static void patch_add_file(PATCH_JOB *job, char *path)
 {
-	unsigned char	byte , prompt[100];
-	long	file_offset , block_offset;
-
-	file_offset = get_number("Enter file offset :");
-	if ( file_offset < current_file_offset ||
-		file_offset >= (current_file_offset+block_bytes) ) {
-		error_message("Offset not in current block");
-		return(1);
+	if ( job->num_files % 256 == 0 ) {
+		job->files = (char **)realloc(job->files,
+							(job->num_files + 256) * sizeof(char *));
+		if ( job->files == NULL ) {
+			quit(1,"malloc failed");
+		} /* IF */
 	} /* IF */
-	sprintf((char *)prompt,"Enter hex value for byte at 0x%x:",
-			file_offset);
-	byte = get_hex_byte((char *)prompt);
-	block_offset = file_offset - current_file_offset;
-	block_buffer[block_offset] = byte;
-	save_current_block();
-	display_block();
+	job->files[job->num_files++] = path;
 
-	return(0);
-} /* end of change_block_byte */
+	return;
+} /* end of patch_add_file */
 
 /*********************************************************************
 *
-* Function  : scan_block
+* Function  : compare_names
 *
-* Purpose   : Scan forward for a string.
+* Purpose   : qsort() comparison function for file names.
 *
-* Inputs    : unsigned char *block - file data buffer
-*             int byte_count - byte count for file data buffer
-*             char *string - search string
+* Inputs    : const void *first - first name
+*             const void *second - second name
 *
 * Output    : (none)
 *
-* Returns   : zero
+* Returns   : < 0 , 0 or > 0
 *
-* Example   : scan_block();
+* Example   : qsort(names,count,sizeof(char *),compare_names);
 *
 * Notes     : (none)
 *
 *********************************************************************/
 
-int scan_block(unsigned char *block, int byte_count, char *string)
+static int compare_names(const void *first, const void *second)
+{
+	return(strcmp(*(char * const *)first,*(char * const *)second));
+} /* end of compare_names */
+
+/*********************************************************************
+*
+* Function  : run_patches
+*
+* Purpose   : Apply a patch file to a list of files and directories.
+*
+* Inputs    : char *patch_file - name of patch file
+*             int num_names - number of file and directory names
+*             char *names[] - the names
+*
+* Output    : A line on stdout for each file patched
+*
+* Returns   : 0 --> all files patched , 1 --> error
+*
+* Example   : exit(run_patches(patch_file,argc - optind,&argv[optind]));
+*
+* Notes     : Used for the -P option. Every regular file directly
+*             inside a named directory is patched. The files are
+*             shared out between the -t threads.
+*
+*********************************************************************/
+
+static int run_patches(char *patch_file, int num_names, char *names[])
 {
-	int		string_size , match , num_loops , count;
-	unsigned char	*ptr1;
+	PATCH_SET	patches;
+	PATCH_JOB	job;
+	pthread_t	threads[MAX_THREADS];
+	struct stat	stats;
+	struct dirent	*entry;
+	DIR		*dir;
+	char	*path;
+	int		index , num_threads , first_file;
 
-	match = 0;
-	string_size = strlen(string);
-	if ( string_size <= byte_count ) {
-		num_loops = (byte_count - string_size) + 1;
-		ptr1 = block;
-		for ( count = 0 ; count < num_loops ; ++count , ++ptr1 ) {
-			if ( memcmp(ptr1,string,string_size) == 0 ) {
-				return(1);
+	if ( load_patches(patch_file,&patches) < 0 ) {
+		return(1);
+	} /* IF */
+	memset(&job,0,sizeof(job));
+	job.patches = &patches;
+	for ( index = 0 ; index < num_names ; ++index ) {
+		if ( stat(names[index],&stats) < 0 || ! S_ISDIR(stats.st_mode) ) {
+			patch_add_file(&job,names[index]);
+			continue;
+		} /* IF */
+		dir = opendir(names[index]);
+		if ( dir == NULL ) {
+			quit(1,"Can't open directory \"%s\"",names[index]);
+		} /* IF */
+		first_file = job.num_files;
+		while ( (entry = readdir(dir)) != NULL ) {
+			path = (char *)malloc(strlen(names[index]) +
+							strlen(entry->d_name) + 2);
+			if ( path == NULL ) {
+				quit(1,"malloc failed");
 			} /* IF */
-		} /* FOR */
+			sprintf(path,"%s/%s",names[index],entry->d_name);
+			if ( stat(path,&stats) == 0 && S_ISREG(stats.st_mode) ) {
+				patch_add_file(&job,path);
+			} /* IF */
+			else {
+				free(path);
+			} /* ELSE */
+		} /* WHILE */
+		closedir(dir);
+		qsort(&job.files[first_file],job.num_files - first_file,sizeof(char *),
+				compare_names);
+	} /* FOR */
+	if ( job.num_files == 0 ) {
+		fprintf(stderr,"No files to patch\n");
+		return(1);
+	} /* IF */
+	job.results = (char **)calloc(job.num_files,sizeof(char *));
+	if ( job.results == NULL ) {
+		quit(1,"malloc failed");
+	} /* IF */
+	pthread_mutex_init(&job.lock,NULL);
+
+	num_threads = opt_threads < job.num_files ? opt_threads : job.num_files;
+	for ( index = 0 ; index < num_threads ; ++index ) {
+		if ( pthread_create(&threads[index],NULL,patch_worker,&job) != 0 ) {
+			break;
+		} /* IF */
+	} /* FOR */
+	num_threads = index;
+	if ( num_threads == 0 ) {
+		patch_worker(&job);
 	} /* IF */
+	for ( index = 0 ; index < num_threads ; ++index ) {
+		pthread_join(threads[index],NULL);
+	} /* FOR */
+	pthread_mutex_destroy(&job.lock);
 
-	return(match);
-} /* end of scan_block */
+	for ( index = 0 ; index < job.num_files ; ++index ) {
+		printf("%s\n",job.results[index] != NULL ? job.results[index] :
+					"out of memory");
+	} /* FOR */
+	if ( job.num_failed > 0 ) {
+		fprintf(stderr,"%d of %d files not patched\n",job.num_failed,
+				job.num_files);
+	} /* IF */
+
+	return(job.num_failed > 0 ? 1 : 0);
+} /* end of run_patches */
 
 /*********************************************************************
 *
-* Function  : scan_forward
+* Function  : follow_open
 *
-* Purpose   : Scan forward for a string.
+* Purpose   : Start watching the file for growth.
 *
 * Inputs    : (none)
 *
 * Output    : (none)
 *
-* Returns   : If found Then file offset Else -1L
+* Returns   : (nothing)
 *
-* Example   : scan_forward();
+* Example   : follow_open();
 *
-* Notes     : (none)
+* Notes     : Used for the -f option. If inotify can not be used the
+*             file is polled with fstat() instead.
 *
 *********************************************************************/
 
-long scan_forward()
+static void follow_open()
 {
-	char	string[200];
-	int		num_bytes , match;
-	long	offset;
+	follow_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if ( follow_fd < 0 ) {
+		debug_print("inotify_init1 failed (%s), polling\n",strerror(errno));
+		return;
+	} /* IF */
+	if ( inotify_add_watch(follow_fd,filename,IN_MODIFY | IN_ATTRIB |
+						IN_CLOSE_WRITE) < 0 ) {
+		debug_print("inotify_add_watch failed (%s), polling\n",strerror(errno));
+		close(follow_fd);
+		follow_fd = -1;
+	} /* IF */
 
-	get_string("Enter string : ",string);
+	return;
+} /* end of follow_open */
 
-	match = 0;
-	offset = current_file_offset;
-	while ( 1 ) {
-		if ( lseek(input_fd,offset,SEEK_SET) < 0 ) {
-			system_error("Can't lseek to offset 0x%x", offset);
-			break;
+/*********************************************************************
+*
+* Function  : follow_check
+*
+* Purpose   : Pick up any change in the size of the file.
+*
+* Inputs    : (none)
+*
+* Output    : (none)
+*
+* Returns   : (nothing)
+*
+* Example   : follow_check();
+*
+* Notes     : Appended bytes are added to the end of the edited file.
+*             If the last block was being viewed the view stays at the
+*             end of the file , moving on to the new last block when
+*             the current one is full. display_block() only redraws the
+*             rows which changed , so normally just the new bytes are
+*             sent to the terminal. A file which shrinks (e.g. is
+*             rotated) is reopened when there are no unsaved changes.
+*             Otherwise a mapping is dropped for pread() , so that the
+*             bytes which are gone read short instead of faulting.
+*
+*********************************************************************/
+
+static void follow_check()
+{
+	struct stat	stats;
+	long	old_size , new_size;
+	int		pinned;
+
+	if ( fstat(input_fd,&stats) < 0 || ! S_ISREG(stats.st_mode) ) {
+		return;
+	} /* IF */
+	old_size = input_source.size;
+	new_size = (long)stats.st_size;
+	if ( new_size == old_size ) {
+		return;
+	} /* IF */
+	pinned = current_file_offset + block_span >= filesize;
+
+	if ( new_size < old_size ) {
+		if ( file_edits.dirty ) {
+			if ( input_source.kind == SOURCE_MAPPED ) {
+				/* pages past the new end would fault , pread() them */
+				source_close(&input_source);
+				cache_open(&input_source);
+			} /* IF */
+			status_message("File : %s was truncated to %ld bytes , "
+					"save or quit",filename,new_size);
+			return;
 		} /* IF */
-		num_bytes = read(input_fd,temp_buffer,blocksize);
-		if ( num_bytes <= 0 ) {
-			break;
-		}
-		if ( scan_block(temp_buffer,num_bytes,string) ) {
-			match = 1;
-			return(offset);
+		source_close(&input_source);
+		if ( source_open(&input_source,input_fd,&stats) < 0 ||
+					edit_reset(&file_edits,input_source.size) < 0 ) {
+			quit(1,"Can't reopen file \"%s\"",filename);
 		} /* IF */
-		offset += blocksize;
-		if ( offset >= filesize ) {
-			break;
+		input_source.edits = &file_edits;
+		filestats = stats;
+	} /* IF */
+	else {
+		if ( source_grow(&input_source,new_size) < 0 ) {
+			if ( input_source.kind != SOURCE_MEMORY ) {
+				system_error("Can't follow growth of file");
+				return;
+			} /* IF */
+			/* was empty when opened , so read into memory */
+			source_close(&input_source);
+			if ( source_open(&input_source,input_fd,&stats) < 0 ) {
+				quit(1,"Can't reopen file \"%s\"",filename);
+			} /* IF */
+			input_source.edits = &file_edits;
 		} /* IF */
-	} /* WHILE */
-	error_message("Not found");
+		if ( edit_extend(&file_edits,old_size,
+						input_source.size - old_size) < 0 ) {
+			quit(1,"malloc failed");
+		} /* IF */
+		filestats = stats;
+	} /* ELSE */
+	set_file_size();
+	if ( new_size < old_size ) {
+		note_change(0L,old_size,new_size);
+	} /* IF */
+	else {
+		note_change(old_size,0L,new_size - old_size);
+	} /* ELSE */
+	debug_print("follow : size %ld --> %ld\n",old_size,filesize);
 
+	if ( pinned && current_file_offset + block_span < filesize ) {
+		current_file_offset = record_first + (num_blocks - 1L) * block_span;
+	} /* IF */
 	display_block();
-	return(-1L);
-} /* end of scan_forward */
+
+	return;
+} /* end of follow_check */
 
 /*********************************************************************
 *
-* Function  : scan_backward
+* Function  : get_command
 *
-* Purpose   : Scan forward for a string.
+* Purpose   : Wait for the next command key.
 *
 * Inputs    : (none)
 *
 * Output    : (none)
 *
-* Returns   : If found Then file offset Else -1L
+* Returns   : the key
 *
-* Example   : scan_backward();
+* Example   : command = get_command();
 *
-* Notes     : (none)
+* Notes     : In follow mode the file is checked for growth while
+*             waiting. Keys already read by curses are taken first ,
+*             then the terminal and the inotify descriptor are waited
+*             on together with poll(). While the overview map is being
+*             built it is redrawn as regions are done , and the map
+*             lock is only released here.
 *
 *********************************************************************/
 
-long scan_backward()
+static int get_command()
 {
-	char	string[200];
-	int		num_bytes;
-	long	offset;
+	struct pollfd	fds[2];
+	char	events[4096];
+	int		ch , timeout , ready;
 
-	get_string("Enter string : ",string);
-
-	offset = current_file_offset;
-	debug_print("scan_backward() from offset 0x%x looking for '%s'\n",
-					offset,string);
-	while ( offset >= 0L ) {
-		if ( lseek(input_fd,offset,SEEK_SET) < 0 ) {
-			system_error("Can't lseek to offset 0x%x", offset);
-			break;
+	if ( ! opt_f && ! overview.active ) {
+		return(wgetch(msg_win));
+	} /* IF */
+	while ( 1 ) {
+		wtimeout(msg_win,0);
+		ch = wgetch(msg_win);
+		wtimeout(msg_win,-1);
+		if ( ch != ERR ) {
+			return(ch);
 		} /* IF */
-		num_bytes = read(input_fd,temp_buffer,blocksize);
-		if ( num_bytes <= 0 ) {
-			break;
-		}
-		if ( scan_block(temp_buffer,num_bytes,string) ) {
-			debug_print("Found it.\n");
-			return(offset);
+		timeout = -1;
+		if ( opt_f ) {
+			timeout = follow_fd >= 0 ? FOLLOW_IDLE_MSECS : FOLLOW_POLL_MSECS;
+		} /* IF */
+		if ( map_busy() && (timeout < 0 || timeout > MAP_POLL_MSECS) ) {
+			timeout = MAP_POLL_MSECS;
+		} /* IF */
+		fds[0].fd = 0;
+		fds[0].events = POLLIN;
+		fds[1].fd = opt_f ? follow_fd : -1;
+		fds[1].events = POLLIN;
+		if ( overview.active ) {
+			/* let the map thread read the file while we wait */
+			pthread_mutex_unlock(&overview.lock);
+		} /* IF */
+		ready = poll(fds,2,timeout);
+		if ( overview.active ) {
+			pthread_mutex_lock(&overview.lock);
+		} /* IF */
+		if ( ready > 0 && (fds[0].revents & POLLIN) ) {
+			continue;
+		} /* IF */
+		if ( opt_f ) {
+			if ( follow_fd >= 0 ) {
+				while ( read(follow_fd,events,sizeof(events)) > 0 ) {
+					;
+				} /* WHILE */
+			} /* IF */
+			follow_check();
+		} /* IF */
+		if ( overview.active && overview.updates != overview.drawn ) {
+			map_draw(-1L);
+			wnoutrefresh(msg_win);
+			doupdate();
 		} /* IF */
-		offset -= blocksize;
-		debug_print("not found, backup to offset 0x%x\n",offset);
 	} /* WHILE */
-	error_message("Not found");
-	debug_print("Not found\n");
+} /* end of get_command */
 
-	display_block();
-	return(-1L);
-} /* end of scan_backward */
+/*********************************************************************
+*
+* Function  : ok_to_quit
+*
+* Purpose   : Check with the user before discarding unsaved changes.
+*
+* Inputs    : (none)
+*
+* Output    : (none)
+*
+* Returns   : 1 --> ok to quit , 0 --> keep editing
+*
+* Example   : if ( ok_to_quit() ) ...
+*
+* Notes     : (none)
+*
+*********************************************************************/
+
+static int ok_to_quit()
+{
+	int		answer;
+
+	if ( ! file_edits.dirty ) {
+		return(1);
+	} /* IF */
+	message("Discard unsaved changes (y/n) ? ");
+	answer = wgetch(msg_win);
+
+	return(answer == 'y' || answer == 'Y');
+} /* end of ok_to_quit */
 
 /*********************************************************************
 *
@@ -834,21 +11413,62 @@ long scan_backward()
 
 int main(int argc, char *argv[])
 {
-	char	command , *command_prompt , *ptr;
-	long	block_num , longnum , offset;
-	int		c , errflag , open_mode , row1;
+	char	command , *command_prompt , *ptr , *range , *patch_file;
+	char	*template_file , *records , prompt_text[100];
+	long	block_num , longnum , offset , range_length;
+	int		c , errflag , open_mode , row1 , which , map_cols , side_cols;
+	int		pairs_given;
 
 	errflag = 0;
-	while ( (c = getopt(argc,argv,":dwp:")) != -1 ) {
+	range = NULL;
+	patch_file = NULL;
+	template_file = NULL;
+	records = NULL;
+	pairs_given = 0;
+	while ( (c = getopt(argc,argv,":dwxDfenp:r:t:C:P:T:R:")) != -1 ) {
 		switch (c) {
 		case 'w':
 			opt_w = 1;
 			break;
+		case 'D':
+			opt_D = 1;
+			break;
+		case 'f':
+			opt_f = 1;
+			break;
+		case 'e':
+			opt_e = 1;
+			break;
+		case 'n':
+			opt_n = 1;
+			break;
 		case 'd':
 			opt_d = 1;
 			break;
+		case 'x':
+			opt_x = 1;
+			break;
+		case 'r':
+			range = optarg;
+			break;
+		case 'P':
+			patch_file = optarg;
+			break;
+		case 'C':
+			compare_name = optarg;
+			break;
+		case 'T':
+			template_file = optarg;
+			break;
+		case 'R':
+			records = optarg;
+			break;
 		case 'p':
 			num_pairs = atoi(optarg);
+			pairs_given = 1;
+			break;
+		case 't':
+			opt_threads = atoi(optarg);
 			break;
 		case '?':
 			printf("Unknown option '%c'\n",optopt);
@@ -864,20 +11484,106 @@ int main(int argc, char *argv[])
 	} /* WHILE */
 
 	if ( errflag || optind >= argc ) {
-		die(1,"Usage : %s [-dw] [-p num_pairs] filename\n",argv[0]);
+		die(1,"Usage : %s [-dwxDfen] [-p num_pairs] [-r offset[,length]] [-t num_threads] [-C compare_file]\n"
+				"        [-T template_file] [-R record_size[,stride[,first]]] filename\n"
+				"        %s -P patch_file [-t num_threads] file_or_directory ...\n",
+				argv[0],argv[0]);
+	} /* IF */
+	if ( opt_threads <= 0 ) {
+		opt_threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+	} /* IF */
+	if ( opt_threads < 1 ) {
+		opt_threads = 1;
+	} /* IF */
+	if ( opt_threads > MAX_THREADS ) {
+		opt_threads = MAX_THREADS;
+	} /* IF */
+	if ( patch_file != NULL ) {
+		exit(run_patches(patch_file,argc - optind,&argv[optind]));
+	} /* IF */
+	if ( template_file != NULL && load_template(template_file,
+						&record_template) < 0 ) {
+		exit(1);
+	} /* IF */
+	if ( records != NULL ) {
+		record_size = strtol(records,&ptr,0);
+		record_stride = record_size;
+		if ( *ptr == ',' ) {
+			record_stride = strtol(ptr + 1,&ptr,0);
+		} /* IF */
+		if ( *ptr == ',' ) {
+			record_first = strtol(ptr + 1,&ptr,0);
+		} /* IF */
+		if ( *ptr != '\0' || record_size <= 0L || record_stride <= 0L ||
+					record_first < 0L ) {
+			die(1,"Invalid records \"%s\"\n",records);
+		} /* IF */
+		if ( compare_name != NULL ) {
+			die(1,"Record mode can't be used with -C\n");
+		} /* IF */
 	} /* IF */
 
 	filename = argv[optind];
-	open_mode = opt_w ? O_RDWR : O_RDONLY;
-	input_fd = open(filename,open_mode);
+	open_mode = (opt_w ? O_RDWR : O_RDONLY) | O_LARGEFILE;
+	input_fd = -1;
+	if ( opt_D ) {
+		/* not every filesystem supports O_DIRECT , e.g. tmpfs */
+		input_fd = open(filename,open_mode | O_DIRECT);
+	} /* IF */
+	if ( input_fd < 0 ) {
+		input_fd = open(filename,open_mode);
+	} /* IF */
 	if ( input_fd < 0 ) {
 		quit(1,"Can't open file \"%s\"",filename);
 	}
-	if ( stat(filename,&filestats) < 0 ) {
+	if ( fstat(input_fd,&filestats) < 0 ) {
 		quit(1,"stat failed");
 	} /* IF */
-	filesize = filestats.st_size;
+	if ( source_open(&input_source,input_fd,&filestats) < 0 ) {
+		quit(1,"Can't access data for file \"%s\"",filename);
+	} /* IF */
+	filesize = input_source.size;
+	if ( edit_init(&file_edits,filesize) < 0 ) {
+		quit(1,"malloc failed");
+	} /* IF */
+	input_source.edits = &file_edits;
+	diff_clear(&file_diffs);
+	if ( compare_name != NULL ) {
+		compare_fd = open(compare_name,O_RDONLY | O_LARGEFILE);
+		if ( compare_fd < 0 ) {
+			quit(1,"Can't open file \"%s\"",compare_name);
+		} /* IF */
+		if ( fstat(compare_fd,&compare_stats) < 0 ) {
+			quit(1,"stat failed");
+		} /* IF */
+		if ( source_open(&compare_source,compare_fd,&compare_stats) < 0 ) {
+			quit(1,"Can't access data for file \"%s\"",compare_name);
+		} /* IF */
+	} /* IF */
+	format_init();
+	crc32c_tables();
+	offset_width = offset_digits(filesize);
+	if ( compare_name != NULL && compare_source.size > filesize ) {
+		offset_width = offset_digits(compare_source.size);
+	} /* IF */
 	current_file_offset = 0L;
+	range_length = -1L;
+	if ( range != NULL ) {
+		current_file_offset = strtol(range,&ptr,0);
+		if ( *ptr == ',' ) {
+			range_length = strtol(ptr + 1,&ptr,0);
+		} /* IF */
+		if ( *ptr != '\0' || current_file_offset < 0L ||
+				current_file_offset > filesize || range_length < -1L ) {
+			die(1,"Invalid range \"%s\"\n",range);
+		} /* IF */
+	} /* IF */
+	if ( opt_x ) {
+		if ( num_pairs < 1 ) {
+			die(1,"Invalid number of pairs %d\n",num_pairs);
+		} /* IF */
+		exit(dump_file(current_file_offset,range_length));
+	} /* IF */
 
 	if ( opt_d ) {
 		ptr = getenv("HOME");
@@ -892,6 +11598,11 @@ int main(int argc, char *argv[])
 	else {
 		debug_fp = NULL;
 	} /* ELSE */
+	if ( ! opt_n ) {
+		sidecar_open(&filestats);
+		sidecar_load_hits();
+		sidecar_load_hashes();
+	} /* IF */
 
 	initscr();	/* initialize curses */
 	nonl();
@@ -913,7 +11624,18 @@ int main(int argc, char *argv[])
 		num_cols = tty_num_cols;
 	} /* ELSE */
 
-	max_data_pairs = ( (tty_num_cols - 13) / 7 ) - 1;
+	map_cols = opt_e ? MAP_WIDTH : 0;
+	side_cols = map_cols + (template_file != NULL ? TEMPLATE_WIDTH : 0);
+	max_data_pairs = ( (tty_num_cols - side_cols - 5 - offset_width) / 7 ) - 1;
+	if ( compare_name != NULL ) {
+		/* room for the bytes of both files side by side */
+		max_data_pairs = (tty_num_cols - side_cols - 11 - offset_width) / 14;
+	} /* IF */
+	if ( record_size > 0L && ! pairs_given &&
+					record_size <= 2L * max_data_pairs ) {
+		/* one record per row */
+		num_pairs = (int)((record_size + 1L) / 2L);
+	} /* IF */
 	if ( num_pairs > max_data_pairs ) {
 		num_pairs = max_data_pairs;
 	} /* IF too many requested columns */
@@ -922,17 +11644,34 @@ int main(int argc, char *argv[])
 
 	num_data_rows = num_lines - 8;
 	blocksize = num_data_rows * num_pairs_bytes;
-	num_blocks = (filesize + blocksize - 1) / blocksize;
+	block_span = blocksize;
+	if ( record_size > 0L ) {
+		if ( record_size > blocksize ) {
+			record_size = blocksize;	/* only the start of each record fits */
+		} /* IF */
+		record_rows = (int)((record_size + num_pairs_bytes - 1) / num_pairs_bytes);
+		records_per_block = num_data_rows / record_rows;
+		block_span = records_per_block * record_stride;
+	} /* IF */
+	num_blocks = block_count();
 	block_buffer = (unsigned char *)malloc(blocksize);
 	if ( block_buffer == NULL ) {
 		quit(1,"malloc failed");
 	} /* IF */
-	temp_buffer = (unsigned char *)malloc(blocksize);
+	temp_buffer = (unsigned char *)malloc(search_chunk_size +
+							SEARCH_MAX_PATTERN);
 	if ( temp_buffer == NULL ) {
 		quit(1,"malloc failed");
 	} /* IF */
+	if ( compare_name != NULL ) {
+		compare_buffer = (unsigned char *)malloc(blocksize);
+		compare_line = (char *)malloc(23 + 7 * num_pairs);
+		if ( compare_buffer == NULL || compare_line == NULL ) {
+			quit(1,"malloc failed");
+		} /* IF */
+	} /* IF */
 
-	data_win = newwin(num_lines-6,num_cols,0,0);
+	data_win = newwin(num_lines-6,num_cols - side_cols,0,0);
 	if ( data_win == NULL ) {
 		clear();
 		addstr("newwin failed for data window");
@@ -945,6 +11684,11 @@ int main(int argc, char *argv[])
 	wborder(data_win,0,0,0,0,0,0,0,0);
 	mvwaddstr(data_win,1,1,"File data");
 	wrefresh(data_win);
+	if ( frame_init(&data_frame,num_lines - 6,num_cols - side_cols - 3,
+					compare_name != NULL ? 25 + 14 * num_pairs :
+						22 + 7 * num_pairs) < 0 ) {
+		quit(1,"malloc failed");
+	} /* IF */
 
 	row1 = num_lines - 6;
 	msg_win = newwin(3,num_cols,row1,0);
@@ -971,34 +11715,71 @@ int main(int argc, char *argv[])
 		exit(1);
 	}
 	row1 += 3;
+	if ( opt_e ) {
+		map_win = newwin(num_lines-6,map_cols,0,num_cols - map_cols);
+		if ( map_win == NULL || map_open() < 0 ) {
+			quit(1,"Can't create overview map");
+		} /* IF */
+		sidecar_load_map();
+	} /* IF */
+	if ( template_file != NULL ) {
+		template_win = newwin(num_lines-6,side_cols - map_cols,0,
+							num_cols - side_cols);
+		if ( template_win == NULL ) {
+			quit(1,"Can't create template pane");
+		} /* IF */
+	} /* IF */
+	if ( compare_name != NULL ) {
+		compare_files();
+	} /* IF */
 	display_block();
-	command_prompt = "Enter your command (q,n,p,1,$,#,o,w,c,s,/,\\,?) : ";
+	/* list the commands of the modes in use */
+	strcpy(prompt_text,"Enter your command (q,n,p,1,$,#,o,w,c,i,d,s,u,r,/,\\,m,f,],[,h");
+	if ( compare_name != NULL ) {
+		strcat(prompt_text,",>,<,=");
+	} /* IF */
+	if ( opt_e ) {
+		strcat(prompt_text,",e");
+	} /* IF */
+	if ( record_size > 0L ) {
+		strcat(prompt_text,",F");
+	} /* IF */
+	strcat(prompt_text,",?) : ");
+	command_prompt = prompt_text;
+	if ( opt_f ) {
+		follow_open();
+	} /* IF */
 	message("%s",command_prompt);
-	command = wgetch(msg_win);
+	command = get_command();
 
 	debug_print("Process file \"%s\"",debug_filename);
 	debug_print(" , num_blocks = %ld , block_bytes = %ld\n",
 			num_blocks,block_bytes);
 	debug_print("blocksize = %d , 0x%x\n",blocksize,blocksize);
 
-	while ( command != QUIT ) {
+	while ( command != QUIT || ! ok_to_quit() ) {
 		switch ( command ) {
 		case NEXT_BLOCK:
-			if ( current_file_offset+blocksize >= filesize ) {
+			if ( current_file_offset+block_span >= filesize ) {
 				error_message("Already on last block");
 			} /* IF */
 			else {
-				current_file_offset += (long)blocksize;
+				current_file_offset += block_span;
 				display_block();
+				source_prefetch(&input_source,current_file_offset + block_span,
+						CACHE_PREFETCH_PAGES * CACHE_PAGE_SIZE);
 			} /* ELSE */
 			break;
 		case PREV_BLOCK:
-			if ( current_file_offset-blocksize < 0L ) {
+			if ( current_file_offset-block_span < record_first ) {
 				error_message("Already on 1st block");
 			} /* IF */
 			else {
-				current_file_offset -= (long)blocksize;
+				current_file_offset -= block_span;
 				display_block();
+				source_prefetch(&input_source,
+						current_file_offset - CACHE_PREFETCH_PAGES * CACHE_PAGE_SIZE,
+						CACHE_PREFETCH_PAGES * CACHE_PAGE_SIZE);
 			} /* ELSE */
 			break;
 		case BLOCK1:
@@ -1006,14 +11787,24 @@ int main(int argc, char *argv[])
 			display_block();
 			break;
 		case LASTBLOCK:
-			current_file_offset = filesize - blocksize;
-			current_file_offset = (num_blocks - 1L) * blocksize;
+			current_file_offset = record_first + (num_blocks - 1L) * block_span;
 			if ( current_file_offset < 0L ) {
 				current_file_offset = 0L;
 			} /* IF */
 			display_block();
 			break;
 		case BLOCKNUM:
+			if ( record_size > 0L ) {
+				block_num = get_number("Enter record # : ");
+				if ( block_num < 0L || block_num >= num_records ) {
+					error_message("Invalid record number");
+				} /* IF */
+				else {
+					current_file_offset = record_first + block_num * record_stride;
+					display_block();
+				} /* ELSE */
+				break;
+			} /* IF */
 			block_num = get_number("Enter block # : ");
 			if ( block_num < 0L || block_num >= num_blocks ) {
 				error_message("Invalid block number");
@@ -1040,11 +11831,30 @@ int main(int argc, char *argv[])
 			write_current_block();
 			break;
 		case SAVE_BLOCK:
-			save_current_block();
+			save_changes();
+			break;
+		case UNDO:
+		case REDO:
+			offset = undo_redo(command == REDO);
+			if ( offset >= 0L ) {
+				if ( offset < current_file_offset ||
+						offset >= current_file_offset + block_span ) {
+					current_file_offset = offset;
+				} /* IF */
+				display_block();
+			} /* IF */
+			break;
+		case QUIT:
 			break;
 		case CHANGE_BYTE:
 			change_block_byte();
 			break;
+		case INSERT_BYTES:
+			insert_bytes();
+			break;
+		case DELETE_BYTES:
+			delete_bytes();
+			break;
 		case SCAN_FORWARD:
 			offset = scan_forward();
 			if ( offset >= 0L ) {
@@ -1059,16 +11869,80 @@ int main(int argc, char *argv[])
 				display_block();
 			} /* IF */
 			break;
+		case MULTI_SCAN:
+			offset = multi_scan(&which);
+			if ( offset >= 0L ) {
+				current_file_offset = offset;
+				display_block();
+				status_message("Pattern %d [%.40s] found at offset 0x%lx",
+					which + 1,multi_patterns.names[which],offset);
+			} /* IF */
+			break;
+		case FIND_ALL:
+			offset = find_all();
+			if ( offset >= 0L ) {
+				current_file_offset = offset;
+				display_block();
+			} /* IF */
+			break;
+		case NEXT_HIT:
+		case PREV_HIT:
+			offset = goto_hit(command == NEXT_HIT ? 1 : -1);
+			if ( offset >= 0L ) {
+				current_file_offset = offset;
+				display_block();
+			} /* IF */
+			break;
+		case NEXT_DIFF:
+		case PREV_DIFF:
+			offset = goto_diff(command == NEXT_DIFF ? 1 : -1);
+			if ( offset >= 0L ) {
+				current_file_offset = offset;
+				display_block();
+			} /* IF */
+			break;
+		case SELECT_REGION:
+			offset = map_select();
+			if ( offset >= 0L ) {
+				current_file_offset = offset;
+				display_block();
+			} /* IF */
+			break;
+		case HASH_FILE:
+			hash_file();
+			break;
+		case FIND_RECORDS:
+			offset = find_records();
+			if ( offset >= 0L ) {
+				current_file_offset = offset;
+				display_block();
+			} /* IF */
+			break;
+		case COMPARE_AGAIN:
+			if ( compare_name == NULL ) {
+				error_message("No file to compare with , use the -C option");
+			} /* IF */
+			else if ( compare_files() == 0 ) {
+				display_block();
+			} /* ELSE IF */
+			break;
 		default:
 			error_message("Invalid command [%c]",command);
 		} /* SWITCH */
 		message("%s",command_prompt);
-		command = wgetch(msg_win);
+		command = get_command();
 	} /* WHILE */
 	delwin(data_win);
 	delwin(msg_win);
 	clear();
 	refresh();
 	endwin();	/* terminate curses processing */
+	sidecar_save();
+	map_close();
+	sidecar_close();
+	source_close(&input_source);
+	if ( compare_name != NULL ) {
+		source_close(&compare_source);
+	} /* IF */
 	exit(0);
 } /* end of main */
@@ -0,0 +1,477 @@
+/*********************************************************************
+*
+* File      : hed5_bench.c
+*
+* Author    : Barry Kimelman
+*
+* Created   : October 17, 2026
+*
+* Purpose   : Benchmarks for the internals of hed5.
+*
+* Notes     : hed5.c is included here so that its static functions
+*             can be called directly. Run with
+*             "make -f make.mk CFLAGS=-O2 bench" , or run hed5_bench
+*             with the largest file size to try in MB (default 1000).
+*             Files are written to /tmp and are in the page cache
+*             when timed , so the rates are for searching memory.
+*
+*********************************************************************/
+
+#define	main	hed5_main
+#include	"hed5.c"
+#undef	main
+
+#include	<sys/time.h>
+
+#define	BENCH_OLD_BLOCK	640		/* 20 rows of 32 bytes , as hed5 used to read */
+#define	BENCH_PATTERN	"hed5 bench text"
+
+/*********************************************************************
+*
+* Function  : elapsed_seconds
+*
+* Purpose   : Find the time since a starting time.
+*
+* Inputs    : struct timeval *start - the starting time
+*
+* Output    : (none)
+*
+* Returns   : seconds since start
+*
+* Example   : seconds = elapsed_seconds(&start);
+*
+* Notes     : (none)
+*
+*********************************************************************/
+
+static double elapsed_seconds(struct timeval *start)
+{
+	struct timeval	now;
+
+	gettimeofday(&now,NULL);
+
+	return((now.tv_sec - start->tv_sec) +
+				(now.tv_usec - start->tv_usec) / 1000000.0);
+} /* end of elapsed_seconds */
+
+/*********************************************************************
+*
+* Function  : make_data_file
+*
+* Purpose   : Create a temporary file of pseudo random bytes with the
+*             benchmark pattern at its end.
+*
+* Inputs    : char *path - buffer for the name of the file
+*             long size - size of the file
+*
+* Output    : (none)
+*
+* Returns   : descriptor of the file opened for reading and writing
+*
+* Example   : fd = make_data_file(path,size);
+*
+* Notes     : The bytes come from a xorshift generator , so the
+*             prefilter sees as many false candidates as on real data.
+*             The caller unlinks the file.
+*
+*********************************************************************/
+
+static int make_data_file(char *path, long size)
+{
+	unsigned long long	state;
+	unsigned char	*buffer;
+	long	position , count , index;
+	int		fd;
+
+	strcpy(path,"/tmp/hed5_benchXXXXXX");
+	fd = mkstemp(path);
+	buffer = (unsigned char *)malloc(SEARCH_CHUNK_SIZE);
+	if ( fd < 0 || buffer == NULL ) {
+		quit(1,"Can't create a temporary file");
+	} /* IF */
+	state = 88172645463325252ULL;
+	for ( position = 0L ; position < size ; position += count ) {
+		count = size - position;
+		if ( count > SEARCH_CHUNK_SIZE ) {
+			count = SEARCH_CHUNK_SIZE;
+		} /* IF */
+		for ( index = 0L ; index < count ; ++index ) {
+			state ^= state << 13;
+			state ^= state >> 7;
+			state ^= state << 17;
+			buffer[index] = (unsigned char)state;
+		} /* FOR */
+		if ( write(fd,buffer,count) != count ) {
+			quit(1,"Can't write \"%s\"",path);
+		} /* IF */
+	} /* FOR */
+	count = (long)strlen(BENCH_PATTERN);
+	if ( pwrite(fd,BENCH_PATTERN,count,(off_t)(size - count)) != count ) {
+		quit(1,"Can't write \"%s\"",path);
+	} /* IF */
+	free(buffer);
+
+	return(fd);
+} /* end of make_data_file */
+
+/*********************************************************************
+*
+* Function  : old_scan
+*
+* Purpose   : Search a file the way hed5 did before the search engine ,
+*             a screen block at a time with a memcmp() at every offset.
+*
+* Inputs    : int fd - descriptor of the file
+*             char *string - the string
+*
+* Output    : (none)
+*
+* Returns   : If found Then offset of the block holding the match
+*             Else -1L
+*
+* Example   : offset = old_scan(fd,BENCH_PATTERN);
+*
+* Notes     : This is scan_forward() and scan_block() as they were ,
+*             for comparison only. Matches straddling two blocks are
+*             missed , the benchmark pattern is inside one.
+*
+*********************************************************************/
+
+static long old_scan(int fd, char *string)
+{
+	unsigned char	block[BENCH_OLD_BLOCK];
+	int		string_size , num_bytes , count;
+	long	offset;
+
+	string_size = strlen(string);
+	for ( offset = 0L ; ; offset += BENCH_OLD_BLOCK ) {
+		if ( lseek(fd,offset,SEEK_SET) < 0 ) {
+			break;
+		} /* IF */
+		num_bytes = read(fd,block,BENCH_OLD_BLOCK);
+		if ( num_bytes <= 0 ) {
+			break;
+		} /* IF */
+		for ( count = 0 ; count <= num_bytes - string_size ; ++count ) {
+			if ( memcmp(&block[count],string,string_size) == 0 ) {
+				return(offset);
+			} /* IF */
+		} /* FOR */
+	} /* FOR */
+
+	return(-1L);
+} /* end of old_scan */
+
+/*********************************************************************
+*
+* Function  : bench_search
+*
+* Purpose   : Compare the search engine with the old block scan on
+*             files of 1 MB up to a maximum size.
+*
+* Inputs    : long max_size - size of the largest file
+*
+* Output    : a table of search rates
+*
+* Returns   : (nothing)
+*
+* Example   : bench_search(1000L * 1024L * 1024L);
+*
+* Notes     : The pattern is at the end of each file , so the whole
+*             file is searched. search_forward() is timed on its own ,
+*             one thread.
+*
+*********************************************************************/
+
+static void bench_search(long max_size)
+{
+	char	path[64];
+	unsigned char	*buffer;
+	struct stat	stats;
+	struct timeval	start;
+	DATA_SOURCE	source;
+	SEARCH_PATTERN	pattern;
+	long	size , found;
+	double	old_seconds , new_seconds;
+	int		fd;
+
+	buffer = (unsigned char *)malloc(search_chunk_size + SEARCH_MAX_PATTERN);
+	if ( buffer == NULL || compile_pattern(BENCH_PATTERN,&pattern) < 0 ) {
+		quit(1,"Can't set up the search");
+	} /* IF */
+	printf("search for a %d byte string at the end of the file\n",
+			pattern.length);
+	printf("%10s %16s %16s %8s\n","size MB","scan_block MB/s",
+			"engine MB/s","speedup");
+	for ( size = 1024L * 1024L ; size <= max_size ; size *= 10L ) {
+		fd = make_data_file(path,size);
+		if ( fstat(fd,&stats) < 0 || source_open(&source,fd,&stats) < 0 ) {
+			quit(1,"Can't open \"%s\"",path);
+		} /* IF */
+		source_advise(&source,MADV_WILLNEED);
+
+		gettimeofday(&start,NULL);
+		found = old_scan(fd,BENCH_PATTERN);
+		old_seconds = elapsed_seconds(&start);
+		if ( found < 0L ) {
+			printf("scan_block did not find the pattern\n");
+		} /* IF */
+
+		gettimeofday(&start,NULL);
+		found = search_forward(&source,0L,-1L,&pattern,buffer,NULL);
+		new_seconds = elapsed_seconds(&start);
+		if ( found != size - pattern.length ) {
+			printf("search_forward found the pattern at 0x%lx\n",found);
+		} /* IF */
+
+		printf("%10ld %16.1f %16.1f %7.1fx\n",size / (1024L * 1024L),
+				size / old_seconds / (1024.0 * 1024.0),
+				size / new_seconds / (1024.0 * 1024.0),
+				old_seconds / new_seconds);
+		source_close(&source);
+		close(fd);
+		unlink(path);
+	} /* FOR */
+	free(buffer);
+
+	return;
+} /* end of bench_search */
+
+/*********************************************************************
+*
+* Function  : bench_threads
+*
+* Purpose   : Time the parallel search with 1 thread up to one per
+*             processor.
+*
+* Inputs    : long size - size of the file
+*
+* Output    : a table of search rates
+*
+* Returns   : (nothing)
+*
+* Example   : bench_threads(1000L * 1024L * 1024L);
+*
+* Notes     : Every thread count must give the same offset. The
+*             thread counts double , the last is the number of
+*             processors.
+*
+*********************************************************************/
+
+static void bench_threads(long size)
+{
+	char	path[64];
+	struct stat	stats;
+	struct timeval	start;
+	DATA_SOURCE	source;
+	SEARCH_PATTERN	pattern;
+	long	found;
+	double	seconds , one_thread;
+	int		fd , num_cpus;
+
+	temp_buffer = (unsigned char *)malloc(search_chunk_size +
+							SEARCH_MAX_PATTERN);
+	if ( temp_buffer == NULL || compile_pattern(BENCH_PATTERN,&pattern) < 0 ) {
+		quit(1,"Can't set up the search");
+	} /* IF */
+	num_cpus = (int)sysconf(_SC_NPROCESSORS_ONLN);
+	if ( num_cpus > MAX_THREADS ) {
+		num_cpus = MAX_THREADS;
+	} /* IF */
+	fd = make_data_file(path,size);
+	if ( fstat(fd,&stats) < 0 || source_open(&source,fd,&stats) < 0 ) {
+		quit(1,"Can't open \"%s\"",path);
+	} /* IF */
+	source_advise(&source,MADV_WILLNEED);
+
+	printf("\nparallel search of %ld MB on %d processors\n",
+			size / (1024L * 1024L),num_cpus);
+	printf("%10s %16s %8s\n","threads","MB/s","speedup");
+	one_thread = 0.0;
+	for ( opt_threads = 1 ; opt_threads <= num_cpus ;
+				opt_threads = opt_threads < num_cpus && opt_threads * 2 > num_cpus ?
+								num_cpus : opt_threads * 2 ) {
+		gettimeofday(&start,NULL);
+		found = parallel_search(&source,1,0L,&pattern);
+		seconds = elapsed_seconds(&start);
+		if ( found != size - pattern.length ) {
+			printf("%d threads found the pattern at 0x%lx\n",opt_threads,found);
+		} /* IF */
+		if ( opt_threads == 1 ) {
+			one_thread = seconds;
+		} /* IF */
+		printf("%10d %16.1f %7.1fx\n",opt_threads,
+				size / seconds / (1024.0 * 1024.0),one_thread / seconds);
+	} /* FOR */
+
+	source_close(&source);
+	close(fd);
+	unlink(path);
+	free(temp_buffer);
+
+	return;
+} /* end of bench_threads */
+
+/*********************************************************************
+*
+* Function  : old_format_row
+*
+* Purpose   : Format one row of a dump the way display_block() did
+*             before format_row() , with sprintf() and strcat().
+*
+* Inputs    : char *line - receives the hex part of the row
+*             char *chars - receives the character part of the row
+*             long offset - file offset of the first byte
+*             const unsigned char *data - the bytes
+*             int num_pairs_bytes - number of bytes in a row
+*
+* Output    : (none)
+*
+* Returns   : (nothing)
+*
+* Example   : old_format_row(line,chars,offset,data,16);
+*
+* Notes     : For comparison only. pad_string() is done inline.
+*
+*********************************************************************/
+
+static void old_format_row(char *line, char *chars, long offset,
+					const unsigned char *data, int num_pairs_bytes)
+{
+	char	chunk[64];
+	int		num_bytes , count , length;
+
+	sprintf(line,"%08lx : ",offset);
+	for ( num_bytes = 0 ; num_bytes < num_pairs_bytes ; num_bytes += 2 ) {
+		sprintf(chunk,"%02x%02x ",data[num_bytes],data[num_bytes + 1]);
+		strcat(line,chunk);
+	} /* FOR */
+	length = strlen(line);
+	if ( length < 11 + num_pairs_bytes / 2 * 5 ) {
+		memset(&line[length],' ',11 + num_pairs_bytes / 2 * 5 - length);
+		line[11 + num_pairs_bytes / 2 * 5] = '\0';
+	} /* IF */
+	sprintf(chunk,"|%-*.*s|",num_pairs_bytes,num_pairs_bytes," ");
+	strcat(line,chunk);
+	sprintf(chars,"%-*.*s",num_pairs_bytes,num_pairs_bytes," ");
+	for ( count = 0 ; count < num_bytes ; ++count ) {
+		chars[count] = data[count] < 0x20 || data[count] > 0x7e ? '.' : data[count];
+	} /* FOR */
+
+	return;
+} /* end of old_format_row */
+
+/*********************************************************************
+*
+* Function  : bench_format
+*
+* Purpose   : Compare format_row() with the old sprintf() and strcat()
+*             formatting.
+*
+* Inputs    : (none)
+*
+* Output    : a table of rows per second
+*
+* Returns   : (nothing)
+*
+* Example   : bench_format();
+*
+* Notes     : Each row length formats the same 64 KB of pseudo random
+*             bytes over and over for about a second.
+*
+*********************************************************************/
+
+static void bench_format()
+{
+	static	int	pairs[] = { 8 , 16 , 32 , 0 };
+	unsigned char	*data;
+	char	line[512] , chars[256];
+	struct timeval	start;
+	long	offset , num_rows , row_bytes;
+	double	old_rate , new_rate , seconds;
+	int		index;
+
+	data = (unsigned char *)malloc(65536 + 64);
+	if ( data == NULL ) {
+		quit(1,"malloc failed");
+	} /* IF */
+	for ( index = 0 ; index < 65536 + 64 ; ++index ) {
+		data[index] = (unsigned char)(index * 2654435761U >> 24);
+	} /* FOR */
+	format_init();
+
+	printf("\nformatting of dump rows\n");
+	printf("%10s %16s %18s %8s\n","pairs","sprintf rows/s",
+			"format_row rows/s","speedup");
+	for ( index = 0 ; pairs[index] != 0 ; ++index ) {
+		row_bytes = 2L * pairs[index];
+		gettimeofday(&start,NULL);
+		num_rows = 0L;
+		do {
+			for ( offset = 0L ; offset < 65536L ; offset += row_bytes ) {
+				old_format_row(line,chars,offset,&data[offset],(int)row_bytes);
+				num_rows += 1L;
+			} /* FOR */
+			seconds = elapsed_seconds(&start);
+		} while ( seconds < 1.0 );
+		old_rate = num_rows / seconds;
+
+		gettimeofday(&start,NULL);
+		num_rows = 0L;
+		do {
+			for ( offset = 0L ; offset < 65536L ; offset += row_bytes ) {
+				format_row(line,offset,&data[offset],(int)row_bytes,pairs[index]);
+				num_rows += 1L;
+			} /* FOR */
+			seconds = elapsed_seconds(&start);
+		} while ( seconds < 1.0 );
+		new_rate = num_rows / seconds;
+
+		printf("%10d %15.2fM %17.2fM %7.1fx\n",pairs[index],old_rate / 1e6,
+				new_rate / 1e6,new_rate / old_rate);
+	} /* FOR */
+	free(data);
+
+	return;
+} /* end of bench_format */
+
+/*********************************************************************
+*
+* Function  : main
+*
+* Purpose   : Run the benchmarks.
+*
+* Inputs    : int argc - number of arguments
+*             char *argv[] - size of the largest file in MB
+*
+* Output    : the results
+*
+* Returns   : 0
+*
+* Example   : hed5_bench 10000
+*
+* Notes     : Sizes go up by 10 times from 1 MB , so 10000 tries
+*             1 MB to 10 GB.
+*
+*********************************************************************/
+
+int main(int argc, char *argv[])
+{
+	long	max_size;
+
+	max_size = 1000L;
+	if ( argc > 1 ) {
+		max_size = atol(argv[1]);
+	} /* IF */
+	if ( max_size < 1L ) {
+		die(1,"Usage : %s [max_megabytes]\n",argv[0]);
+	} /* IF */
+	max_size *= 1024L * 1024L;
+
+	bench_search(max_size);
+	bench_threads(max_size < 1000L * 1024L * 1024L ? max_size :
+						1000L * 1024L * 1024L);
+	bench_format();
+
+	exit(0);
+} /* end of main */
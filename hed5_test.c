@@ -0,0 +1,1799 @@
+/*********************************************************************
+*
+* File      : hed5_test.c
+*
+* Author    : Barry Kimelman
+*
+* Created   : October 17, 2026
+*
+* Purpose   : Regression checks for the internals of hed5.
+*
+* Notes     : hed5.c is included here so that its static functions
+*             can be called directly. Run with "make -f make.mk test".
+*
+*********************************************************************/
+
+#define	main	hed5_main
+#include	"hed5.c"
+#undef	main
+
+static	int		num_checks = 0;
+static	int		num_failed = 0;
+
+/*********************************************************************
+*
+* Function  : check
+*
+* Purpose   : Count a check and report it if it failed.
+*
+* Inputs    : int ok - result of the check
+*             char *format - format string (ala printf)
+*             ... - variable arguments list ala printf
+*
+* Output    : a message for a failed check
+*
+* Returns   : ok
+*
+* Example   : check(count == 10L,"count is %ld",count);
+*
+* Notes     : (none)
+*
+*********************************************************************/
+
+static int check(int ok, char *format, ...)
+{
+	va_list	ap;
+
+	num_checks += 1;
+	if ( ! ok ) {
+		num_failed += 1;
+		printf("FAILED : ");
+		va_start(ap,format);
+		vprintf(format,ap);
+		va_end(ap);
+		printf("\n");
+	} /* IF */
+
+	return(ok);
+} /* end of check */
+
+/*********************************************************************
+*
+* Function  : make_file
+*
+* Purpose   : Create a temporary file filled with one byte value.
+*
+* Inputs    : char *path - buffer for the name of the file
+*             long size - size of the file
+*             int value - value of every byte
+*
+* Output    : (none)
+*
+* Returns   : descriptor of the file opened for reading and writing
+*
+* Example   : fd = make_file(path,8192L,0xaa);
+*
+* Notes     : The caller unlinks the file.
+*
+*********************************************************************/
+
+static int make_file(char *path, long size, int value)
+{
+	unsigned char	buffer[4096];
+	long	position , count;
+	int		fd;
+
+	strcpy(path,"/tmp/hed5_testXXXXXX");
+	fd = mkstemp(path);
+	if ( fd < 0 ) {
+		quit(1,"Can't create a temporary file");
+	} /* IF */
+	memset(buffer,value,sizeof(buffer));
+	for ( position = 0L ; position < size ; position += count ) {
+		count = size - position;
+		if ( count > (long)sizeof(buffer) ) {
+			count = (long)sizeof(buffer);
+		} /* IF */
+		if ( write(fd,buffer,count) != count ) {
+			quit(1,"Can't write \"%s\"",path);
+		} /* IF */
+	} /* FOR */
+
+	return(fd);
+} /* end of make_file */
+
+/*********************************************************************
+*
+* Function  : check_boundary_search
+*
+* Purpose   : Search for a pattern planted at each position at which it
+*             straddles the boundary between two search chunks.
+*
+* Inputs    : DATA_SOURCE *source - data source of the file
+*             int fd - descriptor of the file
+*             char *text - pattern text , matching the bytes ABCDEFGH
+*             unsigned char *buffer - read buffer of at least
+*                       search_chunk_size + SEARCH_MAX_PATTERN bytes
+*
+* Output    : messages for failed checks
+*
+* Returns   : (nothing)
+*
+* Example   : check_boundary_search(&source,fd,"ABCDEFGH",buffer);
+*
+* Notes     : The file is zeros apart from the planted bytes.
+*
+*********************************************************************/
+
+static void check_boundary_search(DATA_SOURCE *source, int fd, char *text,
+					unsigned char *buffer)
+{
+	static	unsigned char	zeros[8];
+	SEARCH_PATTERN	pattern;
+	long	position , found;
+
+	check(compile_pattern(text,&pattern) == 0,"pattern \"%s\"",text);
+	for ( position = search_chunk_size - 7L ; position < search_chunk_size ;
+					++position ) {
+		if ( pwrite(fd,"ABCDEFGH",8,(off_t)position) != 8 ) {
+			quit(1,"Can't plant pattern");
+		} /* IF */
+		cache_invalidate(source);
+		found = search_forward(source,0L,-1L,&pattern,buffer,NULL);
+		check(found == position,"\"%s\" at 0x%lx found forward at 0x%lx",
+				text,position,found);
+		found = search_forward(source,position + 1L,-1L,&pattern,buffer,NULL);
+		check(found == -1L,"\"%s\" at 0x%lx found again forward at 0x%lx",
+				text,position,found);
+		found = search_backward(source,source->size - 1L,0L,&pattern,buffer,
+							NULL);
+		check(found == position,"\"%s\" at 0x%lx found backward at 0x%lx",
+				text,position,found);
+		found = search_backward(source,position - 1L,0L,&pattern,buffer,NULL);
+		check(found == -1L,"\"%s\" at 0x%lx found again backward at 0x%lx",
+				text,position,found);
+		if ( pwrite(fd,zeros,8,(off_t)position) != 8 ) {
+			quit(1,"Can't remove pattern");
+		} /* IF */
+	} /* FOR */
+
+	return;
+} /* end of check_boundary_search */
+
+/*********************************************************************
+*
+* Function  : test_boundary_search
+*
+* Purpose   : Check that matches straddling two search chunks are found
+*             forward and backward , with and without masks , for
+*             mapped and pread() sources.
+*
+* Inputs    : (none)
+*
+* Output    : messages for failed checks
+*
+* Returns   : (nothing)
+*
+* Example   : test_boundary_search();
+*
+* Notes     : (none)
+*
+*********************************************************************/
+
+static void test_boundary_search()
+{
+	char	path[64];
+	unsigned char	*buffer;
+	struct stat	stats;
+	DATA_SOURCE	source;
+	int		fd , kind;
+
+	buffer = (unsigned char *)malloc(search_chunk_size + SEARCH_MAX_PATTERN);
+	if ( buffer == NULL ) {
+		quit(1,"malloc failed");
+	} /* IF */
+	fd = make_file(path,2L * SEARCH_CHUNK_SIZE + 100L,0);
+	if ( fstat(fd,&stats) < 0 ) {
+		quit(1,"Can't stat \"%s\"",path);
+	} /* IF */
+	for ( kind = 0 ; kind < 2 ; ++kind ) {
+		if ( source_open(&source,fd,&stats) < 0 ) {
+			quit(1,"Can't open \"%s\"",path);
+		} /* IF */
+		if ( kind == 1 ) {
+			source_close(&source);
+			cache_open(&source);
+		} /* IF */
+		check_boundary_search(&source,fd,"ABCDEFGH",buffer);
+		check_boundary_search(&source,fd,"=41 42 ?? 44 4? 46 47 48",buffer);
+		check_boundary_search(&source,fd,"=?1 42 43 44 45 46 47 4?",buffer);
+		source_close(&source);
+	} /* FOR */
+	close(fd);
+	unlink(path);
+	free(buffer);
+
+	return;
+} /* end of test_boundary_search */
+
+/*********************************************************************
+*
+* Function  : test_random
+*
+* Purpose   : Get a pseudo random number.
+*
+* Inputs    : long limit - the numbers are below this
+*
+* Output    : (none)
+*
+* Returns   : a number from 0 to limit - 1
+*
+* Example   : offset = test_random(size);
+*
+* Notes     : A xorshift generator with a fixed seed , so that a
+*             failure can be repeated.
+*
+*********************************************************************/
+
+static long test_random(long limit)
+{
+	static	unsigned long long	state = 88172645463325252ULL;
+
+	state ^= state << 13;
+	state ^= state >> 7;
+	state ^= state << 17;
+
+	return(limit > 0L ? (long)(state % (unsigned long long)limit) : 0L);
+} /* end of test_random */
+
+/*********************************************************************
+*
+* Function  : check_edited
+*
+* Purpose   : Compare the edited contents of a data source with the
+*             bytes they should be.
+*
+* Inputs    : DATA_SOURCE *source - data source with pending edits
+*             unsigned char *model - the bytes of the edited file
+*             long size - size of the edited file
+*             int num_ranges - number of random ranges read , 0 for
+*                              the whole file
+*             char *what - description for messages
+*
+* Output    : messages for failed checks
+*
+* Returns   : (nothing)
+*
+* Example   : check_edited(&source,model,size,8,"after 10 edits");
+*
+* Notes     : Each range is read with source_read() , which assembles
+*             it from the pieces it covers.
+*
+*********************************************************************/
+
+static void check_edited(DATA_SOURCE *source, unsigned char *model,
+					long size, int num_ranges, char *what)
+{
+	unsigned char	*buffer;
+	long	offset , length , num_bytes;
+	int		count;
+
+	check(source_size(source) == size,"%s : size %ld , expected %ld",what,
+			source_size(source),size);
+	buffer = (unsigned char *)malloc(size + 1);
+	if ( buffer == NULL ) {
+		quit(1,"malloc failed");
+	} /* IF */
+	for ( count = 0 ; count < (num_ranges > 0 ? num_ranges : 1) ; ++count ) {
+		offset = 0L;
+		length = size;
+		if ( num_ranges > 0 ) {
+			offset = test_random(size + 1L);
+			length = test_random(size - offset + 2L);
+		} /* IF */
+		num_bytes = source_read(source,offset,buffer,length);
+		if ( offset + length > size ) {
+			length = size - offset;
+		} /* IF */
+		if ( ! check(num_bytes == length,"%s : read 0x%lx..0x%lx gave %ld bytes",
+					what,offset,offset + length,num_bytes) ) {
+			break;
+		} /* IF */
+		if ( ! check(memcmp(buffer,&model[offset],length) == 0,
+					"%s : read 0x%lx..0x%lx differs",what,offset,offset + length) ) {
+			break;
+		} /* IF */
+	} /* FOR */
+	free(buffer);
+
+	return;
+} /* end of check_edited */
+
+/*********************************************************************
+*
+* Function  : open_source
+*
+* Purpose   : Create a temporary file of pseudo random bytes and open a
+*             data source for it.
+*
+* Inputs    : char *path - buffer for the name of the file
+*             DATA_SOURCE *source - the data source
+*             unsigned char *model - receives the bytes of the file
+*             long size - size of the file
+*             int use_pread - 1 --> read through the page cache
+*
+* Output    : (none)
+*
+* Returns   : descriptor of the file opened for reading and writing
+*
+* Example   : fd = open_source(path,&source,model,65536L,0);
+*
+* Notes     : The caller closes the source and unlinks the file.
+*
+*********************************************************************/
+
+static int open_source(char *path, DATA_SOURCE *source, unsigned char *model,
+					long size, int use_pread)
+{
+	struct stat	stats;
+	long	index;
+	int		fd;
+
+	for ( index = 0L ; index < size ; ++index ) {
+		model[index] = (unsigned char)test_random(256L);
+	} /* FOR */
+	fd = make_file(path,0L,0);
+	if ( pwrite(fd,model,size,0) != size || fstat(fd,&stats) < 0 ||
+				source_open(source,fd,&stats) < 0 ) {
+		quit(1,"Can't open \"%s\"",path);
+	} /* IF */
+	if ( use_pread ) {
+		source_close(source);
+		cache_open(source);
+	} /* IF */
+
+	return(fd);
+} /* end of open_source */
+
+/*********************************************************************
+*
+* Function  : test_piece_table
+*
+* Purpose   : Apply random overwrites to the piece table and compare
+*             the edited file with a flat copy of its bytes.
+*
+* Inputs    : (none)
+*
+* Output    : messages for failed checks
+*
+* Returns   : (nothing)
+*
+* Example   : test_piece_table();
+*
+* Notes     : Done for mapped and pread() sources. A range inside a
+*             piece of added data must be overwritten in place , and
+*             consecutive edits must grow a single piece.
+*
+*********************************************************************/
+
+static void test_piece_table()
+{
+	char	path[64] , what[64];
+	unsigned char	model[65536] , data[64];
+	EDIT_BUFFER	edits;
+	DATA_SOURCE	source;
+	long	size , offset , count , index;
+	int		fd , kind , number;
+
+	size = (long)sizeof(model);
+	for ( kind = 0 ; kind < 2 ; ++kind ) {
+		fd = open_source(path,&source,model,size,kind);
+		edit_init(&edits,size);
+		source.edits = &edits;
+		for ( number = 1 ; number <= 2000 ; ++number ) {
+			offset = test_random(size);
+			count = 1L + test_random(size - offset < 64L ? size - offset : 64L);
+			for ( index = 0L ; index < count ; ++index ) {
+				data[index] = (unsigned char)test_random(256L);
+			} /* FOR */
+			check(edit_replace(&edits,offset,count,data,count) == 0,
+					"overwrite of %ld bytes at 0x%lx",count,offset);
+			memcpy(&model[offset],data,count);
+			if ( number % 50 == 0 ) {
+				sprintf(what,"after %d overwrites",number);
+				check_edited(&source,model,size,8,what);
+			} /* IF */
+		} /* FOR */
+		check_edited(&source,model,size,0,"after all overwrites");
+		edit_reset(&edits,0L);
+		free(edits.added);
+		source_close(&source);
+		close(fd);
+		unlink(path);
+	} /* FOR */
+
+	/* edits inside added data are done in place */
+	fd = open_source(path,&source,model,size,0);
+	edit_init(&edits,size);
+	source.edits = &edits;
+	memset(data,0x11,sizeof(data));
+	edit_replace(&edits,1000L,50L,data,50L);
+	count = edits.num_pieces;
+	memset(data,0x22,sizeof(data));
+	check(edit_replace(&edits,1000L,50L,data,50L) == 0 &&
+			edits.num_pieces == count && edits.added_length == 50L,
+			"overwrite of an added piece made %ld pieces and %ld bytes",
+			edits.num_pieces,edits.added_length);
+	memcpy(&model[1000],data,50);
+	check_edited(&source,model,size,0,"after overwriting an added piece");
+
+	/* typing over the file grows one added piece */
+	count = edits.num_pieces;
+	for ( offset = 2000L ; offset < 2040L ; ++offset ) {
+		data[0] = (unsigned char)offset;
+		edit_replace(&edits,offset,1L,data,1L);
+		model[offset] = data[0];
+	} /* FOR */
+	check(edits.num_pieces == count + 2L,
+			"40 consecutive overwrites made %ld pieces from %ld",
+			edits.num_pieces,count);
+	check_edited(&source,model,size,0,"after consecutive overwrites");
+	edit_reset(&edits,0L);
+	free(edits.added);
+	source_close(&source);
+	close(fd);
+	unlink(path);
+
+	return;
+} /* end of test_piece_table */
+
+/*********************************************************************
+*
+* Function  : open_edit_file
+*
+* Purpose   : Make a temporary file the file being edited , with an
+*             empty edit journal.
+*
+* Inputs    : char *path - buffer for the name of the file
+*             unsigned char *model - receives the bytes of the file
+*             long size - size of the file
+*
+* Output    : (none)
+*
+* Returns   : descriptor of the file
+*
+* Example   : fd = open_edit_file(path,model,65536L);
+*
+* Notes     : Sets up the globals used by change_bytes() and
+*             undo_redo(). See close_edit_file().
+*
+*********************************************************************/
+
+static int open_edit_file(char *path, unsigned char *model, long size)
+{
+	int		fd;
+
+	fd = open_source(path,&input_source,model,size,0);
+	if ( edit_init(&file_edits,size) < 0 ) {
+		quit(1,"Out of memory");
+	} /* IF */
+	input_source.edits = &file_edits;
+	memset(&edit_journal,0,sizeof(edit_journal));
+	blocksize = 640;
+	block_span = blocksize;
+	current_file_offset = 0L;
+	set_file_size();
+
+	return(fd);
+} /* end of open_edit_file */
+
+/*********************************************************************
+*
+* Function  : close_edit_file
+*
+* Purpose   : Release the file set up by open_edit_file().
+*
+* Inputs    : char *path - name of the file
+*             int fd - descriptor of the file
+*
+* Output    : (none)
+*
+* Returns   : (nothing)
+*
+* Example   : close_edit_file(path,fd);
+*
+* Notes     : (none)
+*
+*********************************************************************/
+
+static void close_edit_file(char *path, int fd)
+{
+	edit_reset(&file_edits,0L);
+	free(file_edits.added);
+	memset(&file_edits,0,sizeof(file_edits));
+	free(edit_journal.entries);
+	free(edit_journal.old_data);
+	free(edit_journal.new_data);
+	memset(&edit_journal,0,sizeof(edit_journal));
+	source_close(&input_source);
+	memset(&input_source,0,sizeof(input_source));
+	close(fd);
+	unlink(path);
+
+	return;
+} /* end of close_edit_file */
+
+/*********************************************************************
+*
+* Function  : test_undo_redo
+*
+* Purpose   : Check that runs of edits are undone as one step , that a
+*             new edit discards what was undone , and that undo and
+*             redo give back the right bytes.
+*
+* Inputs    : (none)
+*
+* Output    : messages for failed checks
+*
+* Returns   : (nothing)
+*
+* Example   : test_undo_redo();
+*
+* Notes     : (none)
+*
+*********************************************************************/
+
+static void test_undo_redo()
+{
+	char	path[64];
+	unsigned char	model[65600] , original[65536] , typed[65536] , byte;
+	long	size , offset;
+	int		fd;
+
+	size = (long)sizeof(original);
+	fd = open_edit_file(path,model,size);
+	memcpy(original,model,size);
+
+	/* typing over a run of bytes is one change */
+	for ( offset = 100L ; offset < 105L ; ++offset ) {
+		byte = (unsigned char)('A' + offset - 100L);
+		change_bytes(offset,1L,&byte,1L);
+		model[offset] = byte;
+	} /* FOR */
+	check(edit_journal.num_entries == 1 && edit_journal.position == 1,
+			"typing 5 bytes made %d changes",edit_journal.num_entries);
+	check(undo_redo(0) == 100L,"undo of typing");
+	check_edited(&input_source,original,size,0,"after undo of typing");
+	check(undo_redo(1) == 100L,"redo of typing");
+	check_edited(&input_source,model,size,0,"after redo of typing");
+	memcpy(typed,model,size);
+
+	/* as is inserting a run of bytes , and deleting one */
+	for ( offset = 200L ; offset < 204L ; ++offset ) {
+		byte = (unsigned char)offset;
+		change_bytes(offset,0L,&byte,1L);
+		memmove(&model[offset + 1L],&model[offset],size - offset);
+		model[offset] = byte;
+		size += 1L;
+	} /* FOR */
+	for ( offset = 0L ; offset < 3L ; ++offset ) {
+		change_bytes(300L,1L,NULL,0L);
+		memmove(&model[300],&model[301],size - 301L);
+		size -= 1L;
+	} /* FOR */
+	check(edit_journal.num_entries == 3 && edit_journal.position == 3,
+			"typing , inserting and deleting made %d changes",
+			edit_journal.num_entries);
+	check_edited(&input_source,model,size,0,"after inserting and deleting");
+
+	/* undo everything , redo the typing , then a new change */
+	check(undo_redo(0) == 300L && undo_redo(0) == 200L && undo_redo(0) == 100L,
+			"undo of 3 changes");
+	check_edited(&input_source,original,sizeof(original),0,
+			"after undo of 3 changes");
+	check(undo_redo(1) == 100L,"redo of first change");
+	byte = 0x5a;
+	change_bytes(500L,1L,&byte,1L);
+	typed[500] = byte;
+	check(edit_journal.num_entries == 2 && edit_journal.position == 2,
+			"new change after undo left %d changes , at %d",
+			edit_journal.num_entries,edit_journal.position);
+	check_edited(&input_source,typed,sizeof(typed),0,"after change after undo");
+	check(undo_redo(0) == 500L && undo_redo(0) == 100L,"undo of 2 changes");
+	check_edited(&input_source,original,sizeof(original),0,
+			"after undo of 2 changes");
+
+	close_edit_file(path,fd);
+
+	return;
+} /* end of test_undo_redo */
+
+/*********************************************************************
+*
+* Function  : test_journal_limits
+*
+* Purpose   : Check that the oldest changes are forgotten when the
+*             journal has too many changes or too many bytes , and that
+*             the rest can still be undone.
+*
+* Inputs    : (none)
+*
+* Output    : messages for failed checks
+*
+* Returns   : (nothing)
+*
+* Example   : test_journal_limits();
+*
+* Notes     : The changes are apart so that they are not merged.
+*
+*********************************************************************/
+
+static void test_journal_limits()
+{
+	char	path[64];
+	unsigned char	*model , *original , *data , byte;
+	long	size , number , total , chunk , undone;
+	int		fd;
+
+	size = 8L << 20;
+	model = (unsigned char *)malloc(size);
+	original = (unsigned char *)malloc(size);
+	data = (unsigned char *)malloc(9L << 20);
+	if ( model == NULL || original == NULL || data == NULL ) {
+		quit(1,"malloc failed");
+	} /* IF */
+
+	/* too many changes */
+	fd = open_edit_file(path,model,size);
+	memcpy(original,model,size);
+	total = JOURNAL_MAX_ENTRIES + 100L;
+	for ( number = 0L ; number < total ; ++number ) {
+		byte = (unsigned char)~model[2L * number];
+		change_bytes(2L * number,1L,&byte,1L);
+		model[2L * number] = byte;
+	} /* FOR */
+	check(edit_journal.num_entries <= JOURNAL_MAX_ENTRIES &&
+			edit_journal.num_dropped > 0L &&
+			edit_journal.num_dropped + edit_journal.num_entries == total,
+			"%ld changes kept %d and dropped %ld",total,
+			edit_journal.num_entries,edit_journal.num_dropped);
+	for ( undone = 0L ; edit_journal.position > 0 ; ++undone ) {
+		if ( undo_redo(0) < 0L ) {
+			break;
+		} /* IF */
+	} /* FOR */
+	check(undone == edit_journal.num_entries && edit_journal.position == 0,
+			"undid %ld of %d changes kept",undone,edit_journal.num_entries);
+	for ( number = 0L ; number < edit_journal.num_dropped ; ++number ) {
+		original[2L * number] = model[2L * number];
+	} /* FOR */
+	check_edited(&input_source,original,size,16,"after undo of all changes kept");
+	close_edit_file(path,fd);
+
+	/* too many bytes , 3 MB changes at 0 and 4 MB in turn */
+	fd = open_edit_file(path,model,size);
+	memcpy(original,model,size);
+	chunk = 3L << 20;
+	for ( number = 0L ; number < 3L ; ++number ) {
+		memset(data,(int)number + 1,chunk);
+		change_bytes((number % 2L) * (4L << 20),chunk,data,chunk);
+		if ( number == 0L ) {
+			memset(original,1,chunk);	/* the change which is forgotten */
+		} /* IF */
+		memset(&model[(number % 2L) * (4L << 20)],(int)number + 1,chunk);
+	} /* FOR */
+	check(edit_journal.num_dropped == 1L && edit_journal.num_entries == 2 &&
+			edit_journal.old_length + edit_journal.new_length <=
+							JOURNAL_MAX_DATA,
+			"3 changes of 3 MB kept %d , dropped %ld , %ld bytes",
+			edit_journal.num_entries,edit_journal.num_dropped,
+			edit_journal.old_length + edit_journal.new_length);
+	check_edited(&input_source,model,size,16,"after 3 changes of 3 MB");
+	check(undo_redo(0) == 0L && undo_redo(0) == 4L << 20,"undo of 2 changes");
+	check_edited(&input_source,original,size,16,"after undo of 2 changes");
+
+	/* a change too big to keep makes everything before it permanent */
+	check(undo_redo(1) == 4L << 20,"redo of 4 MB change");
+	memset(data,0x77,9L << 20);
+	check(change_bytes(size,0L,data,9L << 20) == 0,"insert of 9 MB");
+	check(edit_journal.num_entries == 0 && edit_journal.position == 0,
+			"journal after insert of 9 MB has %d changes",
+			edit_journal.num_entries);
+	check(source_size(&input_source) == size + (9L << 20),
+			"size after insert of 9 MB");
+	close_edit_file(path,fd);
+
+	free(model);
+	free(original);
+	free(data);
+
+	return;
+} /* end of test_journal_limits */
+
+/*********************************************************************
+*
+* Function  : check_stream
+*
+* Purpose   : Write the edited file with edit_stream() and compare the
+*             output with the bytes it should be.
+*
+* Inputs    : EDIT_BUFFER *edits - the edit buffer
+*             DATA_SOURCE *source - the original file
+*             unsigned char *model - the bytes of the edited file
+*             long size - size of the edited file
+*             char *what - description for messages
+*
+* Output    : messages for failed checks
+*
+* Returns   : (nothing)
+*
+* Example   : check_stream(&edits,&source,model,size,"at the end");
+*
+* Notes     : (none)
+*
+*********************************************************************/
+
+static void check_stream(EDIT_BUFFER *edits, DATA_SOURCE *source,
+					unsigned char *model, long size, char *what)
+{
+	char	path[64];
+	unsigned char	*buffer;
+	int		fd;
+
+	fd = make_file(path,0L,0);
+	buffer = (unsigned char *)malloc(size + 1);
+	if ( buffer == NULL ) {
+		quit(1,"malloc failed");
+	} /* IF */
+	check(edit_stream(edits,source,fd) == 0,"%s : edit_stream failed",what);
+	check(pread(fd,buffer,size + 1,0) == size,"%s : streamed file size",what);
+	check(memcmp(buffer,model,size) == 0,"%s : streamed file differs",what);
+	free(buffer);
+	close(fd);
+	unlink(path);
+
+	return;
+} /* end of check_stream */
+
+/*********************************************************************
+*
+* Function  : test_insert_delete
+*
+* Purpose   : Apply random overwrites , inserts and deletes to the
+*             piece table and compare the edited file , as read and as
+*             streamed , with a flat copy of its bytes.
+*
+* Inputs    : (none)
+*
+* Output    : messages for failed checks
+*
+* Returns   : (nothing)
+*
+* Example   : test_insert_delete();
+*
+* Notes     : Done for mapped and pread() sources. The last pass saves
+*             the edits with rewrite_file() , as the s command does.
+*
+*********************************************************************/
+
+static void test_insert_delete()
+{
+	char	path[64] , what[64];
+	unsigned char	*model , data[256];
+	EDIT_BUFFER	edits;
+	DATA_SOURCE	source;
+	long	size , max_size , offset , old_count , new_count , index;
+	int		fd , kind , number;
+
+	max_size = 262144L;
+	model = (unsigned char *)malloc(max_size);
+	if ( model == NULL ) {
+		quit(1,"malloc failed");
+	} /* IF */
+	for ( kind = 0 ; kind < 2 ; ++kind ) {
+		size = 65536L;
+		fd = open_source(path,&source,model,size,kind);
+		edit_init(&edits,size);
+		source.edits = &edits;
+		for ( number = 1 ; number <= 3000 ; ++number ) {
+			offset = test_random(size + 1L);
+			old_count = test_random(size - offset < 128L ? size - offset + 1L : 128L);
+			switch ( test_random(4L) ) {
+			case 0:
+				new_count = old_count;		/* overwrite */
+				break;
+			case 1:
+				old_count = 0L;				/* insert */
+				new_count = 1L + test_random(128L);
+				break;
+			case 2:
+				new_count = 0L;				/* delete */
+				break;
+			default:
+				new_count = test_random(128L);	/* replace */
+			} /* SWITCH */
+			if ( size - old_count + new_count > max_size ) {
+				new_count = old_count;
+			} /* IF */
+			for ( index = 0L ; index < new_count ; ++index ) {
+				data[index] = (unsigned char)test_random(256L);
+			} /* FOR */
+			check(edit_replace(&edits,offset,old_count,data,new_count) == 0,
+					"replace of %ld bytes at 0x%lx by %ld",old_count,offset,
+					new_count);
+			memmove(&model[offset + new_count],&model[offset + old_count],
+						size - offset - old_count);
+			memcpy(&model[offset],data,new_count);
+			size += new_count - old_count;
+			if ( number % 50 == 0 ) {
+				sprintf(what,"after %d changes",number);
+				check_edited(&source,model,size,8,what);
+			} /* IF */
+			if ( number % 1000 == 0 ) {
+				check_stream(&edits,&source,model,size,what);
+			} /* IF */
+		} /* FOR */
+		check(edits.resized,"inserts and deletes not noted");
+
+		if ( kind == 1 ) {
+			/* save as the s command does */
+			filename = path;
+			input_fd = fd;
+			if ( fstat(fd,&filestats) < 0 ) {
+				quit(1,"Can't stat \"%s\"",path);
+			} /* IF */
+			input_source = source;
+			file_edits = edits;
+			input_source.edits = &file_edits;
+			check(rewrite_file() == 0,"rewrite_file failed");
+			fd = input_fd;
+			source = input_source;
+			edits = file_edits;
+			source.edits = &edits;
+			check(! edits.dirty && edits.num_pieces == 1L,
+					"edits left after rewrite_file");
+			check_edited(&source,model,size,0,"after rewrite_file");
+			check(pread(fd,data,1,(off_t)size) == 0 && filestats.st_size == size,
+					"size after rewrite_file");
+			memset(&input_source,0,sizeof(input_source));
+			memset(&file_edits,0,sizeof(file_edits));
+			input_fd = -1;
+			filename = NULL;
+		} /* IF */
+		edit_reset(&edits,0L);
+		free(edits.added);
+		source_close(&source);
+		close(fd);
+		unlink(path);
+	} /* FOR */
+	free(model);
+
+	return;
+} /* end of test_insert_delete */
+
+/*********************************************************************
+*
+* Function  : load_patch_text
+*
+* Purpose   : Load patches from a temporary patch file with the given
+*             lines.
+*
+* Inputs    : char *text - the lines of the patch file
+*             PATCH_SET *patches - receives the patches
+*
+* Output    : (none)
+*
+* Returns   : result of load_patches()
+*
+* Example   : status = load_patch_text("0x10 9090\n",&patches);
+*
+* Notes     : The messages of load_patches() about bad lines are
+*             thrown away.
+*
+*********************************************************************/
+
+static int load_patch_text(char *text, PATCH_SET *patches)
+{
+	char	path[64];
+	int		fd , saved_stderr , null_fd , status;
+
+	fd = make_file(path,0L,0);
+	if ( write(fd,text,strlen(text)) != (ssize_t)strlen(text) ) {
+		quit(1,"Can't write \"%s\"",path);
+	} /* IF */
+	close(fd);
+	fflush(stderr);
+	saved_stderr = dup(2);
+	null_fd = open("/dev/null",O_WRONLY);
+	dup2(null_fd,2);
+	status = load_patches(path,patches);
+	fflush(stderr);
+	dup2(saved_stderr,2);
+	close(saved_stderr);
+	close(null_fd);
+	unlink(path);
+
+	return(status);
+} /* end of load_patch_text */
+
+/*********************************************************************
+*
+* Function  : free_patches
+*
+* Purpose   : Release a patch set.
+*
+* Inputs    : PATCH_SET *patches - the patch set
+*
+* Output    : (none)
+*
+* Returns   : (nothing)
+*
+* Example   : free_patches(&patches);
+*
+* Notes     : (none)
+*
+*********************************************************************/
+
+static void free_patches(PATCH_SET *patches)
+{
+	free(patches->records);
+	free(patches->data);
+	memset(patches,0,sizeof(PATCH_SET));
+
+	return;
+} /* end of free_patches */
+
+/*********************************************************************
+*
+* Function  : test_patches
+*
+* Purpose   : Check the reading of patch files and the patching of a
+*             file.
+*
+* Inputs    : (none)
+*
+* Output    : messages for failed checks
+*
+* Returns   : (nothing)
+*
+* Example   : test_patches();
+*
+* Notes     : (none)
+*
+*********************************************************************/
+
+static void test_patches()
+{
+	char	path[64] , result[256];
+	unsigned char	model[8192] , data[8193];
+	PATCH_SET	patches;
+	int		fd;
+
+	/* records are sorted , adjacent ones make a run */
+	check(load_patch_text("0x20 aabb\n# comment\n\n0x10 0102 # note\n"
+			"0x12 0304\n0x100 ff 00\n",&patches) == 0,"load of 4 patches");
+	check(patches.num_records == 4L && patches.num_runs == 3L &&
+			patches.end == 0x101L,
+			"4 patches gave %ld records , %ld runs , end 0x%lx",
+			patches.num_records,patches.num_runs,patches.end);
+	check(patches.records[0].offset == 0x10L &&
+			patches.records[1].offset == 0x12L &&
+			patches.records[2].offset == 0x20L &&
+			patches.records[3].offset == 0x100L &&
+			patches.records[3].expect_offset >= 0L &&
+			patches.data[patches.records[2].data_offset] == 0xaa,
+			"patches not sorted");
+	free_patches(&patches);
+
+	/* bad lines */
+	check(load_patch_text("0x10 0102\n0x11 03\n",&patches) < 0,
+			"overlapping patches accepted");
+	free_patches(&patches);
+	check(load_patch_text("0x10 010\n",&patches) < 0,
+			"odd number of digits accepted");
+	free_patches(&patches);
+	check(load_patch_text("0x10 0102 030\n",&patches) < 0,
+			"expected bytes of another length accepted");
+	free_patches(&patches);
+	check(load_patch_text("0x10 01zz\n",&patches) < 0,
+			"bad hex digit accepted");
+	free_patches(&patches);
+	check(load_patch_text("# nothing\n",&patches) < 0,"empty patch file accepted");
+	free_patches(&patches);
+
+	/* unexpected bytes leave the file alone */
+	fd = make_file(path,sizeof(model),0xaa);
+	memset(model,0xaa,sizeof(model));
+	load_patch_text("0x10 0102\n0x20 0304 aaaa\n0x30 0506 1234\n",&patches);
+	check(patch_file(&patches,path,result,sizeof(result)) < 0 &&
+			strstr(result,"line 3") != NULL,"patch with wrong bytes : %s",result);
+	check(pread(fd,data,sizeof(data),0) == sizeof(model) &&
+			memcmp(data,model,sizeof(model)) == 0,
+			"file changed by patches with wrong bytes");
+	free_patches(&patches);
+
+	/* runs of adjacent records are written together */
+	load_patch_text("0x1000 0102\n0x10 11\n0x11 2222 aaaa\n0x13 33\n"
+			"0x1fff ff\n",&patches);
+	check(patch_file(&patches,path,result,sizeof(result)) == 0 &&
+			strstr(result,"5 patches applied with 3 writes") != NULL,
+			"patch of 3 runs : %s",result);
+	model[0x10] = 0x11;
+	model[0x11] = 0x22;
+	model[0x12] = 0x22;
+	model[0x13] = 0x33;
+	model[0x1000] = 0x01;
+	model[0x1001] = 0x02;
+	model[0x1fff] = 0xff;
+	check(pread(fd,data,sizeof(data),0) == sizeof(model) &&
+			memcmp(data,model,sizeof(model)) == 0,"file after patch of 3 runs");
+	free_patches(&patches);
+
+	/* nothing is written past the end */
+	load_patch_text("0x1fff 0102\n",&patches);
+	check(patch_file(&patches,path,result,sizeof(result)) < 0,
+			"patch past the end : %s",result);
+	free_patches(&patches);
+	close(fd);
+	unlink(path);
+
+	return;
+} /* end of test_patches */
+
+/* a data source read by several threads at once , see cache_reader() */
+typedef struct cache_test {
+	DATA_SOURCE	*source;
+	unsigned char	*model;		/* the bytes of the file */
+	long	size;
+	long	num_reads;
+	long	num_bad;			/* reads which gave the wrong bytes */
+	unsigned long long	seed;
+} CACHE_TEST;
+
+/*********************************************************************
+*
+* Function  : cache_reader
+*
+* Purpose   : Thread function which reads random ranges of a data
+*             source and compares them with the bytes of the file.
+*
+* Inputs    : void *argument - the CACHE_TEST of this thread
+*
+* Output    : (none)
+*
+* Returns   : NULL
+*
+* Example   : pthread_create(&thread,NULL,cache_reader,&test);
+*
+* Notes     : Has its own random numbers , test_random() is not
+*             thread safe.
+*
+*********************************************************************/
+
+static void *cache_reader(void *argument)
+{
+	CACHE_TEST	*test;
+	unsigned char	*buffer;
+	long	number , offset , length , num_bytes;
+
+	test = (CACHE_TEST *)argument;
+	buffer = (unsigned char *)malloc(CACHE_MAX_READ);
+	if ( buffer == NULL ) {
+		test->num_bad = test->num_reads;
+		return(NULL);
+	} /* IF */
+	for ( number = 0L ; number < test->num_reads ; ++number ) {
+		test->seed ^= test->seed << 13;
+		test->seed ^= test->seed >> 7;
+		test->seed ^= test->seed << 17;
+		offset = (long)(test->seed % (unsigned long long)test->size);
+		length = 1L + (long)((test->seed >> 32) % CACHE_MAX_READ);
+		if ( length > test->size - offset ) {
+			length = test->size - offset;
+		} /* IF */
+		num_bytes = source_read(test->source,offset,buffer,length);
+		if ( num_bytes != length ||
+					memcmp(buffer,&test->model[offset],length) != 0 ) {
+			test->num_bad += 1L;
+		} /* IF */
+	} /* FOR */
+	free(buffer);
+
+	return(NULL);
+} /* end of cache_reader */
+
+/*********************************************************************
+*
+* Function  : wait_prefetched
+*
+* Purpose   : Wait for the prefetch thread of a page cache to read a
+*             number of pages.
+*
+* Inputs    : PAGE_CACHE *cache - the cache
+*             long num_pages - count of pages prefetched waited for
+*
+* Output    : (none)
+*
+* Returns   : count of pages prefetched
+*
+* Example   : count = wait_prefetched(source.cache,prefetched + 4L);
+*
+* Notes     : Gives up after about 5 seconds.
+*
+*********************************************************************/
+
+static long wait_prefetched(PAGE_CACHE *cache, long num_pages)
+{
+	long	prefetched;
+	int		count;
+
+	for ( count = 0 ; count < 5000 ; ++count ) {
+		pthread_mutex_lock(&cache->lock);
+		prefetched = cache->prefetched;
+		pthread_mutex_unlock(&cache->lock);
+		if ( prefetched >= num_pages ) {
+			break;
+		} /* IF */
+		usleep(1000);
+	} /* FOR */
+
+	return(prefetched);
+} /* end of wait_prefetched */
+
+/*********************************************************************
+*
+* Function  : test_page_cache
+*
+* Purpose   : Check reads through the page cache of a pread() source ,
+*             by several threads at once , after prefetching and after
+*             the file has been saved.
+*
+* Inputs    : (none)
+*
+* Output    : messages for failed checks
+*
+* Returns   : (nothing)
+*
+* Example   : test_page_cache();
+*
+* Notes     : The file is 4 times the size of the cache , so that
+*             pages are evicted while other threads use them.
+*
+*********************************************************************/
+
+static void test_page_cache()
+{
+	char	path[64];
+	unsigned char	*model , buffer[256];
+	CACHE_TEST	tests[4];
+	pthread_t	threads[4];
+	EDIT_BUFFER	edits;
+	DATA_SOURCE	source;
+	PAGE_CACHE	*cache;
+	long	size , hits , misses , prefetched , offset;
+	int		fd , count;
+
+	size = 4L * CACHE_NUM_PAGES * CACHE_PAGE_SIZE + 1000L;
+	model = (unsigned char *)malloc(size);
+	if ( model == NULL ) {
+		quit(1,"malloc failed");
+	} /* IF */
+	fd = open_source(path,&source,model,size,1);
+	cache = source.cache;
+	if ( ! check(source.kind == SOURCE_PREAD && cache != NULL,
+				"no page cache for a pread source") ) {
+		return;
+	} /* IF */
+
+	/* several readers at once */
+	for ( count = 0 ; count < 4 ; ++count ) {
+		tests[count].source = &source;
+		tests[count].model = model;
+		tests[count].size = size;
+		tests[count].num_reads = 2000L;
+		tests[count].num_bad = 0L;
+		tests[count].seed = 88172645463325252ULL + count;
+		pthread_create(&threads[count],NULL,cache_reader,&tests[count]);
+	} /* FOR */
+	for ( count = 0 ; count < 4 ; ++count ) {
+		pthread_join(threads[count],NULL);
+		check(tests[count].num_bad == 0L,"reader %d had %ld bad reads of %ld",
+				count,tests[count].num_bad,tests[count].num_reads);
+	} /* FOR */
+	check(cache->hits > 0L && cache->misses > 0L,
+			"%ld hits and %ld misses after 4 readers",cache->hits,cache->misses);
+
+	/* a page read again is a hit */
+	misses = cache->misses;
+	source_read(&source,size - 100L,buffer,100L);
+	hits = cache->hits;
+	source_read(&source,size - 100L,buffer,100L);
+	check(cache->hits == hits + 1L && cache->misses <= misses + 1L,
+			"read of the same page again , %ld hits and %ld misses",
+			cache->hits - hits,cache->misses - misses);
+
+	/* prefetched pages are then hits */
+	offset = 2L * CACHE_NUM_PAGES * CACHE_PAGE_SIZE;
+	cache_invalidate(&source);
+	prefetched = cache->prefetched;
+	source_prefetch(&source,offset,CACHE_PREFETCH_PAGES * CACHE_PAGE_SIZE);
+	check(wait_prefetched(cache,prefetched + CACHE_PREFETCH_PAGES) ==
+				prefetched + CACHE_PREFETCH_PAGES,
+			"%ld pages prefetched",cache->prefetched - prefetched);
+	misses = cache->misses;
+	for ( count = 0 ; count < CACHE_PREFETCH_PAGES ; ++count ) {
+		source_read(&source,offset + count * CACHE_PAGE_SIZE,buffer,
+					sizeof(buffer));
+	} /* FOR */
+	check(cache->misses == misses,"%ld misses reading prefetched pages",
+			cache->misses - misses);
+
+	/* the cache does not give old bytes after a save */
+	source_read(&source,1000L,buffer,sizeof(buffer));
+	edit_init(&edits,size);
+	source.edits = &edits;
+	memset(buffer,0x5a,sizeof(buffer));
+	edit_replace(&edits,1000L,sizeof(buffer),buffer,sizeof(buffer));
+	memcpy(&model[1000],buffer,sizeof(buffer));
+	check(edit_commit(&edits,&source) == 0,"edit_commit failed");
+	source.edits = NULL;
+	memset(buffer,0,sizeof(buffer));
+	check(source_read(&source,1000L,buffer,sizeof(buffer)) == sizeof(buffer) &&
+			memcmp(buffer,&model[1000],sizeof(buffer)) == 0,
+			"cache gave old bytes after a save");
+	edit_reset(&edits,0L);
+	free(edits.added);
+
+	source_close(&source);
+	close(fd);
+	unlink(path);
+	free(model);
+
+	return;
+} /* end of test_page_cache */
+
+/*********************************************************************
+*
+* Function  : check_large_file
+*
+* Purpose   : Check the sizing , reading and display of a sparse file
+*             too big for 32-bit offsets.
+*
+* Inputs    : long size - size of the file
+*             int num_digits - digits expected in the offset column
+*
+* Output    : messages for failed checks
+*
+* Returns   : (nothing)
+*
+* Example   : check_large_file((1L << 32) + 100L,9);
+*
+* Notes     : Only the last 64 bytes of the file are written. The
+*             block geometry is that of an 80 column screen.
+*
+*********************************************************************/
+
+static void check_large_file(long size, int num_digits)
+{
+	char	path[64] , line[256] , expected[32];
+	unsigned char	tail[64] , buffer[64];
+	struct stat	stats;
+	DATA_SOURCE	source;
+	long	last , num_bytes;
+	int		fd , length;
+
+	fd = make_file(path,0L,0);
+	memset(tail,0x5a,sizeof(tail));
+	if ( ftruncate(fd,(off_t)size) < 0 ||
+			pwrite(fd,tail,sizeof(tail),(off_t)(size - sizeof(tail))) !=
+							sizeof(tail) ||
+			fstat(fd,&stats) < 0 ) {
+		printf("can't make a sparse file of 0x%lx bytes , not checked\n",size);
+		close(fd);
+		unlink(path);
+		return;
+	} /* IF */
+	check(source_open(&source,fd,&stats) == 0 && source.size == size,
+			"source of sparse file of 0x%lx bytes has 0x%lx",size,source.size);
+	num_bytes = source_read(&source,size - sizeof(tail),buffer,sizeof(buffer));
+	check(num_bytes == sizeof(tail) && memcmp(buffer,tail,sizeof(tail)) == 0,
+			"end of sparse file of 0x%lx bytes",size);
+	check(source_read(&source,size,buffer,sizeof(buffer)) == 0L,
+			"read past the end of sparse file of 0x%lx bytes",size);
+
+	/* the offset column */
+	offset_width = offset_digits(size);
+	check(offset_width == num_digits,"%d offset digits for 0x%lx",
+			offset_width,size);
+	format_init();
+	length = format_row(line,size - 16L,&buffer[48],16,8);
+	sprintf(expected,"%0*lx : 5a5a ",num_digits,size - 16L);
+	check(strncmp(line,expected,strlen(expected)) == 0 &&
+			length == num_digits + 3 + 40 + 18,
+			"row at 0x%lx is \"%s\"",size - 16L,line);
+	length = format_row(line,0L,buffer,16,8);
+	check(length == num_digits + 3 + 40 + 18 && line[num_digits - 1] == '0' &&
+			line[num_digits] == ' ',"row at 0 is \"%s\"",line);
+
+	/* the last block , as LASTBLOCK and # find it */
+	filesize = size;
+	blocksize = 32 * 18;
+	block_span = blocksize;
+	num_blocks = block_count();
+	last = record_first + (num_blocks - 1L) * block_span;
+	check(last < size && last + blocksize >= size &&
+			(num_blocks - 1L) * blocksize == last,
+			"last block of 0x%lx bytes at 0x%lx",size,last);
+	check(source_read(&source,last,buffer,sizeof(buffer)) ==
+				(size - last < (long)sizeof(buffer) ? size - last :
+							(long)sizeof(buffer)),
+			"read of last block at 0x%lx",last);
+
+	offset_width = 8;
+	filesize = 0L;
+	num_blocks = 0L;
+	source_close(&source);
+	close(fd);
+	unlink(path);
+
+	return;
+} /* end of check_large_file */
+
+/*********************************************************************
+*
+* Function  : test_large_files
+*
+* Purpose   : Check files bigger than 4 GB and 1 TB.
+*
+* Inputs    : (none)
+*
+* Output    : messages for failed checks
+*
+* Returns   : (nothing)
+*
+* Example   : test_large_files();
+*
+* Notes     : (none)
+*
+*********************************************************************/
+
+static void test_large_files()
+{
+	check_large_file((1L << 32) + 100L,9);
+	check_large_file((1L << 40) + 64L,11);
+
+	return;
+} /* end of test_large_files */
+
+/*********************************************************************
+*
+* Function  : check_direct_write
+*
+* Purpose   : Write a run of bytes through source_pwritev() with
+*             O_DIRECT rules and check the whole file afterwards.
+*
+* Inputs    : long size - size of the file
+*             long offset - offset of the run
+*             long length - length of the run
+*
+* Output    : messages for failed checks
+*
+* Returns   : (nothing)
+*
+* Example   : check_direct_write(8192L,0L,1L);
+*
+* Notes     : The rules of 512 byte sectors are forced on the source ,
+*             so that this works on filesystems without O_DIRECT (e.g.
+*             tmpfs).
+*
+*********************************************************************/
+
+static void check_direct_write(long size, long offset, long length)
+{
+	char	path[64];
+	unsigned char	*data , *run;
+	struct iovec	iov[2];
+	struct stat	stats;
+	DATA_SOURCE	source;
+	long	index , bad;
+	int		fd;
+
+	fd = make_file(path,size,0xaa);
+	if ( fstat(fd,&stats) < 0 || source_open(&source,fd,&stats) < 0 ) {
+		quit(1,"Can't open \"%s\"",path);
+	} /* IF */
+	source.direct = 1;
+	source.align = 512L;
+
+	run = (unsigned char *)malloc(length);
+	data = (unsigned char *)malloc(size + 1);
+	if ( run == NULL || data == NULL ) {
+		quit(1,"malloc failed");
+	} /* IF */
+	memset(run,0x11,length);
+	iov[0].iov_base = run;
+	iov[0].iov_len = length / 2;
+	iov[1].iov_base = &run[length / 2];
+	iov[1].iov_len = length - length / 2;
+	check(source_pwritev(&source,iov,2,offset) == length,
+			"direct write of %ld bytes at 0x%lx",length,offset);
+
+	check(pread(fd,data,size + 1,0) == size,
+			"size after direct write of %ld bytes at 0x%lx",length,offset);
+	for ( bad = -1L , index = 0L ; bad < 0L && index < size ; ++index ) {
+		if ( data[index] != (index >= offset && index < offset + length ?
+						0x11 : 0xaa) ) {
+			bad = index;
+		} /* IF */
+	} /* FOR */
+	check(bad < 0L,"direct write of %ld bytes at 0x%lx changed 0x%lx",
+			length,offset,bad);
+
+	source_close(&source);
+	close(fd);
+	unlink(path);
+	free(run);
+	free(data);
+
+	return;
+} /* end of check_direct_write */
+
+/*********************************************************************
+*
+* Function  : test_direct_write
+*
+* Purpose   : Check the read modify write of partly changed sectors.
+*
+* Inputs    : (none)
+*
+* Output    : messages for failed checks
+*
+* Returns   : (nothing)
+*
+* Example   : test_direct_write();
+*
+* Notes     : (none)
+*
+*********************************************************************/
+
+static void test_direct_write()
+{
+	check_direct_write(8192L,0L,1L);		/* aligned , less than a sector */
+	check_direct_write(8192L,512L,100L);
+	check_direct_write(8192L,700L,10L);		/* inside one sector */
+	check_direct_write(8192L,500L,530L);	/* partial first and last */
+	check_direct_write(8192L,1024L,1024L);	/* whole sectors */
+	check_direct_write(8000L,7990L,10L);	/* last sector of the file */
+
+	return;
+} /* end of test_direct_write */
+
+/*********************************************************************
+*
+* Function  : check_hash
+*
+* Purpose   : Hash some bytes in one piece and in pieces of several
+*             sizes and compare the digest with the known answer.
+*
+* Inputs    : int algorithm - HASH_CRC32C , HASH_XXH64 or HASH_SHA256
+*             const unsigned char *data - the bytes
+*             long length - number of bytes
+*             char *expected - the digest in hex
+*
+* Output    : messages for failed checks
+*
+* Returns   : (nothing)
+*
+* Example   : check_hash(HASH_CRC32C,"123456789",9L,"e3069283");
+*
+* Notes     : (none)
+*
+*********************************************************************/
+
+static void check_hash(int algorithm, const unsigned char *data, long length,
+					char *expected)
+{
+	static	long	piece_sizes[] = { 0L , 1L , 3L , 7L , 31L , 64L , 1000L };
+	HASH_STATE	state;
+	unsigned char	digest[HASH_MAX_DIGEST];
+	char	text[2 * HASH_MAX_DIGEST + 1];
+	long	offset , count;
+	int		size , num_bytes , index;
+
+	for ( size = 0 ; size < 7 ; ++size ) {
+		hash_start(&state,algorithm);
+		for ( offset = 0L ; offset < length ; offset += count ) {
+			count = piece_sizes[size] > 0L ? piece_sizes[size] : length;
+			if ( count > length - offset ) {
+				count = length - offset;
+			} /* IF */
+			hash_update(&state,&data[offset],count);
+		} /* FOR */
+		num_bytes = hash_finish(&state,digest);
+		for ( index = 0 ; index < num_bytes ; ++index ) {
+			sprintf(&text[2 * index],"%02x",digest[index]);
+		} /* FOR */
+		check(strcmp(text,expected) == 0,
+				"hash %d of %ld bytes in pieces of %ld is %s , expected %s",
+				algorithm,length,piece_sizes[size],text,expected);
+	} /* FOR */
+
+	return;
+} /* end of check_hash */
+
+/*********************************************************************
+*
+* Function  : test_hashes
+*
+* Purpose   : Check the hashes against known answers , with and
+*             without the crc32 instruction.
+*
+* Inputs    : (none)
+*
+* Output    : messages for failed checks
+*
+* Returns   : (nothing)
+*
+* Example   : test_hashes();
+*
+* Notes     : The answers for 1000 bytes of (7 * n + 3) & 0xff came
+*             from the reference implementations.
+*
+*********************************************************************/
+
+static void test_hashes()
+{
+	unsigned char	*data;
+	long	index;
+	int		hardware , pass;
+
+	data = (unsigned char *)malloc(1000000L);
+	if ( data == NULL ) {
+		quit(1,"malloc failed");
+	} /* IF */
+	crc32c_tables();
+	hardware = crc32c_hardware;
+	for ( pass = 0 ; pass < (hardware ? 2 : 1) ; ++pass ) {
+		crc32c_hardware = pass;
+		check_hash(HASH_CRC32C,(unsigned char *)"123456789",9L,"e3069283");
+		check_hash(HASH_CRC32C,(unsigned char *)"",0L,"00000000");
+		for ( index = 0L ; index < 1000L ; ++index ) {
+			data[index] = (unsigned char)(7L * index + 3L);
+		} /* FOR */
+		check_hash(HASH_CRC32C,data,1000L,"dd2edff7");
+	} /* FOR */
+	crc32c_hardware = hardware;
+
+	check_hash(HASH_XXH64,(unsigned char *)"",0L,"ef46db3751d8e999");
+	check_hash(HASH_XXH64,(unsigned char *)"abc",3L,"44bc2cf5ad770999");
+	check_hash(HASH_XXH64,data,1000L,"5f235fa033f1a3fb");
+
+	check_hash(HASH_SHA256,(unsigned char *)"abc",3L,
+		"ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad");
+	check_hash(HASH_SHA256,data,1000L,
+		"1e9bc38cbf860b9ec31918b065f9b52476c549a782e0e7990bed8ce3868d2371");
+	memset(data,'a',1000000L);
+	check_hash(HASH_SHA256,data,1000000L,
+		"cdc76e5c9914fb9281a1c7e284d73e67f1809a48a497200e046d39ccc7112cd0");
+	free(data);
+
+	return;
+} /* end of test_hashes */
+
+/*********************************************************************
+*
+* Function  : test_hash_invalidate
+*
+* Purpose   : Check which chunks of a hash tree go stale when the file
+*             is changed.
+*
+* Inputs    : (none)
+*
+* Output    : messages for failed checks
+*
+* Returns   : (nothing)
+*
+* Example   : test_hash_invalidate();
+*
+* Notes     : (none)
+*
+*********************************************************************/
+
+static void test_hash_invalidate()
+{
+	HASH_TREE	*tree;
+	long	number , bad;
+
+	tree = &hash_trees[HASH_SHA256];
+	filesize = 8L * HASH_CHUNK_SIZE + 100L;
+	if ( hash_tree_resize(tree) < 0 ) {
+		quit(1,"Out of memory");
+	} /* IF */
+	check(tree->num_chunks == 9L,"%ld chunks",tree->num_chunks);
+
+	/* an overwrite inside one chunk */
+	memset(tree->state,CHUNK_VALID,tree->num_chunks);
+	hash_tree_invalidate(2L * HASH_CHUNK_SIZE + 10L,5L,5L);
+	for ( bad = -1L , number = 0L ; number < tree->num_chunks ; ++number ) {
+		if ( tree->state[number] != (number == 2L ? CHUNK_STALE : CHUNK_VALID) ) {
+			bad = number;
+		} /* IF */
+	} /* FOR */
+	check(bad < 0L,"overwrite in chunk 2 , chunk %ld is wrong",bad);
+
+	/* an overwrite across two chunks */
+	memset(tree->state,CHUNK_VALID,tree->num_chunks);
+	hash_tree_invalidate(4L * HASH_CHUNK_SIZE - 1L,2L,2L);
+	for ( bad = -1L , number = 0L ; number < tree->num_chunks ; ++number ) {
+		if ( tree->state[number] != (number == 3L || number == 4L ?
+								CHUNK_STALE : CHUNK_VALID) ) {
+			bad = number;
+		} /* IF */
+	} /* FOR */
+	check(bad < 0L,"overwrite in chunks 3 and 4 , chunk %ld is wrong",bad);
+
+	/* an insert moves every later byte */
+	memset(tree->state,CHUNK_VALID,tree->num_chunks);
+	filesize += 1L;
+	hash_tree_invalidate(5L * HASH_CHUNK_SIZE,0L,1L);
+	for ( bad = -1L , number = 0L ; number < tree->num_chunks ; ++number ) {
+		if ( tree->state[number] != (number >= 5L ? CHUNK_STALE : CHUNK_VALID) ) {
+			bad = number;
+		} /* IF */
+	} /* FOR */
+	check(bad < 0L,"insert in chunk 5 , chunk %ld is wrong",bad);
+
+	free(tree->digests);
+	free(tree->state);
+	free(tree->changed);
+	memset(tree,0,sizeof(HASH_TREE));
+	filesize = 0L;
+
+	return;
+} /* end of test_hash_invalidate */
+
+/*********************************************************************
+*
+* Function  : check_record_filter
+*
+* Purpose   : Run a record filter over a file with 1 and 3 threads and
+*             check the records it finds.
+*
+* Inputs    : long stride - bytes from one record to the next
+*             long field - offset of the field in a record
+*             long num_records - number of records in the file
+*             long every - the field matches in every this many records
+*
+* Output    : messages for failed checks
+*
+* Returns   : (nothing)
+*
+* Example   : check_record_filter(2000000L,1500000L,3L,2L);
+*
+* Notes     : The field is 4 bytes of zeros in a file of 0xaa bytes.
+*
+*********************************************************************/
+
+static void check_record_filter(long stride, long field, long num_records,
+					long every)
+{
+	static	unsigned char	zeros[4];
+	char	path[64];
+	struct stat	stats;
+	DATA_SOURCE	source;
+	RECORD_FILTER	filter;
+	HIT_INDEX	hits;
+	long	record , number , bad;
+	int		fd;
+
+	fd = make_file(path,(num_records - 1L) * stride + field + 4L,0xaa);
+	for ( record = 0L ; record < num_records ; record += every ) {
+		if ( pwrite(fd,zeros,4,(off_t)(record * stride + field)) != 4 ) {
+			quit(1,"Can't write \"%s\"",path);
+		} /* IF */
+	} /* FOR */
+	if ( fstat(fd,&stats) < 0 || source_open(&source,fd,&stats) < 0 ) {
+		quit(1,"Can't open \"%s\"",path);
+	} /* IF */
+
+	memset(&filter,0,sizeof(filter));
+	filter.first = 0L;
+	filter.stride = stride;
+	filter.num_records = num_records;
+	filter.field = field;
+	filter.length = 4L;
+	for ( opt_threads = 1 ; opt_threads <= 3 ; opt_threads += 2 ) {
+		memset(&hits,0,sizeof(hits));
+		check(filter_records(&source,&filter,&hits) == 0L,
+				"record filter of stride %ld field %ld failed",stride,field);
+		check(hits.num_hits == (num_records + every - 1L) / every,
+				"record filter of stride %ld field %ld found %ld records",
+				stride,field,hits.num_hits);
+		for ( bad = -1L , number = 0L ; bad < 0L && number < hits.num_hits ;
+						++number ) {
+			if ( hit_index_get(&hits,number) != number * every * stride ) {
+				bad = number;
+			} /* IF */
+		} /* FOR */
+		check(bad < 0L,"record filter of stride %ld field %ld , hit %ld is wrong",
+				stride,field,bad);
+		hit_index_clear(&hits);
+	} /* FOR */
+
+	source_close(&source);
+	close(fd);
+	unlink(path);
+
+	return;
+} /* end of check_record_filter */
+
+/*********************************************************************
+*
+* Function  : test_record_filter
+*
+* Purpose   : Check the record filter with fields inside and beyond the
+*             read buffer.
+*
+* Inputs    : (none)
+*
+* Output    : messages for failed checks
+*
+* Returns   : (nothing)
+*
+* Example   : test_record_filter();
+*
+* Notes     : (none)
+*
+*********************************************************************/
+
+static void test_record_filter()
+{
+	check_record_filter(100L,10L,30000L,7L);	/* many records per read */
+	check_record_filter(1000L,996L,40000L,3L);	/* several segments */
+	check_record_filter(2000000L,1500000L,3L,2L);	/* field beyond the buffer */
+	check_record_filter(2000000L,SEARCH_CHUNK_SIZE - 2L,3L,1L);	/* straddles it */
+
+	return;
+} /* end of test_record_filter */
+
+/*********************************************************************
+*
+* Function  : main
+*
+* Purpose   : Run the regression checks.
+*
+* Inputs    : (none)
+*
+* Output    : messages for failed checks and a summary
+*
+* Returns   : 0 --> all passed , 1 --> a check failed
+*
+* Example   : hed5_test
+*
+* Notes     : (none)
+*
+*********************************************************************/
+
+int main()
+{
+	temp_buffer = (unsigned char *)malloc(search_chunk_size +
+							SEARCH_MAX_PATTERN);
+	if ( temp_buffer == NULL ) {
+		quit(1,"malloc failed");
+	} /* IF */
+	test_boundary_search();
+	test_piece_table();
+	test_undo_redo();
+	test_journal_limits();
+	test_insert_delete();
+	test_patches();
+	test_page_cache();
+	test_large_files();
+	test_direct_write();
+	test_hashes();
+	test_hash_invalidate();
+	test_record_filter();
+
+	printf("%d checks , %d failed\n",num_checks,num_failed);
+	exit(num_failed == 0 ? 0 : 1);
+} /* end of main */
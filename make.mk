@@ -1,15 +1,34 @@
 # This makefile was generated Tue Jun 30 14:15:18 2020
 
 CC=cc
+LFS_FLAGS=-D_FILE_OFFSET_BITS=64 -D_LARGEFILE_SOURCE
 
 hed5 : hed5.o die.o quit.o
-	$(CC) hed5.o die.o quit.o -o hed5 -lcurses
+	$(CC) hed5.o die.o quit.o -o hed5 -lcurses -lpthread -lm
 
 hed5.o : hed5.c
-	$(CC) -c $(CFLAGS) hed5.c
+	$(CC) -c $(CFLAGS) $(LFS_FLAGS) hed5.c
 
 quit.o : quit.c
 	$(CC) -c quit.c
 
 die.o : die.c
 	$(CC) -c die.c
+
+test : hed5_test
+	./hed5_test
+
+hed5_test : hed5_test.o die.o quit.o
+	$(CC) hed5_test.o die.o quit.o -o hed5_test -lcurses -lpthread -lm
+
+hed5_test.o : hed5_test.c hed5.c
+	$(CC) -c $(CFLAGS) $(LFS_FLAGS) hed5_test.c
+
+bench : hed5_bench
+	./hed5_bench
+
+hed5_bench : hed5_bench.o die.o quit.o
+	$(CC) hed5_bench.o die.o quit.o -o hed5_bench -lcurses -lpthread -lm
+
+hed5_bench.o : hed5_bench.c hed5.c
+	$(CC) -c $(CFLAGS) $(LFS_FLAGS) hed5_bench.c